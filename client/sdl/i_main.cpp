@@ -70,6 +70,7 @@
 #include "i_sound.h"
 #include "r_main.h"
 #include "m_ostring.h"
+#include "cl_analyze.h"
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -118,6 +119,11 @@ int main(int argc, char *argv[])
 		// [ML] 2007/9/3: From Eternity (originally chocolate Doom) Thanks SoM & fraggle!
 		Args.SetArgs (argc, argv);
 
+		// -analyzebatch only drives other odamex processes
+		int batchresult = CL_AnalyzeBatch();
+		if (batchresult >= 0)
+			return batchresult;
+
 		const char *CON_FILE = Args.CheckValue("-confile");
 		if(CON_FILE)CON.open(CON_FILE, std::ios::in);
 
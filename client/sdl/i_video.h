@@ -62,6 +62,7 @@ DCanvas* I_GetPrimaryCanvas();
 
 IWindowSurface* I_GetEmulatedSurface();
 void I_BlitEmulatedSurface();
+bool I_CheckBlit();
 
 IWindowSurface* I_AllocateSurface(int width, int height, int bpp);
 void I_FreeSurface(IWindowSurface* &surface);
@@ -998,6 +998,11 @@ int STACK_ARGS DPrintf(const char *format, ...)
 	return 0;
 }
 
+// The client writes each line to LOG as it is printed
+void C_FlushLog()
+{
+}
+
 void C_FlushDisplay()
 {
 	for (int i = 0; i < NUMNOTIFIES; i++)
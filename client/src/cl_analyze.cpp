@@ -0,0 +1,565 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Headless netdemo analysis
+//
+//	The simulation keeps all of its state in globals, so a process can only
+//	play one netdemo at a time.  Batches are spread over cores by running
+//	one process per demo.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#ifdef UNIX
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#endif
+
+#include "json/json.h"
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "m_argv.h"
+#include "m_fileio.h"
+#include "cmdlib.h"
+#include "c_console.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "g_level.h"
+#include "cl_demo.h"
+#include "cl_analyze.h"
+
+extern NetDemo netdemo;
+extern bool nodrawers;
+extern bool noblit;
+extern bool timingdemo;
+
+void CL_NetDemoPlay(const std::string &filename);
+void STACK_ARGS call_terms(void);
+
+// world units covered by one heatmap cell
+static const int HEATMAP_CELL_SIZE = 128;
+
+// player positions are sampled this often
+static const int HEATMAP_INTERVAL = TICRATE / 5;
+
+typedef std::map<std::pair<int, int>, int> heatmap_t;
+
+struct analyzeplayer_t
+{
+	std::string		name;
+	int				frags;
+	int				deaths;
+	int				suicides;
+	int				damagetaken;
+	int				shots[NUMWEAPONS];
+	std::map<std::string, int> pickups;
+	std::map<std::string, heatmap_t> heatmaps;	// by map name
+
+	analyzeplayer_t() : frags(0), deaths(0), suicides(0), damagetaken(0)
+	{
+		memset(shots, 0, sizeof(shots));
+	}
+};
+
+static bool analyzing = false;
+static std::string analyze_outfile;
+static std::string analyze_demo;
+static dtime_t analyze_starttime;
+static int analyze_tics;
+
+static std::map<int, analyzeplayer_t> analyze_players;	// by player id
+static Json::Value analyze_events(Json::arrayValue);
+
+static analyzeplayer_t &AnalyzePlayer(player_t &player)
+{
+	analyzeplayer_t &ap = analyze_players[player.id];
+
+	if (!player.userinfo.netname.empty())
+		ap.name = player.userinfo.netname;
+
+	return ap;
+}
+
+static Json::Value AnalyzeEvent(const char *type)
+{
+	Json::Value event(Json::objectValue);
+	event["type"] = type;
+	event["tic"] = gametic;
+	event["map"] = level.mapname;
+	return event;
+}
+
+//
+// CL_AnalyzeWrite
+//
+// Writes everything collected so far to the output file
+//
+static bool CL_AnalyzeWrite(bool complete)
+{
+	static const char *weaponnames[NUMWEAPONS] =
+	{
+		"fist", "pistol", "shotgun", "chaingun", "missile",
+		"plasma", "bfg", "chainsaw", "supershotgun"
+	};
+
+	Json::Value root(Json::objectValue);
+
+	root["demo"] = analyze_demo;
+	root["complete"] = complete;
+	root["tics"] = analyze_tics;
+	root["seconds"] = (double)I_ConvertTimeToMs(I_GetTime() - analyze_starttime) / 1000.0;
+	root["heatmapcellsize"] = HEATMAP_CELL_SIZE;
+
+	Json::Value jplayers(Json::arrayValue);
+
+	for (std::map<int, analyzeplayer_t>::iterator it = analyze_players.begin();
+		 it != analyze_players.end(); ++it)
+	{
+		analyzeplayer_t &ap = it->second;
+		Json::Value jp(Json::objectValue);
+
+		jp["id"] = it->first;
+		jp["name"] = ap.name;
+		jp["frags"] = ap.frags;
+		jp["deaths"] = ap.deaths;
+		jp["suicides"] = ap.suicides;
+		jp["damagetaken"] = ap.damagetaken;
+
+		int totalshots = 0;
+		Json::Value jshots(Json::objectValue);
+		for (int i = 0; i < NUMWEAPONS; i++)
+		{
+			if (ap.shots[i])
+				jshots[weaponnames[i]] = ap.shots[i];
+			totalshots += ap.shots[i];
+		}
+		jp["shots"] = jshots;
+
+		// damage is not attributed to its source in the protocol, so frags
+		// per shot is the closest thing to accuracy that can be measured
+		jp["fragspershot"] = totalshots ? (double)ap.frags / totalshots : 0.0;
+
+		Json::Value jpickups(Json::objectValue);
+		for (std::map<std::string, int>::iterator pit = ap.pickups.begin();
+			 pit != ap.pickups.end(); ++pit)
+			jpickups[pit->first] = pit->second;
+		jp["pickups"] = jpickups;
+
+		Json::Value jheatmaps(Json::objectValue);
+		for (std::map<std::string, heatmap_t>::iterator mit = ap.heatmaps.begin();
+			 mit != ap.heatmaps.end(); ++mit)
+		{
+			Json::Value cells(Json::arrayValue);
+			for (heatmap_t::iterator cit = mit->second.begin(); cit != mit->second.end(); ++cit)
+			{
+				Json::Value cell(Json::arrayValue);
+				cell.append(cit->first.first);
+				cell.append(cit->first.second);
+				cell.append(cit->second);
+				cells.append(cell);
+			}
+			jheatmaps[mit->first] = cells;
+		}
+		jp["heatmaps"] = jheatmaps;
+
+		jplayers.append(jp);
+	}
+
+	root["players"] = jplayers;
+	root["events"] = analyze_events;
+
+	std::ofstream out(analyze_outfile.c_str());
+	Json::FastWriter writer;
+	out << writer.write(root);
+	out.close();
+
+	return !out.fail();
+}
+
+//
+// CL_AnalyzeFinish
+//
+// Writes the results and exits, the process has nothing else to do
+//
+static void CL_AnalyzeFinish(bool complete)
+{
+	analyzing = false;
+
+	bool written = CL_AnalyzeWrite(complete);
+	if (!written)
+		Printf(PRINT_HIGH, "analyze: unable to write %s\n", analyze_outfile.c_str());
+
+	call_terms();
+	exit(complete && written ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+//
+// CL_AnalyzeStart
+//
+void CL_AnalyzeStart(const char *outfile, const char *demo)
+{
+	analyzing = true;
+	analyze_outfile = outfile;
+	analyze_demo = demo;
+	analyze_starttime = I_GetTime();
+	analyze_tics = 0;
+
+	// run as fast as possible without drawing anything
+	nodrawers = noblit = true;
+	timingdemo = true;
+
+	CL_NetDemoPlay(demo);
+}
+
+bool CL_IsAnalyzing()
+{
+	return analyzing;
+}
+
+//
+// CL_AnalyzeTicker
+//
+// Samples player positions and notices when playback has ended
+//
+void CL_AnalyzeTicker()
+{
+	if (!analyzing)
+		return;
+
+	if (!netdemo.isPlaying() && !netdemo.isPaused())
+	{
+		// playback stopped without reaching the end of the demo
+		CL_AnalyzeFinish(false);
+		return;
+	}
+
+	analyze_tics++;
+
+	if (gamestate != GS_LEVEL || gametic % HEATMAP_INTERVAL)
+		return;
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (!it->ingame() || it->spectator || !it->mo || it->mo->health <= 0)
+			continue;
+
+		int x = (it->mo->x >> FRACBITS) / HEATMAP_CELL_SIZE;
+		int y = (it->mo->y >> FRACBITS) / HEATMAP_CELL_SIZE;
+
+		AnalyzePlayer(*it).heatmaps[level.mapname][std::make_pair(x, y)]++;
+	}
+}
+
+//
+// CL_AnalyzeDemoStop
+//
+// The end of the netdemo was reached
+//
+void CL_AnalyzeDemoStop()
+{
+	if (analyzing)
+		CL_AnalyzeFinish(true);
+}
+
+void CL_AnalyzeFrag(AActor *source, AActor *target, int mod)
+{
+	if (!analyzing || !target || !target->player)
+		return;
+
+	player_t *victim = target->player;
+	player_t *killer = (source && source->player) ? source->player : NULL;
+
+	AnalyzePlayer(*victim).deaths++;
+
+	if (!killer || killer == victim)
+		AnalyzePlayer(*victim).suicides++;
+	else
+		AnalyzePlayer(*killer).frags++;
+
+	Json::Value event = AnalyzeEvent("frag");
+	event["killer"] = killer ? killer->id : 0;
+	event["victim"] = victim->id;
+	event["mod"] = mod;
+	analyze_events.append(event);
+}
+
+void CL_AnalyzeShot(player_t &player, int weapon)
+{
+	if (!analyzing || weapon < 0 || weapon >= NUMWEAPONS)
+		return;
+
+	AnalyzePlayer(player).shots[weapon]++;
+}
+
+void CL_AnalyzeMissile(AActor *missile)
+{
+	if (!analyzing || !missile || !missile->target || !missile->target->player)
+		return;
+
+	// the recording player's own shots are counted by CL_FireWeapon
+	player_t &player = *missile->target->player;
+	if (player.id == consoleplayer_id)
+		return;
+
+	switch (missile->type)
+	{
+	case MT_ROCKET:
+		CL_AnalyzeShot(player, wp_missile);
+		break;
+	case MT_PLASMA:
+		CL_AnalyzeShot(player, wp_plasma);
+		break;
+	case MT_BFG:
+		CL_AnalyzeShot(player, wp_bfg);
+		break;
+	default:
+		break;
+	}
+}
+
+void CL_AnalyzeDamage(player_t &player, int damage)
+{
+	if (!analyzing || damage <= 0)
+		return;
+
+	AnalyzePlayer(player).damagetaken += damage;
+}
+
+//
+// CL_AnalyzeItemRemoved
+//
+// Pickups are only sent to the player making them, everyone else just sees
+// the item disappear.  Credit it to the player standing on it.
+//
+void CL_AnalyzeItemRemoved(AActor *item)
+{
+	if (!analyzing || !item || !(item->flags & MF_SPECIAL))
+		return;
+
+	player_t *picker = NULL;
+	fixed_t best = MAXINT;
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (!it->ingame() || it->spectator || !it->mo || it->mo->health <= 0)
+			continue;
+
+		// some slack since positions arrive a tic or two late
+		fixed_t reach = it->mo->radius + item->radius + 16 * FRACUNIT;
+		fixed_t dx = abs(it->mo->x - item->x);
+		fixed_t dy = abs(it->mo->y - item->y);
+
+		if (dx > reach || dy > reach)
+			continue;
+
+		if (dx + dy < best)
+		{
+			best = dx + dy;
+			picker = &*it;
+		}
+	}
+
+	if (!picker)
+		return;
+
+	const char *name = item->info->name ? item->info->name : "unknown";
+	AnalyzePlayer(*picker).pickups[name]++;
+
+	Json::Value event = AnalyzeEvent("pickup");
+	event["player"] = picker->id;
+	event["item"] = name;
+	event["x"] = item->x >> FRACBITS;
+	event["y"] = item->y >> FRACBITS;
+	analyze_events.append(event);
+}
+
+//
+// CL_AnalyzeBatch
+//
+// Hands each demo to its own "-analyze" process, keeping up to -jobs of
+// them running, and reports the throughput
+//
+int CL_AnalyzeBatch()
+{
+	size_t p = Args.CheckParm("-analyzebatch");
+	if (!p)
+		return -1;
+
+	if (p + 1 >= Args.NumArgs())
+	{
+		fprintf(stderr, "usage: -analyzebatch <output directory> [-jobs n] demo.odd ...\n");
+		return EXIT_FAILURE;
+	}
+
+	std::string outdir = Args.GetArg(p + 1);
+
+	unsigned int jobs = I_GetCPUCount();
+	const char *jobsarg = Args.CheckValue("-jobs");
+	if (jobsarg && atoi(jobsarg) > 0)
+		jobs = atoi(jobsarg);
+
+	// everything that isn't ours is passed on to the workers (-iwad,
+	// -waddir and so on)
+	std::vector<std::string> demos;
+	std::vector<std::string> passthrough;
+
+	for (size_t i = 1; i < Args.NumArgs(); i++)
+	{
+		std::string arg = Args.GetArg(i);
+		std::string ext;
+		M_ExtractFileExtension(arg, ext);
+
+		if (i == p || ((arg == "-jobs") && jobsarg))
+			i++;
+		else if (iequals(ext, "odd"))
+			demos.push_back(arg);
+		else
+			passthrough.push_back(arg);
+	}
+
+	std::vector<std::string> outfiles;
+	std::map<std::string, int> names;
+
+	for (size_t i = 0; i < demos.size(); i++)
+	{
+		std::string base;
+		M_ExtractFileBase(demos[i], base);
+
+		int n = ++names[base];
+		if (n > 1)
+		{
+			char suffix[16];
+			sprintf(suffix, "_%d", n);
+			base += suffix;
+		}
+
+		outfiles.push_back(outdir + PATHSEP + base + ".json");
+	}
+
+	printf("analyzing %u netdemos with %u jobs\n", (unsigned int)demos.size(), jobs);
+
+	dtime_t starttime = I_GetTime();
+	size_t next = 0, failed = 0;
+
+#ifdef UNIX
+	std::map<pid_t, size_t> running;
+
+	while (next < demos.size() || !running.empty())
+	{
+		while (next < demos.size() && running.size() < jobs)
+		{
+			std::vector<const char *> argv;
+			argv.push_back(Args.GetArg(0));
+			for (size_t i = 0; i < passthrough.size(); i++)
+				argv.push_back(passthrough[i].c_str());
+			argv.push_back("-novideo");
+			argv.push_back("-nosound");
+			argv.push_back("-analyze");
+			argv.push_back(outfiles[next].c_str());
+			argv.push_back(demos[next].c_str());
+			argv.push_back(NULL);
+
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				execvp(argv[0], (char * const *)&argv[0]);
+				_exit(127);
+			}
+
+			if (pid < 0)
+			{
+				printf("%s: unable to start worker\n", demos[next].c_str());
+				failed++;
+			}
+			else
+				running[pid] = next;
+
+			next++;
+		}
+
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0)
+			break;
+
+		std::map<pid_t, size_t>::iterator it = running.find(pid);
+		if (it == running.end())
+			continue;
+
+		bool ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+		printf("%s: %s\n", demos[it->second].c_str(), ok ? "ok" : "failed");
+		if (!ok)
+			failed++;
+
+		running.erase(it);
+	}
+#else
+	// no fork, one demo at a time
+	for (; next < demos.size(); next++)
+	{
+		std::vector<const char *> argv;
+		argv.push_back(Args.GetArg(0));
+		for (size_t i = 0; i < passthrough.size(); i++)
+			argv.push_back(passthrough[i].c_str());
+		argv.push_back("-novideo");
+		argv.push_back("-nosound");
+		argv.push_back("-analyze");
+		argv.push_back(outfiles[next].c_str());
+		argv.push_back(demos[next].c_str());
+		argv.push_back(NULL);
+
+		bool ok = _spawnv(_P_WAIT, argv[0], &argv[0]) == EXIT_SUCCESS;
+		printf("%s: %s\n", demos[next].c_str(), ok ? "ok" : "failed");
+		if (!ok)
+			failed++;
+	}
+#endif
+
+	double seconds = (double)I_ConvertTimeToMs(I_GetTime() - starttime) / 1000.0;
+	double rate = seconds > 0.0 ? demos.size() * 60.0 / seconds : 0.0;
+
+	printf("%u netdemos (%u failed) in %.1f seconds, %.1f demos/min\n",
+		   (unsigned int)demos.size(), (unsigned int)failed, seconds, rate);
+
+	Json::Value summary(Json::objectValue);
+	summary["demos"] = (int)demos.size();
+	summary["failed"] = (int)failed;
+	summary["jobs"] = jobs;
+	summary["seconds"] = seconds;
+	summary["demospermin"] = rate;
+
+	std::ofstream out((outdir + PATHSEP + "summary.json").c_str());
+	Json::StyledWriter writer;
+	out << writer.write(summary);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+VERSION_CONTROL (cl_analyze_cpp, "$Id$")
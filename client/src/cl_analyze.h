@@ -0,0 +1,51 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Headless netdemo analysis
+//
+//	"-analyze <file.json> <demo.odd>" plays a netdemo without a window or
+//	sound as fast as possible and writes the frags, shots, pickups and
+//	movement heatmaps it saw as JSON.  "-analyzebatch <dir> demos..."
+//	runs one such process per demo, several at once.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __CL_ANALYZE_H__
+#define __CL_ANALYZE_H__
+
+#include "actor.h"
+#include "d_player.h"
+
+// Runs the batch driver if -analyzebatch is given.  Returns the exit code
+// for main or -1 when not in batch mode.  Called before anything else is
+// initialized.
+int CL_AnalyzeBatch();
+
+void CL_AnalyzeStart(const char *outfile, const char *demo);
+bool CL_IsAnalyzing();
+void CL_AnalyzeTicker();
+void CL_AnalyzeDemoStop();
+
+// Events reported by the message parser
+void CL_AnalyzeFrag(AActor *source, AActor *target, int mod);
+void CL_AnalyzeShot(player_t &player, int weapon);
+void CL_AnalyzeMissile(AActor *missile);
+void CL_AnalyzeDamage(player_t &player, int damage);
+void CL_AnalyzeItemRemoved(AActor *item);
+
+#endif // __CL_ANALYZE_H__
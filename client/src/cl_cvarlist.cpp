@@ -292,6 +292,9 @@ CVAR_RANGE(			cl_prednudge,	"0.70", "Smooth out collisions",
 CVAR(				cl_predictlocalplayer, "1", "Predict local player position",
 					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
 
+CVAR(				cl_predictincremental, "1", "Only replay predicted tics when the server disagrees with the prediction",
+					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
+
 CVAR(				cl_predictweapons, "1", "Draw weapon effects immediately",
 					CVARTYPE_BOOL, CVAR_USERINFO | CVAR_CLIENTARCHIVE)
 
@@ -367,6 +370,10 @@ CVAR(				cl_autoscreenshot, "0", "Automatically capture a screenshot at the end
 CVAR(				cl_splitnetdemos, "0", "Create separate netdemos for each map",
 					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
 
+CVAR_RANGE(			cl_netdemosnapshotspacing, "20", "Seconds between netdemo snapshots.  " \
+					"Smaller values make seeking faster but the netdemo larger",
+					CVARTYPE_INT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 1.0f, 60.0f)
+
 // Mouse settings
 // --------------
 
@@ -586,6 +593,9 @@ CVAR_RANGE(		r_drawplayersprites, "1", "Weapon Transparency",
 CVAR(			r_particles, "1", "Draw particles",
 				CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
 
+CVAR_FUNC_DECL(	r_pvs, "0", "Skip parts of the level that cannot be seen from the current sector",
+				CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
+
 CVAR_RANGE_FUNC_DECL(r_stretchsky, "2", "Stretch sky textures. (0 - always off, 1 - always on, 2 - auto)",
 				CVARTYPE_BYTE, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 2.0f)
 
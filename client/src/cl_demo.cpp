@@ -22,6 +22,15 @@
 //
 //-----------------------------------------------------------------------------
 
+#include "win32inc.h"
+#ifndef _WIN32
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
 #include "doomtype.h"
 #include "cl_main.h"
 #include "p_ctf.h"
@@ -38,9 +47,13 @@
 #include "st_stuff.h"
 #include "p_mobj.h"
 #include "g_level.h"
+#include "i_system.h"
+#include "farchive.h"
+#include "s_sound.h"
 
 EXTERN_CVAR(sv_maxclients)
 EXTERN_CVAR(sv_maxplayers)
+EXTERN_CVAR(cl_netdemosnapshotspacing)
 
 extern std::string server_host;
 extern std::string digest;
@@ -49,11 +62,459 @@ extern std::vector<std::string> wadfiles, wadhashes;
 argb_t CL_GetPlayerColor(player_t*);
 
 
+//
+// NetDemoWriter
+//
+
+NetDemoWriter::NetDemoWriter(FILE *fp, size_t maxsnapshotsize) :
+	m_File(fp), m_Synchronous(false), m_Quit(0), m_Failed(0), m_StallTime(0),
+	m_Compressed(maxsnapshotsize), m_BytesWritten(0)
+{
+	for (int i = 0; i < POOL_SIZE; i++)
+	{
+		m_Jobs[i].id = i;
+		m_Jobs[i].data.reserve(MAX_UDP_PACKET);
+		m_Free.push(i);
+	}
+
+	// Without a thread the jobs are simply written as they are submitted
+	if (!m_Thread.start(NetDemoWriter::threadFunc, this))
+	{
+		DPrintf("NetDemoWriter: unable to start writer thread\n");
+		m_Synchronous = true;
+	}
+}
+
+NetDemoWriter::~NetDemoWriter()
+{
+	finish();
+}
+
+//
+// acquire()
+//
+//   Returns an empty job from the pool.  Only blocks when the writer has
+//   fallen a whole pool behind the game.
+//
+NetDemoWriter::job_t *NetDemoWriter::acquire()
+{
+	int id;
+	if (!m_Free.pop(id))
+	{
+		dtime_t start = I_GetTime();
+
+		while (!m_Free.pop(id))
+			m_FreeEvent.wait(10);
+
+		m_StallTime += I_GetTime() - start;
+	}
+
+	job_t *job = &m_Jobs[id];
+	job->data.clear();
+	job->flags = 0;
+	return job;
+}
+
+void NetDemoWriter::submit(job_t *job)
+{
+	if (m_Synchronous)
+	{
+		if (!failed() && !write(job))
+			I_AtomicStore(&m_Failed, 1);
+		m_Free.push(job->id);
+		return;
+	}
+
+	m_Queued.push(job->id);
+	m_WorkEvent.signal();
+}
+
+//
+// finish()
+//
+//   Waits for all submitted jobs to be written.
+//
+void NetDemoWriter::finish()
+{
+	if (m_Thread.running())
+	{
+		I_AtomicStore(&m_Quit, 1);
+		m_WorkEvent.signal();
+		m_Thread.join();
+	}
+
+	fflush(m_File);
+}
+
+void NetDemoWriter::threadFunc(void *data)
+{
+	static_cast<NetDemoWriter*>(data)->run();
+}
+
+void NetDemoWriter::run()
+{
+	while (true)
+	{
+		int id;
+		if (m_Queued.pop(id))
+		{
+			job_t *job = &m_Jobs[id];
+
+			// keep recycling jobs after a failure so the game never stalls
+			if (!failed() && !write(job))
+				I_AtomicStore(&m_Failed, 1);
+
+			m_Free.push(id);
+			m_FreeEvent.signal();
+			continue;
+		}
+
+		// a job may have been queued just before m_Quit was set
+		if (I_AtomicLoad(&m_Quit))
+		{
+			if (m_Queued.empty())
+				break;
+			continue;
+		}
+
+		m_WorkEvent.wait(100);
+	}
+}
+
+//
+// write()
+//
+//   Writes a job as a message chunk, compressing it first if asked to.
+//
+bool NetDemoWriter::write(job_t *job)
+{
+	const byte *data = job->data.empty() ? NULL : &job->data[0];
+	size_t length = job->data.size();
+
+	if (job->flags & JOB_COMPRESS)
+	{
+		length = FLZOMemFile::CompressImage(data, length, &m_Compressed[0], m_Compressed.size());
+		if (length == 0)
+			return false;
+		data = &m_Compressed[0];
+	}
+
+	uint32_t offset = ftell(m_File);
+	if (job->flags & JOB_SNAPSHOTINDEX)
+		m_SnapshotOffsets.push_back(offset);
+	if (job->flags & JOB_MAPINDEX)
+		m_MapOffsets.push_back(offset);
+
+	// type, length, gametic
+	byte msgheader[9];
+	uint32_t len = LELONG((uint32_t)length);
+	uint32_t tic = LELONG(job->gametic);
+
+	msgheader[0] = job->type;
+	memcpy(msgheader + 1, &len, sizeof(len));
+	memcpy(msgheader + 5, &tic, sizeof(tic));
+
+	if (fwrite(msgheader, 1, sizeof(msgheader), m_File) < sizeof(msgheader))
+		return false;
+	if (length && fwrite(data, 1, length, m_File) < length)
+		return false;
+
+	m_BytesWritten += sizeof(msgheader) + length;
+	return true;
+}
+
+
+//
+// NetDemoReader
+//
+
+NetDemoReader::NetDemoReader() :
+	m_Data(NULL), m_Size(0), m_Pos(0), m_MapHandle(NULL), m_Quit(0),
+	m_Requested(NO_OFFSET), m_Working(NO_OFFSET), m_ReadyOffset(NO_OFFSET)
+{
+}
+
+NetDemoReader::~NetDemoReader()
+{
+	close();
+}
+
+bool NetDemoReader::open(const std::string &filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_Size = GetFileSize(file, NULL);
+
+	HANDLE mapping = m_Size ? CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
+
+	if (mapping)
+	{
+		m_Data = (const byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (m_Data)
+			m_MapHandle = mapping;
+		else
+			CloseHandle(mapping);
+	}
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0)
+		m_Size = st.st_size;
+
+	if (m_Size)
+	{
+		void *mapping = mmap(NULL, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED)
+		{
+			madvise(mapping, m_Size, MADV_SEQUENTIAL);
+			m_Data = (const byte*)mapping;
+			m_MapHandle = mapping;
+		}
+	}
+	::close(fd);
+#endif
+
+	if (!m_Data)
+	{
+		// the mapping failed, read the whole file instead
+		FILE *fp = fopen(filename.c_str(), "rb");
+		if (!fp)
+			return false;
+
+		fseek(fp, 0, SEEK_END);
+		m_Size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		m_Fallback.resize(m_Size + 1);
+		size_t cnt = fread(&m_Fallback[0], 1, m_Size, fp);
+		fclose(fp);
+
+		if (cnt < m_Size)
+		{
+			m_Fallback.clear();
+			m_Size = 0;
+			return false;
+		}
+
+		m_Data = &m_Fallback[0];
+	}
+
+	m_Pos = 0;
+	m_Quit = 0;
+
+	if (!m_Thread.start(NetDemoReader::threadFunc, this))
+		DPrintf("NetDemoReader: unable to start snapshot thread\n");
+
+	return true;
+}
+
+void NetDemoReader::close()
+{
+	if (m_Thread.running())
+	{
+		I_AtomicStore(&m_Quit, 1);
+		m_WorkEvent.signal();
+		m_Thread.join();
+	}
+
+	if (m_MapHandle)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_Data);
+		CloseHandle((HANDLE)m_MapHandle);
+#else
+		munmap(m_MapHandle, m_Size);
+#endif
+		m_MapHandle = NULL;
+	}
+
+	m_Fallback.clear();
+	m_Data = NULL;
+	m_Size = m_Pos = 0;
+
+	m_Requested = m_Working = m_ReadyOffset = NO_OFFSET;
+	m_Ready.clear();
+}
+
+bool NetDemoReader::seek(size_t offset)
+{
+	if (offset > m_Size)
+		return false;
+
+	m_Pos = offset;
+	return true;
+}
+
+bool NetDemoReader::skip(size_t length)
+{
+	if (length > m_Size - m_Pos)
+		return false;
+
+	m_Pos += length;
+	return true;
+}
+
+size_t NetDemoReader::read(void *buf, size_t size, size_t count)
+{
+	if (!size)
+		return 0;
+
+	size_t avail = (m_Size - m_Pos) / size;
+	if (count > avail)
+		count = avail;
+
+	memcpy(buf, m_Data + m_Pos, size * count);
+	m_Pos += size * count;
+
+	return count;
+}
+
+const byte *NetDemoReader::map(size_t length)
+{
+	if (length > m_Size - m_Pos)
+		return NULL;
+
+	const byte *data = m_Data + m_Pos;
+	m_Pos += length;
+
+	return data;
+}
+
+//
+// expandSnapshot()
+//
+//   Decompresses the snapshot chunk at offset.  Only reads the mapping, so
+//   it is safe to call from the snapshot thread.
+//
+bool NetDemoReader::expandSnapshot(size_t offset, std::vector<byte> &image) const
+{
+	const size_t MESSAGE_HEADER_SIZE = 9;
+
+	if (offset >= m_Size || m_Size - offset < MESSAGE_HEADER_SIZE)
+		return false;
+
+	const byte *chunk = m_Data + offset;
+
+	uint32_t len;
+	memcpy(&len, chunk + 1, sizeof(len));
+	len = LELONG(len);
+
+	if (len > m_Size - offset - MESSAGE_HEADER_SIZE)
+		return false;
+
+	chunk += MESSAGE_HEADER_SIZE;
+
+	size_t expanded = FLZOMemFile::ExpandedImageLength(chunk, len);
+	if (expanded == 0)
+		return false;
+
+	image.resize(expanded);
+	return FLZOMemFile::DecompressImage(chunk, len, &image[0], image.size()) != 0;
+}
+
+void NetDemoReader::prefetchSnapshot(size_t offset)
+{
+	if (!m_Thread.running())
+		return;
+
+	{
+		OMutexLock lock(m_Mutex);
+		if (offset == m_ReadyOffset || offset == m_Working)
+			return;
+		m_Requested = offset;
+	}
+
+	m_WorkEvent.signal();
+}
+
+bool NetDemoReader::loadSnapshot(size_t offset, std::vector<byte> &image)
+{
+	while (true)
+	{
+		{
+			OMutexLock lock(m_Mutex);
+
+			if (offset == m_ReadyOffset)
+			{
+				image.swap(m_Ready);
+				m_ReadyOffset = NO_OFFSET;
+				return true;
+			}
+
+			// not prefetched, don't let the thread start on something else
+			if (offset != m_Working)
+			{
+				if (m_Requested == offset)
+					m_Requested = NO_OFFSET;
+				break;
+			}
+		}
+
+		// the thread is already expanding this one, wait for it
+		m_DoneEvent.wait(100);
+	}
+
+	return expandSnapshot(offset, image);
+}
+
+void NetDemoReader::threadFunc(void *data)
+{
+	static_cast<NetDemoReader*>(data)->run();
+}
+
+void NetDemoReader::run()
+{
+	std::vector<byte> image;
+
+	while (!I_AtomicLoad(&m_Quit))
+	{
+		size_t offset;
+		{
+			OMutexLock lock(m_Mutex);
+			offset = m_Working = m_Requested;
+			m_Requested = NO_OFFSET;
+		}
+
+		if (offset == NO_OFFSET)
+		{
+			m_WorkEvent.wait(100);
+			continue;
+		}
+
+		bool ok = expandSnapshot(offset, image);
+
+		{
+			OMutexLock lock(m_Mutex);
+			if (ok)
+			{
+				m_Ready.swap(image);
+				m_ReadyOffset = offset;
+			}
+			m_Working = NO_OFFSET;
+		}
+
+		m_DoneEvent.signal();
+	}
+}
+
+
 NetDemo::NetDemo() :
 	state(st_stopped), oldstate(st_stopped), filename(""),
-	demofp(NULL)
+	demofp(NULL), reader(NULL), writer(NULL), captured(NULL),
+	netdemotic(0), catchup_tic(0)
 {
     memset(&header, 0, sizeof(header));
+    memset(&recstats, 0, sizeof(recstats));
 }
 
 NetDemo::~NetDemo()
@@ -76,7 +537,9 @@ void NetDemo::copy(NetDemo &to, const NetDemo &from)
 	to.oldstate			= from.oldstate;
 	to.filename			= from.filename;
 	to.demofp			= from.demofp;
-	to.captured			= from.captured;
+	to.reader			= NULL;		// owned by the original
+	to.writer			= NULL;
+	to.captured			= NULL;
 	to.snapshot_index	= from.snapshot_index;
 	to.map_index		= from.map_index;
 	memcpy(&to.header, &from.header, sizeof(header));
@@ -101,7 +564,6 @@ void NetDemo::reset()
 	
 	filename = "";	
 	memset(&header, 0, sizeof(header));
-	captured.clear();
 }
 
 //
@@ -116,6 +578,21 @@ void NetDemo::cleanUp()
 	{
 		stopRecording();	// Try to write any unwritten data
 	}
+
+	if (writer)
+	{
+		writer->finish();
+		delete writer;
+		writer = NULL;
+	}
+	captured = NULL;
+
+	if (reader)
+	{
+		delete reader;
+		reader = NULL;
+	}
+	endCatchUp();
 	
 	// close all files
 	if (demofp)
@@ -171,7 +648,6 @@ bool NetDemo::writeHeader()
 	strncpy(header.identifier, "ODAD", 4);
 	header.version = NETDEMOVER;
 	header.compression = 0;
-	header.snapshot_spacing = NetDemo::SNAPSHOT_SPACING;
 
 	netdemo_header_t tmpheader;
 	memcpy(&tmpheader, &header, sizeof(header));
@@ -222,35 +698,35 @@ bool NetDemo::writeHeader()
 //
 //   Reads the header struct from the netdemo file, converting it from
 //   little-endian format to whatever the client's architecture uses.  Assumes
-//   that demofp has been opened correctly elsewhere.  Does not close the file.
+//   that the reader has been opened correctly elsewhere.
 
 bool NetDemo::readHeader()
 {
-	fseek(demofp, 0, SEEK_SET);
+	reader->seek(0);
 	
 	size_t cnt = 0;
 	cnt += sizeof(header.identifier) *
-		fread(&header.identifier, sizeof(header.identifier), 1, demofp);
+		reader->read(&header.identifier, sizeof(header.identifier), 1);
 	cnt += sizeof(header.version) *
-		fread(&header.version, sizeof(header.version), 1, demofp);
+		reader->read(&header.version, sizeof(header.version), 1);
 	cnt += sizeof(header.compression) *
-		fread(&header.compression, sizeof(header.compression), 1, demofp);
+		reader->read(&header.compression, sizeof(header.compression), 1);
 	cnt += sizeof(header.snapshot_index_size) *
-		fread(&header.snapshot_index_size, sizeof(header.snapshot_index_size), 1, demofp);
+		reader->read(&header.snapshot_index_size, sizeof(header.snapshot_index_size), 1);
 	cnt += sizeof(header.snapshot_index_offset)*
-		fread(&header.snapshot_index_offset, sizeof(header.snapshot_index_offset), 1, demofp);
+		reader->read(&header.snapshot_index_offset, sizeof(header.snapshot_index_offset), 1);
 	cnt += sizeof(header.map_index_size) *
-		fread(&header.map_index_size, sizeof(header.map_index_size), 1, demofp);
+		reader->read(&header.map_index_size, sizeof(header.map_index_size), 1);
 	cnt += sizeof(header.map_index_offset)*
-		fread(&header.map_index_offset, sizeof(header.map_index_offset), 1, demofp);
+		reader->read(&header.map_index_offset, sizeof(header.map_index_offset), 1);
 	cnt += sizeof(header.snapshot_spacing) *
-		fread(&header.snapshot_spacing, sizeof(header.snapshot_spacing), 1, demofp);
+		reader->read(&header.snapshot_spacing, sizeof(header.snapshot_spacing), 1);
 	cnt += sizeof(header.starting_gametic) *
-		fread(&header.starting_gametic, sizeof(header.starting_gametic), 1, demofp);
+		reader->read(&header.starting_gametic, sizeof(header.starting_gametic), 1);
 	cnt += sizeof(header.ending_gametic) *
-		fread(&header.ending_gametic, sizeof(header.ending_gametic), 1, demofp);
+		reader->read(&header.ending_gametic, sizeof(header.ending_gametic), 1);
 	cnt += sizeof(header.reserved) *
-		fread(&header.reserved, sizeof(header.reserved), 1, demofp);
+		reader->read(&header.reserved, sizeof(header.reserved), 1);
 	
 	if (cnt < NetDemo::HEADER_SIZE)
 		return false;
@@ -307,11 +783,11 @@ bool NetDemo::writeSnapshotIndex()
 //
 //   Reads the snapshot index from the netdemo file, converting it from
 //   little-endian format to whatever the client's architecture uses.  Assumes
-//   that demofp has been opened correctly elsewhere.  Does not close the file.
+//   that the reader has been opened correctly elsewhere.
 
 bool NetDemo::readSnapshotIndex()
 {
-	fseek(demofp, header.snapshot_index_offset, SEEK_SET);
+	reader->seek(header.snapshot_index_offset);
 
 	for (int i = 0; i < header.snapshot_index_size; i++)
 	{
@@ -319,9 +795,9 @@ bool NetDemo::readSnapshotIndex()
 		
 		size_t cnt = 0;
 		cnt += sizeof(entry.ticnum) *
-			fread(&entry.ticnum, sizeof(entry.ticnum), 1, demofp);
+			reader->read(&entry.ticnum, sizeof(entry.ticnum), 1);
 		cnt += sizeof(entry.offset) *
-			fread(&entry.offset, sizeof(entry.offset), 1, demofp);
+			reader->read(&entry.offset, sizeof(entry.offset), 1);
 		
 		if (cnt < INDEX_ENTRY_SIZE)
 			return false;
@@ -363,7 +839,7 @@ bool NetDemo::writeMapIndex()
 
 bool NetDemo::readMapIndex()
 {
-	fseek(demofp, header.map_index_offset, SEEK_SET);
+	reader->seek(header.map_index_offset);
 
 	for (int i = 0; i < header.map_index_size; i++)
 	{
@@ -371,9 +847,9 @@ bool NetDemo::readMapIndex()
 		
 		size_t cnt = 0;
 		cnt += sizeof(entry.ticnum) *
-			fread(&entry.ticnum, sizeof(entry.ticnum), 1, demofp);
+			reader->read(&entry.ticnum, sizeof(entry.ticnum), 1);
 		cnt += sizeof(entry.offset) *
-			fread(&entry.offset, sizeof(entry.offset), 1, demofp);
+			reader->read(&entry.offset, sizeof(entry.offset), 1);
 		
 		if (cnt < INDEX_ENTRY_SIZE)
 			return false;
@@ -426,6 +902,10 @@ bool NetDemo::startRecording(const std::string &filename)
 	}
 
 	memset(&header, 0, sizeof(header));
+	header.snapshot_spacing = cl_netdemosnapshotspacing.asInt() * TICRATE;
+	if (header.snapshot_spacing == 0)
+		header.snapshot_spacing = NetDemo::SNAPSHOT_SPACING;
+
 	// Note: The header is not finalized at this point.  Write it anyway to
 	// reserve space in the output file for it and overwrite it later.
 	if (!writeHeader())
@@ -434,6 +914,11 @@ bool NetDemo::startRecording(const std::string &filename)
 		return false;
 	}
 
+	// from here on the file belongs to the writer thread until stopRecording
+	writer = new NetDemoWriter(demofp, NetDemo::MAX_SNAPSHOT_SIZE);
+	captured = NULL;
+	memset(&recstats, 0, sizeof(recstats));
+
 	state = NetDemo::st_recording;
 	header.starting_gametic = gametic;
 	Printf(PRINT_HIGH, "Recording netdemo %s.\n", filename.c_str());
@@ -498,7 +983,8 @@ bool NetDemo::startPlaying(const std::string &filename)
 		return false;
 	}
 
-	if (!(demofp = fopen(filename.c_str(), "rb")))
+	reader = new NetDemoReader;
+	if (!reader->open(filename))
 	{
 		error("Unable to open netdemo file.");
 		return false;
@@ -516,7 +1002,7 @@ bool NetDemo::startPlaying(const std::string &filename)
     }
 
 	// read the demo's index
-	if (fseek(demofp, header.snapshot_index_offset, SEEK_SET) != 0)
+	if (!reader->seek(header.snapshot_index_offset))
 	{
 		error("Unable to find netdemo snapshot index.\n");
 		return false;
@@ -529,7 +1015,7 @@ bool NetDemo::startPlaying(const std::string &filename)
 	}
 
 	// read the demo's map index
-	if (fseek(demofp, header.map_index_offset, SEEK_SET) != 0)
+	if (!reader->seek(header.map_index_offset))
 	{
 		error("Unable to find netdemo map index.\n");
 		return false;
@@ -542,8 +1028,13 @@ bool NetDemo::startPlaying(const std::string &filename)
 	}
 
 	// get set up to read server cmds
-	fseek(demofp, NetDemo::HEADER_SIZE, SEEK_SET);
+	reader->seek(NetDemo::HEADER_SIZE);
 	state = NetDemo::st_playing;
+	netdemotic = 0;
+	endCatchUp();
+
+	if (!snapshot_index.empty())
+		reader->prefetchSnapshot(snapshot_index[0].offset);
 
 	Printf(PRINT_HIGH, "Playing netdemo %s.\n", filename.c_str());
 	
@@ -606,7 +1097,29 @@ bool NetDemo::stopRecording()
 
 	// write the end-of-demo marker
 	byte marker = svc_netdemostop;
-	writeChunk(&marker, sizeof(marker), NetDemo::msg_packet);
+	queueChunk(&marker, sizeof(marker), NetDemo::msg_packet);
+
+	// wait for the writer to catch up, the file is ours again afterwards
+	writer->finish();
+	captured = NULL;
+
+	if (writer->failed())
+	{
+		error("Unable to write netdemo message chunk.");
+		return false;
+	}
+
+	// the offsets of the snapshots are only known once they are written
+	const std::vector<uint32_t> &snapoffsets = writer->snapshotOffsets();
+	for (size_t i = 0; i < snapshot_index.size() && i < snapoffsets.size(); i++)
+		snapshot_index[i].offset = snapoffsets[i];
+
+	const std::vector<uint32_t> &mapoffsets = writer->mapOffsets();
+	for (size_t i = 0; i < map_index.size() && i < mapoffsets.size(); i++)
+		map_index[i].offset = mapoffsets[i];
+
+	delete writer;
+	writer = NULL;
 
 	// write the number of the last gametic in the recording
 	header.ending_gametic = gametic;
@@ -662,11 +1175,12 @@ bool NetDemo::stopPlaying()
 	SZ_Clear(&net_message);
 	CL_QuitNetGame();
 
-	if (demofp)
+	if (reader)
 	{
-		fclose(demofp);
-		demofp = NULL;
+		delete reader;
+		reader = NULL;
 	}
+	endCatchUp();
 	
 	Printf(PRINT_HIGH, "Demo has ended.\n");
 	reset();
@@ -717,29 +1231,34 @@ void NetDemo::writeLocalCmd(buf_t *netbuffer) const
 }
 
 
-void NetDemo::writeChunk(const byte *data, size_t size, netdemo_message_t type)
+//
+// queueChunk()
+//
+//   Hands a complete message chunk to the writer thread.
+//
+void NetDemo::queueChunk(const byte *data, size_t size, netdemo_message_t type)
 {
-	message_header_t msgheader;
-	memset(&msgheader, 0, sizeof(msgheader));
-	
-	msgheader.type = static_cast<byte>(type);
-	msgheader.length = LELONG((uint32_t)size);
-	msgheader.gametic = LELONG(gametic);
-	
-	size_t cnt = 0;
-	cnt += sizeof(msgheader.type) *
-		fwrite(&msgheader.type, sizeof(msgheader.type), 1, demofp);
-	cnt += sizeof(msgheader.length) *
-		fwrite(&msgheader.length, sizeof(msgheader.length), 1, demofp);
-	cnt += sizeof(msgheader.gametic) *
-		fwrite(&msgheader.gametic, sizeof(msgheader.gametic), 1, demofp);
+	NetDemoWriter::job_t *job = writer->acquire();
 
-	cnt += fwrite(data, 1, size, demofp);
-	if (cnt < size + NetDemo::MESSAGE_HEADER_SIZE)
-	{
-		error("Unable to write netdemo message chunk\n");
-		return;
-	}
+	job->type = static_cast<byte>(type);
+	job->gametic = gametic;
+	job->data.assign(data, data + size);
+
+	writer->submit(job);
+}
+
+
+//
+// captureData()
+//
+//   Appends data to the packet chunk for the current tic.
+//
+void NetDemo::captureData(const byte *data, size_t size)
+{
+	if (!captured)
+		captured = writer->acquire();
+
+	captured->data.insert(captured->data.end(), data, data + size);
 }
 
 
@@ -764,6 +1283,22 @@ bool NetDemo::atSnapshotInterval()
 void NetDemo::ticker()
 {
 	netdemotic++;
+
+	if (catchup_tic && netdemotic >= catchup_tic)
+		endCatchUp();
+}
+
+
+//
+// endCatchUp()
+//
+//   Stops replaying towards a seek target and lets sounds through again.
+//   Anything that moves playback elsewhere has to call this.
+//
+void NetDemo::endCatchUp()
+{
+	catchup_tic = 0;
+	S_MuteSounds(false);
 }
 
 //
@@ -778,43 +1313,70 @@ void NetDemo::writeMessages()
 	if (!isRecording())
 		return;
 
+	// stopRecording() reports the error
+	if (writer->failed())
+	{
+		stopRecording();
+		return;
+	}
+
+	dtime_t starttime = I_GetTime();
+
 	static buf_t netbuf_localcmd(1024);
 
 	if (atSnapshotInterval())
-	{
-		size_t length;
-		writeSnapshotData(snapbuf, length);
-		writeSnapshotIndexEntry();
-			
-		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
-	}
+		queueSnapshot(NetDemoWriter::JOB_SNAPSHOTINDEX);
 
 	if (connected)
 	{	
 		// Write the console player's game data
 		SZ_Clear(&netbuf_localcmd);
 		writeLocalCmd(&netbuf_localcmd);
-		captured.push_back(netbuf_localcmd);
+		captureData(netbuf_localcmd.data, netbuf_localcmd.size());
 	}
 
-	byte *output_buf = new byte[captured.size() * MAX_UDP_PACKET];
+	// a chunk is written every tic, even an empty one
+	if (!captured)
+		captured = writer->acquire();
 
-	uint32_t output_len = 0;
-	while (!captured.empty())
-	{
-		buf_t netbuf(captured.front());
-		uint32_t len = netbuf.BytesLeftToRead();
+	captured->type = NetDemo::msg_packet;
+	captured->gametic = gametic;
+	writer->submit(captured);
+	captured = NULL;
 
-		byte *chunk = netbuf.ReadChunk(len);
-		memcpy(output_buf + output_len, chunk, len);
-		output_len += len;
-		
-		captured.pop_front();
-	}
+	dtime_t elapsed = I_GetTime() - starttime;
+	recstats.tics++;
+	recstats.totaltime += elapsed;
+	if (elapsed > recstats.maxtime)
+		recstats.maxtime = elapsed;
+}
 
-	writeChunk(output_buf, output_len, NetDemo::msg_packet);
 
-	delete [] output_buf;
+//
+// printRecordingStats()
+//
+//   Reports the time recording takes on the game thread.
+//
+void NetDemo::printRecordingStats() const
+{
+	if (!isRecording() || !writer)
+	{
+		Printf(PRINT_HIGH, "Not recording a netdemo.\n");
+		return;
+	}
+
+	double avg = recstats.tics ?
+		(double)I_ConvertTimeToMs(recstats.totaltime) / recstats.tics : 0.0;
+	double snapavg = recstats.snapshots ?
+		(double)I_ConvertTimeToMs(recstats.snapshottime) / recstats.snapshots : 0.0;
+
+	Printf(PRINT_HIGH, "Recording %s:\n", filename.c_str());
+	Printf(PRINT_HIGH, "  %u tics, %.3f ms avg, %u ms max per tic\n",
+		recstats.tics, avg, (unsigned int)I_ConvertTimeToMs(recstats.maxtime));
+	Printf(PRINT_HIGH, "  %u snapshots, %.3f ms avg to serialize\n",
+		recstats.snapshots, snapavg);
+	Printf(PRINT_HIGH, "  %u ms spent waiting on the writer thread\n",
+		(unsigned int)I_ConvertTimeToMs(writer->stallTime()));
 }
 
 
@@ -833,11 +1395,11 @@ bool NetDemo::readMessageHeader(netdemo_message_t &type, uint32_t &len, uint32_t
 	
 	size_t cnt = 0;
 	cnt += sizeof(msgheader.type) *
-		fread(&msgheader.type, sizeof(msgheader.type), 1, demofp);
+		reader->read(&msgheader.type, sizeof(msgheader.type), 1);
 	cnt += sizeof(msgheader.length) *
-		fread(&msgheader.length, sizeof(msgheader.length), 1, demofp);
+		reader->read(&msgheader.length, sizeof(msgheader.length), 1);
 	cnt += sizeof(msgheader.gametic) *
-		fread(&msgheader.gametic, sizeof(msgheader.gametic), 1, demofp);
+		reader->read(&msgheader.gametic, sizeof(msgheader.gametic), 1);
 	
 	if (cnt < NetDemo::MESSAGE_HEADER_SIZE)
 	{
@@ -862,12 +1424,9 @@ bool NetDemo::readMessageHeader(netdemo_message_t &type, uint32_t &len, uint32_t
  
 void NetDemo::readMessageBody(buf_t *netbuffer, uint32_t len)
 {
-	char *msgdata = new char[len];
-	
-	size_t cnt = fread(msgdata, 1, len, demofp);
-	if (cnt < len)
+	const byte *msgdata = reader->map(len);
+	if (!msgdata)
 	{
-		delete[] msgdata;
 		fatalError("Can not read netdemo message.");
 		return;
 	}
@@ -878,8 +1437,7 @@ void NetDemo::readMessageBody(buf_t *netbuffer, uint32_t len)
 		netbuffer->resize(len + netbuffer->size() + 1, false);
 	}
 
-	netbuffer->WriteChunk(msgdata, len);
-	delete [] msgdata;
+	netbuffer->WriteChunk((const char *)msgdata, len);
 
 	if (!connected)
 	{
@@ -934,7 +1492,11 @@ void NetDemo::readMessages(buf_t* netbuffer)
 	while (type == NetDemo::msg_snapshot)
 	{
 		// skip over snapshots and read the next message instead
-		fseek(demofp, len, SEEK_CUR);
+		if (!reader->skip(len))
+		{
+			fatalError("Can not read netdemo message.");
+			return;
+		}
 		readMessageHeader(type, len, tic);
 	}
 
@@ -965,7 +1527,8 @@ void NetDemo::capture(const buf_t* inputbuffer)
 
 	if (inputbuffer->size() > 0)
 	{
-		captured.push_back(*inputbuffer);
+		captureData(inputbuffer->data + inputbuffer->readpos,
+					inputbuffer->BytesLeftToRead());
 	}
 }
 
@@ -1287,6 +1850,7 @@ void NetDemo::nextSnapshot()
 	if (nextsnapindex >= header.snapshot_index_size)
 		return;
 	
+	endCatchUp();
 	readSnapshot(&snapshot_index[nextsnapindex]);
 }
 
@@ -1307,7 +1871,12 @@ void NetDemo::prevSnapshot()
 	if (prevsnapindex < 0)
 		prevsnapindex = 0;
 
+	endCatchUp();
 	readSnapshot(&snapshot_index[prevsnapindex]);
+
+	// rewinding is usually repeated
+	if (prevsnapindex > 0 && isPlaying())
+		reader->prefetchSnapshot(snapshot_index[prevsnapindex - 1].offset);
 }
 
 //
@@ -1327,6 +1896,7 @@ void NetDemo::nextMap()
 
 	const NetDemo::netdemo_index_entry_t *snap = &map_index[nextmapindex];
 	
+	endCatchUp();
 	readSnapshot(snap);
 }
 
@@ -1347,6 +1917,7 @@ void NetDemo::prevMap()
 
 	const NetDemo::netdemo_index_entry_t *snap = &map_index[prevmapindex];
 
+	endCatchUp();
 	readSnapshot(snap);
 }
 
@@ -1354,6 +1925,9 @@ void NetDemo::prevMap()
 //
 // readSnapshot()
 //
+//   Restores the snapshot and leaves the reader at the message that follows
+//   it.  The snapshot after it is expanded in the background since playback
+//   is most likely to need it next.
 //
 void NetDemo::readSnapshot(const netdemo_index_entry_t *snap)
 {
@@ -1361,29 +1935,84 @@ void NetDemo::readSnapshot(const netdemo_index_entry_t *snap)
 		return;
 
 	gametic = snap->ticnum;
-	int file_offset = snap->offset;
-	fseek(demofp, file_offset, SEEK_SET);
 	
 	// read the values for length, gametic, and message type
 	netdemo_message_t type;
 	uint32_t len = 0, tic = 0;
-	readMessageHeader(type, len, tic);
 
-	if (len > NetDemo::MAX_SNAPSHOT_SIZE)
-	{
-		fatalError("Snapshot too large to read");
-		return;
-	}
-		
-	size_t cnt = fread(snapbuf, 1, len, demofp);
-	if (cnt < len)
+	if (!reader->seek(snap->offset) || !readMessageHeader(type, len, tic) ||
+		type != NetDemo::msg_snapshot ||
+		!reader->loadSnapshot(snap->offset, snapimage) || !reader->skip(len))
 	{
 		fatalError("Unable to read snapshot from data file");
 		return;
 	}
 
-	readSnapshotData(snapbuf, len);
+	readSnapshotData(&snapimage[0], snapimage.size());
 	netdemotic = snap->ticnum - header.starting_gametic;
+
+	int index = findSnapshotIndex(snap->ticnum);
+	if (index + 1 < (int)snapshot_index.size())
+		reader->prefetchSnapshot(snapshot_index[index + 1].offset);
+}
+
+
+//
+// findSnapshotIndex()
+//
+//   Returns the index of the last snapshot at or before ticnum, or -1 if
+//   there is none.
+//
+int NetDemo::findSnapshotIndex(int ticnum) const
+{
+	int low = 0, high = (int)snapshot_index.size();
+
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if ((int)snapshot_index[mid].ticnum <= ticnum)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low - 1;
+}
+
+
+//
+// seek()
+//
+//   Jumps to ticnum tics from the start of the demo by restoring the closest
+//   snapshot before it and then replaying the messages in between.
+//   CL_RunTics runs the replay without drawing the skipped frames and
+//   S_MuteSounds keeps it quiet.
+//
+void NetDemo::seek(int ticnum)
+{
+	if (!isPlaying() || snapshot_index.empty())
+		return;
+
+	ticnum += header.starting_gametic;
+
+	if (ticnum < (int)header.starting_gametic)
+		ticnum = header.starting_gametic;
+	if (ticnum > (int)header.ending_gametic)
+		ticnum = header.ending_gametic;
+
+	int index = findSnapshotIndex(ticnum);
+	if (index < 0)
+		index = 0;
+
+	endCatchUp();
+	readSnapshot(&snapshot_index[index]);
+
+	if (!isPlaying())
+		return;
+
+	catchup_tic = ticnum - header.starting_gametic;
+	if (isCatchingUp())
+		S_MuteSounds(true);
 }
 
 
@@ -1436,42 +2065,59 @@ const std::vector<int> NetDemo::getMapChangeTimes()
 
 void NetDemo::writeMapChange()
 {
-	if (connected && gamestate == GS_LEVEL)
-	{
-		size_t length;
-		writeSnapshotData(snapbuf, length);
-		writeMapIndexEntry();
-		writeSnapshotIndexEntry();
-		
-		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
-	}
+	if (isRecording() && connected && gamestate == GS_LEVEL)
+		queueSnapshot(NetDemoWriter::JOB_MAPINDEX | NetDemoWriter::JOB_SNAPSHOTINDEX);
 }
 
 void NetDemo::writeIntermission()
 {
-	if (connected && gamestate == GS_INTERMISSION)
-	{
-		size_t length;
-		writeSnapshotData(snapbuf, length);
+	if (isRecording() && connected && gamestate == GS_INTERMISSION)
+		queueSnapshot(NetDemoWriter::JOB_SNAPSHOTINDEX);
+}
+
+
+//
+// queueSnapshot()
+//
+//   Serializes the world into a pooled job and hands it to the writer, which
+//   compresses it.  The index entries get their file offsets once the writer
+//   is done with them in stopRecording().
+//
+void NetDemo::queueSnapshot(int indexflags)
+{
+	dtime_t starttime = I_GetTime();
+
+	NetDemoWriter::job_t *job = writer->acquire();
+	writeSnapshotData(job->data);
+
+	if (indexflags & NetDemoWriter::JOB_MAPINDEX)
+		writeMapIndexEntry();
+	if (indexflags & NetDemoWriter::JOB_SNAPSHOTINDEX)
 		writeSnapshotIndexEntry();
-		
-		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
-	}
+
+	job->type = NetDemo::msg_snapshot;
+	job->gametic = gametic;
+	job->flags = indexflags | NetDemoWriter::JOB_COMPRESS;
+	writer->submit(job);
+
+	recstats.snapshots++;
+	recstats.snapshottime += I_GetTime() - starttime;
 }
 
 //
 // writeSnapshotData()
 //
-//   Write the entire state of the game to netbuffer.  Called by
-//   writeSnapshot() and used to simulate SV_ClientFullUpdate() when
-//   writing the connection sequence at the start of a netdemo.
+//   Write the entire state of the game to buf.  Called by queueSnapshot()
+//   and used to simulate SV_ClientFullUpdate() when writing the connection
+//   sequence at the start of a netdemo.  The image is left uncompressed for
+//   the writer thread to compress.
 //
 
-void NetDemo::writeSnapshotData(byte *buf, size_t &length)
+void NetDemo::writeSnapshotData(std::vector<byte> &buf)
 {
 	G_SnapshotLevel();
 
-	FLZOMemFile memfile;
+	FLZOMemFile memfile(true);
 	memfile.Open();			// open for writing
 
 	FArchive arc(memfile);
@@ -1523,8 +2169,8 @@ void NetDemo::writeSnapshotData(byte *buf, size_t &length)
 	arc.Close();
 
 	// get the size of the snapshot data	
-	length = memfile.Length();
-	memfile.WriteToBuffer(buf, NetDemo::MAX_SNAPSHOT_SIZE);
+	buf.resize(memfile.Length());
+	memfile.WriteToBuffer(&buf[0], buf.size());
 			
     if (level.info->snapshot != NULL)
     {
@@ -1669,11 +2315,10 @@ void NetDemo::readSnapshotData(byte *buf, size_t length)
 //   
 void NetDemo::writeSnapshotIndexEntry()
 {
-	// Update the snapshot index
+	// Update the snapshot index, the offset is filled in by stopRecording()
 	netdemo_index_entry_t entry;
 	
-	fflush(demofp);
-	entry.offset = ftell(demofp);
+	entry.offset = 0;
 	entry.ticnum = gametic;
 	snapshot_index.push_back(entry);
 }
@@ -1684,11 +2329,10 @@ void NetDemo::writeSnapshotIndexEntry()
 //   
 void NetDemo::writeMapIndexEntry()
 {
-	// Update the map index
+	// Update the map index, the offset is filled in by stopRecording()
 	netdemo_index_entry_t entry;
 	
-	fflush(demofp);
-	entry.offset = ftell(demofp);
+	entry.offset = 0;
 	entry.ticnum = gametic;
 	map_index.push_back(entry);
 }
@@ -3,11 +3,148 @@
 
 #include "doomtype.h"
 #include "i_net.h"
+#include "i_thread.h"
 #include "d_net.h"
 #include <string>
 #include <vector>
 #include <list>
 
+//
+// NetDemoWriter
+//
+// Owns the netdemo file while recording and writes to it from a background
+// thread.  The game thread fills pooled job buffers and hands them over
+// through a lock-free ring, so recording never allocates or touches the
+// disk on the game thread once the pool has warmed up.  Snapshots arrive
+// serialized but uncompressed and are compressed by the writer.
+//
+class NetDemoWriter
+{
+public:
+	enum
+	{
+		JOB_SNAPSHOTINDEX	= 1,	// record the chunk offset in the snapshot index
+		JOB_MAPINDEX		= 2,	// record the chunk offset in the map index
+		JOB_COMPRESS		= 4		// data is an uncompressed FLZOMemFile image
+	};
+
+	struct job_t
+	{
+		int			id;
+		byte		type;
+		uint32_t	gametic;
+		int			flags;
+		std::vector<byte> data;
+	};
+
+	NetDemoWriter(FILE *fp, size_t maxsnapshotsize);
+	~NetDemoWriter();
+
+	// game thread
+	job_t *acquire();
+	void submit(job_t *job);
+	void finish();
+
+	bool failed() { return I_AtomicLoad(&m_Failed) != 0; }
+	dtime_t stallTime() const { return m_StallTime; }
+
+	// valid once finish() has returned
+	const std::vector<uint32_t> &snapshotOffsets() const { return m_SnapshotOffsets; }
+	const std::vector<uint32_t> &mapOffsets() const { return m_MapOffsets; }
+	size_t bytesWritten() const { return m_BytesWritten; }
+
+private:
+	static const int POOL_SIZE = 64;
+
+	static void threadFunc(void *data);
+	void run();
+	bool write(job_t *job);
+
+	FILE				*m_File;
+	OThread				m_Thread;
+	OEvent				m_WorkEvent;	// a job was submitted
+	OEvent				m_FreeEvent;	// a job was recycled
+
+	job_t				m_Jobs[POOL_SIZE];
+	OSPSCRing<int, POOL_SIZE> m_Free;	// writer -> game thread
+	OSPSCRing<int, POOL_SIZE> m_Queued;	// game thread -> writer
+
+	bool				m_Synchronous;	// no thread, submit() writes directly
+	volatile int		m_Quit;
+	volatile int		m_Failed;
+	dtime_t				m_StallTime;
+
+	std::vector<byte>	m_Compressed;
+	std::vector<uint32_t> m_SnapshotOffsets;
+	std::vector<uint32_t> m_MapOffsets;
+	size_t				m_BytesWritten;
+};
+
+//
+// NetDemoReader
+//
+// Read-only view of a netdemo file for playback.  The file is mapped into
+// memory so messages are parsed straight out of the mapping instead of
+// being copied through stdio.  Snapshots are LZO compressed; the next one
+// the player is likely to seek to is expanded by a background thread so a
+// seek only has to parse it.
+//
+class NetDemoReader
+{
+public:
+	NetDemoReader();
+	~NetDemoReader();
+
+	bool open(const std::string &filename);
+	void close();
+	bool isOpen() const { return m_Data != NULL; }
+
+	size_t size() const { return m_Size; }
+	size_t tell() const { return m_Pos; }
+	bool seek(size_t offset);
+	bool skip(size_t length);
+
+	// same semantics as fread
+	size_t read(void *buf, size_t size, size_t count);
+
+	// returns the next length bytes and moves past them, or NULL if the
+	// file is too short
+	const byte *map(size_t length);
+
+	// start expanding the snapshot chunk at offset in the background
+	void prefetchSnapshot(size_t offset);
+
+	// expands the snapshot chunk at offset into a stored FLZOMemFile image,
+	// using the prefetched copy when there is one
+	bool loadSnapshot(size_t offset, std::vector<byte> &image);
+
+private:
+	static void threadFunc(void *data);
+	void run();
+	bool expandSnapshot(size_t offset, std::vector<byte> &image) const;
+
+	const byte			*m_Data;
+	size_t				m_Size;
+	size_t				m_Pos;
+
+	void				*m_MapHandle;	// platform specific mapping state
+	std::vector<byte>	m_Fallback;		// file contents when mapping fails
+
+	OThread				m_Thread;
+	OMutex				m_Mutex;
+	OEvent				m_WorkEvent;
+	OEvent				m_DoneEvent;
+	volatile int		m_Quit;
+
+	// guarded by m_Mutex
+	size_t				m_Requested;	// offset the thread should expand next
+	size_t				m_Working;		// offset the thread is expanding
+	size_t				m_ReadyOffset;	// offset m_Ready holds
+	std::vector<byte>	m_Ready;
+
+	static const size_t NO_OFFSET = (size_t)-1;
+};
+
 class NetDemo
 {
 public:
@@ -28,6 +165,9 @@ public:
 	void capture(const buf_t* netbuffer);
 	void writeMapChange();
 	void writeIntermission();
+	void printRecordingStats() const;
+	void seek(int ticnum);
+	bool isCatchingUp() const { return isPlaying() && netdemotic < catchup_tic; }
 
 	bool isRecording() const { return (state == NetDemo::st_recording); }
 	bool isPlaying() const { return (state == NetDemo::st_playing); }
@@ -79,18 +219,22 @@ private:
 	void error(const std::string &message);
 	void fatalError(const std::string &message);
 	void reset();
+	void endCatchUp();
 
 	const netdemo_index_entry_t *snapshotLookup(int ticnum) const;
 	void writeLauncherSequence(buf_t *netbuffer);
 	void writeConnectionSequence(buf_t *netbuffer);
 	
 	void readSnapshotData(byte *buf, size_t length);
-	void writeSnapshotData(byte *buf, size_t &length);
+	void writeSnapshotData(std::vector<byte> &buf);
 	
 	void writeSnapshotIndexEntry();
 	void writeMapIndexEntry();
 	void readSnapshot(const netdemo_index_entry_t *snap);
-	void writeChunk(const byte *data, size_t size, netdemo_message_t type);
+	int findSnapshotIndex(int ticnum) const;
+	void queueSnapshot(int indexflags);
+	void queueChunk(const byte *data, size_t size, netdemo_message_t type);
+	void captureData(const byte *data, size_t size);
 	bool writeHeader();
 	bool readHeader();
 	
@@ -136,14 +280,27 @@ private:
 	std::string			filename;
 	FILE*				demofp;
 
-	std::list<buf_t>	captured;
+	NetDemoReader*		reader;
+	NetDemoWriter*		writer;
+	NetDemoWriter::job_t* captured;		// messages received this tic
+
+	// recording overhead on the game thread
+	struct recordstats_t
+	{
+		unsigned int	tics;
+		unsigned int	snapshots;
+		dtime_t			totaltime;
+		dtime_t			maxtime;
+		dtime_t			snapshottime;
+	} recstats;
 
 	netdemo_header_t	header;	
 	std::vector<netdemo_index_entry_t> snapshot_index;
 	std::vector<netdemo_index_entry_t> map_index;
 	
-	byte				snapbuf[NetDemo::MAX_SNAPSHOT_SIZE];
+	std::vector<byte>	snapimage;	// expanded snapshot being read
 	int					netdemotic;
+	int					catchup_tic;	// netdemotic a seek is replaying up to
 };
 
 
@@ -34,6 +34,7 @@
 #include "md5.h"
 #include "m_argv.h"
 #include "m_fileio.h"
+#include "w_hashindex.h"
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -217,6 +218,9 @@ void IntDownloadComplete(void)
 
     Printf(PRINT_HIGH, "Saved download as \"%s\"\n", filename.c_str());
 
+    // the reconnect will look for this file, no need to read it back in
+    W_HashIndexStore(filename, actual_md5);
+
 	download.clear();
     CL_QuitNetGame();
     CL_Reconnect();
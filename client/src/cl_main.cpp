@@ -53,6 +53,8 @@
 #include "r_sky.h"
 #include "cl_demo.h"
 #include "cl_download.h"
+#include "cl_analyze.h"
+#include "v_screenshot.h"
 #include "p_local.h"
 #include "cl_maplist.h"
 #include "cl_vote.h"
@@ -68,6 +70,8 @@
 #include "g_warmup.h"
 #include "v_text.h"
 #include "hu_stuff.h"
+#include "farchive.h"
+#include "i_netschema.h"
 
 #include <string>
 #include <vector>
@@ -109,6 +113,7 @@ int       last_svgametic = 0;
 int       last_player_update = 0;
 
 bool		recv_full_update = false;
+static int	fullupdate_serial = -1;	// full update being pieced together
 
 std::string connectpasshash = "";
 
@@ -409,6 +414,7 @@ void CL_QuitNetGame(void)
 	players.clear();
 
 	recv_full_update = false;
+	fullupdate_serial = -1;
 
 	if (netdemo.isRecording())
 		netdemo.stopRecording();
@@ -430,6 +436,7 @@ void CL_QuitNetGame(void)
 void CL_Reconnect(void)
 {
 	recv_full_update = false;
+	fullupdate_serial = -1;
 
 	if (netdemo.isRecording())
 		forcenetdemosplit = true;
@@ -642,6 +649,8 @@ void CL_StepTics(unsigned int count)
 		gametic++;
 		if (netdemo.isPlaying() && !netdemo.isPaused())
 			netdemo.ticker();
+
+		CL_AnalyzeTicker();
 	}
 
 	DObject::EndFrame ();
@@ -693,6 +702,17 @@ void CL_RunTics()
  				Printf(PRINT_HIGH, "level.time %d, prndindex %d\n", level.time, prndindex);
 		}
 	}
+	else if (netdemo.isCatchingUp())
+	{
+		// replay up to the target of a netdemo seek, only the last tic
+		// run this frame gets drawn
+		dtime_t stoptime = I_GetTime() + I_ConvertTimeFromMs(100);
+
+		do
+		{
+			CL_StepTics(1);
+		} while (netdemo.isCatchingUp() && I_GetTime() < stoptime);
+	}
 	else
 	{
 		CL_StepTics(1);
@@ -1123,6 +1143,8 @@ std::string CL_GenerateNetDemoFileName(const std::string &filename = cl_netdemon
 void CL_NetDemoStop()
 {
 	netdemo.stopPlaying();
+	CL_AnalyzeDemoStop();
+	V_StopFrameExport();
 }
 
 void CL_NetDemoRecord(const std::string &filename)
@@ -1255,6 +1277,12 @@ BEGIN_COMMAND(netdemostats)
 }
 END_COMMAND(netdemostats)
 
+BEGIN_COMMAND(netrecstats)
+{
+	netdemo.printRecordingStats();
+}
+END_COMMAND(netrecstats)
+
 BEGIN_COMMAND(netff)
 {
 	if (netdemo.isPlaying())
@@ -1283,6 +1311,19 @@ BEGIN_COMMAND(netprevmap)
 }
 END_COMMAND(netprevmap)
 
+BEGIN_COMMAND(netseek)
+{
+	if (argc < 2)
+	{
+		Printf(PRINT_HIGH, "Usage: netseek <seconds>\n");
+		return;
+	}
+
+	if (netdemo.isPlaying())
+		netdemo.seek(atoi(argv[1]) * TICRATE);
+}
+END_COMMAND(netseek)
+
 void CL_NetDemoLoadSnap()
 {
 	AddCommandString("netprevmap");
@@ -1428,17 +1469,15 @@ void CL_TeamPoints (void)
 //
 void CL_MoveMobj(void)
 {
-	AActor  *mo;
-	int      netid;
-	fixed_t  x, y, z;
+	int values[MOVEMOBJ_NUMFIELDS];
+	MSG_ReadSchema(movemobj_schema, values);
 
-	netid = MSG_ReadShort();
-	mo = P_FindThingById (netid);
+	AActor *mo = P_FindThingById(values[MOVEMOBJ_NETID]);
 
-	byte rndindex = MSG_ReadByte();
-	x = MSG_ReadLong();
-	y = MSG_ReadLong();
-	z = MSG_ReadLong();
+	byte rndindex = values[MOVEMOBJ_RNDINDEX];
+	fixed_t x = values[MOVEMOBJ_X];
+	fixed_t y = values[MOVEMOBJ_Y];
+	fixed_t z = values[MOVEMOBJ_Z];
 
 	if (!mo)
 		return;
@@ -1629,6 +1668,15 @@ bool CL_PrepareConnect(void)
 		Printf(PRINT_HIGH, "> Server Version %i.%i.%i\n", gameversion / 256, (gameversion % 256) / 10, (gameversion % 256) % 10);
 	}
 
+	// The movement messages and the full update are laid out differently
+	// before 0.8.1, and the server only turns away older clients
+	if (gameversion < GAMEVER)
+	{
+		Printf(PRINT_HIGH, "This server is too old for Odamex %s.\n", DOTVERSIONSTR);
+		CL_QuitNetGame();
+		return false;
+	}
+
     Printf(PRINT_HIGH, "\n");
 
     // DEH/BEX Patch files
@@ -1677,6 +1725,7 @@ bool CL_PrepareConnect(void)
 	}
 
 	recv_full_update = false;
+	fullupdate_serial = -1;
 
 	connecttimeout = 0;
 	CL_TryToConnect(server_token);
@@ -1934,24 +1983,26 @@ void CL_ClearPlayerJustTeleported(player_t *player)
 
 void CL_UpdatePlayer()
 {
-	byte who = MSG_ReadByte();
-	player_t *p = &idplayer(who);
+	int values[MOVEPLAYER_NUMFIELDS];
+	MSG_ReadSchema(moveplayer_schema, values);
 
-	MSG_ReadLong();	// Read and ignore for now
+	player_t *p = &idplayer(values[MOVEPLAYER_ID]);
 
-	fixed_t x = MSG_ReadLong();
-	fixed_t y = MSG_ReadLong();
-	fixed_t z = MSG_ReadLong();
+	// MOVEPLAYER_TIC is ignored for now
 
-	angle_t angle = MSG_ReadShort() << FRACBITS;
-	angle_t pitch = MSG_ReadShort() << FRACBITS;
+	fixed_t x = values[MOVEPLAYER_X];
+	fixed_t y = values[MOVEPLAYER_Y];
+	fixed_t z = values[MOVEPLAYER_Z];
 
-	int frame = MSG_ReadByte();
-	fixed_t momx = MSG_ReadLong();
-	fixed_t momy = MSG_ReadLong();
-	fixed_t momz = MSG_ReadLong();
+	angle_t angle = values[MOVEPLAYER_ANGLE];
+	angle_t pitch = values[MOVEPLAYER_PITCH];
+
+	int frame = values[MOVEPLAYER_FRAME];
+	fixed_t momx = values[MOVEPLAYER_MOMX];
+	fixed_t momy = values[MOVEPLAYER_MOMY];
+	fixed_t momz = values[MOVEPLAYER_MOMZ];
 
-	int invisibility = MSG_ReadByte();
+	int invisibility = values[MOVEPLAYER_INVISIBILITY];
 
 	if	(!validplayer(*p) || !p->mo)
 		return;
@@ -2205,6 +2256,7 @@ void CL_SpawnMobj()
 		if(target)
 			mo->target = target->ptr();
 		CL_SetMobjSpeedAndAngle();
+		CL_AnalyzeMissile(mo);
 	}
 
     if (mo->flags & MF_COUNTKILL)
@@ -2231,6 +2283,7 @@ void CL_SpawnMobj()
 	{
 		mo->radius = int(MSG_ReadByte()) << FRACBITS;
 		mo->height = int(MSG_ReadByte()) << FRACBITS;
+		mo->bmapnode.UpdateBounds();
 	}
 }
 
@@ -2361,7 +2414,7 @@ void CL_SpawnPlayer()
 		ST_Start ();
 
 		// [SL] 2012-04-23 - Clear predicted sectors
-		movingsectors.clear();
+		P_ClearMovingSectors();
 	}
 
 	if (p->id == displayplayer().id)
@@ -2421,16 +2474,15 @@ void CL_PlayerInfo(void)
 //
 void CL_SetMobjSpeedAndAngle(void)
 {
-	AActor *mo;
-	int     netid;
+	int values[SPEEDANGLE_NUMFIELDS];
+	MSG_ReadSchema(speedangle_schema, values);
 
-	netid = MSG_ReadShort();
-	mo = P_FindThingById(netid);
+	AActor *mo = P_FindThingById(values[SPEEDANGLE_NETID]);
 
-	angle_t angle = MSG_ReadLong();
-	fixed_t momx = MSG_ReadLong();
-	fixed_t momy = MSG_ReadLong();
-	fixed_t momz = MSG_ReadLong();
+	angle_t angle = values[SPEEDANGLE_ANGLE];
+	fixed_t momx = values[SPEEDANGLE_MOMX];
+	fixed_t momy = values[SPEEDANGLE_MOMY];
+	fixed_t momz = values[SPEEDANGLE_MOMZ];
 
 	if (!mo)
 		return;
@@ -2522,6 +2574,9 @@ void CL_RemoveMobj(void)
 	if (mo && mo->player && mo->player->id == displayplayer_id)
 		displayplayer_id = consoleplayer_id;
 
+	if (mo)
+		CL_AnalyzeItemRemoved(mo);
+
 	P_ClearId(netid);
 }
 
@@ -2554,6 +2609,7 @@ void CL_DamagePlayer(void)
 
 	if (damage > 0) {
 		p->damagecount += damage;
+		CL_AnalyzeDamage(*p, damage);
 
 		if (p->damagecount > 100)
 			p->damagecount = 100;
@@ -2584,6 +2640,8 @@ void CL_KillMobj(void)
 
 	target->health = health;
 
+	CL_AnalyzeFrag(source, target, MeansOfDeath);
+
     if (!serverside && target->flags & MF_COUNTKILL)
 		level.killed_monsters++;
 
@@ -2618,6 +2676,7 @@ void CL_FireWeapon (void)
 		MSG_WriteMarker (&net_buffer, clc_getplayerinfo);
 	}
 
+	CL_AnalyzeShot(*p, firedweap);
 }
 
 //
@@ -2634,7 +2693,10 @@ void CL_FirePistol(void)
 		return;
 
 	if (&p != &consoleplayer())
+	{
 		S_Sound (p.mo, CHAN_WEAPON, "weapons/pistol", 1, ATTN_NORM);
+		CL_AnalyzeShot(p, wp_pistol);
+	}
 }
 
 //
@@ -2651,7 +2713,10 @@ void CL_FireShotgun(void)
 		return;
 
 	if (&p != &consoleplayer())
+	{
 		S_Sound (p.mo, CHAN_WEAPON,  "weapons/shotgf", 1, ATTN_NORM);
+		CL_AnalyzeShot(p, wp_shotgun);
+	}
 }
 
 //
@@ -2668,7 +2733,10 @@ void CL_FireSSG(void)
 		return;
 
 	if (&p != &consoleplayer())
+	{
 		S_Sound (p.mo, CHAN_WEAPON, "weapons/sshotf", 1, ATTN_NORM);
+		CL_AnalyzeShot(p, wp_supershotgun);
+	}
 }
 
 
@@ -2686,7 +2754,10 @@ void CL_FireChainGun(void)
 		return;
 
 	if (&p != &consoleplayer())
+	{
 		S_Sound (p.mo, CHAN_WEAPON, "weapons/chngun", 1, ATTN_NORM);
+		CL_AnalyzeShot(p, wp_chaingun);
+	}
 }
 
 //
@@ -3076,6 +3147,77 @@ void CL_FinishedFullUpdate()
 		netdemo.writeMapChange();
 }
 
+//
+// CL_FullUpdateChunk
+//
+// Collects the pieces of the compressed full update.  Once all of them are
+// in, the messages inside are parsed in one go so the whole world appears
+// on the same tic.
+//
+void CL_FullUpdateChunk()
+{
+	static bool applied = false;
+	static std::vector<byte> image;
+	static std::set<size_t> offsets;
+	static size_t received = 0;
+	static dtime_t starttime = 0;
+
+	byte newserial = MSG_ReadByte();
+	size_t size = MSG_ReadLong();
+	size_t offset = MSG_ReadLong();
+	size_t len = (unsigned short)MSG_ReadShort();
+	const byte *data = (const byte *)MSG_ReadChunk(len);
+
+	if (!data || offset + len > size)
+		return;
+
+	if (newserial != fullupdate_serial)
+	{
+		fullupdate_serial = newserial;
+		applied = false;
+		image.assign(size, 0);
+		offsets.clear();
+		received = 0;
+		starttime = I_GetTime();
+	}
+
+	// duplicates of a piece, or of one from an update that is done already
+	if (applied || image.size() != size || !offsets.insert(offset).second)
+		return;
+
+	memcpy(&image[offset], data, len);
+	received += len;
+
+	if (received < size)
+		return;
+
+	applied = true;
+
+	size_t expanded = FLZOMemFile::ExpandedImageLength(&image[0], image.size());
+	std::vector<byte> messages(expanded);
+
+	if (!expanded || !FLZOMemFile::DecompressImage(&image[0], image.size(), &messages[0], expanded))
+	{
+		Printf(PRINT_HIGH, "CL_FullUpdateChunk: bad full update\n");
+		CL_QuitNetGame();
+		return;
+	}
+
+	DPrintf("Full update: %u bytes (%u compressed) in %u ms\n",
+			(unsigned int)(expanded - 8), (unsigned int)image.size(),
+			(unsigned int)I_ConvertTimeToMs(I_GetTime() - starttime));
+
+	image.clear();
+	offsets.clear();
+
+	// parse it as if it were a packet of its own, then carry on with the
+	// rest of this one
+	buf_t update(expanded - 8);
+	SZ_Write(&update, &messages[8], expanded - 8);
+
+	CL_ParseCommands(update);
+}
+
 //
 // CL_SetMobjState
 //
@@ -3312,7 +3454,7 @@ void CL_LoadMap(void)
 
 	G_InitNew (mapname);
 
-	movingsectors.clear();
+	P_ClearMovingSectors();
 	teleported_players.clear();
 
 	CL_ClearSectorSnapshots();
@@ -3441,7 +3583,7 @@ void CL_Spectate()
 			player.playerstate = PST_LIVE; // resurrect dead spectators
 			// GhostlyDeath -- Sometimes if the player spectates while he is falling down he squats
 			player.deltaviewheight = 1000 << FRACBITS;
-			movingsectors.clear(); //clear all moving sectors, otherwise client side prediction will not move active sectors
+			P_ClearMovingSectors(); //clear all moving sectors, otherwise client side prediction will not move active sectors
 		}
 		else
 		{
@@ -3576,6 +3718,7 @@ void CL_InitCommands(void)
 	cmds[svc_netdemostop]       = &CL_NetDemoStop;
 	cmds[svc_netdemoloadsnap]	= &CL_NetDemoLoadSnap;
 	cmds[svc_fullupdatedone]	= &CL_FinishedFullUpdate;
+	cmds[svc_fullupdatechunk]	= &CL_FullUpdateChunk;
 
 	cmds[svc_vote_update] = &CL_VoteUpdate;
 	cmds[svc_maplist] = &CL_Maplist;
@@ -3586,7 +3729,7 @@ void CL_InitCommands(void)
 //
 // CL_ParseCommands
 //
-void CL_ParseCommands(void)
+void CL_ParseCommands(buf_t &msg)
 {
 	std::vector<svc_t>	history;
 	svc_t				cmd = svc_abort;
@@ -3595,9 +3738,11 @@ void CL_ParseCommands(void)
 	if(once)CL_InitCommands();
 	once = false;
 
+	buf_t *oldread = MSG_SetReadBuffer(&msg);
+
 	while(connected)
 	{
-		size_t byteStart = net_message.BytesRead();
+		size_t byteStart = msg.BytesRead();
 
 		cmd = (svc_t)MSG_ReadByte();
 		history.push_back(cmd);
@@ -3619,7 +3764,7 @@ void CL_ParseCommands(void)
 
 		i->second();
 
-		if (net_message.overflowed)
+		if (msg.overflowed)
 		{
 			CL_QuitNetGame();
 			Printf(PRINT_HIGH, "CL_ParseCommands: Bad server message\n");
@@ -3633,11 +3778,15 @@ void CL_ParseCommands(void)
 		}
 
 		// Measure length of each message, so we can keep track of bandwidth.
-		if (net_message.BytesRead() < byteStart)
-			Printf(PRINT_HIGH, "CL_ParseCommands: end byte (%d) < start byte (%d)\n", net_message.BytesRead(), byteStart);
+		// A reassembled full update was counted as it came in.
+		if (msg.BytesRead() < byteStart)
+			Printf(PRINT_HIGH, "CL_ParseCommands: end byte (%d) < start byte (%d)\n", msg.BytesRead(), byteStart);
 
-		netgraph.addTrafficIn(net_message.BytesRead() - byteStart);
+		if (&msg == &net_message)
+			netgraph.addTrafficIn(msg.BytesRead() - byteStart);
 	}
+
+	MSG_SetReadBuffer(oldread);
 }
 
 
@@ -51,7 +51,7 @@ void CL_QuitNetGame(void);
 void CL_InitNetwork (void);
 void CL_RequestConnectInfo(void);
 bool CL_PrepareConnect(void);
-void CL_ParseCommands(void);
+void CL_ParseCommands(buf_t &msg = net_message);
 void CL_ReadPacketHeader(void);
 void CL_SendCmd(void);
 void CL_SaveCmd(void);
@@ -22,6 +22,8 @@
 //-----------------------------------------------------------------------------
 
 
+#include <algorithm>
+
 #include "doomtype.h"
 #include "doomstat.h"
 #include "d_player.h"
@@ -44,6 +46,7 @@ EXTERN_CVAR (co_realactorheight)
 EXTERN_CVAR (cl_prednudge)
 EXTERN_CVAR (cl_predictsectors)
 EXTERN_CVAR (cl_predictlocalplayer)
+EXTERN_CVAR (cl_predictincremental)
 
 extern NetGraph netgraph;
 
@@ -53,10 +56,38 @@ void P_CalcHeight (player_t *player);
 
 extern NetCommand localcmds[MAXSAVETICS];
 static PlayerSnapshot cl_savedsnaps[MAXSAVETICS];
+static int cl_savedsnaptics[MAXSAVETICS];
+
+// State left behind by the last call to CL_PredictWorld, used to tell if the
+// prediction can be carried on without replaying from the server's snapshot
+struct predictionstate_t
+{
+	int				gametic;		// gametic it was predicted for
+	AActor			*mo;
+	PlayerSnapshot	snap;			// the player after that tic
+	int				verifiedtime;	// the newest server snapshot agreed with,
+									// -1 if the player was nudged since
+	int				sectorstamp;	// CL_SectorSnapshotStamp() at the time
+};
+
+static predictionstate_t lastprediction;
+
+// Prediction counters for predstats
+struct predictionstats_t
+{
+	unsigned int	incremental;	// tics predicted without replaying
+	unsigned int	replays;		// tics the prediction was rolled back
+	unsigned int	replayedtics;	// tics re-simulated by those rollbacks
+	unsigned int	mispredictions;	// rollbacks that moved the player
+	int				recent[TICRATE];	// replayed tics in the last second
+};
+
+static predictionstats_t predstats;
 
 bool predicting;
 
 extern std::map<unsigned short, SectorSnapshotManager> sector_snaps;
+extern int last_svgametic;
 
 
 //
@@ -105,6 +136,21 @@ bool CL_SectorIsPredicting(sector_t *sector)
 	return false;
 }
 
+//
+// CL_RunSectorThinkers
+//
+// Moves the floor and ceiling of a predicted sector by one tic
+//
+static void CL_RunSectorThinkers(const movingsector_t &movesec)
+{
+	sector_t *sector = movesec.sector;
+
+	if (sector && sector->ceilingdata && movesec.moving_ceiling)
+		sector->ceilingdata->RunThink();
+	if (sector && sector->floordata && movesec.moving_floor)
+		sector->floordata->RunThink();
+}
+
 //
 // CL_ResetSectors
 //
@@ -123,7 +169,10 @@ static void CL_ResetSectors()
 		sector_t *sector = itr->sector;
 		unsigned short sectornum = sector - sectors;
 		if (sectornum >= numsectors)
+		{
+			++itr;
 			continue;
+		}
 		
 		// Find the most recent snapshot received from the server for this sector
 		SectorSnapshotManager *mgr = CL_GetSectorSnapshotManager(sector);
@@ -145,6 +194,13 @@ static void CL_ResetSectors()
 				// snapshots have been received for this sector recently, so
 				// reset this sector to the most recent snapshot from the server
 				snap.toSector(sector);
+
+				// the server only resends a sector when it stops moving the
+				// way the last update said it would, so bring an older
+				// snapshot up to the server's current tic
+				int catchup = std::min(last_svgametic - mostrecent, NUM_SNAPSHOTS);
+				for (int i = 0; i < catchup; i++)
+					CL_RunSectorThinkers(*itr);
 			}
 		}
 		else
@@ -156,7 +212,7 @@ static void CL_ResetSectors()
 		{
 			// no valid snapshots in the container so remove this sector from the
 			// movingsectors list whenever prediction is done
-			movingsectors.erase(itr++);
+			itr = P_RemoveMovingSector(itr);
 		}
 		else
 		{
@@ -182,10 +238,7 @@ static void CL_PredictSectors(int predtic)
 		if (predtic < gametic && !CL_SectorHasSnapshots(sector))
 			continue;
 
-		if (sector && sector->ceilingdata && itr->moving_ceiling)
-			sector->ceilingdata->RunThink();
-		if (sector && sector->floordata && itr->moving_floor)
-			sector->floordata->RunThink();				
+		CL_RunSectorThinkers(*itr);
 	}
 }
 
@@ -263,6 +316,89 @@ static void CL_PredictLocalPlayer(int predtic)
 	player->mo->RunThink();
 }
 
+//
+// CL_SectorSnapshotStamp
+//
+// Changes whenever a sector snapshot arrives from the server
+//
+static int CL_SectorSnapshotStamp()
+{
+	int stamp = sector_snaps.size();
+
+	std::map<unsigned short, SectorSnapshotManager>::const_iterator itr;
+	for (itr = sector_snaps.begin(); itr != sector_snaps.end(); ++itr)
+		stamp += itr->second.getMostRecentTime();
+
+	return stamp;
+}
+
+static bool CL_SamePlayerPosition(const PlayerSnapshot &a, const PlayerSnapshot &b)
+{
+	return a.getX() == b.getX() && a.getY() == b.getY() && a.getZ() == b.getZ() &&
+		   a.getMomX() == b.getMomX() && a.getMomY() == b.getMomY() &&
+		   a.getMomZ() == b.getMomZ();
+}
+
+//
+// CL_PredictionStillValid
+//
+// Returns true if the local player can be moved on from where the last tic's
+// prediction left them.  That holds as long as nothing else moved them and
+// every snapshot the server has sent since matches what was predicted for
+// that tic.
+//
+static bool CL_PredictionStillValid(player_t *p)
+{
+	if (lastprediction.gametic != gametic - 1 || lastprediction.mo != p->mo)
+		return false;
+
+	// the player was lerped towards a correction, so where they are is not
+	// anything the server will confirm
+	if (lastprediction.verifiedtime < 0)
+		return false;
+
+	// something other than prediction moved the player
+	if (!CL_SamePlayerPosition(PlayerSnapshot(p->tic, p), lastprediction.snap))
+		return false;
+
+	// sectors the player may be standing on were corrected
+	if (cl_predictsectors && lastprediction.sectorstamp != CL_SectorSnapshotStamp())
+		return false;
+
+	int snaptime = p->snapshots.getMostRecentTime();
+	if (snaptime == lastprediction.verifiedtime)
+		return true;
+
+	// the server's snapshot is the player after tic p->tic, which is what
+	// was saved at the start of the following tic
+	int aftertic = p->tic + 1;
+	if (aftertic <= gametic - MAXSAVETICS || aftertic > gametic ||
+		cl_savedsnaptics[aftertic % MAXSAVETICS] != aftertic)
+		return false;
+
+	PlayerSnapshot snap = p->snapshots.getSnapshot(snaptime);
+	if (!snap.isContinuous() ||
+		!CL_SamePlayerPosition(snap, cl_savedsnaps[aftertic % MAXSAVETICS]))
+		return false;
+
+	lastprediction.verifiedtime = snaptime;
+	return true;
+}
+
+//
+// CL_FinishPrediction
+//
+static void CL_FinishPrediction(player_t *p, int snaptime, int replayed)
+{
+	lastprediction.gametic = gametic;
+	lastprediction.mo = p->mo;
+	lastprediction.snap = PlayerSnapshot(p->tic, p);
+	lastprediction.verifiedtime = snaptime;
+	lastprediction.sectorstamp = CL_SectorSnapshotStamp();
+
+	predstats.recent[gametic % TICRATE] = replayed;
+}
+
 //
 // CL_PredictWorld
 //
@@ -307,6 +443,21 @@ void CL_PredictWorld(void)
 	// Save a snapshot of the player's state before prediction
 	PlayerSnapshot prevsnap(p->tic, p);
 	cl_savedsnaps[gametic % MAXSAVETICS] = prevsnap;
+	cl_savedsnaptics[gametic % MAXSAVETICS] = gametic;
+
+	// Carry on from last tic when the server agrees with what was predicted
+	if (cl_predictlocalplayer && cl_predictincremental && CL_PredictionStillValid(p))
+	{
+		predicting = false;
+
+		if (cl_predictsectors)
+			CL_PredictSectors(gametic);
+		CL_PredictLocalPlayer(gametic);
+
+		predstats.incremental++;
+		CL_FinishPrediction(p, lastprediction.verifiedtime, 0);
+		return;
+	}
 
 	// Move sectors to the last position received from the server
 	if (cl_predictsectors)
@@ -317,10 +468,15 @@ void CL_PredictWorld(void)
 	PlayerSnapshot snap = p->snapshots.getSnapshot(snaptime);
 	snap.toPlayer(p);
 
+	int replayed = 0;
+
 	if (cl_predictlocalplayer)
 	{
+		predstats.replays++;
+
 		while (++predtic < gametic)
 		{
+			replayed++;
 			if (cl_predictsectors)
 				CL_PredictSectors(predtic);
 			CL_PredictLocalPlayer(predtic);  
@@ -342,10 +498,14 @@ void CL_PredictWorld(void)
 			{
 				// Update the netgraph concerning our prediction's error
 				netgraph.setMisprediction(true);
+				predstats.mispredictions++;
 
 				// Lerp from the our previous position to the correct position
 				PlayerSnapshot lerpedsnap = P_LerpPlayerPosition(prevsnap, correctedprevsnap, cl_prednudge);	
 				lerpedsnap.toPlayer(p);
+
+				// don't carry on from the nudged position next tic
+				snaptime = -1;
 			}
 		}
 	}
@@ -356,7 +516,34 @@ void CL_PredictWorld(void)
 	if (cl_predictsectors)
 		CL_PredictSectors(gametic);		
 	CL_PredictLocalPlayer(gametic);
+
+	predstats.replayedtics += replayed;
+	CL_FinishPrediction(p, snaptime, replayed);
+}
+
+BEGIN_COMMAND (predstats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		memset(&predstats, 0, sizeof(predstats));
+		return;
+	}
+
+	int lastsecond = 0;
+	for (int i = 0; i < TICRATE; i++)
+		lastsecond += predstats.recent[i];
+
+	unsigned int total = predstats.incremental + predstats.replays;
+
+	Printf(PRINT_HIGH, "Prediction: %u tics, %u carried on, %u replayed from the server's snapshot\n",
+		total, predstats.incremental, predstats.replays);
+	Printf(PRINT_HIGH, "  %u tics re-simulated, %.1f per replay, %d in the last second\n",
+		predstats.replayedtics,
+		predstats.replays ? (float)predstats.replayedtics / predstats.replays : 0.0f,
+		lastsecond);
+	Printf(PRINT_HIGH, "  %u mispredictions\n", predstats.mispredictions);
 }
+END_COMMAND (predstats)
 
 
 VERSION_CONTROL (cl_pred_cpp, "$Id$")
@@ -81,6 +81,8 @@
 #include "d_main.h"
 #include "d_dehacked.h"
 #include "cl_download.h"
+#include "cl_analyze.h"
+#include "v_screenshot.h"
 #include "cmdlib.h"
 #include "s_sound.h"
 #include "m_swap.h"
@@ -220,11 +222,14 @@ void D_DisplayTicker()
 //
 void D_Display()
 {
-	if (nodrawers || I_IsHeadless())
+	// headless clients still draw when exporting frames
+	if (nodrawers || (I_IsHeadless() && !V_IsExportingFrames()))
 		return; 				// for comparative timing / profiling
 
 	BEGIN_STAT(D_Display);
 
+	V_UpdateScreenShots();
+
 	// video mode must be changed before surfaces are locked in I_BeginUpdate
 	V_AdjustVideoMode();
 
@@ -328,6 +333,7 @@ void D_Display()
 
 	C_DrawConsole();	// draw console
 	M_Drawer();			// menu is drawn even on top of everything
+	V_ExportFrame();
 	I_FinishUpdate();	// page flip or blit buffer
 
 	END_STAT(D_Display);
@@ -925,6 +931,19 @@ void D_DoomMain()
 		CL_NetDemoPlay(filename);
 	}
 
+	// play a netdemo headless, write what happened in it and quit
+	p = Args.CheckParm("-analyze");
+	if (p && p < Args.NumArgs() - 2)
+		CL_AnalyzeStart(Args.GetArg(p + 1), Args.GetArg(p + 2));
+
+	// play a netdemo, save every frame of it as an image and quit
+	p = Args.CheckParm("-exportframes");
+	if (p && p < Args.NumArgs() - 2)
+	{
+		CL_NetDemoPlay(Args.GetArg(p + 2));
+		V_StartFrameExport(Args.GetArg(p + 1), true);
+	}
+
 	// --- initialization complete ---
 
 	Printf_Bold("\n\35\36\36\36\36 Odamex Client Initialized \36\36\36\36\37\n");
@@ -37,6 +37,7 @@
 #include "doomstat.h"
 #include "r_state.h"
 #include "v_palette.h"
+#include "r_pvs.h"
 
 EXTERN_CVAR (r_particles)
 
@@ -746,6 +747,10 @@ void R_RenderBSPNode (int bspnum)
 {
 	while (!(bspnum & NF_SUBSECTOR))  // Found a subsector?
 	{
+		// nothing below this node can be seen from the view's sector
+		if (pvsnodes && !pvsnodes[bspnum])
+			return;
+
 		node_t *bsp = &nodes[bspnum];
 
 		// Decide which side the view point is on.
@@ -762,7 +767,11 @@ void R_RenderBSPNode (int bspnum)
 		bspnum = bsp->children[backside];
 	}
 
-	R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+	int num = bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR;
+	if (pvssubsectors && !pvssubsectors[num])
+		return;
+
+	R_Subsector(num);
 }
 
 
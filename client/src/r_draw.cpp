@@ -92,6 +92,7 @@ void (*R_FillTranslucentSpan)(void);
 void (*R_DrawSpanD)(void);
 void (*R_DrawSlopeSpanD)(void);
 void (*r_dimpatchD)(IWindowSurface* surface, argb_t color, int alpha, int x1, int y1, int w, int h);
+void (*r_stretchrowD)(argb_t* dest, const argb_t* source, const int* runs, int count) = r_stretchrowD_c;
 
 // ============================================================================
 //
@@ -1588,6 +1589,7 @@ void R_InitVectorizedDrawers()
 		R_DrawSpanD				= R_DrawSpanD_c;
 		R_DrawSlopeSpanD		= R_DrawSlopeSpanD_c;
 		r_dimpatchD             = r_dimpatchD_c;
+		r_stretchrowD           = r_stretchrowD_c;
 	}
 	#ifdef __SSE2__
 	if (optimize_kind == OPTIMIZE_SSE2)
@@ -1595,6 +1597,7 @@ void R_InitVectorizedDrawers()
 		R_DrawSpanD				= R_DrawSpanD_SSE2;
 		R_DrawSlopeSpanD		= R_DrawSlopeSpanD_SSE2;
 		r_dimpatchD             = r_dimpatchD_SSE2;
+		r_stretchrowD           = r_stretchrowD_SSE2;
 	}
 	#endif
 	#ifdef __MMX__
@@ -1603,6 +1606,7 @@ void R_InitVectorizedDrawers()
 		R_DrawSpanD				= R_DrawSpanD_c;		// TODO
 		R_DrawSlopeSpanD		= R_DrawSlopeSpanD_c;	// TODO
 		r_dimpatchD             = r_dimpatchD_MMX;
+		r_stretchrowD           = r_stretchrowD_c;		// TODO
 	}
 	#endif
 	#ifdef __ALTIVEC__
@@ -1611,6 +1615,7 @@ void R_InitVectorizedDrawers()
 		R_DrawSpanD				= R_DrawSpanD_c;		// TODO
 		R_DrawSlopeSpanD		= R_DrawSlopeSpanD_c;	// TODO
 		r_dimpatchD             = r_dimpatchD_ALTIVEC;
+		r_stretchrowD           = r_stretchrowD_c;		// TODO
 	}
 	#endif
 
@@ -1618,6 +1623,16 @@ void R_InitVectorizedDrawers()
 	assert(R_DrawSpanD != NULL);
 	assert(R_DrawSlopeSpanD != NULL);
 	assert(r_dimpatchD != NULL);
+	assert(r_stretchrowD != NULL);
+
+	// r_stretchrowD must give exactly the pixels of the plain blit loop
+	if (!I_CheckBlit() && r_stretchrowD != r_stretchrowD_c)
+	{
+		Printf(PRINT_HIGH, "R_InitVectorizedDrawers: %s r_stretchrowD is not exact, using the C version\n",
+				get_optimization_name(optimize_kind));
+		r_stretchrowD = r_stretchrowD_c;
+		I_CheckBlit();
+	}
 }
 
 // [RH] Initialize the column drawer pointers
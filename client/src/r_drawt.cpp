@@ -42,6 +42,18 @@ void r_dimpatchD_c(IWindowSurface* surface, argb_t color, int alpha, int x1, int
 	}
 }
 
+// Writes runs[i] copies of source[i] for each of the count source pixels.
+// Used by IWindowSurface::blit to stretch a converted row.
+void r_stretchrowD_c(argb_t* dest, const argb_t* source, const int* runs, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const argb_t color = source[i];
+		for (int run = runs[i]; run > 0; run--)
+			*dest++ = color;
+	}
+}
+
 	
 VERSION_CONTROL (r_drawt_cpp, "$Id$")
 
@@ -391,6 +391,33 @@ void r_dimpatchD_SSE2(IWindowSurface* surface, argb_t color, int alpha, int x1,
 	}
 }
 
+void r_stretchrowD_SSE2(argb_t* dest, const argb_t* source, const int* runs, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const int run = runs[i];
+		const argb_t color = source[i];
+
+		if (run >= 4)
+		{
+			// Fill with unaligned stores, the last one overlapping the
+			// previous store so the run needs no scalar tail.
+			const __m128i vec_color = _mm_set1_epi32(color);
+			for (int x = 0; x < run - 4; x += 4)
+				_mm_storeu_si128((__m128i*)(dest + x), vec_color);
+			_mm_storeu_si128((__m128i*)(dest + run - 4), vec_color);
+		}
+		else
+		{
+			for (int x = 0; x < run; x++)
+				dest[x] = color;
+		}
+
+		dest += run;
+	}
+}
+
+
 
 VERSION_CONTROL (r_drawt_sse2_cpp, "$Id$")
 
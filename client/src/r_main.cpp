@@ -40,10 +40,12 @@
 #include "v_video.h"
 #include "stats.h"
 #include "z_zone.h"
+#include "i_system.h"
 #include "i_video.h"
 #include "m_vectors.h"
 #include "f_wipe.h"
 #include "am_map.h"
+#include "r_pvs.h"
 
 void R_BeginInterpolation(fixed_t amount);
 void R_EndInterpolation();
@@ -1008,6 +1010,11 @@ void R_RenderPlayerView(player_t* player)
 	if (!viewactive)
 		return;
 
+	// compose textures the level may need soon, outside of the frame timing
+	R_PrecacheUpdate();
+
+	dtime_t frame_start = I_GetTime();
+
 	R_SetupFrame(player);
 
 	// Clear buffers.
@@ -1036,6 +1043,8 @@ void R_RenderPlayerView(player_t* player)
 	// [RH] Setup particles for this frame
 	R_FindParticleSubsectors();
 
+	R_PVSSetupFrame();
+
     // [Russell] - From zdoom 1.22 source, added camera pointer check
 	// Never draw the player unless in chasecam mode
 	if (camera && camera->player && !(player->cheats & CF_CHASECAM))
@@ -1061,6 +1070,8 @@ void R_RenderPlayerView(player_t* player)
 	}
 
 	R_EndInterpolation();
+
+	R_PrecacheFrameTime(I_GetTime() - frame_start);
 }
 
 
@@ -0,0 +1,627 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Potentially visible set
+//
+//	Visibility flows out of a sector through each of its portals.  Going
+//	from one portal to the next, the next portal is clipped to the region a
+//	line through the first portal and the current one can reach, the same
+//	way qvis clips with separating planes, only in 2D.  When nothing of a
+//	portal is left the flow stops there.  Every clip errs towards keeping
+//	more, so the sets can only be too large, never too small.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "c_console.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "p_local.h"
+#include "r_local.h"
+#include "r_state.h"
+#include "r_pvs.h"
+
+EXTERN_CVAR (r_pvs)
+
+const byte *pvsnodes = NULL;
+const byte *pvssubsectors = NULL;
+
+// bump when the sets are computed differently, so old caches are ignored
+static const uint32_t PVS_VERSION = 1;
+static const char PVS_MAGIC[4] = { 'O', 'P', 'V', 'S' };
+
+// flow steps allowed per source sector before giving up and using every
+// sector connected to it
+static const int PVS_MAX_STEPS = 1 << 20;
+static const int PVS_MAX_DEPTH = 256;
+
+// the sets take numsectors^2 bits
+static const int PVS_MAX_SECTORS = 16384;
+
+// map units a point may be on the wrong side of a line and still be kept
+static const double PVS_EPSILON = 0.5;
+
+struct pvsseg_t
+{
+	double x1, y1, x2, y2;
+};
+
+struct pvsportal_t
+{
+	pvsseg_t	seg;
+	int			line;
+	int			to;			// sector on the other side
+};
+
+//
+// PVS_Side
+//
+// Distance of a point from the line through a and b, positive on the left
+//
+static inline double PVS_Side(double ax, double ay, double bx, double by, double px, double py)
+{
+	double dx = bx - ax, dy = by - ay;
+	double len = sqrt(dx * dx + dy * dy);
+
+	if (len == 0.0)
+		return 0.0;
+
+	return (dx * (py - ay) - dy * (px - ax)) / len;
+}
+
+//
+// PVS_ClipSeg
+//
+// Keeps the part of seg on the keep side (+1 left, -1 right) of the line
+// through a and b.  Returns false if nothing is left.
+//
+static bool PVS_ClipSeg(pvsseg_t &seg, double ax, double ay, double bx, double by, int keep)
+{
+	double d1 = PVS_Side(ax, ay, bx, by, seg.x1, seg.y1) * keep;
+	double d2 = PVS_Side(ax, ay, bx, by, seg.x2, seg.y2) * keep;
+
+	if (d1 >= -PVS_EPSILON && d2 >= -PVS_EPSILON)
+		return true;
+	if (d1 < -PVS_EPSILON && d2 < -PVS_EPSILON)
+		return false;
+
+	// cut where the seg is PVS_EPSILON past the line
+	double t = (d1 + PVS_EPSILON) / (d1 - d2);
+	double x = seg.x1 + t * (seg.x2 - seg.x1);
+	double y = seg.y1 + t * (seg.y2 - seg.y1);
+
+	if (d1 < -PVS_EPSILON)
+		seg.x1 = x, seg.y1 = y;
+	else
+		seg.x2 = x, seg.y2 = y;
+
+	return true;
+}
+
+//
+// PVS_ClipToSeparators
+//
+// Clips target to where a line passing through source and then pass could
+// go next.  The separators are the lines through an end of source and an
+// end of pass that have the two portals on opposite sides.
+//
+static bool PVS_ClipToSeparators(const pvsseg_t &source, const pvsseg_t &pass, pvsseg_t &target)
+{
+	const double sx[2] = { source.x1, source.x2 }, sy[2] = { source.y1, source.y2 };
+	const double px[2] = { pass.x1, pass.x2 }, py[2] = { pass.y1, pass.y2 };
+
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			double so = PVS_Side(sx[i], sy[i], px[j], py[j], sx[i ^ 1], sy[i ^ 1]);
+			double po = PVS_Side(sx[i], sy[i], px[j], py[j], px[j ^ 1], py[j ^ 1]);
+
+			// only a line that clearly splits the two portals bounds anything
+			if (!((so > PVS_EPSILON && po < -PVS_EPSILON) || (so < -PVS_EPSILON && po > PVS_EPSILON)))
+				continue;
+
+			if (!PVS_ClipSeg(target, sx[i], sy[i], px[j], py[j], po > 0 ? 1 : -1))
+				return false;
+		}
+	}
+
+	// the line carries on past pass, away from source.  That only bounds
+	// anything when all of source is behind pass.
+	double s1 = PVS_Side(px[0], py[0], px[1], py[1], sx[0], sy[0]);
+	double s2 = PVS_Side(px[0], py[0], px[1], py[1], sx[1], sy[1]);
+
+	if (std::max(s1, s2) <= 0.0 && std::min(s1, s2) < -PVS_EPSILON)
+		return PVS_ClipSeg(target, px[0], py[0], px[1], py[1], 1);
+	if (std::min(s1, s2) >= 0.0 && std::max(s1, s2) > PVS_EPSILON)
+		return PVS_ClipSeg(target, px[0], py[0], px[1], py[1], -1);
+
+	return true;
+}
+
+//
+// PVSBuilder
+//
+// Owns a copy of the portal geometry so the level can be unloaded while the
+// worker threads are still busy.
+//
+class PVSBuilder
+{
+public:
+	PVSBuilder() : numsectors(0), rowbytes(0), nextsector(0), donesectors(0),
+		cancelled(0), overflows(0), started(0), fromcache(false), hash(0) {}
+	~PVSBuilder() { cancel(); }
+
+	int numsectors;
+	size_t rowbytes;
+	std::vector<byte> rows;
+	std::vector<std::vector<pvsportal_t> > cells;
+
+	volatile int nextsector;
+	volatile int donesectors;
+	volatile int cancelled;
+	volatile int overflows;
+
+	dtime_t started;
+	dtime_t buildtime;
+	bool fromcache;
+	uint64_t hash;
+
+	bool visible(int from, int to) const
+	{
+		return (rows[from * rowbytes + (to >> 3)] & (1 << (to & 7))) != 0;
+	}
+
+	bool finished() const
+	{
+		return numsectors > 0 && I_AtomicLoad((volatile int *)&donesectors) == numsectors;
+	}
+
+	void start()
+	{
+		started = I_GetTime();
+
+		// leave a core for the game
+		unsigned int count = std::max(I_GetCPUCount(), 2u) - 1;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			threads.push_back(new OThread);
+			threads.back()->start(PVSBuilder::work, this);
+		}
+	}
+
+	void join()
+	{
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threads[i]->join();
+			delete threads[i];
+		}
+		threads.clear();
+	}
+
+	void cancel()
+	{
+		I_AtomicStore(&cancelled, 1);
+		join();
+	}
+
+private:
+	std::vector<OThread *> threads;
+
+	struct flowstate_t
+	{
+		byte		*row;
+		int			steps;
+		bool		overflowed;
+		std::vector<int> path;		// portal lines crossed so far
+	};
+
+	static void work(void *data)
+	{
+		PVSBuilder *self = static_cast<PVSBuilder *>(data);
+		flowstate_t state;
+
+		while (!I_AtomicLoad(&self->cancelled))
+		{
+			int sector = I_AtomicAdd(&self->nextsector, 1) - 1;
+			if (sector >= self->numsectors)
+				break;
+
+			self->buildRow(sector, state);
+			I_AtomicAdd(&self->donesectors, 1);
+		}
+	}
+
+	void mark(byte *row, int sector)
+	{
+		row[sector >> 3] |= 1 << (sector & 7);
+	}
+
+	void buildRow(int sector, flowstate_t &state)
+	{
+		state.row = &rows[sector * rowbytes];
+		state.steps = 0;
+		state.overflowed = false;
+
+		mark(state.row, sector);
+
+		const std::vector<pvsportal_t> &portals = cells[sector];
+		for (size_t i = 0; i < portals.size() && !state.overflowed; i++)
+		{
+			mark(state.row, portals[i].to);
+
+			state.path.clear();
+			state.path.push_back(portals[i].line);
+			flow(state, portals[i].to, portals[i].seg, portals[i].seg);
+		}
+
+		// too much to follow, everything it connects to will have to do
+		if (state.overflowed)
+		{
+			I_AtomicAdd(&overflows, 1);
+			flood(state.row, sector);
+		}
+	}
+
+	void flow(flowstate_t &state, int cell, const pvsseg_t &source, const pvsseg_t &pass)
+	{
+		if (++state.steps > PVS_MAX_STEPS || state.path.size() > (size_t)PVS_MAX_DEPTH ||
+			I_AtomicLoad(&cancelled))
+		{
+			state.overflowed = true;
+			return;
+		}
+
+		const std::vector<pvsportal_t> &portals = cells[cell];
+		for (size_t i = 0; i < portals.size() && !state.overflowed; i++)
+		{
+			const pvsportal_t &portal = portals[i];
+
+			// a straight line crosses each linedef once
+			if (std::find(state.path.begin(), state.path.end(), portal.line) != state.path.end())
+				continue;
+
+			pvsseg_t target = portal.seg;
+			if (!PVS_ClipToSeparators(source, pass, target))
+				continue;
+
+			mark(state.row, portal.to);
+
+			state.path.push_back(portal.line);
+			flow(state, portal.to, source, target);
+			state.path.pop_back();
+		}
+	}
+
+	void flood(byte *row, int sector)
+	{
+		std::vector<int> open(1, sector);
+		std::vector<bool> seen(numsectors, false);
+		seen[sector] = true;
+
+		while (!open.empty())
+		{
+			int cell = open.back();
+			open.pop_back();
+			mark(row, cell);
+
+			for (size_t i = 0; i < cells[cell].size(); i++)
+			{
+				int to = cells[cell][i].to;
+				if (!seen[to])
+				{
+					seen[to] = true;
+					open.push_back(to);
+				}
+			}
+		}
+	}
+};
+
+static PVSBuilder *pvs = NULL;
+static bool pvsready = false;
+
+// per-level lookups for picking nodes, filled in by R_BuildPVS
+static std::vector<int> nodeparent;
+static std::vector<int> subsectorparent;
+static std::vector<byte> nodemarks;
+static std::vector<byte> subsectormarks;
+static int markedsector = -1;
+static int visiblenodes, visiblesubsectors;
+
+//
+// R_PVSHash
+//
+// Identifies the portal geometry of the level for the cache
+//
+static uint64_t R_PVSHash()
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	#define PVS_HASH(v) \
+		do { uint32_t _v = (uint32_t)(v); \
+			for (int _b = 0; _b < 4; _b++) \
+				hash = (hash ^ ((_v >> (_b * 8)) & 0xFF)) * 1099511628211ULL; } while (0)
+
+	PVS_HASH(PVS_VERSION);
+	PVS_HASH(numsectors);
+	PVS_HASH(numlines);
+
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t *line = &lines[i];
+		PVS_HASH(line->v1->x);
+		PVS_HASH(line->v1->y);
+		PVS_HASH(line->v2->x);
+		PVS_HASH(line->v2->y);
+		PVS_HASH(line->frontsector ? line->frontsector - sectors : -1);
+		PVS_HASH(line->backsector ? line->backsector - sectors : -1);
+	}
+
+	#undef PVS_HASH
+
+	return hash;
+}
+
+static std::string R_PVSCacheFileName(uint64_t hash)
+{
+	char name[64];
+	sprintf(name, "pvs-%08x%08x.dat", (unsigned int)(hash >> 32), (unsigned int)hash);
+	return I_GetUserFileName(name);
+}
+
+static bool R_LoadPVSCache(PVSBuilder *builder)
+{
+	FILE *fp = fopen(R_PVSCacheFileName(builder->hash).c_str(), "rb");
+	if (!fp)
+		return false;
+
+	char magic[4];
+	uint32_t version, count;
+	uint64_t hash;
+
+	bool ok = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, PVS_MAGIC, 4) == 0 &&
+			  fread(&version, sizeof(version), 1, fp) == 1 && version == PVS_VERSION &&
+			  fread(&count, sizeof(count), 1, fp) == 1 && count == (uint32_t)builder->numsectors &&
+			  fread(&hash, sizeof(hash), 1, fp) == 1 && hash == builder->hash &&
+			  fread(&builder->rows[0], builder->rows.size(), 1, fp) == 1;
+
+	fclose(fp);
+	return ok;
+}
+
+static void R_SavePVSCache(const PVSBuilder *builder)
+{
+	std::string filename = R_PVSCacheFileName(builder->hash);
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if (!fp)
+		return;
+
+	uint32_t version = PVS_VERSION, count = builder->numsectors;
+
+	bool ok = fwrite(PVS_MAGIC, sizeof(PVS_MAGIC), 1, fp) == 1 &&
+			  fwrite(&version, sizeof(version), 1, fp) == 1 &&
+			  fwrite(&count, sizeof(count), 1, fp) == 1 &&
+			  fwrite(&builder->hash, sizeof(builder->hash), 1, fp) == 1 &&
+			  fwrite(&builder->rows[0], builder->rows.size(), 1, fp) == 1;
+
+	if (fclose(fp) != 0 || !ok)
+	{
+		DPrintf("R_SavePVSCache: unable to write %s\n", filename.c_str());
+		remove(filename.c_str());
+	}
+}
+
+//
+// R_ClearPVS
+//
+void R_ClearPVS()
+{
+	delete pvs;
+	pvs = NULL;
+	pvsready = false;
+
+	pvsnodes = pvssubsectors = NULL;
+	markedsector = -1;
+}
+
+//
+// R_BuildPVS
+//
+void R_BuildPVS()
+{
+	R_ClearPVS();
+
+	if (!r_pvs || numsectors <= 0 || numnodes <= 0)
+		return;
+
+	// polyobjects are walls that move
+	if (po_NumPolyobjs > 0 || numsectors > PVS_MAX_SECTORS)
+		return;
+
+	nodeparent.assign(numnodes, -1);
+	subsectorparent.assign(numsubsectors, -1);
+	for (int i = 0; i < numnodes; i++)
+	{
+		for (int side = 0; side < 2; side++)
+		{
+			unsigned int child = nodes[i].children[side];
+			if (child & NF_SUBSECTOR)
+				subsectorparent[child & ~NF_SUBSECTOR] = i;
+			else
+				nodeparent[child] = i;
+		}
+	}
+
+	nodemarks.assign(numnodes, 0);
+	subsectormarks.assign(numsubsectors, 0);
+
+	pvs = new PVSBuilder;
+	pvs->numsectors = numsectors;
+	pvs->rowbytes = (numsectors + 7) / 8;
+	pvs->rows.assign(pvs->rowbytes * numsectors, 0);
+	pvs->hash = R_PVSHash();
+
+	if (R_LoadPVSCache(pvs))
+	{
+		pvs->fromcache = true;
+		pvs->buildtime = 0;
+		pvs->donesectors = numsectors;
+		pvsready = true;
+		return;
+	}
+
+	pvs->cells.resize(numsectors);
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t *line = &lines[i];
+		if (!line->frontsector || !line->backsector || line->frontsector == line->backsector)
+			continue;
+
+		pvsportal_t portal;
+		portal.seg.x1 = FIXED2DOUBLE(line->v1->x);
+		portal.seg.y1 = FIXED2DOUBLE(line->v1->y);
+		portal.seg.x2 = FIXED2DOUBLE(line->v2->x);
+		portal.seg.y2 = FIXED2DOUBLE(line->v2->y);
+		portal.line = i;
+
+		portal.to = line->backsector - sectors;
+		pvs->cells[line->frontsector - sectors].push_back(portal);
+		portal.to = line->frontsector - sectors;
+		pvs->cells[line->backsector - sectors].push_back(portal);
+	}
+
+	pvs->start();
+}
+
+//
+// R_PVSSetupFrame
+//
+void R_PVSSetupFrame()
+{
+	pvsnodes = pvssubsectors = NULL;
+
+	if (!pvs || !r_pvs)
+		return;
+
+	if (!pvsready)
+	{
+		if (!pvs->finished())
+			return;
+
+		pvs->join();
+		pvs->buildtime = I_GetTime() - pvs->started;
+		pvs->cells.clear();
+		pvsready = true;
+
+		R_SavePVSCache(pvs);
+		DPrintf("PVS built in %u ms\n", (unsigned int)I_ConvertTimeToMs(pvs->buildtime));
+	}
+
+	// nothing is out of sight when walking through walls
+	if (camera && camera->player && (camera->player->cheats & CF_NOCLIP))
+		return;
+
+	int viewsector = R_PointInSubsector(viewx, viewy)->sector - sectors;
+
+	if (viewsector != markedsector)
+	{
+		std::fill(nodemarks.begin(), nodemarks.end(), 0);
+		std::fill(subsectormarks.begin(), subsectormarks.end(), 0);
+		visiblenodes = visiblesubsectors = 0;
+
+		for (int i = 0; i < numsubsectors; i++)
+		{
+			if (!pvs->visible(viewsector, subsectors[i].sector - sectors))
+				continue;
+
+			subsectormarks[i] = 1;
+			visiblesubsectors++;
+
+			for (int node = subsectorparent[i]; node != -1 && !nodemarks[node]; node = nodeparent[node])
+			{
+				nodemarks[node] = 1;
+				visiblenodes++;
+			}
+		}
+
+		markedsector = viewsector;
+	}
+
+	pvsnodes = &nodemarks[0];
+	pvssubsectors = &subsectormarks[0];
+}
+
+CVAR_FUNC_IMPL (r_pvs)
+{
+	if (gamestate == GS_LEVEL)
+		R_BuildPVS();
+	else
+		R_ClearPVS();
+}
+
+BEGIN_COMMAND (pvsinfo)
+{
+	if (!pvs)
+	{
+		Printf(PRINT_HIGH, "No PVS for this level\n");
+		return;
+	}
+
+	if (!pvsready)
+	{
+		Printf(PRINT_HIGH, "PVS: building, %d of %d sectors done\n",
+			I_AtomicLoad(&pvs->donesectors), pvs->numsectors);
+		return;
+	}
+
+	size_t pairs = 0;
+	for (size_t i = 0; i < pvs->rows.size(); i++)
+		for (byte bits = pvs->rows[i]; bits; bits &= bits - 1)
+			pairs++;
+
+	if (pvs->fromcache)
+		Printf(PRINT_HIGH, "PVS: %d sectors, loaded from cache\n", pvs->numsectors);
+	else
+		Printf(PRINT_HIGH, "PVS: %d sectors, built in %u ms, %d fell back to connectivity\n",
+			pvs->numsectors, (unsigned int)I_ConvertTimeToMs(pvs->buildtime), pvs->overflows);
+
+	Printf(PRINT_HIGH, "  %.1f%% of sector pairs potentially visible\n",
+		100.0 * pairs / ((double)pvs->numsectors * pvs->numsectors));
+
+	if (markedsector >= 0)
+		Printf(PRINT_HIGH, "  from sector %d: %d of %d nodes, %d of %d subsectors\n",
+			markedsector, visiblenodes, numnodes, visiblesubsectors, numsubsectors);
+}
+END_COMMAND (pvsinfo)
+
+VERSION_CONTROL (r_pvs_cpp, "$Id$")
@@ -123,6 +123,9 @@ CVAR_FUNC_IMPL (snd_channels)
 // whether songs are mus_paused
 static BOOL		mus_paused;
 
+// whether new sounds are dropped
+static bool		sfx_muted = false;
+
 // music currently being played
 static struct mus_playing_t
 {
@@ -562,7 +565,7 @@ static void S_StartSound(fixed_t* pt, fixed_t x, fixed_t y, int channel,
 {
 	int		sep;
 
-	if (volume <= 0.0f)
+	if (volume <= 0.0f || sfx_muted)
 		return;
 
 	if (!consoleplayer().mo && channel != CHAN_INTERFACE)
@@ -926,6 +929,19 @@ void S_ResumeSound (void)
 	}
 }
 
+//
+// S_MuteSounds
+//
+// Sounds started while muted are dropped rather than queued.
+//
+void S_MuteSounds (bool mute)
+{
+	if (mute && !sfx_muted)
+		S_StopAllChannels();
+
+	sfx_muted = mute;
+}
+
 //
 // Updates music & sounds
 //
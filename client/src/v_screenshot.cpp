@@ -26,13 +26,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <deque>
 
 #include "doomtype.h"
+#include "doomstat.h"
 #include "i_video.h"
+#include "i_system.h"
+#include "i_thread.h"
 
 #include "c_dispatch.h"
 #include "m_misc.h"
 #include "g_game.h"
+#include "cl_demo.h"
+#include "v_screenshot.h"
 
 #ifdef USE_PNG
 	#define PNG_SKIP_SETJMP_CHECK
@@ -76,10 +83,71 @@
 #endif	// USE_PNG
 
 bool M_FindFreeName(std::string &filename, const std::string &extension);
+void STACK_ARGS call_terms(void);
+
+extern NetDemo netdemo;
+extern bool timingdemo;
 
 EXTERN_CVAR(gammalevel)
 EXTERN_CVAR(vid_gammatype)
 
+#ifdef USE_PNG
+static const char* screenshot_extension = "png";
+#else
+static const char* screenshot_extension = "bmp";
+#endif	// USE_PNG
+
+//
+// A copy of the screen waiting to be written by an encoder thread.  Everything
+// the encoder needs is copied here by the game thread, so encoding touches no
+// game state.
+//
+struct screenshot_t
+{
+	std::string			filename;
+	int					width;
+	int					height;
+	int					bpp;
+	std::vector<byte>	pixels;			// rows are width * bpp / 8 bytes
+	argb_t				palette[256];
+
+	time_t				now;
+	std::string			gamemode;
+	float				gamma;
+	int					gammatype;
+
+	bool				report;			// print a message once it is written
+	int					result;
+	std::string			error;
+};
+
+// Encoders compress and write the captures in the background so the game
+// does not stall for the time libpng takes
+static const unsigned int MAX_ENCODER_THREADS = 4;
+static OThread encoder_threads[MAX_ENCODER_THREADS];
+static unsigned int num_encoder_threads = 0;
+static volatile int encoders_quit = 0;
+
+static OMutex screenshot_mutex;
+static OEvent encode_event;			// a capture was queued
+static OEvent finished_event;		// a capture was written
+
+// all guarded by screenshot_mutex
+static std::deque<screenshot_t*> encode_queue;
+static std::deque<screenshot_t*> finished_queue;
+static std::vector<screenshot_t*> free_screenshots;
+static unsigned int screenshots_allocated = 0;
+
+// frame export state
+static bool exporting = false;
+static bool export_quit = false;
+static bool export_timingdemo = false;
+static std::string export_prefix;
+static int export_frames = 0;
+static int export_errors = 0;
+static int export_lastgametic = -1;
+static dtime_t export_starttime = 0;
+
 CVAR_FUNC_IMPL(cl_screenshotname)
 {
 	// No empty format strings allowed.
@@ -109,10 +177,7 @@ END_COMMAND(screenshot)
 static void V_SetPNGPalette(png_struct* png_ptr, png_info* info_ptr, const argb_t* palette_colors)
 {
 	if (png_get_color_type(png_ptr, info_ptr) != 3)
-	{
-		Printf(PRINT_HIGH, "I_SetPNGPalette: Cannot create PNG PLTE chunk in 32-bit mode\n");
 		return;
-	}
 
 	png_color pngpalette[256];
 
@@ -132,7 +197,7 @@ static void V_SetPNGPalette(png_struct* png_ptr, png_info* info_ptr, const argb_
 //
 // Write comment lines to PNG file's tEXt chunk
 //
-static void V_SetPNGComments(png_struct *png_ptr, png_info *info_ptr, time_t* now)
+static void V_SetPNGComments(png_struct *png_ptr, png_info *info_ptr, const screenshot_t* shot)
 {
 	#ifdef PNG_TEXT_SUPPORTED
 	const int PNG_TEXT_LINES = 6;
@@ -149,23 +214,28 @@ static void V_SetPNGComments(png_struct *png_ptr, png_info *info_ptr, time_t* no
 	
 	char datebuf[80];
 	const char *dateformat = "%A, %B %d, %Y, %I:%M:%S %p GMT";
-	strftime(datebuf, sizeof(datebuf) / sizeof(char), dateformat, gmtime(now));
+	struct tm gmt;
+	#ifdef _WIN32
+	gmt = *gmtime(&shot->now);
+	#else
+	gmtime_r(&shot->now, &gmt);
+	#endif
+	strftime(datebuf, sizeof(datebuf) / sizeof(char), dateformat, &gmt);
 	
 	pngtext[text_line].key = (png_charp)"Created Time";
 	pngtext[text_line].text = (png_charp)datebuf;
 	text_line++;
 	
 	pngtext[text_line].key = (png_charp)"Game Mode";
-	pngtext[text_line].text = (png_charp)(M_ExpandTokens("%g").c_str());
+	pngtext[text_line].text = (png_charp)shot->gamemode.c_str();
 	text_line++;
 	
 	pngtext[text_line].key = (png_charp)"In-Game Video Mode";
-	pngtext[text_line].text = (I_GetPrimarySurface()->getBitsPerPixel() == 8)
-				? (png_charp)"8bpp" : (png_charp)"32bpp";
+	pngtext[text_line].text = (shot->bpp == 8) ? (png_charp)"8bpp" : (png_charp)"32bpp";
 	text_line++;
 	
 	char gammabuf[20];	// large enough to not overflow with three digits of precision
-	sprintf(gammabuf, "%#.3f", gammalevel.value());
+	sprintf(gammabuf, "%#.3f", shot->gamma);
 	
 	pngtext[text_line].key = (png_charp)"In-game Gamma Correction Level";
 	pngtext[text_line].text = (png_charp)gammabuf;
@@ -173,32 +243,32 @@ static void V_SetPNGComments(png_struct *png_ptr, png_info *info_ptr, time_t* no
 	
 	pngtext[text_line].key = (png_charp)"In-Game Gamma Correction Type";
 	pngtext[text_line].text =
-		(vid_gammatype == 0) ? (png_charp)"Classic Doom" : (png_charp)"ZDoom";
+		(shot->gammatype == 0) ? (png_charp)"Classic Doom" : (png_charp)"ZDoom";
 	text_line++;
 	
 	png_set_text(png_ptr, info_ptr, pngtext, PNG_TEXT_LINES);
-	#else
-	Printf(PRINT_HIGH, "I_SetPNGComments: Skipping PNG tEXt chunk\n");
 	#endif // PNG_TEXT_SUPPORTED
 }
 
 
+
+
 //
 // V_SavePNG
 //
-// Converts the surface to PNG format and saves it to filename.
-// Supporting function for I_ScreenShot to output PNG files.
+// Converts the captured screen to PNG format and saves it to its filename.
+// Supporting function for V_EncoderThread to output PNG files.
 //
-static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
+static int V_SavePNG(screenshot_t* shot)
 {
-	FILE* fp = fopen(filename.c_str(), "wb");
+	FILE* fp = fopen(shot->filename.c_str(), "wb");
 	png_struct *png_ptr;
 	png_info *info_ptr;
-	time_t now = time(NULL); // used for PNG text comments
+	std::vector<png_byte> row;	// declared before setjmp so it is freed on errors
 
 	if (fp == NULL)
 	{
-		Printf(PRINT_HIGH, "I_SavePNG: Could not open %s for writing\n", filename.c_str());
+		shot->error = "I_SavePNG: Could not open " + shot->filename + " for writing";
 		return -1;
 	}
 
@@ -207,7 +277,7 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 	if (png_ptr == NULL)
 	{
 		fclose(fp);
-		Printf(PRINT_HIGH, "I_SavePNG: png_create_write_struct failed\n");
+		shot->error = "I_SavePNG: png_create_write_struct failed";
 		return -1;
 	}
 
@@ -217,7 +287,7 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 	{
 		fclose(fp);
 		png_destroy_write_struct(&png_ptr, (png_infop*)NULL);
-		Printf(PRINT_HIGH, "I_SavePNG: png_create_info_struct failed\n");
+		shot->error = "I_SavePNG: png_create_info_struct failed";
 		return -1;
 	}
 	
@@ -225,23 +295,21 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 	// PNG_ABORT() is invoked instead if PNG_SETJMP_SUPPORTED was not defined
 	// see include/pnglibconf.h for libpng feature support macros
 	#ifdef PNG_SETJMP_SUPPORTED
-	int setjmp_result = setjmp(png_jmpbuf(png_ptr));
-	if (setjmp_result != 0)
+	if (setjmp(png_jmpbuf(png_ptr)) != 0)
 	{
 		fclose(fp);
 		png_destroy_write_struct(&png_ptr, &info_ptr);
-		Printf(PRINT_HIGH, "I_SavePNG: setjmp failed with error code %d\n", setjmp_result);
+		shot->error = "I_SavePNG: libpng failed to write " + shot->filename;
 		return -1;
 	}
 	#endif // PNG_SETJMP_SUPPORTED
 
-	surface->lock();
-	png_uint_32 width = surface->getWidth();
-	png_uint_32 height = surface->getHeight();
+	png_uint_32 width = shot->width;
+	png_uint_32 height = shot->height;
 
 	// is the screen paletted or 32-bit RGBA?
 	// note: we don't want to the preserve A channel in the screenshot if screen is RGBA
-	int png_colortype = surface->getBitsPerPixel() == 8 ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB;
+	int png_colortype = shot->bpp == 8 ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB;
 	// write image dimensions to png file's IHDR chunk
 	png_set_IHDR
 		(png_ptr, info_ptr,
@@ -252,66 +320,38 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 		PNG_COMPRESSION_TYPE_DEFAULT,
 		PNG_FILTER_TYPE_DEFAULT);
 
-	// determine bpp mode, allocate memory space for PNG pixel data
-	int png_bpp = (surface->getBitsPerPixel() == 8) ? 1 : 3;
-	png_byte** row_ptrs = (png_byte**)png_malloc(png_ptr, (png_alloc_size_t)(height * sizeof(png_byte*)));
-	png_byte* row;
-	
-	for (unsigned int rownum = 0; rownum < height; rownum++)
-	{
-		row = (png_byte*)png_malloc(png_ptr, (png_alloc_size_t)(sizeof(uint8_t) * width * png_bpp));
-		
-		if (row != NULL)
-		{
-			row_ptrs[rownum] = row;
-		}
-		else
-		{
-			for (unsigned int i = 0; i < rownum; i++)
-				png_free(png_ptr, row_ptrs[i]);
-
-			png_free(png_ptr, row_ptrs);
-			png_destroy_write_struct(&png_ptr, &info_ptr);
-			fclose(fp);
-			
-			Printf(PRINT_HIGH, "I_SavePNG: Not enough RAM to create PNG file\n");
-			return -1;
-		}
-	}
-	
-	// write PNG in either paletted or RGB form, according to the current screen mode
-	if (surface->getBitsPerPixel() == 8)
-	{
-		V_SetPNGPalette(png_ptr, info_ptr, surface->getPalette());
-		
-		const palindex_t* source = (palindex_t*)surface->getBuffer();
-		const int pitch_remainder = surface->getPitchInPixels() - width;
+	png_init_io(png_ptr, fp);
+	V_SetPNGComments(png_ptr, info_ptr, shot);
 
-		for (unsigned int y = 0; y < height; y++)
-		{
-			row = row_ptrs[y];
+	// set PNG timestamp
+	#ifdef PNG_tIME_SUPPORTED
+	png_time pngtime;
+	png_convert_from_time_t(&pngtime, shot->now);
+	png_set_tIME(png_ptr, info_ptr, &pngtime);
+	#endif // PNG_tIME_SUPPORTED
 
-			for (unsigned int x = 0; x < width; x++)
-			{
-				// gather color index from current pixel of SDL surface,
-				// copy it to current pixel of PNG row
-				// note: this assumes that the PNG and SDL surface palettes match
-				palindex_t pixel = *source++;
-				*row++ = (png_byte)pixel;
-			}
+	// write PNG in either paletted or RGB form, according to the captured screen mode
+	if (shot->bpp == 8)
+	{
+		// the captured rows are already in the PNG's format
+		// note: this assumes that the PNG and SDL surface palettes match
+		V_SetPNGPalette(png_ptr, info_ptr, shot->palette);
+		png_write_info(png_ptr, info_ptr);
 
-			source += pitch_remainder;
-		}
+		for (unsigned int y = 0; y < height; y++)
+			png_write_row(png_ptr, (png_byte*)&shot->pixels[y * width]);
 	}
 	else
 	{
-		const argb_t* source = (argb_t*)surface->getBuffer();
-		const int pitch_remainder = surface->getPitchInPixels() - width;
+		png_write_info(png_ptr, info_ptr);
+
+		row.resize(width * 3);
 
 		for (unsigned int y = 0; y < height; y++)
 		{
-			row = row_ptrs[y];
-			
+			const argb_t* source = (const argb_t*)&shot->pixels[y * width * sizeof(argb_t)];
+			png_byte* dest = &row[0];
+
 			for (unsigned int x = 0; x < width; x++)
 			{
 				// gather color components from current pixel of SDL surface
@@ -320,37 +360,16 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 
 				// write color components to current pixel of PNG row
 				// note: PNG is a big-endian file format
-				*row++ = (png_byte)pixel.getr();
-				*row++ = (png_byte)pixel.getg();
-				*row++ = (png_byte)pixel.getb();
+				*dest++ = (png_byte)pixel.getr();
+				*dest++ = (png_byte)pixel.getg();
+				*dest++ = (png_byte)pixel.getb();
 			}
 
-			source += pitch_remainder;
+			png_write_row(png_ptr, &row[0]);
 		}
 	}
-	
-	// commit PNG image data to file
-	surface->unlock();
-	png_init_io(png_ptr, fp);
-	V_SetPNGComments(png_ptr, info_ptr, &now);
-	
-	// set PNG timestamp
-	#ifdef PNG_tIME_SUPPORTED
-	png_time pngtime;
-	png_convert_from_time_t(&pngtime, now);
-	png_set_tIME(png_ptr, info_ptr, &pngtime);
-	#else
-	Printf(PRINT_HIGH, "I_SavePNG: Skipping PNG tIME chunk\n");
-	#endif // PNG_tIME_SUPPORTED
-	
-	png_set_rows(png_ptr, info_ptr, row_ptrs);
-	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
-	
-	// free allocated PNG image data
-	for (unsigned int y = 0; y < height; y++)
-		png_free(png_ptr, row_ptrs[y]);
 
-	png_free(png_ptr, row_ptrs);
+	png_write_end(png_ptr, info_ptr);
 	png_destroy_write_struct(&png_ptr, &info_ptr);
 	
 	fclose(fp);
@@ -364,30 +383,25 @@ static int V_SavePNG(const std::string& filename, IWindowSurface* surface)
 //
 // V_SaveBMP
 //
-// Converts the surface to BMP format and saves it to filename.
+// Converts the captured screen to BMP format and saves it to its filename.
 // Note: this uses SDL 1.2 for writing to BMP format and may be deprecated
 // in the future.
 //
-static int V_SaveBMP(const std::string& filename, IWindowSurface* surface)
+static int V_SaveBMP(screenshot_t* shot)
 {
-	surface->lock();
-	
-	SDL_Surface* sdlsurface = SDL_CreateRGBSurfaceFrom(surface->getBuffer(),
-								surface->getWidth(), surface->getHeight(),
-								surface->getBitsPerPixel(), surface->getPitch(),
-								0, 0, 0, 0);
-
-	surface->unlock();
+	SDL_Surface* sdlsurface = SDL_CreateRGBSurfaceFrom(&shot->pixels[0],
+								shot->width, shot->height, shot->bpp,
+								shot->width * shot->bpp / 8, 0, 0, 0, 0);
 
 	if (sdlsurface == NULL)
 	{
-		Printf(PRINT_HIGH, "CreateRGBSurfaceFrom failed: %s\n", SDL_GetError());
+		shot->error = std::string("CreateRGBSurfaceFrom failed: ") + SDL_GetError();
 		return -1;
 	}
 
-	if (surface->getBitsPerPixel() == 8)
+	if (shot->bpp == 8)
 	{
-		const argb_t* palette = surface->getPalette();
+		const argb_t* palette = shot->palette;
 		SDL_Color colors[256];
 
 		for (int i = 0; i < 256; i ++, palette++)
@@ -401,31 +415,248 @@ static int V_SaveBMP(const std::string& filename, IWindowSurface* surface)
 		SDL_SetColors(sdlsurface, colors, 0, 256);
 	}
 
-	int result = SDL_SaveBMP(sdlsurface, filename.c_str());
+	int result = SDL_SaveBMP(sdlsurface, shot->filename.c_str());
 
 	if (result != 0)
-		Printf(PRINT_HIGH, "SDL_SaveBMP failed: %s\n", SDL_GetError());
+		shot->error = std::string("SDL_SaveBMP failed: ") + SDL_GetError();
+
+	SDL_FreeSurface(sdlsurface);
 
 	return result;
 }
 #endif	// !USE_PNG
 
 
+//
+// V_EncoderThread
+//
+// Writes queued captures until told to quit.  Nothing in here may touch
+// game state or print to the console.
+//
+static void V_EncoderThread(void* data)
+{
+	while (!I_AtomicLoad(&encoders_quit))
+	{
+		screenshot_t* shot = NULL;
+
+		{
+			OMutexLock lock(screenshot_mutex);
+			if (!encode_queue.empty())
+			{
+				shot = encode_queue.front();
+				encode_queue.pop_front();
+			}
+		}
+
+		if (shot == NULL)
+		{
+			encode_event.wait(100);
+			continue;
+		}
+
+		shot->error.clear();
+		#ifdef USE_PNG
+		shot->result = V_SavePNG(shot);
+		#else
+		shot->result = V_SaveBMP(shot);
+		#endif	// USE_PNG
+
+		{
+			OMutexLock lock(screenshot_mutex);
+			finished_queue.push_back(shot);
+		}
+
+		finished_event.signal();
+	}
+}
+
+
+//
+// V_UpdateScreenShots
+//
+// Reports the captures that have been written and returns their buffers
+// to the pool.  Returns the number still waiting to be written.
+//
+unsigned int V_UpdateScreenShots()
+{
+	std::deque<screenshot_t*> finished;
+	unsigned int pending;
+
+	{
+		OMutexLock lock(screenshot_mutex);
+		finished.swap(finished_queue);
+		pending = screenshots_allocated - free_screenshots.size() - finished.size();
+	}
+
+	for (size_t i = 0; i < finished.size(); i++)
+	{
+		screenshot_t* shot = finished[i];
+
+		if (shot->result != 0)
+		{
+			if (shot->report || export_errors++ == 0)
+				Printf(PRINT_HIGH, "%s\n", shot->error.c_str());
+		}
+		else if (shot->report)
+		{
+			Printf(PRINT_HIGH, "Screenshot taken: %s\n", shot->filename.c_str());
+		}
+	}
+
+	OMutexLock lock(screenshot_mutex);
+	free_screenshots.insert(free_screenshots.end(), finished.begin(), finished.end());
+
+	return pending;
+}
+
+
+//
+// V_WaitForScreenShots
+//
+// Blocks until every capture has been written.
+//
+static void V_WaitForScreenShots()
+{
+	while (V_UpdateScreenShots() > 0)
+		finished_event.wait(100);
+}
+
+
+//
+// V_ShutdownScreenShots
+//
+// Finishes writing the queued captures and stops the encoder threads.
+//
+static void STACK_ARGS V_ShutdownScreenShots()
+{
+	V_WaitForScreenShots();
+
+	I_AtomicStore(&encoders_quit, 1);
+	for (unsigned int i = 0; i < num_encoder_threads; i++)
+		encode_event.signal();
+	for (unsigned int i = 0; i < num_encoder_threads; i++)
+		encoder_threads[i].join();
+	num_encoder_threads = 0;
+
+	for (size_t i = 0; i < free_screenshots.size(); i++)
+		delete free_screenshots[i];
+	free_screenshots.clear();
+	screenshots_allocated = 0;
+}
+
+
+//
+// V_GetScreenShotBuffer
+//
+// Takes a capture buffer from the pool, starting the encoders on first use.
+// When every buffer is waiting to be written, waits for one to be freed so
+// a long frame export cannot run out of memory.
+//
+static screenshot_t* V_GetScreenShotBuffer()
+{
+	if (num_encoder_threads == 0)
+	{
+		unsigned int count = I_GetCPUCount() > 1 ? I_GetCPUCount() - 1 : 1;
+		if (count > MAX_ENCODER_THREADS)
+			count = MAX_ENCODER_THREADS;
+
+		I_AtomicStore(&encoders_quit, 0);
+		for (unsigned int i = 0; i < count; i++)
+			if (encoder_threads[i].start(V_EncoderThread, NULL))
+				num_encoder_threads++;
+
+		if (num_encoder_threads == 0)
+			return NULL;
+
+		atterm(V_ShutdownScreenShots);
+	}
+
+	while (true)
+	{
+		{
+			OMutexLock lock(screenshot_mutex);
+
+			if (!free_screenshots.empty())
+			{
+				screenshot_t* shot = free_screenshots.back();
+				free_screenshots.pop_back();
+				return shot;
+			}
+
+			if (screenshots_allocated < num_encoder_threads * 2)
+			{
+				screenshots_allocated++;
+				return new screenshot_t;
+			}
+		}
+
+		finished_event.wait(100);
+		V_UpdateScreenShots();
+	}
+}
+
+
+//
+// V_CaptureScreen
+//
+// Copies the primary surface into a capture buffer and queues it to be
+// written to filename.
+//
+static bool V_CaptureScreen(const std::string& filename, bool report)
+{
+	screenshot_t* shot = V_GetScreenShotBuffer();
+	if (shot == NULL)
+	{
+		Printf(PRINT_HIGH, "V_CaptureScreen: Unable to start the encoder threads\n");
+		return false;
+	}
+
+	IWindowSurface* surface = I_GetPrimarySurface();
+
+	surface->lock();
+
+	shot->filename = filename;
+	shot->width = surface->getWidth();
+	shot->height = surface->getHeight();
+	shot->bpp = surface->getBitsPerPixel();
+
+	const int rowbytes = shot->width * shot->bpp / 8;
+	shot->pixels.resize(rowbytes * shot->height);
+
+	const byte* source = (const byte*)surface->getBuffer();
+	for (int y = 0; y < shot->height; y++)
+		memcpy(&shot->pixels[y * rowbytes], source + y * surface->getPitch(), rowbytes);
+
+	if (shot->bpp == 8)
+		memcpy(shot->palette, surface->getPalette(), sizeof(shot->palette));
+
+	surface->unlock();
+
+	shot->now = time(NULL);
+	shot->gamemode = M_ExpandTokens("%g");
+	shot->gamma = gammalevel.value();
+	shot->gammatype = vid_gammatype.asInt();
+	shot->report = report;
+
+	{
+		OMutexLock lock(screenshot_mutex);
+		encode_queue.push_back(shot);
+	}
+
+	encode_event.signal();
+	return true;
+}
+
+
 //
 // V_ScreenShot
 //
 // Dumps the contents of the screen framebuffer to a file. The default output
 // format is PNG (if libpng is found at compile-time) with BMP as the fallback.
+// The screen is copied right away and written by an encoder thread.
 //
 void V_ScreenShot(std::string filename)
 {
-	// is PNG supported?
-	#ifdef USE_PNG
-	const std::string extension("png");
-	#else
-	const std::string extension("bmp");
-	#endif	// USE_PNG
-
 	// If no filename was passed, use the screenshot format variable.
 	if (filename.empty())
 		filename = cl_screenshotname.cstring();
@@ -434,35 +665,135 @@ void V_ScreenShot(std::string filename)
 	filename = M_ExpandTokens(filename).c_str();
 
 	// If the file already exists, append numbers.
-	if (!M_FindFreeName(filename, extension))
+	if (!M_FindFreeName(filename, screenshot_extension))
 	{
 		Printf(PRINT_HIGH, "I_ScreenShot: Delete some screenshots\n");
 		return;
 	}
 
-	// Create an SDL_Surface object from our screen buffer
-	IWindowSurface* primary_surface = I_GetPrimarySurface();
+	// Create the file now so the name is not picked again before the
+	// encoder gets to it
+	FILE* fp = fopen(filename.c_str(), "wb");
+	if (fp == NULL)
+	{
+		Printf(PRINT_HIGH, "I_ScreenShot: Could not open %s for writing\n", filename.c_str());
+		return;
+	}
+	fclose(fp);
+
+	V_CaptureScreen(filename, true);
+}
+
 
-	#ifdef USE_PNG
-	int result = V_SavePNG(filename, primary_surface); 
-	if (result != 0)
+//
+// V_StartFrameExport
+//
+// Saves the screen once every gametic to prefix000000.png and so on until
+// V_StopFrameExport.  The game runs as fast as the frames can be written.
+// With quit set the program exits once the netdemo being played ends.
+//
+void V_StartFrameExport(const std::string& prefix, bool quit)
+{
+	if (exporting)
+		V_StopFrameExport();
+
+	exporting = true;
+	export_quit = quit;
+	export_prefix = prefix;
+	export_frames = 0;
+	export_errors = 0;
+	export_lastgametic = -1;
+	export_starttime = I_GetTime();
+
+	// one simulation tic per displayed frame, as fast as possible
+	export_timingdemo = timingdemo;
+	timingdemo = true;
+
+	Printf(PRINT_HIGH, "Exporting frames to %s*.%s\n", prefix.c_str(), screenshot_extension);
+}
+
+
+//
+// V_StopFrameExport
+//
+// Waits for the exported frames to be written and reports the throughput.
+//
+void V_StopFrameExport()
+{
+	if (!exporting)
+		return;
+
+	exporting = false;
+	timingdemo = export_timingdemo;
+
+	V_WaitForScreenShots();
+
+	double seconds = (double)I_ConvertTimeToMs(I_GetTime() - export_starttime) / 1000.0;
+	double fps = seconds > 0.0 ? export_frames / seconds : 0.0;
+
+	Printf(PRINT_HIGH, "Exported %d frames (%d failed) in %.1f seconds, %.1f fps\n",
+			export_frames, export_errors, seconds, fps);
+
+	if (export_quit)
 	{
-		Printf(PRINT_HIGH, "I_SavePNG Error: Returned error code %d\n", result);
+		call_terms();
+		exit(export_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+}
+
+
+bool V_IsExportingFrames()
+{
+	return exporting;
+}
+
+
+//
+// V_ExportFrame
+//
+// Called by D_Display once the frame is complete.
+//
+void V_ExportFrame()
+{
+	if (!exporting || gametic == export_lastgametic)
+		return;
+
+	export_lastgametic = gametic;
+
+	char number[16];
+	sprintf(number, "%06d.", export_frames);
+
+	if (V_CaptureScreen(export_prefix + number + screenshot_extension, false))
+		export_frames++;
+}
+
+
+BEGIN_COMMAND(exportframes)
+{
+	if (argc < 2)
+	{
+		Printf(PRINT_HIGH, "Usage: exportframes <prefix>\n");
+		Printf(PRINT_HIGH, "Saves every frame of the netdemo being played as an image.\n");
 		return;
 	}
-	#else
-	int result = V_SaveBMP(filename, primary_surface); 
-	if (result != 0)
+
+	if (!netdemo.isPlaying())
 	{
-		Printf(PRINT_HIGH, "I_SaveBMP Error: Returned error code %d\n", result);
+		Printf(PRINT_HIGH, "exportframes: No netdemo is being played\n");
 		return;
 	}
-	#endif	// USE_PNG
 
-	Printf(PRINT_HIGH, "Screenshot taken: %s\n", filename.c_str());
+	V_StartFrameExport(argv[1], false);
 }
+END_COMMAND(exportframes)
 
 
-VERSION_CONTROL (v_screenshot_cpp, "$Id$")
+BEGIN_COMMAND(stopexport)
+{
+	V_StopFrameExport();
+}
+END_COMMAND(stopexport)
+
 
+VERSION_CONTROL (v_screenshot_cpp, "$Id$")
 
@@ -20,6 +20,10 @@
 //
 // Screenshots
 //
+//	The screen is copied on the game thread and compressed and written by
+//	encoder threads, so taking a screenshot does not stall the game.  The
+//	same pipeline exports every frame of a netdemo as an image sequence.
+//
 //-----------------------------------------------------------------------------
 
 
@@ -30,4 +34,14 @@
 
 void V_ScreenShot(std::string filename);
 
+// Reports written screenshots, returns how many are still being written
+unsigned int V_UpdateScreenShots();
+
+void V_StartFrameExport(const std::string& prefix, bool quit);
+void V_StopFrameExport();
+bool V_IsExportingFrames();
+
+// Captures the finished frame when exporting
+void V_ExportFrame();
+
 #endif // __V_SCREENSHOT_H__
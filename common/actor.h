@@ -274,7 +274,6 @@ class AActor : public DThinker
 {
 	DECLARE_SERIAL (AActor, DThinker)
 	typedef szp<AActor> AActorPtr;
-	AActorPtr self;
 
 	class AActorPtrCounted
 	{
@@ -339,115 +338,132 @@ public:
 
 	virtual void RunThink ();
 
-    // Info for drawing: position.
-    fixed_t		x;
-    fixed_t		y;
-    fixed_t		z;
+	//
+	// The members are ordered by how often they are touched.  The first
+	// block is read whenever another actor, the blockmap or the network
+	// code looks at this one, the second by the actor's own think and the
+	// rest only by spawning, scripting and the odd special case.  Keep new
+	// fields out of the first two blocks unless they are read every tic.
+	//
 
-	fixed_t		prevx;
-	fixed_t		prevy;
-	fixed_t		prevz;
+	// Position, momentum and size, used by every movement and collision
+	// check
+	fixed_t		x;
+	fixed_t		y;
+	fixed_t		z;
 
-	AActor			*snext, **sprev;	// links in sector (if needed)
+	fixed_t		momx;
+	fixed_t		momy;
+	fixed_t		momz;
 
-    //More drawing info: to determine current sprite.
-    angle_t		angle;	// orientation
-	angle_t		prevangle;
-    spritenum_t		sprite;	// used to find patch_t and flip value
-    int			frame;	// might be ORed with FF_FULLBRIGHT
-	fixed_t		pitch;
-	angle_t		prevpitch;
+	fixed_t		radius;
+	fixed_t		height;
 
-	DWORD			effects;			// [RH] see p_effect.h
+	// The closest interval over all contacted Sectors.
+	fixed_t		floorz;
+	fixed_t		ceilingz;
 
-    // Interaction info, by BLOCKMAP.
-    // Links in blocks (if needed).
-	struct subsector_s		*subsector;
+	int				flags;
+	int				flags2;	// Heretic flags
+	int				oflags;			// Odamex flags
+	int 			health;
+	mobjtype_t		type;
+	int             netid;          // every object has its own netid
 
-    // The closest interval over all contacted Sectors.
-    fixed_t		floorz;
-    fixed_t		ceilingz;
-	fixed_t		dropoffz;
-	struct sector_s		*floorsector;
+	angle_t		angle;	// orientation
 
-    // For movement checking.
-    fixed_t		radius;
-    fixed_t		height;
+	// If == validcount, already checked.
+	int			validcount;
 
-    // Momentums, used to update position.
-    fixed_t		momx;
-    fixed_t		momy;
-    fixed_t		momz;
+	struct subsector_s		*subsector;
 
-    // If == validcount, already checked.
-    int			validcount;
+	// Additional info record for player avatars only.
+	// Only valid if type == MT_PLAYER
+	player_s*	player;
 
-	mobjtype_t		type;
-    mobjinfo_t*		info;	// &mobjinfo[mobj->type]
-    int				tics;	// state tic counter
+	mobjinfo_t*		info;	// &mobjinfo[mobj->type]
 	state_t			*state;
-	int				damage;			// For missiles	
-	int				flags;
-	int				flags2;	// Heretic flags
-	int				oflags;			// Odamex flags
-	int				special1;		// Special info
-	int				special2;		// Special info
-	int 			health;
+	int				tics;	// state tic counter
 
-    // Movement direction, movement generation (zig-zagging).
-    byte			movedir;	// 0-7
-    int				movecount;	// when 0, select a new dir
-	char			visdir;
+	// Movement direction, movement generation (zig-zagging).
+	int				movecount;	// when 0, select a new dir
 
-    // Thing being chased/attacked (or NULL),
-    // also the originator for missiles.
+	// Thing being chased/attacked (or NULL),
+	// also the originator for missiles.
 	AActorPtr		target;
-	AActorPtr		lastenemy;		// Last known enemy -- killogh 2/15/98
 
-    // Reaction time: if non 0, don't attack yet.
-    // Used by player to freeze a bit after teleporting.
-    int				reactiontime;
+	// Everything else the actor's own think reads or writes
+	fixed_t			dropoffz;
+	struct sector_s		*floorsector;
 
-    // If >0, the target will be chased
-    // no matter what (even if shot)
-    int			threshold;
+	// Reaction time: if non 0, don't attack yet.
+	// Used by player to freeze a bit after teleporting.
+	int				reactiontime;
 
-    // Additional info record for player avatars only.
-    // Only valid if type == MT_PLAYER
-	player_s*	player;
+	// If >0, the target will be chased
+	// no matter what (even if shot)
+	int				threshold;
 
-    // Player number last looked for.
-    unsigned int	lastlook;
+	int				special1;		// Special info
+	int				special2;		// Special info
+	int				damage;			// For missiles
 
-    // For nightmare respawn.
-    mapthing2_t		spawnpoint;
+	// Player number last looked for.
+	unsigned int	lastlook;
 
-	// Thing being chased/attacked for tracers.
-	AActorPtr		tracer;
-	byte			special;		// special
-	byte			args[5];		// special arguments
+	// More drawing info: to determine current sprite.
+	spritenum_t		sprite;	// used to find patch_t and flip value
+	int				frame;	// might be ORed with FF_FULLBRIGHT
+	DWORD			effects;			// [RH] see p_effect.h
+	fixed_t			pitch;
+	fixed_t			translucency;	// 65536=fully opaque, 0=fully invisible
 
-	AActor			*inext, *iprev;	// Links to other mobjs in same bucket
+	byte			movedir;	// 0-7
+	char			visdir;
+	byte			waterlevel;		// 0=none, 1=feet, 2=waist, 3=eyes
+	bool			onground;		// NES - Fixes infinite jumping bug like a charm.
+	unsigned char	rndindex;		// denis - because everything should have a random number generator, for prediction
+	short           deadtic;        // tics after player's death
+
+	// Copies of the last tic's position for interpolation
+	fixed_t		prevx;
+	fixed_t		prevy;
+	fixed_t		prevz;
+	angle_t		prevangle;
+	angle_t		prevpitch;
+
+	AActor			*snext, **sprev;	// links in sector (if needed)
 
 	// denis - playerids of players to whom this object has been sent
 	// [SL] changed to use a bitfield instead of a vector for O(1) lookups
 	PlayerBitField	players_aware;
 
-	AActorPtr		goal;			// Monster's goal if not chasing anything
-	translationref_t translation;	// Translation table (or NULL)
-	fixed_t			translucency;	// 65536=fully opaque, 0=fully invisible
-	byte			waterlevel;		// 0=none, 1=feet, 2=waist, 3=eyes
-	SWORD			gear;			// killough 11/98: used in torque simulation
-
-	bool			onground;		// NES - Fixes infinite jumping bug like a charm.
+	// Rarely used from here on
+	AActorPtr		self;
 
 	// a linked list of sectors where this object appears
 	struct msecnode_s	*touching_sectorlist;				// phares 3/14/98
 
-	short           deadtic;        // tics after player's death
+	AActorPtr		lastenemy;		// Last known enemy -- killogh 2/15/98
+
+	// Thing being chased/attacked for tracers.
+	AActorPtr		tracer;
+
+	AActorPtr		goal;			// Monster's goal if not chasing anything
+
+	// For nightmare respawn.
+	mapthing2_t		spawnpoint;
+
+	byte			special;		// special
+	byte			args[5];		// special arguments
+
+	SWORD			gear;			// killough 11/98: used in torque simulation
+	short			tid;			// thing identifier
 	int             oldframe;
 
-	unsigned char	rndindex;		// denis - because everything should have a random number generator, for prediction
+	AActor			*inext, *iprev;	// Links to other mobjs in same bucket
+
+	translationref_t translation;	// Translation table (or NULL)
 
 	// ThingIDs
 	static void ClearTIDHashes ();
@@ -458,9 +474,6 @@ public:
 	AActor *FindGoal (int tid, int kind) const;
 	static AActor *FindGoal (const AActor *first, int tid, int kind);
 
-	int             netid;          // every object has its own netid
-	short			tid;			// thing identifier
-
 private:
 	static const size_t TIDHashSize = 256;
 	static const size_t TIDHashMask = TIDHashSize - 1;
@@ -485,20 +498,28 @@ public:
 	// be in the mapblock where its center was located, even if it was
 	// overlapping other blocks.
 	//
+	// The actor's entries now live in the blockthings arrays of those
+	// mapblocks and only their positions in the arrays are kept here.
+	//
 	class ActorBlockMapListNode
 	{
 	public:
 		ActorBlockMapListNode(AActor *mo);
 		void Link();
 		void Unlink();
-		AActor* Next(int bmx, int bmy);
+		void UpdateBounds();
+
+		// position of the actor in the blockthings array of a mapblock,
+		// or -1 if it is not linked there
+		int getSlot(int bmx, int bmy) const;
+		void setSlot(int bmx, int bmy, int slot);
 
 	private:
 		void clear();
-		size_t getIndex(int bmx, int bmy);
+		int getIndex(int bmx, int bmy) const;
 		
-		static const size_t BLOCKSX = 3;
-		static const size_t BLOCKSY = 3;
+		static const int BLOCKSX = 3;
+		static const int BLOCKSY = 3;
 
 		AActor		*actor;
 			
@@ -509,10 +530,9 @@ public:
 		int			blockcntx;
 		int			blockcnty;
 
-		// the next and previous actors in each of the possible blockmaps
-		// this actor can inhabit
-		AActor		*next[BLOCKSX * BLOCKSY];
-		AActor		**prev[BLOCKSX * BLOCKSY];
+		// the positions in each of the possible blockmaps this actor
+		// can inhabit
+		int			slots[BLOCKSX * BLOCKSY];
 	};
 	
 	ActorBlockMapListNode bmapnode;
@@ -59,6 +59,9 @@ void C_NewModeAdjust (void);
 void C_Ticker (void);
 
 int PrintString (int printlevel, const char *string);
+
+// Makes sure everything printed so far is in LOG before it is reopened
+void C_FlushLog();
 int STACK_ARGS Printf_Bold (const char *format, ...);
 
 void C_AddNotifyString (int printlevel, const char *s);
@@ -913,8 +913,14 @@ BEGIN_COMMAND (logfile)
 	struct tm * timeinfo;
 	const char* DEFAULT_LOG_FILE = (serverside ? "odasrv.log" : "odamex.log");
 
+	// argv goes away with the command, LOG_FILE has to outlive it
+	static std::string logfilename;
+	std::string filename = (argc > 1 ? argv[1] : DEFAULT_LOG_FILE);
+
+	C_FlushLog();
+
 	if (LOG.is_open()) {
-		if ((argc == 1 && LOG_FILE == DEFAULT_LOG_FILE) || (argc > 1 && LOG_FILE == argv[1])) {
+		if (LOG_FILE && filename == LOG_FILE) {
 			Printf (PRINT_HIGH, "Log file %s already in use\n", LOG_FILE);
 			return;
 		}
@@ -922,10 +928,12 @@ BEGIN_COMMAND (logfile)
     	time (&rawtime);
     	timeinfo = localtime (&rawtime);
     	Printf (PRINT_HIGH, "Log file %s closed on %s\n", LOG_FILE, asctime (timeinfo));
+		C_FlushLog();
 		LOG.close();
 	}
 
-	LOG_FILE = (argc > 1 ? argv[1] : DEFAULT_LOG_FILE);
+	logfilename = filename;
+	LOG_FILE = logfilename.c_str();
 	LOG.open (LOG_FILE, std::ios::app);
 
 	if (!LOG.is_open())
@@ -949,6 +957,7 @@ BEGIN_COMMAND (stoplog)
 		time (&rawtime);
     	timeinfo = localtime (&rawtime);
 		Printf (PRINT_HIGH, "Logging to file %s stopped %s\n", LOG_FILE, asctime (timeinfo));
+		C_FlushLog();
 		LOG.close();
 	}
 }
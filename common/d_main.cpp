@@ -61,6 +61,7 @@
 #include "s_sound.h"
 #include "gi.h"
 #include "w_ident.h"
+#include "w_hashindex.h"
 
 #ifdef GEKKO
 #include "i_wii.h"
@@ -225,24 +226,14 @@ static char *GetRegistryString(registry_value_t *reg_val)
 #endif
 
 //
-// BaseFileSearchDir
-// denis - Check single paths for a given file with a possible extension
-// Case insensitive, but returns actual file name
+// BaseFileListDir
+// denis - list files in the directory of interest, case-desensitize
+// then see which ones are the wanted wad.  Returns the actual file names.
 //
-static std::string BaseFileSearchDir(std::string dir, const std::string &file, const std::string &ext, std::string hash = "")
+static std::vector<std::string> BaseFileListDir(std::string dir, const std::string &file, const std::string &ext, const std::string &dothash)
 {
-	std::string found;
-
-	if (dir[dir.length() - 1] != PATHSEPCHAR)
-		dir += PATHSEP;
-
-	hash = StdStringToUpper(hash);
-	std::string dothash;
-	if (!hash.empty())
-		dothash = "." + hash;
+	std::vector<std::string> names;
 
-	// denis - list files in the directory of interest, case-desensitize
-	// then see if wanted wad is listed
 #ifdef UNIX
 	struct dirent **namelist = 0;
 	int n = scandir(dir.c_str(), &namelist, 0, alphasort);
@@ -253,30 +244,13 @@ static std::string BaseFileSearchDir(std::string dir, const std::string &file, c
 
 		M_Free(namelist[i]);
 
-		if (found.empty())
-		{
-			if (d_name == "." || d_name == "..")
-				continue;
-
-			std::string tmp = StdStringToUpper(d_name);
+		if (d_name == "." || d_name == "..")
+			continue;
 
-			if (file == tmp || (file + ext) == tmp || (file + dothash) == tmp || (file + ext + dothash) == tmp)
-			{
-				std::string local_file(dir + d_name);
-				std::string local_hash(W_MD5(local_file));
+		std::string tmp = StdStringToUpper(d_name);
 
-				if (hash.empty() || hash == local_hash)
-				{
-					found = d_name;
-				}
-				else if (!hash.empty())
-				{
-					Printf (PRINT_HIGH, "WAD at %s does not match required copy\n", local_file.c_str());
-					Printf (PRINT_HIGH, "Local MD5: %s\n", local_hash.c_str());
-					Printf (PRINT_HIGH, "Required MD5: %s\n\n", hash.c_str());
-				}
-			}
-		}
+		if (file == tmp || (file + ext) == tmp || (file + dothash) == tmp || (file + ext + dothash) == tmp)
+			names.push_back(d_name);
 	}
 
 	M_Free(namelist);
@@ -288,7 +262,7 @@ static std::string BaseFileSearchDir(std::string dir, const std::string &file, c
 	HANDLE hFind = FindFirstFile(all_ext.c_str(), &FindFileData);
 
 	if (hFind == INVALID_HANDLE_VALUE)
-		return "";
+		return names;
 
 	do
 	{
@@ -298,28 +272,60 @@ static std::string BaseFileSearchDir(std::string dir, const std::string &file, c
 		std::string tmp = StdStringToUpper(FindFileData.cFileName);
 
 		if (file == tmp || (file + ext) == tmp || (file + dothash) == tmp || (file + ext + dothash) == tmp)
-		{
-			std::string local_file(dir + FindFileData.cFileName);
-			std::string local_hash(W_MD5(local_file));
-
-			if (hash.empty() || hash == local_hash)
-			{
-				found = FindFileData.cFileName;
-				break;
-			}
-			else if (!hash.empty())
-			{
-				Printf (PRINT_HIGH, "WAD at %s does not match required copy\n", local_file.c_str());
-				Printf (PRINT_HIGH, "Local MD5: %s\n", local_hash.c_str());
-				Printf (PRINT_HIGH, "Required MD5: %s\n\n", hash.c_str());
-			}
-		}
+			names.push_back(FindFileData.cFileName);
 	} while (FindNextFile(hFind, &FindFileData));
 
 	FindClose(hFind);
 #endif
 
-	return found;
+	return names;
+}
+
+//
+// BaseFileMatchesHash
+//
+// Checks a file found while searching against the MD5 asked for, which
+// has to be in upper case
+//
+static bool BaseFileMatchesHash(const std::string &local_file, const std::string &hash)
+{
+	// hashes come out of the index unless the file changed
+	std::string local_hash(W_MD5(local_file));
+
+	if (hash == local_hash)
+		return true;
+
+	Printf (PRINT_HIGH, "WAD at %s does not match required copy\n", local_file.c_str());
+	Printf (PRINT_HIGH, "Local MD5: %s\n", local_hash.c_str());
+	Printf (PRINT_HIGH, "Required MD5: %s\n\n", hash.c_str());
+
+	return false;
+}
+
+//
+// BaseFileSearchDir
+// denis - Check single paths for a given file with a possible extension
+// Case insensitive, but returns actual file name
+//
+static std::string BaseFileSearchDir(std::string dir, const std::string &file, const std::string &ext, std::string hash = "")
+{
+	if (dir[dir.length() - 1] != PATHSEPCHAR)
+		dir += PATHSEP;
+
+	hash = StdStringToUpper(hash);
+	std::string dothash;
+	if (!hash.empty())
+		dothash = "." + hash;
+
+	std::vector<std::string> names = BaseFileListDir(dir, file, ext, dothash);
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (hash.empty() || BaseFileMatchesHash(dir + names[i], hash))
+			return names[i];
+	}
+
+	return "";
 }
 
 //
@@ -513,6 +519,38 @@ static std::string BaseFileSearch(std::string file, std::string ext = "", std::s
 
 	dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
 
+	// hash every candidate that isn't in the index yet in one go, so they
+	// are read in parallel rather than one directory at a time, then take
+	// the first that matches in search order
+	if (!hash.empty())
+	{
+		hash = StdStringToUpper(hash);
+		std::string dothash = "." + hash;
+		std::vector<std::string> candidates;
+
+		for (size_t i = 0; i < dirs.size(); i++)
+		{
+			std::string dir = dirs[i];
+			if (dir[dir.length() - 1] != PATHSEPCHAR)
+				dir += PATHSEP;
+
+			std::vector<std::string> names = BaseFileListDir(dir, file, ext, dothash);
+			for (size_t j = 0; j < names.size(); j++)
+				candidates.push_back(dir + names[j]);
+		}
+
+		W_HashIndexUpdate(candidates);
+
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			if (BaseFileMatchesHash(candidates[i], hash))
+				return candidates[i];
+		}
+
+		// Not found
+		return "";
+	}
+
 	for (size_t i = 0; i < dirs.size(); i++)
 	{
 		std::string found = BaseFileSearchDir(dirs[i], file, ext, hash);
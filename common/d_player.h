@@ -302,6 +302,36 @@ public:
 			download_t(const download_t& other) : name(other.name), next_offset(other.next_offset) {}
 		}download;
 
+		// world state for a joining client, sent as one compressed image
+		// at the client's rate.  Reliable messages written in the meantime
+		// are held back until the image is through, so the client can apply
+		// it in one go.
+		class fullupdate_t
+		{
+		public:
+			std::vector<byte> image;	// LZO image of the full update messages
+			size_t next_offset;
+			size_t length;				// uncompressed size
+			byte serial;				// which full update this is, for the client
+			bool holding;
+			std::vector<std::vector<byte> > held;
+			size_t heldsize;			// bytes in held
+			dtime_t starttime;
+
+			fullupdate_t() : next_offset(0), length(0), serial(0), holding(false), heldsize(0), starttime(0) {}
+		}fullupdate;
+
+		// the movingsector_t::serial and gametic of the last update of
+		// each moving sector sent to the client, by sector number
+		struct sectorsync_t
+		{
+			unsigned int serial;
+			int tic;
+
+			sectorsync_t() : serial(0), tic(0) {}
+		};
+		std::vector<sectorsync_t> sectorsync;
+
 		client_t()
 		{
 			// GhostlyDeath -- Initialize to Zero
@@ -357,7 +387,9 @@ public:
 			allow_rcon(false),
 			displaydisconnect(true),
 			compressor(other.compressor),
-			download(other.download)
+			download(other.download),
+			fullupdate(other.fullupdate),
+			sectorsync(other.sectorsync)
 		{
 				memcpy(packetbegin, other.packetbegin, sizeof(packetbegin));
 				memcpy(packetsize, other.packetsize, sizeof(packetsize));
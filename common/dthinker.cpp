@@ -37,6 +37,7 @@ IMPLEMENT_SERIAL (DThinker, DObject)
 
 DThinker *DThinker::FirstThinker = NULL;
 DThinker *DThinker::LastThinker = NULL;
+void (*DThinker::ThinkHook) (DThinker *thinker) = NULL;
 
 std::vector<DThinker *> LingerDestroy;
 
@@ -266,7 +267,12 @@ void DThinker::RunThinkers ()
 	while (currentthinker)
 	{
 		if (!IndependentThinker(currentthinker))
-			currentthinker->RunThink();
+		{
+			if (ThinkHook)
+				ThinkHook(currentthinker);
+			else
+				currentthinker->RunThink();
+		}
 		currentthinker = currentthinker->m_Next;
 	}
 	END_STAT (ThinkCycles);
@@ -71,6 +71,10 @@ public:
 	static DThinker *FirstThinker;
 	static DThinker *LastThinker;
 	static void RunThinkers ();
+
+	// If set, RunThinkers calls this with each thinker instead of calling
+	// its RunThink, so that a profiler can time it
+	static void (*ThinkHook) (DThinker *thinker);
 	static void DestroyAllThinkers ();
 	static void DestroyMostThinkers ();
 	static void SerializeAll (FArchive &arc, bool keepPlayers, bool noStorePlayers);
@@ -352,6 +352,14 @@ FLZOMemFile::FLZOMemFile() :
 	m_ImplodedBuffer = NULL;
 }
 
+FLZOMemFile::FLZOMemFile(bool dontcompress) :
+	FLZOFile()
+{
+	m_SourceFromMem = false;
+	m_ImplodedBuffer = NULL;
+	m_NoCompress = dontcompress;
+}
+
 FLZOMemFile::~FLZOMemFile()
 {
 }
@@ -492,6 +500,89 @@ void FLZOMemFile::WriteToBuffer(void* buf, size_t length) const
 		memcpy(buf, m_Buffer, length);
 }
 
+size_t FLZOMemFile::CompressImage(const void* image, size_t length, void* out, size_t outlength)
+{
+	if (length < 8)
+		return 0;
+
+	const byte* src = (const byte*)image;
+	unsigned int compressed_len = BELONG(((unsigned int*)src)[0]);
+	unsigned int input_len = BELONG(((unsigned int*)src)[1]);
+
+	if (compressed_len == 0 && input_len + 8 <= length)
+	{
+		byte* compressed = new lzo_byte[MaxLZOCompressedLength(input_len)];
+		lzo_byte* wrkmem = new lzo_byte[LZO1X_1_MEM_COMPRESS];
+		lzo_uint newlen = 0;
+
+		int res = lzo1x_1_compress(src + 8, input_len, compressed, &newlen, wrkmem);
+		delete [] wrkmem;
+
+		if (res == LZO_E_OK && newlen < input_len && newlen + 8 <= outlength)
+		{
+			((unsigned int*)out)[0] = BELONG((unsigned int)newlen);
+			((unsigned int*)out)[1] = BELONG(input_len);
+			memcpy((byte*)out + 8, compressed, newlen);
+
+			delete [] compressed;
+			return newlen + 8;
+		}
+
+		delete [] compressed;
+	}
+
+	// already compressed or incompressible, keep it as it is
+	if (length > outlength)
+		return 0;
+
+	memcpy(out, image, length);
+	return length;
+}
+
+size_t FLZOMemFile::ExpandedImageLength(const void* image, size_t length)
+{
+	if (length < 8)
+		return 0;
+
+	const byte* src = (const byte*)image;
+	unsigned int compressed_len = BELONG(((unsigned int*)src)[0]);
+	unsigned int input_len = BELONG(((unsigned int*)src)[1]);
+
+	if ((compressed_len ? compressed_len : input_len) + 8 > length)
+		return 0;
+
+	return input_len + 8;
+}
+
+size_t FLZOMemFile::DecompressImage(const void* image, size_t length, void* out, size_t outlength)
+{
+	size_t expanded_len = ExpandedImageLength(image, length);
+	if (expanded_len == 0 || expanded_len > outlength)
+		return 0;
+
+	const byte* src = (const byte*)image;
+	unsigned int compressed_len = BELONG(((unsigned int*)src)[0]);
+	unsigned int input_len = BELONG(((unsigned int*)src)[1]);
+
+	if (compressed_len != 0)
+	{
+		lzo_uint newlen = input_len;
+
+		int res = lzo1x_decompress_safe(src + 8, compressed_len, (byte*)out + 8, &newlen, NULL);
+		if (res != LZO_E_OK || newlen != input_len)
+			return 0;
+	}
+	else
+	{
+		memcpy((byte*)out + 8, src + 8, input_len);
+	}
+
+	((unsigned int*)out)[0] = 0;
+	((unsigned int*)out)[1] = BELONG(input_len);
+
+	return expanded_len;
+}
+
 //============================================
 //
 // FArchive
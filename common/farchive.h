@@ -108,6 +108,7 @@ class FLZOMemFile : public FLZOFile
 {
 public:
 	FLZOMemFile();
+	FLZOMemFile(bool dontcompress);
 
 	virtual ~FLZOMemFile();
 
@@ -123,6 +124,19 @@ public:
 	size_t Length() const;
 	void WriteToBuffer(void* buf, size_t length) const;
 
+	// Compresses an imploded image that was stored uncompressed (written
+	// by a FLZOMemFile constructed with dontcompress) into out.  Returns the
+	// length of the new image or 0 if it does not fit.  Does not touch any
+	// shared state, so it may run on a worker thread.
+	static size_t CompressImage(const void* image, size_t length, void* out, size_t outlength);
+
+	// The reverse of CompressImage: expands an imploded image into a stored
+	// image that Open(void*) accepts without decompressing again.
+	// ExpandedImageLength gives the size out needs to be, or 0 if the image
+	// is malformed.
+	static size_t ExpandedImageLength(const void* image, size_t length);
+	static size_t DecompressImage(const void* image, size_t length, void* out, size_t outlength);
+
 protected:
 	virtual bool FreeOnExplode() { return !m_SourceFromMem; }
 
@@ -1181,7 +1181,7 @@ void G_InitLevelLocals()
 	if (memcmp(level.fadeto_color, old_fadeto_color, 4) != 0)
 		V_RefreshColormaps();
 
-	movingsectors.clear();
+	P_ClearMovingSectors();
 }
 
 // Static level info from original game
@@ -27,6 +27,23 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <cstddef>
+
+#include "i_crash.h"
+
+static void (*crashLogFlush)() = NULL;
+
+void I_SetCrashLogFlush(void (*flush)())
+{
+	crashLogFlush = flush;
+}
+
+static void flushLog()
+{
+	if (crashLogFlush)
+		crashLogFlush();
+}
+
 #if defined _WIN32 && !defined _XBOX && defined _MSC_VER
 
 #include <csignal>
@@ -88,6 +105,7 @@ void writeMinidump(EXCEPTION_POINTERS* exceptionPtrs)
 LONG CALLBACK sehCallback(EXCEPTION_POINTERS* e)
 {
 	writeMinidump(e);
+	flushLog();
 	return EXCEPTION_CONTINUE_SEARCH;
 }
 
@@ -95,6 +113,7 @@ void terminateCallback()
 {
 	// Exception pointer is located at _pxcptinfoptrs.
 	writeMinidump(static_cast<PEXCEPTION_POINTERS>(_pxcptinfoptrs));
+	flushLog();
 
 	// Set the standard abort handler.
 	std::signal(SIGABRT, SIG_DFL);
@@ -107,6 +126,7 @@ void purecallCallback()
 {
 	// Exception pointer is located at _pxcptinfoptrs.
 	writeMinidump(static_cast<PEXCEPTION_POINTERS>(_pxcptinfoptrs));
+	flushLog();
 
 	// Set the standard abort handler.
 	std::signal(SIGABRT, SIG_DFL);
@@ -119,6 +139,7 @@ void invalidparamCallback(const wchar_t* expression, const wchar_t* function, co
 {
 	// Exception pointer is located at _pxcptinfoptrs.
 	writeMinidump(static_cast<PEXCEPTION_POINTERS>(_pxcptinfoptrs));
+	flushLog();
 
 	// Set the standard abort handler.
 	std::signal(SIGABRT, SIG_DFL);
@@ -135,6 +156,7 @@ int newCallback(size_t)
 {
 	// Exception pointer is located at _pxcptinfoptrs.
 	writeMinidump(static_cast<PEXCEPTION_POINTERS>(_pxcptinfoptrs));
+	flushLog();
 
 	// Set the standard abort handler.
 	std::signal(SIGABRT, SIG_DFL);
@@ -153,6 +175,7 @@ void signalCallback(int sig)
 
 	// Exception pointer is located at _pxcptinfoptrs.
 	writeMinidump(static_cast<PEXCEPTION_POINTERS>(_pxcptinfoptrs));
+	flushLog();
 
 	// Once we're done, bail out.
 	std::abort();
@@ -271,6 +294,9 @@ void sigactionCallback(int sig, siginfo_t* si, void* ctx)
 	// Write out the backtrace
 	writeBacktrace(sig, si);
 
+	// Get the last lines the log thread is holding on to out
+	flushLog();
+
 	// Once we're done, re-raise the signal.
 	kill(getpid(), sig);
 }
@@ -26,4 +26,7 @@
 
 void I_SetCrashCallbacks();
 
+// Called once a crash has been dumped, to get buffered log lines out
+void I_SetCrashLogFlush(void (*flush)());
+
 #endif
@@ -107,6 +107,7 @@ int         	localport;
 netadr_t    	net_from;   // address of who sent the packet
 
 buf_t       net_message(MAX_UDP_PACKET);
+static buf_t *msg_read = &net_message;	// where the MSG_Read functions read from
 extern bool	simulated_connection;
 
 // buffer for compression/decompression
@@ -723,29 +724,47 @@ void MSG_WriteHexString(buf_t *b, const char *s)
     MSG_WriteChunk(b, output, numdigits);
 }
 
+//
+// MSG_SetReadBuffer
+//
+// Points the MSG_Read functions at another buffer, such as one reassembled
+// from several packets, and returns the one they read from before
+//
+buf_t *MSG_SetReadBuffer(buf_t *buf)
+{
+	buf_t *old = msg_read;
+	msg_read = buf ? buf : &net_message;
+	return old;
+}
+
+buf_t *MSG_GetReadBuffer(void)
+{
+	return msg_read;
+}
+
 int MSG_BytesLeft(void)
 {
-	return net_message.BytesLeftToRead();
+	return msg_read->BytesLeftToRead();
 }
 
 int MSG_ReadByte (void)
 {
-    return net_message.ReadByte();
+    return msg_read->ReadByte();
 }
 
 int MSG_NextByte (void)
 {
-	return net_message.NextByte();
+	return msg_read->NextByte();
 }
 
 void *MSG_ReadChunk (const size_t &size)
 {
-	return net_message.ReadChunk(size);
+	return msg_read->ReadChunk(size);
 }
 
 size_t MSG_SetOffset (const size_t &offset, const buf_t::seek_loc_t &loc)
 {
-    return net_message.SetOffset(offset, loc);
+    return msg_read->SetOffset(offset, loc);
 }
 
 // Output buffer size for LZO compression, extra space in case uncompressable
@@ -871,12 +890,12 @@ bool MSG_CompressAdaptive (huffman &huff, buf_t &buf, size_t start_offset, size_
 
 int MSG_ReadShort (void)
 {
-    return net_message.ReadShort();
+    return msg_read->ReadShort();
 }
 
 int MSG_ReadLong (void)
 {
-	return net_message.ReadLong();
+	return msg_read->ReadLong();
 }
 
 //
@@ -885,7 +904,7 @@ int MSG_ReadLong (void)
 // Read a boolean value
 bool MSG_ReadBool(void)
 {
-    int Value = net_message.ReadByte();
+    int Value = msg_read->ReadByte();
 
     if (Value < 0 || Value > 1)
     {
@@ -903,7 +922,7 @@ bool MSG_ReadBool(void)
 // Read a null terminated string
 const char *MSG_ReadString (void)
 {
-	return net_message.ReadString();
+	return msg_read->ReadString();
 }
 
 //
@@ -1028,6 +1047,7 @@ void InitNetMessageFormats()
 	MSG(svc_inttimeleft,		"x"),
 	MSG(svc_mobjtranslation,	"x"),
 	MSG(svc_fullupdatedone,		"x"),
+	MSG(svc_fullupdatechunk,	"x"),
 	MSG(svc_railtrail,			"x"),
 	MSG(svc_playerstate,		"x")
    };
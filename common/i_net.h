@@ -63,7 +63,7 @@ enum svc_t
 	svc_disconnect,
 	svc_reserved3,
 	svc_playerinfo,			// weapons, ammo, maxammo, raisedweapon for local player
-	svc_moveplayer,			// [byte] [int] [int] [int] [int] [byte]
+	svc_moveplayer,			// moveplayer_schema, see i_netschema.h
 	svc_updatelocalplayer,	// [int] [int] [int] [int] [int]
 	svc_pingrequest,		// [SL] 2011-05-11 [long:timestamp]
 	svc_updateping,			// [byte] [byte]
@@ -71,11 +71,11 @@ enum svc_t
 	svc_disconnectclient,
 	svc_loadmap,
 	svc_consoleplayer,
-	svc_mobjspeedangle,
+	svc_mobjspeedangle,		// speedangle_schema
 	svc_explodemissile,		// [short] - netid
 	svc_removemobj,
 	svc_userinfo,
-	svc_movemobj,			// [short] [byte] [int] [int] [int]
+	svc_movemobj,			// movemobj_schema
 	svc_spawnplayer,
 	svc_damageplayer,
 	svc_killmobj,
@@ -123,6 +123,7 @@ enum svc_t
 	svc_playerstate,		// [SL] Health, armor, and weapon of a player
 	svc_warmupstate,		// [AM] Broadcast warmup state to client
 	svc_resetmap,			// [AM] Server is resetting the map
+	svc_fullupdatechunk,	// [byte:serial] [long:size] [long:offset] [short:len] [byte[]:data]
 
 	// for co-op
 	svc_mobjstate = 70,
@@ -556,6 +557,9 @@ void MSG_WriteString (buf_t *b, const char *s);
 void MSG_WriteHexString(buf_t *b, const char *s);
 void MSG_WriteChunk (buf_t *b, const void *p, unsigned l);
 
+buf_t *MSG_SetReadBuffer(buf_t *buf);
+buf_t *MSG_GetReadBuffer(void);
+
 int MSG_BytesLeft(void);
 int MSG_NextByte (void);
 
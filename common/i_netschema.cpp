@@ -0,0 +1,592 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Bit-packed network messages described by a schema
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "cmdlib.h"
+#include "m_fixed.h"
+#include "tables.h"
+#include "c_console.h"
+#include "c_dispatch.h"
+#include "i_system.h"
+#include "i_net.h"
+
+#include "i_netschema.h"
+
+extern bool simulated_connection;
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static const netfield_t movemobj_fields[] =
+{
+	{ "netid",			NF_UINT,	16,	2 },
+	{ "rndindex",		NF_BITS,	8,	1 },
+	{ "x",				NF_FIXED,	0,	4 },
+	{ "y",				NF_FIXED,	0,	4 },
+	{ "z",				NF_FIXED,	0,	4 }
+};
+
+static const netfield_t speedangle_fields[] =
+{
+	{ "netid",			NF_UINT,	16,	2 },
+	{ "angle",			NF_ANGLE,	32,	4 },
+	{ "momx",			NF_FIXED,	0,	4 },
+	{ "momy",			NF_FIXED,	0,	4 },
+	{ "momz",			NF_FIXED,	0,	4 }
+};
+
+static const netfield_t moveplayer_fields[] =
+{
+	{ "id",				NF_BITS,	8,	1 },
+	{ "tic",			NF_UINT,	32,	4 },
+	{ "x",				NF_FIXED,	0,	4 },
+	{ "y",				NF_FIXED,	0,	4 },
+	{ "z",				NF_FIXED,	0,	4 },
+	{ "angle",			NF_ANGLE,	16,	2 },
+	{ "pitch",			NF_ANGLE,	16,	2 },
+	{ "frame",			NF_UINT,	8,	1 },
+	{ "momx",			NF_FIXED,	0,	4 },
+	{ "momy",			NF_FIXED,	0,	4 },
+	{ "momz",			NF_FIXED,	0,	4 },
+	{ "invisibility",	NF_UINT,	8,	1 }
+};
+
+netschema_t movemobj_schema =
+	{ "movemobj", movemobj_fields, ARRAY_SIZE(movemobj_fields), 0, 0 };
+netschema_t speedangle_schema =
+	{ "mobjspeedangle", speedangle_fields, ARRAY_SIZE(speedangle_fields), 0, 0 };
+netschema_t moveplayer_schema =
+	{ "moveplayer", moveplayer_fields, ARRAY_SIZE(moveplayer_fields), 0, 0 };
+
+static netschema_t *schemas[] =
+{
+	&movemobj_schema,
+	&speedangle_schema,
+	&moveplayer_schema
+};
+
+static int schemastats_tic = 0;
+
+//
+// BitWriter
+//
+// Collects bits lowest first into a small scratch buffer that is copied
+// into the message buffer in one go
+//
+class BitWriter
+{
+public:
+	BitWriter() : acc(0), count(0), written(0) {}
+
+	void write(unsigned int value, int bits)
+	{
+		if (bits < 32)
+			value &= (1u << bits) - 1;
+
+		acc |= (uint64_t)value << count;
+		count += bits;
+
+		while (count >= 8)
+		{
+			if (written < sizeof(data))
+				data[written++] = (byte)acc;
+			acc >>= 8;
+			count -= 8;
+		}
+	}
+
+	// pads the last byte with zeros and appends the bytes to the buffer
+	size_t finish(buf_t *b)
+	{
+		if (count > 0)
+			write(0, 8 - count);
+
+		b->WriteChunk((const char *)data, written);
+		return written;
+	}
+
+private:
+	// 12 fields of at most 34 bits each is the largest message so far
+	byte		data[64];
+	uint64_t	acc;
+	int			count;
+	size_t		written;
+};
+
+//
+// BitReader
+//
+// Mirror of BitWriter, only takes bytes from the buffer as they are needed
+// so the read position ends up right after the padding
+//
+class BitReader
+{
+public:
+	BitReader(buf_t *b) : buf(b), acc(0), count(0), pos(b->readpos), failed(false) {}
+
+	unsigned int read(int bits)
+	{
+		while (count < bits)
+		{
+			if (pos >= buf->cursize)
+			{
+				failed = true;
+				return 0;
+			}
+
+			acc |= (uint64_t)buf->data[pos++] << count;
+			count += 8;
+		}
+
+		unsigned int value = (unsigned int)(acc & (((uint64_t)1 << bits) - 1));
+		acc >>= bits;
+		count -= bits;
+		return value;
+	}
+
+	bool finish()
+	{
+		if (failed)
+		{
+			buf->readpos = buf->cursize;
+			buf->overflowed = true;
+			return false;
+		}
+
+		buf->readpos = pos;
+		return true;
+	}
+
+private:
+	buf_t		*buf;
+	uint64_t	acc;
+	int			count;
+	size_t		pos;
+	bool		failed;
+};
+
+//
+// Width of each of the four size classes of an NF_UINT field
+//
+static inline int MSG_SizeClassBits(int bits, int sizeclass)
+{
+	return bits * (sizeclass + 1) / 4;
+}
+
+static void MSG_WriteUInt(BitWriter &writer, unsigned int value, int bits)
+{
+	int sizeclass = 0;
+	while (sizeclass < 3 && (value >> MSG_SizeClassBits(bits, sizeclass)) != 0)
+		sizeclass++;
+
+	writer.write(sizeclass, 2);
+	writer.write(value, MSG_SizeClassBits(bits, sizeclass));
+}
+
+static unsigned int MSG_ReadUInt(BitReader &reader, int bits)
+{
+	int sizeclass = reader.read(2);
+	return reader.read(MSG_SizeClassBits(bits, sizeclass));
+}
+
+// zigzag so that small negative numbers are small too
+static inline unsigned int MSG_ZigZag(int value)
+{
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+static inline int MSG_UnZigZag(unsigned int value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+enum
+{
+	FIXED_ZERO,
+	FIXED_WHOLE,
+	FIXED_FULL
+};
+
+static inline int MSG_AngleShift(int bits)
+{
+	return 32 - bits;
+}
+
+//
+// MSG_SchemaFieldValue
+//
+int MSG_SchemaFieldValue(const netfield_t &field, int value)
+{
+	switch (field.type)
+	{
+	case NF_BITS:
+	case NF_UINT:
+		if (field.bits < 32)
+			return value & ((1 << field.bits) - 1);
+		return value;
+
+	case NF_SINT:
+		return value;
+
+	case NF_FIXED:
+		return (int)(((unsigned int)value >> field.bits) << field.bits);
+
+	case NF_ANGLE:
+		return (int)(((unsigned int)value >> MSG_AngleShift(field.bits)) << MSG_AngleShift(field.bits));
+	}
+
+	return value;
+}
+
+static void MSG_WriteField(BitWriter &writer, const netfield_t &field, int value)
+{
+	switch (field.type)
+	{
+	case NF_BITS:
+		writer.write(value, field.bits);
+		break;
+
+	case NF_UINT:
+		MSG_WriteUInt(writer, MSG_SchemaFieldValue(field, value), field.bits);
+		break;
+
+	case NF_SINT:
+		MSG_WriteUInt(writer, MSG_ZigZag(value), field.bits);
+		break;
+
+	case NF_FIXED:
+		value = MSG_SchemaFieldValue(field, value);
+
+		if (value == 0)
+		{
+			writer.write(FIXED_ZERO, 2);
+		}
+		else if ((value & (FRACUNIT - 1)) == 0 && value >= -32768 * FRACUNIT && value <= 32767 * FRACUNIT)
+		{
+			writer.write(FIXED_WHOLE, 2);
+			MSG_WriteUInt(writer, MSG_ZigZag(value >> FRACBITS), 16);
+		}
+		else
+		{
+			writer.write(FIXED_FULL, 2);
+			writer.write((unsigned int)value >> field.bits, 32 - field.bits);
+		}
+		break;
+
+	case NF_ANGLE:
+	{
+		unsigned int angle = (unsigned int)value >> MSG_AngleShift(field.bits);
+		int coarse = field.bits - 8;
+
+		// monsters and most things in a map face one of a few directions
+		if (coarse > 0 && (angle & ((1u << coarse) - 1)) == 0)
+		{
+			writer.write(1, 1);
+			writer.write(angle >> coarse, 8);
+		}
+		else
+		{
+			writer.write(0, 1);
+			writer.write(angle, field.bits);
+		}
+		break;
+	}
+	}
+}
+
+static int MSG_ReadField(BitReader &reader, const netfield_t &field)
+{
+	switch (field.type)
+	{
+	case NF_BITS:
+		return reader.read(field.bits);
+
+	case NF_UINT:
+		return MSG_ReadUInt(reader, field.bits);
+
+	case NF_SINT:
+		return MSG_UnZigZag(MSG_ReadUInt(reader, field.bits));
+
+	case NF_FIXED:
+		switch (reader.read(2))
+		{
+		case FIXED_WHOLE:
+			return MSG_UnZigZag(MSG_ReadUInt(reader, 16)) * FRACUNIT;
+		case FIXED_FULL:
+			return (int)(reader.read(32 - field.bits) << field.bits);
+		default:
+			return 0;
+		}
+
+	case NF_ANGLE:
+	{
+		unsigned int angle;
+		int coarse = field.bits - 8;
+
+		if (reader.read(1))
+			angle = reader.read(8) << coarse;
+		else
+			angle = reader.read(field.bits);
+
+		return (int)(angle << MSG_AngleShift(field.bits));
+	}
+	}
+
+	return 0;
+}
+
+static size_t MSG_PackSchema(buf_t *b, const netschema_t &schema, const int *values)
+{
+	BitWriter writer;
+
+	for (size_t i = 0; i < schema.numfields; i++)
+		MSG_WriteField(writer, schema.fields[i], values[i]);
+
+	return writer.finish(b);
+}
+
+//
+// MSG_WriteSchema
+//
+void MSG_WriteSchema(buf_t *b, netschema_t &schema, const int *values)
+{
+	if (simulated_connection)
+		return;
+
+	schema.messages++;
+	schema.bytes += MSG_PackSchema(b, schema, values);
+}
+
+//
+// MSG_ReadSchema
+//
+bool MSG_ReadSchema(buf_t *b, const netschema_t &schema, int *values)
+{
+	BitReader reader(b);
+
+	for (size_t i = 0; i < schema.numfields; i++)
+		values[i] = MSG_ReadField(reader, schema.fields[i]);
+
+	if (!reader.finish())
+	{
+		for (size_t i = 0; i < schema.numfields; i++)
+			values[i] = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool MSG_ReadSchema(const netschema_t &schema, int *values)
+{
+	return MSG_ReadSchema(MSG_GetReadBuffer(), schema, values);
+}
+
+static size_t MSG_LegacySize(const netschema_t &schema)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < schema.numfields; i++)
+		size += schema.fields[i].legacybytes;
+	return size;
+}
+
+BEGIN_COMMAND (netschemastats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		for (size_t i = 0; i < ARRAY_SIZE(schemas); i++)
+			schemas[i]->messages = schemas[i]->bytes = 0;
+		schemastats_tic = gametic;
+		return;
+	}
+
+	int tics = gametic - schemastats_tic;
+	if (tics < 1)
+		tics = 1;
+
+	Printf(PRINT_HIGH, "%-16s %8s %8s %8s %10s %10s\n",
+		"message", "count", "bytes", "legacy", "bytes/tic", "legacy/tic");
+
+	for (size_t i = 0; i < ARRAY_SIZE(schemas); i++)
+	{
+		const netschema_t &schema = *schemas[i];
+		unsigned int legacy = schema.messages * MSG_LegacySize(schema);
+
+		Printf(PRINT_HIGH, "%-16s %8u %8.2f %8u %10.1f %10.1f\n",
+			schema.name, schema.messages,
+			schema.messages ? (float)schema.bytes / schema.messages : 0.0f,
+			(unsigned int)MSG_LegacySize(schema),
+			(float)schema.bytes / tics, (float)legacy / tics);
+	}
+}
+END_COMMAND (netschemastats)
+
+//
+// Random values shaped like what each kind of field really carries: mostly
+// zero, whole numbers and small values with some full range ones mixed in
+//
+static int MSG_RandomFieldValue(const netfield_t &field)
+{
+	int value = (rand() << 16) ^ rand();
+
+	switch (field.type)
+	{
+	case NF_BITS:
+	case NF_UINT:
+		if (rand() & 1)
+			value = rand() % 100;
+		break;
+
+	case NF_SINT:
+		if (rand() & 1)
+			value = rand() % 200 - 100;
+		break;
+
+	case NF_FIXED:
+		switch (rand() % 4)
+		{
+		case 0:
+			value = 0;
+			break;
+		case 1:
+			value = (rand() % 65536 - 32768) * FRACUNIT;
+			break;
+		}
+		break;
+
+	case NF_ANGLE:
+		if (rand() & 1)
+			value = (rand() % 8) * ANG45;
+		break;
+	}
+
+	return MSG_SchemaFieldValue(field, value);
+}
+
+static void MSG_WriteLegacy(buf_t *b, const netschema_t &schema, const int *values)
+{
+	for (size_t i = 0; i < schema.numfields; i++)
+	{
+		switch (schema.fields[i].legacybytes)
+		{
+		case 1:
+			b->WriteByte(values[i]);
+			break;
+		case 2:
+			b->WriteShort(values[i]);
+			break;
+		default:
+			b->WriteLong(values[i]);
+			break;
+		}
+	}
+}
+
+//
+// netschematest
+//
+// Round trips random messages through every schema and compares the
+// packing cost with the plain byte-aligned encoding
+//
+BEGIN_COMMAND (netschematest)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	if (iterations < 1)
+		iterations = 1;
+
+	const size_t batch = 64;
+	buf_t buf(MAX_UDP_PACKET);
+	bool passed = true;
+
+	for (size_t s = 0; s < ARRAY_SIZE(schemas); s++)
+	{
+		const netschema_t &schema = *schemas[s];
+		std::vector<int> values(schema.numfields * batch);
+		std::vector<int> decoded(schema.numfields);
+
+		dtime_t packtime = 0, legacytime = 0;
+		size_t packbytes = 0, legacybytes = 0;
+		int failures = 0;
+
+		for (int done = 0; done < iterations; done += batch)
+		{
+			for (size_t i = 0; i < values.size(); i++)
+				values[i] = MSG_RandomFieldValue(schema.fields[i % schema.numfields]);
+
+			buf.clear();
+			dtime_t start = I_GetTime();
+			for (size_t m = 0; m < batch; m++)
+				MSG_WriteLegacy(&buf, schema, &values[m * schema.numfields]);
+			legacytime += I_GetTime() - start;
+			legacybytes += buf.cursize;
+
+			buf.clear();
+			start = I_GetTime();
+			for (size_t m = 0; m < batch; m++)
+				MSG_PackSchema(&buf, schema, &values[m * schema.numfields]);
+			packtime += I_GetTime() - start;
+			packbytes += buf.cursize;
+
+			for (size_t m = 0; m < batch; m++)
+			{
+				if (!MSG_ReadSchema(&buf, schema, &decoded[0]))
+				{
+					failures++;
+					break;
+				}
+
+				for (size_t f = 0; f < schema.numfields; f++)
+				{
+					if (decoded[f] != values[m * schema.numfields + f])
+					{
+						if (failures++ == 0)
+							Printf(PRINT_HIGH, "%s.%s: wrote %d, read %d\n", schema.name,
+								schema.fields[f].name, values[m * schema.numfields + f], decoded[f]);
+						break;
+					}
+				}
+			}
+
+			if (buf.readpos != buf.cursize)
+				failures++;
+		}
+
+		size_t messages = ((iterations + batch - 1) / batch) * batch;
+
+		Printf(PRINT_HIGH, "%-16s %s  %5.2f bytes (%5.2f)  %6.1f ns (%6.1f)\n",
+			schema.name, failures ? "FAILED" : "ok",
+			(float)packbytes / messages, (float)legacybytes / messages,
+			(float)packtime / messages, (float)legacytime / messages);
+
+		if (failures)
+			passed = false;
+	}
+
+	Printf(PRINT_HIGH, "%s, bytes and encode time per message, plain encoding in brackets\n",
+		passed ? "All schemas round trip" : "Round trip failures");
+}
+END_COMMAND (netschematest)
+
+VERSION_CONTROL (i_netschema_cpp, "$Id$")
@@ -0,0 +1,119 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Bit-packed network messages described by a schema
+//
+//	A schema lists the fields of a message and how each one is packed.
+//	The fields are written as one run of bits after the message marker,
+//	padded to a whole byte at the end, so the rest of the packet is
+//	unaffected.  Values are passed around as an array of ints in schema
+//	order.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __I_NETSCHEMA_H__
+#define __I_NETSCHEMA_H__
+
+#include "doomtype.h"
+#include "i_net.h"
+
+enum netfieldtype_t
+{
+	NF_BITS,	// unsigned, always exactly bits wide
+	NF_UINT,	// unsigned, at most bits wide, small values are shorter
+	NF_SINT,	// signed, at most bits wide, small magnitudes are shorter
+	NF_FIXED,	// fixed_t, zero and whole numbers are shorter, the lowest
+				// bits fields are dropped
+	NF_ANGLE	// angle_t, only the highest bits are kept, angles that are
+				// a multiple of 1/256th of a turn are shorter
+};
+
+struct netfield_t
+{
+	const char		*name;
+	netfieldtype_t	type;
+	int				bits;
+	int				legacybytes;	// width of the field before packing
+};
+
+struct netschema_t
+{
+	const char			*name;
+	const netfield_t	*fields;
+	size_t				numfields;
+
+	// traffic written since the last netschemastats reset
+	unsigned int		messages;
+	unsigned int		bytes;
+};
+
+// svc_movemobj
+enum
+{
+	MOVEMOBJ_NETID,
+	MOVEMOBJ_RNDINDEX,
+	MOVEMOBJ_X,
+	MOVEMOBJ_Y,
+	MOVEMOBJ_Z,
+	MOVEMOBJ_NUMFIELDS
+};
+
+// svc_mobjspeedangle
+enum
+{
+	SPEEDANGLE_NETID,
+	SPEEDANGLE_ANGLE,
+	SPEEDANGLE_MOMX,
+	SPEEDANGLE_MOMY,
+	SPEEDANGLE_MOMZ,
+	SPEEDANGLE_NUMFIELDS
+};
+
+// svc_moveplayer
+enum
+{
+	MOVEPLAYER_ID,
+	MOVEPLAYER_TIC,
+	MOVEPLAYER_X,
+	MOVEPLAYER_Y,
+	MOVEPLAYER_Z,
+	MOVEPLAYER_ANGLE,
+	MOVEPLAYER_PITCH,
+	MOVEPLAYER_FRAME,
+	MOVEPLAYER_MOMX,
+	MOVEPLAYER_MOMY,
+	MOVEPLAYER_MOMZ,
+	MOVEPLAYER_INVISIBILITY,
+	MOVEPLAYER_NUMFIELDS
+};
+
+extern netschema_t movemobj_schema;
+extern netschema_t speedangle_schema;
+extern netschema_t moveplayer_schema;
+
+// Writes the fields of one message after its marker
+void MSG_WriteSchema(buf_t *b, netschema_t &schema, const int *values);
+
+// Reads the fields of one message, returns false if it was cut short
+bool MSG_ReadSchema(buf_t *b, const netschema_t &schema, int *values);
+bool MSG_ReadSchema(const netschema_t &schema, int *values);
+
+// The value a field will have after being written and read back
+int MSG_SchemaFieldValue(const netfield_t &field, int value);
+
+#endif	// __I_NETSCHEMA_H__
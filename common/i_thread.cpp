@@ -0,0 +1,295 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//   Minimal portable threading primitives (pthreads / Win32).
+//
+//-----------------------------------------------------------------------------
+
+#include "i_thread.h"
+
+#ifdef _WIN32
+	#include "win32inc.h"
+#else
+	#include <pthread.h>
+	#include <errno.h>
+	#include <sys/time.h>
+	#include <unistd.h>
+#endif
+
+#include "version.h"
+
+//
+// Atomics
+//
+
+int I_AtomicAdd(volatile int* value, int amount)
+{
+#if defined(_WIN32)
+	return InterlockedExchangeAdd((volatile LONG*)value, amount) + amount;
+#else
+	return __sync_add_and_fetch(value, amount);
+#endif
+}
+
+int I_AtomicLoad(volatile int* value)
+{
+#if defined(_WIN32)
+	return InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+#else
+	return __sync_add_and_fetch(value, 0);
+#endif
+}
+
+void I_AtomicStore(volatile int* value, int newvalue)
+{
+#if defined(_WIN32)
+	InterlockedExchange((volatile LONG*)value, newvalue);
+#else
+	__sync_synchronize();
+	*value = newvalue;
+	__sync_synchronize();
+#endif
+}
+
+unsigned int I_GetCPUCount()
+{
+	long count = 1;
+
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	count = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	return count < 1 ? 1 : (unsigned int)count;
+}
+
+//
+// OMutex
+//
+
+OMutex::OMutex()
+{
+#ifdef _WIN32
+	CRITICAL_SECTION* cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	m_Handle = cs;
+#else
+	pthread_mutex_t* mutex = new pthread_mutex_t;
+	pthread_mutex_init(mutex, NULL);
+	m_Handle = mutex;
+#endif
+}
+
+OMutex::~OMutex()
+{
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION*)m_Handle);
+	delete (CRITICAL_SECTION*)m_Handle;
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)m_Handle);
+	delete (pthread_mutex_t*)m_Handle;
+#endif
+}
+
+void OMutex::lock()
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION*)m_Handle);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)m_Handle);
+#endif
+}
+
+void OMutex::unlock()
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION*)m_Handle);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)m_Handle);
+#endif
+}
+
+//
+// OEvent
+//
+
+#ifndef _WIN32
+struct event_t
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool signaled;
+};
+#endif
+
+OEvent::OEvent()
+{
+#ifdef _WIN32
+	m_Handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+	event_t* ev = new event_t;
+	pthread_mutex_init(&ev->mutex, NULL);
+	pthread_cond_init(&ev->cond, NULL);
+	ev->signaled = false;
+	m_Handle = ev;
+#endif
+}
+
+OEvent::~OEvent()
+{
+#ifdef _WIN32
+	CloseHandle((HANDLE)m_Handle);
+#else
+	event_t* ev = (event_t*)m_Handle;
+	pthread_cond_destroy(&ev->cond);
+	pthread_mutex_destroy(&ev->mutex);
+	delete ev;
+#endif
+}
+
+void OEvent::signal()
+{
+#ifdef _WIN32
+	SetEvent((HANDLE)m_Handle);
+#else
+	event_t* ev = (event_t*)m_Handle;
+	pthread_mutex_lock(&ev->mutex);
+	ev->signaled = true;
+	pthread_cond_signal(&ev->cond);
+	pthread_mutex_unlock(&ev->mutex);
+#endif
+}
+
+bool OEvent::wait(unsigned int timeout)
+{
+#ifdef _WIN32
+	return WaitForSingleObject((HANDLE)m_Handle, timeout) == WAIT_OBJECT_0;
+#else
+	event_t* ev = (event_t*)m_Handle;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	struct timespec until;
+	until.tv_sec = now.tv_sec + timeout / 1000;
+	until.tv_nsec = (now.tv_usec + (timeout % 1000) * 1000) * 1000;
+	if (until.tv_nsec >= 1000000000)
+	{
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&ev->mutex);
+
+	int res = 0;
+	while (!ev->signaled && res != ETIMEDOUT)
+		res = pthread_cond_timedwait(&ev->cond, &ev->mutex, &until);
+
+	bool signaled = ev->signaled;
+	ev->signaled = false;
+
+	pthread_mutex_unlock(&ev->mutex);
+
+	return signaled;
+#endif
+}
+
+//
+// OThread
+//
+
+struct thread_start_t
+{
+	OThread::ThreadFunc func;
+	void* data;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI I_ThreadStart(LPVOID param)
+#else
+static void* I_ThreadStart(void* param)
+#endif
+{
+	thread_start_t start = *(thread_start_t*)param;
+	delete (thread_start_t*)param;
+
+	start.func(start.data);
+
+	return 0;
+}
+
+OThread::OThread() : m_Handle(NULL)
+{
+}
+
+OThread::~OThread()
+{
+	join();
+}
+
+bool OThread::start(ThreadFunc func, void* data)
+{
+	if (m_Handle)
+		return false;
+
+	thread_start_t* start = new thread_start_t;
+	start->func = func;
+	start->data = data;
+
+#ifdef _WIN32
+	HANDLE thread = CreateThread(NULL, 0, I_ThreadStart, start, 0, NULL);
+	if (thread == NULL)
+	{
+		delete start;
+		return false;
+	}
+	m_Handle = thread;
+#else
+	pthread_t* thread = new pthread_t;
+	if (pthread_create(thread, NULL, I_ThreadStart, start) != 0)
+	{
+		delete thread;
+		delete start;
+		return false;
+	}
+	m_Handle = thread;
+#endif
+
+	return true;
+}
+
+void OThread::join()
+{
+	if (!m_Handle)
+		return;
+
+#ifdef _WIN32
+	WaitForSingleObject((HANDLE)m_Handle, INFINITE);
+	CloseHandle((HANDLE)m_Handle);
+#else
+	pthread_join(*(pthread_t*)m_Handle, NULL);
+	delete (pthread_t*)m_Handle;
+#endif
+
+	m_Handle = NULL;
+}
+
+VERSION_CONTROL (i_thread_cpp, "$Id$")
@@ -0,0 +1,170 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//   Minimal portable threading primitives (pthreads / Win32).
+//
+//   The game simulation is single threaded and stays that way.  These are
+//   for moving self-contained work (file I/O, compression, hashing) off the
+//   game thread, or for work that only reads the world while the game
+//   thread waits for it (see p_sight.cpp), so only the handful of
+//   primitives that needs is provided.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __I_THREAD_H__
+#define __I_THREAD_H__
+
+#include <stddef.h>
+
+//
+// Atomic operations on aligned ints.  All of them are full memory barriers.
+//
+int I_AtomicAdd(volatile int* value, int amount);	// returns the new value
+int I_AtomicLoad(volatile int* value);
+void I_AtomicStore(volatile int* value, int newvalue);
+
+// Number of logical processors available, at least 1
+unsigned int I_GetCPUCount();
+
+class OMutex
+{
+public:
+	OMutex();
+	~OMutex();
+
+	void lock();
+	void unlock();
+
+private:
+	OMutex(const OMutex&);
+	OMutex& operator=(const OMutex&);
+
+	void* m_Handle;
+};
+
+//
+// OMutexLock
+//
+// Holds a mutex for the lifetime of the object.
+//
+class OMutexLock
+{
+public:
+	OMutexLock(OMutex& mutex) : m_Mutex(mutex) { m_Mutex.lock(); }
+	~OMutexLock() { m_Mutex.unlock(); }
+
+private:
+	OMutexLock(const OMutexLock&);
+	OMutexLock& operator=(const OMutexLock&);
+
+	OMutex& m_Mutex;
+};
+
+//
+// OEvent
+//
+// Auto-reset event: signal() wakes one waiter, or the next call to wait()
+// if nobody is waiting yet.  Used to put idle worker threads to sleep.
+//
+class OEvent
+{
+public:
+	OEvent();
+	~OEvent();
+
+	void signal();
+
+	// Returns false if the timeout (in ms) ran out before a signal arrived
+	bool wait(unsigned int timeout);
+
+private:
+	OEvent(const OEvent&);
+	OEvent& operator=(const OEvent&);
+
+	void* m_Handle;
+};
+
+class OThread
+{
+public:
+	typedef void (*ThreadFunc)(void* data);
+
+	OThread();
+	~OThread();
+
+	bool start(ThreadFunc func, void* data);
+	void join();
+	bool running() const { return m_Handle != NULL; }
+
+private:
+	OThread(const OThread&);
+	OThread& operator=(const OThread&);
+
+	void* m_Handle;
+};
+
+//
+// OSPSCRing
+//
+// Fixed size ring for passing items from exactly one producer thread to
+// exactly one consumer thread without locking.  The size must be a power
+// of two.
+//
+template <typename T, int SIZE>
+class OSPSCRing
+{
+public:
+	OSPSCRing() : m_Head(0), m_Tail(0) { }
+
+	bool empty() { return I_AtomicLoad(&m_Head) == I_AtomicLoad(&m_Tail); }
+	bool full() { return count(I_AtomicLoad(&m_Head), I_AtomicLoad(&m_Tail)) == SIZE; }
+
+	// producer side
+	bool push(const T& item)
+	{
+		int head = I_AtomicLoad(&m_Head);
+		if (count(head, I_AtomicLoad(&m_Tail)) == SIZE)
+			return false;
+
+		m_Items[(unsigned int)head & (SIZE - 1)] = item;
+		I_AtomicStore(&m_Head, (int)((unsigned int)head + 1));
+		return true;
+	}
+
+	// consumer side
+	bool pop(T& item)
+	{
+		int tail = I_AtomicLoad(&m_Tail);
+		if (I_AtomicLoad(&m_Head) == tail)
+			return false;
+
+		item = m_Items[(unsigned int)tail & (SIZE - 1)];
+		I_AtomicStore(&m_Tail, (int)((unsigned int)tail + 1));
+		return true;
+	}
+
+private:
+	// the indices wrap around, only their difference is meaningful
+	static unsigned int count(int head, int tail) { return (unsigned int)head - (unsigned int)tail; }
+
+	T m_Items[SIZE];
+	volatile int m_Head;
+	volatile int m_Tail;
+};
+
+#endif	// __I_THREAD_H__
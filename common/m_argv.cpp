@@ -154,6 +154,12 @@ void DArgs::AppendArg (const char *arg)
 		args.push_back(arg);
 }
 
+void DArgs::SetArg (unsigned int argnum, const char *arg)
+{
+	if(arg && argnum < args.size())
+		args[argnum] = arg;
+}
+
 //
 // IsParam
 //
@@ -922,6 +922,81 @@ void A_Chase (AActor *actor)
 }
 
 
+//
+// P_GatherSightQueries
+//
+// Queues the sight checks that monsters about to call A_Look or A_Chase
+// this tic are likely to make, so that they can be made ahead of time.
+// A wrong guess only costs the check.
+//
+void P_GatherSightQueries()
+{
+	// players a waking monster may look for, by id
+	static AActor* lookable[MAXPLAYERS];
+	memset(lookable, 0, sizeof(lookable));
+
+	int maxid = 0;
+	for (Players::iterator it = players.begin();it != players.end();++it)
+	{
+		if (it->ingame() && !it->spectator && !(it->cheats & CF_NOTARGET) &&
+			it->health > 0 && it->mo)
+		{
+			lookable[it->id - 1] = it->mo;
+			if (it->id > maxid)
+				maxid = it->id;
+		}
+	}
+
+	AActor *mo;
+	TThinkerIterator<AActor> iterator;
+
+	while ( (mo = iterator.Next ()) )
+	{
+		// actions are called when the next state starts
+		if (mo->tics != 1 || !mo->state || !mo->subsector || mo->player ||
+			mo->health <= 0 || (mo->flags2 & MF2_DORMANT))
+			continue;
+
+		actionf_p1 action = states[mo->state->nextstate].action;
+
+		if (action == A_Chase)
+		{
+			AActor *targ = mo->target;
+			if (!targ || (mo->flags & MF_JUSTATTACKED))
+				continue;
+
+			// the checks A_Chase makes on its way to P_Move
+			bool melee = mo->info->meleestate &&
+				P_AproxDistance(targ->x - mo->x, targ->y - mo->y) <
+					MELEERANGE - 20*FRACUNIT + targ->info->radius;
+			bool missile = mo->info->missilestate &&
+				(!mo->movecount || sv_skill == sk_nightmare || sv_fastmonsters);
+			bool retarget = multiplayer && mo->threshold <= 1;
+
+			if (melee || missile || retarget)
+				P_QueueSightCheck(mo, targ);
+		}
+		else if (action == A_Look)
+		{
+			AActor *targ = mo->subsector->sector->soundtarget;
+			if (targ && (mo->flags & MF_AMBUSH))
+				P_QueueSightCheck(mo, targ);
+
+			// P_LookForPlayers checks at most two players from lastlook on
+			int queued = 0;
+			for (int i = 0; i < maxid && queued < 2; i++)
+			{
+				AActor *pmo = lookable[(mo->lastlook + i) % maxid];
+				if (pmo)
+				{
+					P_QueueSightCheck(mo, pmo);
+					queued++;
+				}
+			}
+		}
+	}
+}
+
 //
 // A_FaceTarget
 //
@@ -1392,7 +1467,7 @@ void A_VileChase (AActor *actor)
 				// Call PIT_VileCheck to check
 				// whether object is a corpse
 				// that canbe raised.
-				if (!P_BlockThingsIterator(bx,by,PIT_VileCheck))
+				if (!P_BlockThingsIterator<PIT_VileCheck>(bx, by))
 				{
 					// got one!
 					temp = actor->target;
@@ -1412,6 +1487,7 @@ void A_VileChase (AActor *actor)
 					} else {
 						corpsehit->height = P_ThingInfoHeight(info);	// [RH] Use real mobj height
 						corpsehit->radius = info->radius;	// [RH] Use real radius
+						corpsehit->bmapnode.UpdateBounds();
 					}
 
 					corpsehit->flags = info->flags;
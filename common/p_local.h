@@ -130,6 +130,7 @@ BOOL	P_DeactivateMobj (AActor *mobj);
 // P_ENEMY
 //
 void	P_NoiseAlert (AActor* target, AActor* emmiter);
+void	P_GatherSightQueries();
 void	P_SpawnBrainTargets(void);	// killough 3/26/98: spawn icon landings
 
 extern struct brain_s {				// killough 3/26/98: global state of boss brain
@@ -187,7 +188,7 @@ extern fixed_t			lowfloor;
 void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx=MINFIXED, fixed_t refy=0);
 
 BOOL P_BlockLinesIterator (int x, int y, BOOL(*func)(line_t*) );
-BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *start=NULL);
+void P_InitBlockLines (void);
 
 #define PT_ADDLINES 	1
 #define PT_ADDTHINGS	2
@@ -272,6 +273,13 @@ v3fixed_t P_LinePlaneIntersection(const plane_t *plane, const v3fixed_t &lineorg
 
 bool P_CheckSightEdges(const AActor* t1, const AActor* t2, float radius_boost);
 
+// Sight checks made ahead of time on worker threads, see p_sight.cpp
+void P_SetSightWorkers(int count);		// besides the game thread, 0 to disable
+void P_QueueSightCheck(const AActor* t1, const AActor* t2);
+void P_RunSightQueries();
+void P_ClearSightQueries();				// when the world changes under them
+void P_SightSectorMoved(const sector_t* sector);
+
 bool	P_ChangeSector (sector_t* sector, bool crunch);
 
 extern	AActor*	linetarget; 	// who got hit (or NULL)
@@ -305,11 +313,119 @@ extern int				bmapwidth;
 extern int				bmapheight; 	// in mapblocks
 extern fixed_t			bmaporgx;
 extern fixed_t			bmaporgy;		// origin of block map
-extern AActor** 		blocklinks; 	// for thing chains
 
 extern std::set<short>	movable_sectors;
 
 
+//
+// Actors in mapblocks
+//
+// Each mapblock keeps the actors linked into it in an array, in the order
+// they were linked, along with their radius.  Queries test the actor's
+// current position rather than the one it was linked at, since some code
+// moves actors without relinking them.  The arrays are walked from the end, which is the
+// order the thing chains of older versions were walked in, so demos and
+// netgames keep the same results.
+//
+// Unlinking only clears the entry.  The array is packed when it is linked
+// into again, unless it is being walked at the time.
+//
+struct blockthing_t
+{
+	AActor*		actor;			// NULL once unlinked
+	fixed_t		radius;
+};
+
+struct blockthings_t
+{
+	blockthing_t*	things;
+	int				count;		// including the unlinked entries
+	int				unlinked;
+	int				capacity;
+};
+
+extern blockthings_t*	blockthings;
+extern int				blockthingwalks;	// walks running, no packing meanwhile
+
+//
+// P_BlockThingsIterator
+//
+// Calls func for each actor in mapblock (bx, by) until it returns false,
+// starting after the actor "after" if there is one.  The function is a
+// template parameter so that it is called directly.
+//
+template <BOOL (*func)(AActor*)>
+BOOL P_BlockThingsIterator (int bx, int by, AActor *after = NULL);
+
+//
+// P_BlockThingsInBox
+//
+// Same as P_BlockThingsIterator, but skips the actors that cannot touch a
+// box around (x, y) that extends radius in each direction, the way
+// PIT_CheckThing tests for contact.  Only for functions that ignore such
+// actors anyway.
+//
+template <BOOL (*func)(AActor*)>
+BOOL P_BlockThingsInBox (int bx, int by, fixed_t x, fixed_t y, fixed_t radius,
+						 AActor *after = NULL);
+
+template <BOOL (*func)(AActor*), bool inbox>
+inline BOOL P_WalkBlockThings (int bx, int by, fixed_t x, fixed_t y, fixed_t radius,
+							   AActor *after)
+{
+	if (bx<0 || by<0 || bx>=bmapwidth || by>=bmapheight)
+		return true;
+
+	const blockthings_t &block = blockthings[by*bmapwidth+bx];
+
+	int i = block.count;
+	if (after)
+	{
+		int slot = after->bmapnode.getSlot(bx, by);
+		if (slot >= 0 && slot < block.count)
+			i = slot;
+	}
+
+	BOOL result = true;
+	blockthingwalks++;
+
+	// func may link actors, which can move the array
+	while (--i >= 0)
+	{
+		const blockthing_t &bt = block.things[i];
+
+		if (!bt.actor)
+			continue;
+
+		if (inbox && (abs(bt.actor->x - x) >= bt.radius + radius ||
+					  abs(bt.actor->y - y) >= bt.radius + radius))
+			continue;
+
+		if (!func(bt.actor))
+		{
+			result = false;
+			break;
+		}
+	}
+
+	blockthingwalks--;
+	return result;
+}
+
+template <BOOL (*func)(AActor*)>
+inline BOOL P_BlockThingsIterator (int bx, int by, AActor *after)
+{
+	return P_WalkBlockThings<func, false>(bx, by, 0, 0, 0, after);
+}
+
+template <BOOL (*func)(AActor*)>
+inline BOOL P_BlockThingsInBox (int bx, int by, fixed_t x, fixed_t y, fixed_t radius,
+								AActor *after)
+{
+	return P_WalkBlockThings<func, true>(bx, by, x, y, radius, after);
+}
+
+
 //
 // P_INTER
 //
@@ -216,7 +216,7 @@ BOOL P_TeleportMove (AActor *thing, fixed_t x, fixed_t y, fixed_t z, BOOL telefr
 
 	for (bx=xl ; bx<=xh ; bx++)
 		for (by=yl ; by<=yh ; by++)
-			if (!P_BlockThingsIterator(bx,by,PIT_StompThing))
+			if (!P_BlockThingsInBox<PIT_StompThing>(bx, by, tmx, tmy, tmthing->radius))
 				return false;
 
 	// the move is ok,
@@ -494,7 +494,7 @@ BOOL PIT_CheckLine (line_t *ld)
 //
 // PIT_CheckThing
 //
-static BOOL PIT_CheckThing (AActor *thing)
+BOOL PIT_CheckThing (AActor *thing)
 {
 	bool solid = thing->flags & MF_SOLID;
 
@@ -801,7 +801,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 				AActor *robin = NULL;
 				do
 				{
-					if (!P_BlockThingsIterator (bx, by, PIT_CheckThing, robin))
+					if (!P_BlockThingsInBox<PIT_CheckThing>(bx, by, tmx, tmy, thing->radius, robin))
 					{ // [RH] If a thing can be stepped up on, we need to continue checking
 					  // other things in the blocks and see if we hit something that is
 					  // definitely blocking. Otherwise, we need to check the lines, or we
@@ -817,7 +817,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 							if (thingblocker == NULL ||	BlockingMobj->z > thingblocker->z)
 								thingblocker = BlockingMobj;
 
-							robin = BlockingMobj->bmapnode.Next(bx, by);
+							robin = BlockingMobj;
 							BlockingMobj = NULL;
 						}
 						else if (thing->player &&
@@ -831,7 +831,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 							}
 							// Nothing is blocking us, but this actor potentially could
 							// if there is something else to step on.
-							robin = BlockingMobj->bmapnode.Next(bx, by);
+							robin = BlockingMobj;
 							BlockingMobj = NULL;
 						}
 						else
@@ -860,7 +860,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 		// vanilla Doom's check for blocking things
 		for (int bx=xl ; bx<=xh ; bx++)
 			for (int by=yl ; by<=yh ; by++)
-				if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+				if (!P_BlockThingsInBox<PIT_CheckThing>(bx, by, tmx, tmy, thing->radius))
 					return false;
 
 		if (tmflags & MF_NOCLIP)
@@ -934,7 +934,7 @@ bool P_TestMobjZ (AActor *actor)
 
 	for (bx = xl; bx <= xh; bx++)
 		for (by = yl; by <= yh; by++)
-			if (!P_BlockThingsIterator (bx, by, PIT_CheckOnmobjZ))
+			if (!P_BlockThingsInBox<PIT_CheckOnmobjZ>(bx, by, tmx, tmy, tmthing->radius))
 				return false;
 
 	return true;
@@ -2740,7 +2740,7 @@ CVAR_FUNC_IMPL(sv_splashfactor)
 //
 // "bombsource" is the creature that caused the explosion at "bombspot".
 //
-static BOOL PIT_DoomRadiusAttack(AActor* thing)
+BOOL PIT_DoomRadiusAttack(AActor* thing)
 {
 	if (!serverside || !(thing->flags & MF_SHOOTABLE))
 		return true;
@@ -2776,7 +2776,7 @@ static BOOL PIT_DoomRadiusAttack(AActor* thing)
 // "bombsource" is the creature that caused the explosion at "bombspot".
 // [RH] Now it knows about vertical distances and can thrust things vertically, too.
 //
-static BOOL PIT_ZDoomRadiusAttack(AActor* thing)
+BOOL PIT_ZDoomRadiusAttack(AActor* thing)
 {
 	if (!serverside || !(thing->flags & MF_SHOOTABLE))
 		return true;
@@ -2896,11 +2896,11 @@ void P_RadiusAttack(AActor *spot, AActor *source, int damage, int distance,
 		{
 			for (int x=xl ; x<=xh ; x++)
 			{
-				AActor *mobj = blocklinks[y*bmapwidth+x];
-				while (mobj)
+				const blockthings_t &block = blockthings[y*bmapwidth+x];
+				for (int i = 0; i < block.count; i++)
 				{
-					actorset.insert(mobj);
-					mobj = mobj->bmapnode.Next(x, y);
+					if (block.things[i].actor)
+						actorset.insert(block.things[i].actor);
 				}
 			}
 		}
@@ -2915,8 +2915,15 @@ void P_RadiusAttack(AActor *spot, AActor *source, int damage, int distance,
 	else
 	{
 		for (int y=yl ; y<=yh ; y++)
+		{
 			for (int x=xl ; x<=xh ; x++)
-				P_BlockThingsIterator (x, y, pAttackFunc);
+			{
+				if (co_zdoomphys)
+					P_BlockThingsIterator<PIT_ZDoomRadiusAttack>(x, y);
+				else
+					P_BlockThingsIterator<PIT_DoomRadiusAttack>(x, y);
+			}
+		}
 	}
 }
 
@@ -3056,7 +3063,7 @@ bool P_ChangeSector (sector_t *sector, bool crunch)
 		// re-check heights for all things near the moving sector
 		for (x=sector->blockbox[BOXLEFT] ; x<= sector->blockbox[BOXRIGHT] ; x++)
 			for (y=sector->blockbox[BOXBOTTOM];y<= sector->blockbox[BOXTOP] ; y++)
-				P_BlockThingsIterator (x, y, PIT_ChangeSector);
+				P_BlockThingsIterator<PIT_ChangeSector>(x, y);
 
 	}
 
@@ -3546,6 +3553,7 @@ void P_ChangeCeilingHeight(sector_t *sector, fixed_t amount)
 
 	plane_t *plane = &sector->ceilingplane;
 	plane->d -= FixedMul(amount, plane->c);
+	P_SightSectorMoved(sector);
 
 	// The sector's ceilingheight variable is still used for (among other things)
 	// calculating wall texture offsets
@@ -3559,6 +3567,7 @@ void P_ChangeFloorHeight(sector_t *sector, fixed_t amount)
 
 	plane_t *plane = &sector->floorplane;
 	plane->d -= FixedMul(amount, plane->c);
+	P_SightSectorMoved(sector);
 
 	// The sector's floorheight variable is still used for (among other things)
 	// calculating wall texture offsets
@@ -24,6 +24,10 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
 
 #include "m_bbox.h"
 
@@ -31,6 +35,7 @@
 #include "doomstat.h"
 #include "p_local.h"
 #include "r_data.h"
+#include "z_zone.h"
 
 // State.
 #include "r_state.h"
@@ -96,6 +101,69 @@ subsector_t* P_PointInSubsector(fixed_t x, fixed_t y)
 }
 
 
+//
+// P_PackBlockThings
+//
+// Drops the unlinked entries from the array of a mapblock, keeping the
+// order of the others
+//
+static void P_PackBlockThings(blockthings_t &block, int bmx, int bmy)
+{
+	int count = 0;
+
+	for (int i = 0; i < block.count; i++)
+	{
+		const blockthing_t &bt = block.things[i];
+		if (!bt.actor)
+			continue;
+
+		if (count != i)
+		{
+			block.things[count] = bt;
+			bt.actor->bmapnode.setSlot(bmx, bmy, count);
+		}
+		count++;
+	}
+
+	block.count = count;
+	block.unlinked = 0;
+}
+
+//
+// P_AddBlockThing
+//
+// Appends actor to the array of a mapblock and returns its position
+//
+static int P_AddBlockThing(AActor *actor, int bmx, int bmy)
+{
+	blockthings_t &block = blockthings[bmy * bmapwidth + bmx];
+
+	// the array cannot change order while something is walking it
+	if (block.unlinked > block.count / 2 && blockthingwalks == 0)
+		P_PackBlockThings(block, bmx, bmy);
+
+	if (block.count == block.capacity)
+	{
+		int capacity = block.capacity ? block.capacity * 2 : 4;
+		blockthing_t *things = (blockthing_t *)Z_Malloc(capacity * sizeof(*things), PU_LEVEL, 0);
+
+		if (block.things)
+		{
+			memcpy(things, block.things, block.count * sizeof(*things));
+			Z_Free(block.things);
+		}
+
+		block.things = things;
+		block.capacity = capacity;
+	}
+
+	blockthing_t &bt = block.things[block.count];
+	bt.actor = actor;
+	bt.radius = actor->radius;
+
+	return block.count++;
+}
+
 AActor::ActorBlockMapListNode::ActorBlockMapListNode(AActor *mo) :
 	actor(mo)
 {
@@ -128,35 +196,21 @@ void AActor::ActorBlockMapListNode::Link()
 		if (top < 0) top = 0;
 		if (bottom >= bmapheight) bottom = bmapheight - 1;
 
+		// only actors wider than a mapblock can overlap more blocks than
+		// there are slots for
+		if (right - left >= BLOCKSX) right = left + BLOCKSX - 1;
+		if (bottom - top >= BLOCKSY) bottom = top + BLOCKSY - 1;
+
 		originx = left;
 		originy = top;
 		blockcntx = right - left + 1;
 		blockcnty = bottom - top + 1;
 
-		// [SL] 2012-05-15 - Add the actor to the blocklinks list for all of the
+		// [SL] 2012-05-15 - Add the actor to the blockthings arrays for all of the
 		// blockmaps it overlaps, not just the blockmap for the actor's center point.
 		for (int bmy = top; bmy <= bottom; bmy++)
-		{
 			for (int bmx = left; bmx <= right; bmx++)
-			{
-				// killough 8/11/98: simpler scheme using pointer-to-pointer prev
-				// pointers, allows head nodes to be treated like everything else
-
-				AActor **headptr = &blocklinks[bmy * bmapwidth + bmx];
-				AActor *headactor = *headptr;
-
-				size_t thisidx = getIndex(bmx, bmy);
-				
-		        if ((next[thisidx] = headactor))
-		        {
-		        	size_t nextidx = headactor->bmapnode.getIndex(bmx, bmy);
-					headactor->bmapnode.prev[nextidx] = &next[thisidx];
-				}
-				
-		        prev[thisidx] = headptr;
-		        *headptr = actor;
-			}
-		}
+				slots[getIndex(bmx, bmy)] = P_AddBlockThing(actor, bmx, bmy);
 	}
 	else
 	{
@@ -170,58 +224,76 @@ void AActor::ActorBlockMapListNode::Unlink()
 	{
 		for (int bmx = originx; bmx < originx + blockcntx; bmx++)
 		{
-			// killough 8/11/98: simpler scheme using pointers-to-pointers for prev
-			// pointers, allows head node pointers to be treated like everything else
-			//
-			// Also more robust, since it doesn't depend on current position for
-			// unlinking. Old method required computing head node based on position
-			// at time of unlinking, assuming it was the same position as during
-			// linking.
-
-			size_t thisidx = getIndex(bmx, bmy);
-			
-			AActor *nextactor = next[thisidx];
-			AActor **prevactor = prev[thisidx];
-			
-			if (prevactor && (*prevactor = nextactor))
-			{
-				size_t nextidx = nextactor->bmapnode.getIndex(bmx, bmy);
-				nextactor->bmapnode.prev[nextidx] = prevactor;
-			}
+			blockthings_t &block = blockthings[bmy * bmapwidth + bmx];
+			int slot = slots[getIndex(bmx, bmy)];
+
+			if (slot < 0 || slot >= block.count || block.things[slot].actor != actor)
+				continue;
+
+			block.things[slot].actor = NULL;
+			block.unlinked++;
+
+			// nothing left in the block, start again from the beginning
+			if (block.unlinked == block.count && blockthingwalks == 0)
+				block.count = block.unlinked = 0;
+		}
+	}
+
+	clear();
+}
+
+//
+// UpdateBounds
+//
+// Updates the radius the blockmap entries were made with after the radius
+// of a linked actor was changed, without moving it to other mapblocks
+//
+void AActor::ActorBlockMapListNode::UpdateBounds()
+{
+	for (int bmy = originy; bmy < originy + blockcnty; bmy++)
+	{
+		for (int bmx = originx; bmx < originx + blockcntx; bmx++)
+		{
+			blockthings_t &block = blockthings[bmy * bmapwidth + bmx];
+			int slot = slots[getIndex(bmx, bmy)];
+
+			if (slot >= 0 && slot < block.count && block.things[slot].actor == actor)
+				block.things[slot].radius = actor->radius;
 		}
 	}
 }
 
-AActor* AActor::ActorBlockMapListNode::Next(int bmx, int bmy)
+int AActor::ActorBlockMapListNode::getSlot(int bmx, int bmy) const
 {
-	if (bmx < 0 || bmx >= bmapwidth || bmy < 0 || bmy >= bmapheight)
-		return NULL;
+	int index = getIndex(bmx, bmy);
+	return index < 0 ? -1 : slots[index];
+}
 
-	return next[getIndex(bmx, bmy)];
+void AActor::ActorBlockMapListNode::setSlot(int bmx, int bmy, int slot)
+{
+	int index = getIndex(bmx, bmy);
+	if (index >= 0)
+		slots[index] = slot;
 }
 
 void AActor::ActorBlockMapListNode::clear()
 {
 	originx = originy = 0;
 	blockcntx = blockcnty = 0;
-	memset(prev, 0, sizeof(prev));
-	memset(next, 0, sizeof(next));
+	for (int i = 0; i < BLOCKSX * BLOCKSY; i++)
+		slots[i] = -1;
 }
 
-size_t AActor::ActorBlockMapListNode::getIndex(int bmx, int bmy)
+int AActor::ActorBlockMapListNode::getIndex(int bmx, int bmy) const
 {
-	if (!co_blockmapfix)
-		return 0;
-
 	// range check
 	if (bmx < originx || bmx > originx + blockcntx - 1 ||
 		bmy < originy || bmy > originy + blockcnty - 1)
-		return 0;
+		return -1;
 		
 	return (bmy - originy) * BLOCKSX + bmx - originx;
 }
 
-
 //
 // P_AproxDistance
 // Gives an estimation of distance (not exact)
@@ -708,29 +780,6 @@ BOOL P_BlockLinesIterator (int x, int y, BOOL(*func)(line_t*))
 }
 
 
-//
-// P_BlockThingsIterator
-//
-BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *actor)
-{
-	if (x<0 || y<0 || x>=bmapwidth || y>=bmapheight)
-		return true;
-	else
- 	{
-		AActor *mobj = (actor != NULL ? actor : blocklinks[y*bmapwidth+x]);
-		while (mobj)
- 		{
- 			if (!func (mobj))
- 				return false;
-
-			mobj = mobj->bmapnode.Next(x, y);
-		}
-	}
-	return true;
-}
-
-
-
 //
 // INTERCEPT ROUTINES
 //
@@ -751,12 +800,12 @@ int 			ptflags;
 // are on opposite sides of the trace.
 // Returns true if earlyout and a solid line hit.
 //
-BOOL PIT_AddLineIntercepts (line_t *ld)
+static BOOL P_AddLineIntercept (line_t *ld);
+
+static BOOL PIT_AddLineIntercepts (line_t *ld)
 {
 	int 				s1;
 	int 				s2;
-	fixed_t 			frac;
-	divline_t			dl;
 
 	// avoid precision problems with two routines
 	if ( trace.dx > FRACUNIT*16
@@ -776,6 +825,19 @@ BOOL PIT_AddLineIntercepts (line_t *ld)
 	if (s1 == s2)
 		return true;	// line isn't crossed
 
+	return P_AddLineIntercept (ld);
+}
+
+//
+// P_AddLineIntercept
+// Adds a line known to cross the trace to the intercepts list.
+// Returns false if earlyout and a solid line was hit.
+//
+static BOOL P_AddLineIntercept (line_t *ld)
+{
+	fixed_t 			frac;
+	divline_t			dl;
+
 	// hit the line
 	P_MakeDivline (ld, &dl);
 	frac = P_InterceptVector (&trace, &dl);
@@ -869,37 +931,280 @@ BOOL PIT_AddThingIntercepts (AActor* thing)
 
 
 //
-// P_TraverseIntercepts
-// Returns true if the traverser function returns true
-// for all lines.
+// Line ends in mapblocks
 //
-BOOL P_TraverseIntercepts (traverser_t func, fixed_t maxfrac)
+// P_PathTraverse tests every line in each mapblock along the trace, and
+// most of them are not crossed.  The ends of the lines in each mapblock's
+// list are copied into arrays of their own so that the side tests run over
+// contiguous data instead of going through the line and its vertexes.
+// Polyobject vertexes move, so mapblocks holding such lines copy them
+// again before each use.
+//
+static int			*blocklinestart;	// first entry of each mapblock
+static int			*blocklinenums;
+static fixed_t		*blocklinex1;
+static fixed_t		*blockliney1;
+static fixed_t		*blocklinex2;
+static fixed_t		*blockliney2;
+static byte			*blocklinemoving;	// mapblock has polyobject lines
+static byte			*blocklinecrossed;	// P_CrossTrace results
+
+// lines already handled by the current trace
+static std::vector<int>	tracelinemarks;
+static int				tracelinecount;
+
+//
+// P_InitBlockLines
+// Called after the polyobjects were spawned.
+//
+void P_InitBlockLines (void)
 {
-	size_t 				count = intercepts.Size();
-	fixed_t 			dist;
-	size_t		scan;
-	intercept_t*		in = 0;
+	const int numblocks = bmapwidth * bmapheight;
 
-	while (count--)
+	std::vector<byte> moving(numvertexes, 0);
+	for (int i = 0; i < po_NumPolyobjs; i++)
 	{
-		dist = MAXINT;
-		for (scan = 0 ; scan < intercepts.Size(); scan++)
+		for (int j = 0; j < polyobjs[i].numsegs; j++)
 		{
-			if (intercepts[scan].frac < dist)
+			moving[polyobjs[i].segs[j]->v1 - vertexes] = 1;
+			moving[polyobjs[i].segs[j]->v2 - vertexes] = 1;
+		}
+	}
+
+	blocklinestart = (int *)Z_Malloc ((numblocks + 1) * sizeof(int), PU_LEVEL, 0);
+
+	int total = 0, longest = 0;
+	for (int i = 0; i < numblocks; i++)
+	{
+		const int *list = blockmaplump + blockmap[i];
+		int count = 0;
+
+		while (list[count] != -1)
+			count++;
+
+		blocklinestart[i] = total;
+		total += count;
+		longest = MAX(longest, count);
+	}
+	blocklinestart[numblocks] = total;
+
+	blocklinenums = (int *)Z_Malloc (MAX(total, 1) * sizeof(int), PU_LEVEL, 0);
+	blocklinex1 = (fixed_t *)Z_Malloc (MAX(total, 1) * sizeof(fixed_t), PU_LEVEL, 0);
+	blockliney1 = (fixed_t *)Z_Malloc (MAX(total, 1) * sizeof(fixed_t), PU_LEVEL, 0);
+	blocklinex2 = (fixed_t *)Z_Malloc (MAX(total, 1) * sizeof(fixed_t), PU_LEVEL, 0);
+	blockliney2 = (fixed_t *)Z_Malloc (MAX(total, 1) * sizeof(fixed_t), PU_LEVEL, 0);
+	blocklinemoving = (byte *)Z_Malloc (MAX(numblocks, 1), PU_LEVEL, 0);
+	blocklinecrossed = (byte *)Z_Malloc (MAX(longest, 1), PU_LEVEL, 0);
+
+	for (int i = 0; i < numblocks; i++)
+	{
+		const int *list = blockmaplump + blockmap[i];
+
+		blocklinemoving[i] = 0;
+
+		for (int j = blocklinestart[i]; j < blocklinestart[i + 1]; j++, list++)
+		{
+			const line_t *ld = &lines[*list];
+
+			blocklinenums[j] = *list;
+			blocklinex1[j] = ld->v1->x;
+			blockliney1[j] = ld->v1->y;
+			blocklinex2[j] = ld->v2->x;
+			blockliney2[j] = ld->v2->y;
+
+			if (moving[ld->v1 - vertexes] || moving[ld->v2 - vertexes])
+				blocklinemoving[i] = 1;
+		}
+	}
+
+	tracelinemarks.assign(numlines, 0);
+	tracelinecount = 0;
+}
+
+//
+// P_TraceSide
+// P_PointOnDivlineSide for the trace when neither of its deltas is zero,
+// without branches.
+//
+static inline int P_TraceSide (fixed_t x, fixed_t y)
+{
+	fixed_t dx = x - trace.x;
+	fixed_t dy = y - trace.y;
+
+	// try to quickly decide by looking at sign bits
+	int quick = (unsigned int)(trace.dy ^ trace.dx ^ dx ^ dy) >> 31;
+	int back = (unsigned int)(trace.dy ^ dx) >> 31;
+	int slow = FixedMul (dy >> 8, trace.dx >> 8) >= FixedMul (trace.dy >> 8, dx >> 8);
+
+	return quick ? back : slow;
+}
+
+//
+// P_CrossTrace
+// Sets crossed[i] for each of the lines whose ends are on different sides
+// of the trace, the same way PIT_AddLineIntercepts tests long traces.
+//
+static void P_CrossTrace (const fixed_t *x1, const fixed_t *y1,
+						  const fixed_t *x2, const fixed_t *y2, byte *crossed, int count)
+{
+	const fixed_t tx = trace.x;
+	const fixed_t ty = trace.y;
+	const fixed_t tdx = trace.dx;
+	const fixed_t tdy = trace.dy;
+
+	if (co_zdoomphys)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int s1 = int64_t(y1[i] - ty) * int64_t(tdx) + int64_t(tx - x1[i]) * int64_t(tdy) >= 0;
+			int s2 = int64_t(y2[i] - ty) * int64_t(tdx) + int64_t(tx - x2[i]) * int64_t(tdy) >= 0;
+			crossed[i] = s1 != s2;
+		}
+	}
+	else if (!tdx)
+	{
+		for (int i = 0; i < count; i++)
+			crossed[i] = (x1[i] <= tx) != (x2[i] <= tx);
+	}
+	else if (!tdy)
+	{
+		for (int i = 0; i < count; i++)
+			crossed[i] = (y1[i] <= ty) != (y2[i] <= ty);
+	}
+	else
+	{
+		for (int i = 0; i < count; i++)
+			crossed[i] = P_TraceSide (x1[i], y1[i]) != P_TraceSide (x2[i], y2[i]);
+	}
+}
+
+//
+// P_MarkTraceLine
+// Returns false if the current trace already handled the line.
+//
+static inline bool P_MarkTraceLine (const line_t *ld)
+{
+	int &mark = tracelinemarks[ld - lines];
+	if (mark == tracelinecount)
+		return false;
+
+	mark = tracelinecount;
+	return true;
+}
+
+//
+// P_AddBlockLineIntercepts
+// Adds the lines of a mapblock that intercept the trace, in the order
+// P_BlockLinesIterator would pass them to PIT_AddLineIntercepts.
+// Returns false if earlyout and a solid line was hit.
+//
+static BOOL P_AddBlockLineIntercepts (int x, int y)
+{
+	if (x<0 || y<0 || x>=bmapwidth || y>=bmapheight)
+		return true;
+
+	const int offset = y*bmapwidth + x;
+
+	if (PolyBlockMap)
+	{
+		for (polyblock_t *polyLink = PolyBlockMap[offset]; polyLink; polyLink = polyLink->next)
+		{
+			if (!polyLink->polyobj || polyLink->polyobj->validcount == validcount)
+				continue;
+
+			polyLink->polyobj->validcount = validcount;
+
+			seg_t **tempSeg = polyLink->polyobj->segs;
+			for (int i = polyLink->polyobj->numsegs; i; i--, tempSeg++)
 			{
-				dist = intercepts[scan].frac;
-				in = &intercepts[scan];
+				line_t *ld = (*tempSeg)->linedef;
+				if (P_MarkTraceLine (ld) && !PIT_AddLineIntercepts (ld))
+					return false;
 			}
 		}
+	}
 
-		if (dist > maxfrac)
-			return true;		// checked everything in range
+	int first = blocklinestart[offset];
+	const int last = blocklinestart[offset + 1];
 
+	// see P_BlockLinesIterator
+	if (co_blockmapfix && first < last)
+		first++;
 
-		if ( !func (in) )
-			return false;		// don't bother going farther
+	// short traces are tested against the lines instead
+	if (trace.dx <= FRACUNIT*16 && trace.dy <= FRACUNIT*16 &&
+		trace.dx >= -FRACUNIT*16 && trace.dy >= -FRACUNIT*16)
+	{
+		for (int i = first; i < last; i++)
+		{
+			line_t *ld = &lines[blocklinenums[i]];
+			if (P_MarkTraceLine (ld) && !PIT_AddLineIntercepts (ld))
+				return false;
+		}
+		return true;
+	}
+
+	if (blocklinemoving[offset])
+	{
+		for (int i = first; i < last; i++)
+		{
+			const line_t *ld = &lines[blocklinenums[i]];
+			blocklinex1[i] = ld->v1->x;
+			blockliney1[i] = ld->v1->y;
+			blocklinex2[i] = ld->v2->x;
+			blockliney2[i] = ld->v2->y;
+		}
+	}
+
+	P_CrossTrace (blocklinex1 + first, blockliney1 + first,
+				  blocklinex2 + first, blockliney2 + first, blocklinecrossed, last - first);
 
-		in->frac = MAXINT;
+	// lines that are not crossed are not crossed from any other mapblock
+	// either, so only the crossed ones need to be marked
+	for (int i = first; i < last; i++)
+	{
+		if (!blocklinecrossed[i - first])
+			continue;
+
+		line_t *ld = &lines[blocklinenums[i]];
+		if (P_MarkTraceLine (ld) && !P_AddLineIntercept (ld))
+			return false;
+	}
+
+	return true;
+}
+
+
+//
+// P_TraverseIntercepts
+// Returns true if the traverser function returns true
+// for all lines.
+//
+BOOL P_TraverseIntercepts (traverser_t func, fixed_t maxfrac)
+{
+	// Most traversals stop at the first few intercepts, so they are taken
+	// off a heap instead of being sorted.  Intercepts at the same distance
+	// are taken in the order they were found in.
+	static std::vector<std::pair<fixed_t, size_t> > heap;
+
+	heap.clear();
+	for (size_t i = 0; i < intercepts.Size(); i++)
+		heap.push_back(std::make_pair(intercepts[i].frac, i));
+
+	std::greater<std::pair<fixed_t, size_t> > nearer;
+	std::make_heap(heap.begin(), heap.end(), nearer);
+
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), nearer);
+		const std::pair<fixed_t, size_t> next = heap.back();
+		heap.pop_back();
+
+		if (next.first > maxfrac)
+			return true;		// checked everything in range
+
+		if ( !func (&intercepts[next.second]) )
+			return false;		// don't bother going farther
 	}
 
 	return true;				// everything was traversed
@@ -941,6 +1246,7 @@ BOOL P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int flags,
 	earlyout = flags & PT_EARLYOUT;
 
 	validcount++;
+	tracelinecount++;
 
 	intercepts.Clear();
 
@@ -1017,13 +1323,13 @@ BOOL P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int flags,
 	{
 		if (flags & PT_ADDLINES)
 		{
-			if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
+			if (!P_AddBlockLineIntercepts (mapx, mapy))
 				return false;	// early out
 		}
 
 		if (flags & PT_ADDTHINGS)
 		{
-			if (!P_BlockThingsIterator (mapx, mapy,PIT_AddThingIntercepts))
+			if (!P_BlockThingsIterator<PIT_AddThingIntercepts>(mapx, mapy))
 				return false;	// early out
 		}
 
@@ -107,40 +107,37 @@ void MapThing::Serialize (FArchive &arc)
 }
 
 AActor::AActor () :
-    x(0), y(0), z(0), prevx(0), prevy(0), prevz(0),
-	snext(NULL), sprev(NULL), angle(0), prevangle(0), sprite(SPR_UNKN), frame(0),
-    pitch(0), prevpitch(0), effects(0), subsector(NULL),
-    floorz(0), ceilingz(0), dropoffz(0), floorsector(NULL), radius(0), height(0),
-    momx(0), momy(0), momz(0), validcount(0), type(MT_UNKNOWNTHING), info(NULL), tics(0), state(NULL),
-    damage(0), flags(0), flags2(0), oflags(0), special1(0), special2(0), health(0), movedir(0), movecount(0),
-    visdir(0), reactiontime(0), threshold(0), player(NULL), lastlook(0), special(0), inext(NULL),
-    iprev(NULL), translation(translationref_t()), translucency(0), waterlevel(0), gear(0), onground(false),
-    touching_sectorlist(NULL), deadtic(0), oldframe(0), rndindex(0), netid(0),
-    tid(0), bmapnode(this)
+    x(0), y(0), z(0), momx(0), momy(0), momz(0), radius(0), height(0), floorz(0), ceilingz(0),
+    flags(0), flags2(0), oflags(0), health(0), type(MT_UNKNOWNTHING), netid(0), angle(0),
+    validcount(0), subsector(NULL), player(NULL), info(NULL), state(NULL), tics(0), movecount(0),
+    dropoffz(0), floorsector(NULL), reactiontime(0), threshold(0), special1(0), special2(0),
+    damage(0), lastlook(0), sprite(SPR_UNKN), frame(0), effects(0), pitch(0), translucency(0),
+    movedir(0), visdir(0), waterlevel(0), onground(false), rndindex(0), deadtic(0), prevx(0),
+    prevy(0), prevz(0), prevangle(0), prevpitch(0), snext(NULL), sprev(NULL),
+    touching_sectorlist(NULL), special(0), gear(0), tid(0), oldframe(0), inext(NULL), iprev(NULL),
+    translation(translationref_t()), bmapnode(this)
 {
 	memset(args, 0, sizeof(args));
 	self.init(this);
 }
 
 AActor::AActor (const AActor &other) :
-    x(other.x), y(other.y), z(other.z), prevx(other.prevx), prevy(other.prevy), prevz(other.prevz),
-	snext(other.snext), sprev(other.sprev),
-    angle(other.angle), prevangle(other.prevangle), sprite(other.sprite), frame(other.frame),
-    pitch(other.pitch), prevpitch(other.prevpitch), effects(other.effects),
-    subsector(other.subsector),
-    floorz(other.floorz), ceilingz(other.ceilingz), dropoffz(other.dropoffz),
-    floorsector(other.floorsector),	radius(other.radius), height(other.height), momx(other.momx),
-	momy(other.momy), momz(other.momz), validcount(other.validcount),
-	type(other.type), info(other.info), tics(other.tics), state(other.state),
-	damage(other.damage), flags(other.flags), flags2(other.flags2), oflags(other.oflags), special1(other.special1),
-	special2(other.special2), health(other.health), movedir(other.movedir),
-	movecount(other.movecount), visdir(other.visdir), reactiontime(other.reactiontime),
-    threshold(other.threshold), player(other.player), lastlook(other.lastlook),
-    special(other.special),inext(other.inext), iprev(other.iprev), translation(other.translation),
-    translucency(other.translucency), waterlevel(other.waterlevel), gear(other.gear),
-    onground(other.onground), touching_sectorlist(other.touching_sectorlist),
-    deadtic(other.deadtic), oldframe(other.oldframe),
-    rndindex(other.rndindex), netid(other.netid), tid(other.tid), bmapnode(other.bmapnode)
+    x(other.x), y(other.y), z(other.z), momx(other.momx), momy(other.momy), momz(other.momz),
+    radius(other.radius), height(other.height), floorz(other.floorz), ceilingz(other.ceilingz),
+    flags(other.flags), flags2(other.flags2), oflags(other.oflags), health(other.health),
+    type(other.type), netid(other.netid), angle(other.angle), validcount(other.validcount),
+    subsector(other.subsector), player(other.player), info(other.info), state(other.state),
+    tics(other.tics), movecount(other.movecount), dropoffz(other.dropoffz),
+    floorsector(other.floorsector), reactiontime(other.reactiontime), threshold(other.threshold),
+    special1(other.special1), special2(other.special2), damage(other.damage),
+    lastlook(other.lastlook), sprite(other.sprite), frame(other.frame), effects(other.effects),
+    pitch(other.pitch), translucency(other.translucency), movedir(other.movedir),
+    visdir(other.visdir), waterlevel(other.waterlevel), onground(other.onground),
+    rndindex(other.rndindex), deadtic(other.deadtic), prevx(other.prevx), prevy(other.prevy),
+    prevz(other.prevz), prevangle(other.prevangle), prevpitch(other.prevpitch), snext(other.snext),
+    sprev(other.sprev), touching_sectorlist(other.touching_sectorlist), special(other.special),
+    gear(other.gear), tid(other.tid), oldframe(other.oldframe), inext(other.inext),
+    iprev(other.iprev), translation(other.translation), bmapnode(other.bmapnode)
 {
 	memcpy(args, other.args, sizeof(args));
 	self.init(this);
@@ -219,16 +216,15 @@ AActor &AActor::operator= (const AActor &other)
 //
 
 AActor::AActor (fixed_t ix, fixed_t iy, fixed_t iz, mobjtype_t itype) :
-    x(0), y(0), z(0), prevx(0), prevy(0), prevz(0),
-	snext(NULL), sprev(NULL), angle(0), prevangle(0), sprite(SPR_UNKN), frame(0),
-    pitch(0), prevpitch(0), effects(0), subsector(NULL),
-    floorz(0), ceilingz(0), dropoffz(0), floorsector(NULL), radius(0), height(0), momx(0), momy(0), momz(0),
-    validcount(0), type(MT_UNKNOWNTHING), info(NULL), tics(0), state(NULL), damage(0), flags(0), flags2(0), oflags(0),
-    special1(0), special2(0), health(0), movedir(0), movecount(0), visdir(0),
-    reactiontime(0), threshold(0), player(NULL), lastlook(0), special(0), inext(NULL),
-    iprev(NULL), translation(translationref_t()), translucency(0), waterlevel(0), gear(0), onground(false),
-    touching_sectorlist(NULL), deadtic(0), oldframe(0), rndindex(0), netid(0),
-    tid(0), bmapnode(this)
+    x(0), y(0), z(0), momx(0), momy(0), momz(0), radius(0), height(0), floorz(0), ceilingz(0),
+    flags(0), flags2(0), oflags(0), health(0), type(MT_UNKNOWNTHING), netid(0), angle(0),
+    validcount(0), subsector(NULL), player(NULL), info(NULL), state(NULL), tics(0), movecount(0),
+    dropoffz(0), floorsector(NULL), reactiontime(0), threshold(0), special1(0), special2(0),
+    damage(0), lastlook(0), sprite(SPR_UNKN), frame(0), effects(0), pitch(0), translucency(0),
+    movedir(0), visdir(0), waterlevel(0), onground(false), rndindex(0), deadtic(0), prevx(0),
+    prevy(0), prevz(0), prevangle(0), prevpitch(0), snext(NULL), sprev(NULL),
+    touching_sectorlist(NULL), special(0), gear(0), tid(0), oldframe(0), inext(NULL), iprev(NULL),
+    translation(translationref_t()), bmapnode(this)
 {
 	state_t *st;
 
@@ -2621,6 +2617,7 @@ void P_SpawnMapThing (mapthing2_t *mthing, int position)
 	{
 		mobj->radius = mobj->args[0] << FRACBITS;
 		mobj->height = mobj->args[1] << FRACBITS;
+		mobj->bmapnode.UpdateBounds();
 	}
 
 	// [AM] Adjust monster health based on server setting
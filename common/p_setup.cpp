@@ -47,6 +47,7 @@
 #include "c_console.h"
 
 #include "p_setup.h"
+#include "r_pvs.h"
 
 void SV_PreservePlayer(player_t &player);
 void P_SpawnMapThing (mapthing2_t *mthing, int position);
@@ -108,7 +109,8 @@ int				*blockmaplump;	// offsets in blockmap are from here
 fixed_t 		bmaporgx;		// origin of block map
 fixed_t 		bmaporgy;
 
-AActor**		blocklinks;		// for thing chains
+blockthings_t*	blockthings;	// actors in each mapblock
+int				blockthingwalks;
 
 
 
@@ -1417,9 +1419,10 @@ void P_LoadBlockMap (int lump)
 	bmapheight = blockmaplump[3];
 
 	// clear out mobj chains
-	count = sizeof(*blocklinks) * bmapwidth*bmapheight;
-	blocklinks = (AActor **)Z_Malloc (count, PU_LEVEL, 0);
-	memset (blocklinks, 0, count);
+	count = sizeof(*blockthings) * bmapwidth*bmapheight;
+	blockthings = (blockthings_t *)Z_Malloc (count, PU_LEVEL, 0);
+	memset (blockthings, 0, count);
+	blockthingwalks = 0;
 	blockmap = blockmaplump+4;
 }
 
@@ -1764,6 +1767,7 @@ void P_SetupLevel (char *lumpname, int position)
 		P_TranslateTeleportThings ();	// [RH] Assign teleport destination TIDs
 
     PO_Init ();
+    P_InitBlockLines ();
 
     if (serverside)
     {
@@ -1796,6 +1800,8 @@ void P_SetupLevel (char *lumpname, int position)
 	// preload graphics
 	if (precache)
 		R_PrecacheLevel ();
+
+	R_BuildPVS();
 #endif
 }
 
@@ -24,13 +24,17 @@
 //-----------------------------------------------------------------------------
 
 
+#include <vector>
+
 #include "doomdef.h"
 
 #include "i_system.h"
+#include "i_thread.h"
 #include "p_local.h"
 #include "m_random.h"
 #include "m_bbox.h"
 #include "m_vectors.h"
+#include "hashtable.h"
 
 // State.
 #include "r_state.h"
@@ -42,13 +46,35 @@ fixed_t		sightzstart;		// eye z of looker
 fixed_t		topslope;
 fixed_t		bottomslope;		// slopes to top and bottom of target
 
-divline_t	strace;			// from t1 to t2
-fixed_t		t2x;
-fixed_t		t2y;
-
 int		sightcounts[2];
 int		sightcounts2[3];
 
+//
+// sighttrace_t
+//
+// State of a vanilla sight check.  Each thread that checks sight has one
+// of its own, including its own marks for the lines already crossed, so
+// that checks can run side by side as long as the world holds still.
+//
+struct sighttrace_t
+{
+	fixed_t		sightzstart;		// eye z of looker
+	fixed_t		topslope;
+	fixed_t		bottomslope;		// slopes to top and bottom of target
+
+	divline_t	strace;				// from t1 to t2
+	fixed_t		t2x;
+	fixed_t		t2y;
+
+	int					validcount;
+	std::vector<int>	linemarks;	// validcount of each line for this trace
+
+	bool				recordsectors;
+	std::vector<int>	sectors;	// sectors whose heights the traces read
+};
+
+static sighttrace_t gametrace;
+
 extern bool HasBehavior;
 EXTERN_CVAR (co_zdoomphys)
 
@@ -608,9 +634,9 @@ P_InterceptVector2
 //
 // P_CrossSubsector
 // Returns true
-//  if strace crosses the given subsector successfully.
+//  if the trace crosses the given subsector successfully.
 //
-bool P_CrossSubsector (int num)
+static bool P_CrossSubsector (sighttrace_t* st, int num)
 {
     seg_t*		seg;
     line_t*		line;
@@ -646,15 +672,16 @@ bool P_CrossSubsector (int num)
 		line = seg->linedef;
 		
 		// allready checked other side?
-		if (line->validcount == validcount)
+		int& mark = st->linemarks[line - lines];
+		if (mark == st->validcount)
 			continue;
 		
-		line->validcount = validcount;
+		mark = st->validcount;
 		
 		v1 = line->v1;
 		v2 = line->v2;
-		s1 = P_DivlineSide (v1->x,v1->y, &strace);
-		s2 = P_DivlineSide (v2->x, v2->y, &strace);
+		s1 = P_DivlineSide (v1->x,v1->y, &st->strace);
+		s2 = P_DivlineSide (v2->x, v2->y, &st->strace);
 		
 		// line isn't crossed?
 		if (s1 == s2)
@@ -664,8 +691,8 @@ bool P_CrossSubsector (int num)
 		divl.y = v1->y;
 		divl.dx = v2->x - v1->x;
 		divl.dy = v2->y - v1->y;
-		s1 = P_DivlineSide (strace.x, strace.y, &divl);
-		s2 = P_DivlineSide (t2x, t2y, &divl);
+		s1 = P_DivlineSide (st->strace.x, st->strace.y, &divl);
+		s2 = P_DivlineSide (st->t2x, st->t2y, &divl);
 		
 		// line isn't crossed?
 		if (s1 == s2)
@@ -680,7 +707,13 @@ bool P_CrossSubsector (int num)
 		front = seg->frontsector;
 		back = seg->backsector;
 
-		frac = P_InterceptVector2 (&strace, &divl);
+		if (st->recordsectors)
+		{
+			st->sectors.push_back(front - sectors);
+			st->sectors.push_back(back - sectors);
+		}
+
+		frac = P_InterceptVector2 (&st->strace, &divl);
 		
 		// no wall to block sight with?
 		fixed_t crossx = divl.x + FixedMul(frac, divl.dx);
@@ -713,19 +746,19 @@ bool P_CrossSubsector (int num)
 		
 		if (ff != bf)
 		{
-			slope = FixedDiv (openbottom - sightzstart , frac);
-			if (slope > bottomslope)
-				bottomslope = slope;
+			slope = FixedDiv (openbottom - st->sightzstart , frac);
+			if (slope > st->bottomslope)
+				st->bottomslope = slope;
 		}
 		
 		if (fc != bc)
 		{
-			slope = FixedDiv (opentop - sightzstart , frac);
-			if (slope < topslope)
-				topslope = slope;
+			slope = FixedDiv (opentop - st->sightzstart , frac);
+			if (slope < st->topslope)
+				st->topslope = slope;
 		}
 		
-		if (topslope <= bottomslope)
+		if (st->topslope <= st->bottomslope)
 			return false;		// stop				
     }
     // passed the subsector ok
@@ -737,9 +770,9 @@ bool P_CrossSubsector (int num)
 //
 // P_CrossBSPNode
 // Returns true
-//  if strace crosses the given node successfully.
+//  if the trace crosses the given node successfully.
 //
-bool P_CrossBSPNode (int bspnum)
+static bool P_CrossBSPNode (sighttrace_t* st, int bspnum)
 {
     node_t*	bsp;
     int		side;
@@ -747,62 +780,103 @@ bool P_CrossBSPNode (int bspnum)
     if (bspnum & NF_SUBSECTOR)
     {
 		if (bspnum == -1)
-			return P_CrossSubsector (0);
+			return P_CrossSubsector (st, 0);
 		else
-			return P_CrossSubsector (bspnum&(~NF_SUBSECTOR));
+			return P_CrossSubsector (st, bspnum&(~NF_SUBSECTOR));
     }
 	
     bsp = &nodes[bspnum];
     
     // decide which side the start point is on
-    side = P_DivlineSide (strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide (st->strace.x, st->strace.y, (divline_t *)bsp);
     if (side == 2)
 		side = 0;	// an "on" should cross both sides
 	
     // cross the starting side
-    if (!P_CrossBSPNode (bsp->children[side]) )
+    if (!P_CrossBSPNode (st, bsp->children[side]) )
 		return false;
 	
     // the partition plane is crossed here
-    if (side == P_DivlineSide (t2x, t2y,(divline_t *)bsp))
+    if (side == P_DivlineSide (st->t2x, st->t2y,(divline_t *)bsp))
     {
 		// the line doesn't touch the other side
 		return true;
     }
     
     // cross the ending side		
-    return P_CrossBSPNode (bsp->children[side^1]);
+    return P_CrossBSPNode (st, bsp->children[side^1]);
 }
 
 
 //
-// P_CheckSight
-// Returns true
-//  if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_CheckReject
+// Returns true if the REJECT table says nothing in sector s1 can
+// possibly see into sector s2.
 //
-bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
+static bool P_CheckReject (const sector_t* s1, const sector_t* s2)
 {
-    int		s1;
-    int		s2;
     int		pnum;
     int		bytenum;
     int		bitnum;
 
-	if(!t1 || !t2 || !t1->subsector || !t2->subsector)
+    if (rejectempty)
 		return false;
-    
-    // First check for trivial rejection.
 	
     // Determine subsector entries in REJECT table.
-    s1 = (t1->subsector->sector - sectors);
-    s2 = (t2->subsector->sector - sectors);
-    pnum = s1*numsectors + s2;
+    pnum = (s1 - sectors)*numsectors + (s2 - sectors);
     bytenum = pnum>>3;
     bitnum = 1 << (pnum&7);
 	
-    // Check in REJECT table.
-    if (!rejectempty && rejectmatrix[bytenum]&bitnum)
+    return (rejectmatrix[bytenum]&bitnum) != 0;
+}
+
+//
+// P_CheckSightTrace
+// Returns true if a straight line from the eyes of a looker at
+// (x1, y1, z1) with height h1 to any part of a target at (x2, y2, z2)
+// with height h2 is unobstructed.  Changes nothing but st.
+//
+static bool P_CheckSightTrace
+( sighttrace_t* st,
+  fixed_t x1, fixed_t y1, fixed_t z1, fixed_t h1,
+  fixed_t x2, fixed_t y2, fixed_t z2, fixed_t h2 )
+{
+	if (st->linemarks.size() != (size_t)numlines)
+	{
+		st->linemarks.assign(numlines, 0);
+		st->validcount = 0;
+	}
+
+    st->validcount++;
+	
+    st->sightzstart = z1 + h1 - (h1>>2);
+    st->topslope = (z2+h2) - st->sightzstart;
+    st->bottomslope = (z2) - st->sightzstart;
+	
+    st->strace.x = x1;
+    st->strace.y = y1;
+    st->t2x = x2;
+    st->t2y = y2;
+    st->strace.dx = x2 - x1;
+    st->strace.dy = y2 - y1;
+	
+    // the head node is the last node output
+    return P_CrossBSPNode (st, numnodes-1);	
+}
+
+//
+// P_CheckSight
+// Returns true
+//  if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
+{
+	if(!t1 || !t2 || !t1->subsector || !t2->subsector)
+		return false;
+    
+    // First check for trivial rejection.
+    if (P_CheckReject(t1->subsector->sector, t2->subsector->sector))
     {
 		sightcounts[0]++;
 		
@@ -814,21 +888,8 @@ bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 	
-    validcount++;
-	
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
-	
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
-	
-    // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    return P_CheckSightTrace(&gametrace, t1->x, t1->y, t1->z, t1->height,
+							 t2->x, t2->y, t2->z, t2->height);
 }
 
 //
@@ -841,23 +902,9 @@ static bool P_CheckSightDoom
 ( fixed_t x1, fixed_t y1, fixed_t z1, fixed_t h1,
   fixed_t x2, fixed_t y2, fixed_t z2, fixed_t h2 )
 {
-    int		s1;
-    int		s2;
-    int		pnum;
-    int		bytenum;
-    int		bitnum;
-    
     // First check for trivial rejection.
-	
-    // Determine subsector entries in REJECT table.
-    s1 = (P_PointInSubsector(x1, y1)->sector - sectors);
-    s2 = (P_PointInSubsector(x2, y2)->sector - sectors);
-    pnum = s1*numsectors + s2;
-    bytenum = pnum>>3;
-    bitnum = 1 << (pnum&7);
-	
-    // Check in REJECT table.
-    if (!rejectempty && rejectmatrix[bytenum]&bitnum)
+    if (P_CheckReject(P_PointInSubsector(x1, y1)->sector,
+					  P_PointInSubsector(x2, y2)->sector))
     {
 		sightcounts[0]++;
 		
@@ -869,29 +916,335 @@ static bool P_CheckSightDoom
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 	
-    validcount++;
-	
-    sightzstart = z1 + h1 - (h1>>2);
-    topslope = (z2+h2) - sightzstart;
-    bottomslope = (z2) - sightzstart;
-	
-    strace.x = x1;
-    strace.y = y1;
-    t2x = x2;
-    t2y = y2;
-    strace.dx = x2 - x1;
-    strace.dy = y2 - y1;
-	
-    // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    return P_CheckSightTrace(&gametrace, x1, y1, z1, h1, x2, y2, z2, h2);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//  Sight Queries
+//
+//  Monsters spend much of their thinking checking whether they can see
+//  their target.  Before the thinkers run, P_GatherSightQueries queues the
+//  checks they are about to make and worker threads make them while the
+//  world holds still.  P_CheckSight then answers from those results as long
+//  as neither actor has moved and none of the sectors whose heights the
+//  trace looked at has moved a plane since, so the outcome is exactly what
+//  checking on the spot would give.  Only the vanilla sight check is made
+//  ahead of time.
+/////////////////////////////////////////////////////////////////////////////
+
+struct sightquery_t
+{
+	const AActor*		t1;
+	const AActor*		t2;
+
+	// what the answer depends on
+	const subsector_t*	ss1;
+	const subsector_t*	ss2;
+	fixed_t				x1, y1, z1, h1;
+	fixed_t				x2, y2, z2, h2;
+
+	// the sectors whose heights the trace read, in trace->sectors
+	const sighttrace_t*	trace;
+	unsigned int		firstsector;
+	unsigned int		numsectors;
+
+	bool				result;
+};
+
+struct sightqueryhash
+{
+	unsigned int operator()(const AActor* mo) const
+	{
+		return hashfunc<void*>()((void*)mo);
+	}
+};
+
+// index of the first query made by each looker, whose queries are kept
+// together
+typedef OHashTable<const AActor*, size_t, sightqueryhash> SightQueryTable;
+
+static std::vector<sightquery_t> sightqueries;
+static SightQueryTable sightquerytable;
+static bool sightqueriesvalid = false;
+
+// the sightbatch during which each sector last moved a plane
+static std::vector<int> sightsectormoved;
+static int sightbatch = 0;
+
+static const int MAX_SIGHT_WORKERS = 16;
+static const int SIGHT_QUERY_CHUNK = 32;
+
+struct sightworker_t
+{
+	OThread			thread;
+	OEvent			wake;
+	sighttrace_t	trace;
+};
+
+static sightworker_t sightworkers[MAX_SIGHT_WORKERS];
+static int sightworkerswanted = 0;	// 0 to make sight checks as they come up
+static int sightworkercount = 0;	// worker threads running
+static bool sightatterm = false;
+
+static volatile int sightquit = 0;
+static volatile int sightnext = 0;		// first query nobody has taken yet
+static volatile int sightfinished = 0;	// workers done with the batch
+static OEvent sightdone;
+
+//
+// P_RunSightQueryChunks
+//
+// Makes the queries of the current batch that no other thread has taken
+// yet, a chunk at a time
+//
+static void P_RunSightQueryChunks(sighttrace_t* st)
+{
+	const int count = (int)sightqueries.size();
+
+	st->recordsectors = true;
+
+	while (true)
+	{
+		int end = I_AtomicAdd(&sightnext, SIGHT_QUERY_CHUNK);
+		int start = end - SIGHT_QUERY_CHUNK;
+
+		if (start >= count)
+			break;
+		if (end > count)
+			end = count;
+
+		for (int i = start; i < end; i++)
+		{
+			sightquery_t& q = sightqueries[i];
+
+			q.trace = st;
+			q.firstsector = st->sectors.size();
+			q.result = !P_CheckReject(q.ss1->sector, q.ss2->sector) &&
+					   P_CheckSightTrace(st, q.x1, q.y1, q.z1, q.h1,
+										 q.x2, q.y2, q.z2, q.h2);
+			q.numsectors = st->sectors.size() - q.firstsector;
+		}
+	}
+
+	st->recordsectors = false;
+}
+
+static void P_SightWorkerThread(void* data)
+{
+	sightworker_t* worker = (sightworker_t*)data;
+
+	while (true)
+	{
+		if (!worker->wake.wait(1000))
+			continue;
+
+		if (I_AtomicLoad(&sightquit))
+			break;
+
+		P_RunSightQueryChunks(&worker->trace);
+
+		if (I_AtomicAdd(&sightfinished, 1) == sightworkercount)
+			sightdone.signal();
+	}
+}
+
+static void STACK_ARGS P_StopSightWorkers()
+{
+	I_AtomicStore(&sightquit, 1);
+
+	for (int i = 0; i < sightworkercount; i++)
+		sightworkers[i].wake.signal();
+	for (int i = 0; i < sightworkercount; i++)
+		sightworkers[i].thread.join();
+
+	I_AtomicStore(&sightquit, 0);
+	sightworkercount = 0;
+}
+
+static void P_StartSightWorkers()
+{
+	if (!sightatterm)
+	{
+		atterm(P_StopSightWorkers);
+		sightatterm = true;
+	}
+
+	while (sightworkercount < sightworkerswanted)
+	{
+		sightworker_t* worker = &sightworkers[sightworkercount];
+
+		if (!worker->thread.start(P_SightWorkerThread, worker))
+		{
+			Printf(PRINT_HIGH, "Could not start sight query thread %d\n", sightworkercount + 1);
+			sightworkerswanted = sightworkercount;
+			break;
+		}
+
+		sightworkercount++;
+	}
+}
+
+//
+// P_SetSightWorkers
+//
+void P_SetSightWorkers(int count)
+{
+	count = clamp(count, 0, MAX_SIGHT_WORKERS);
+
+	if (sightworkercount > count)
+		P_StopSightWorkers();
+
+	sightworkerswanted = count;
+}
+
+//
+// P_QueueSightCheck
+//
+void P_QueueSightCheck(const AActor* t1, const AActor* t2)
+{
+	if (!t1 || !t2 || !t1->subsector || !t2->subsector)
+		return;
+
+	SightQueryTable::iterator it = sightquerytable.find(t1);
+	if (it == sightquerytable.end())
+		sightquerytable.insert(std::make_pair(t1, sightqueries.size()));
+	else if (sightqueries.back().t1 != t1)
+		return;		// would not be found
+
+	sightquery_t q;
+	q.t1 = t1;
+	q.t2 = t2;
+	q.ss1 = t1->subsector;
+	q.ss2 = t2->subsector;
+	q.x1 = t1->x;
+	q.y1 = t1->y;
+	q.z1 = t1->z;
+	q.h1 = t1->height;
+	q.x2 = t2->x;
+	q.y2 = t2->y;
+	q.z2 = t2->z;
+	q.h2 = t2->height;
+	q.trace = NULL;
+	q.firstsector = q.numsectors = 0;
+	q.result = false;
+
+	sightqueries.push_back(q);
+}
+
+//
+// P_RunSightQueries
+//
+void P_RunSightQueries()
+{
+	sightqueries.clear();
+	sightquerytable.clear();
+	sightqueriesvalid = false;
+
+	if (sightworkerswanted == 0 || co_zdoomphys || HasBehavior)
+		return;
+
+	P_GatherSightQueries();
+
+	if (sightqueries.empty())
+		return;
+
+	if (sightworkercount < sightworkerswanted)
+		P_StartSightWorkers();
+
+	if (sightsectormoved.size() != (size_t)numsectors)
+	{
+		sightsectormoved.assign(numsectors, 0);
+		sightbatch = 0;
+	}
+	sightbatch++;
+
+	gametrace.sectors.clear();
+	for (int i = 0; i < sightworkercount; i++)
+		sightworkers[i].trace.sectors.clear();
+
+	I_AtomicStore(&sightnext, 0);
+	I_AtomicStore(&sightfinished, 0);
+
+	for (int i = 0; i < sightworkercount; i++)
+		sightworkers[i].wake.signal();
+
+	P_RunSightQueryChunks(&gametrace);
+
+	while (I_AtomicLoad(&sightfinished) < sightworkercount)
+		sightdone.wait(100);
+
+	sightqueriesvalid = true;
+}
+
+//
+// P_ClearSightQueries
+//
+void P_ClearSightQueries()
+{
+	sightqueriesvalid = false;
+}
+
+//
+// P_SightSectorMoved
+//
+// Called when a sector's floor or ceiling moves, so the queries whose
+// traces looked at its heights are made again when asked for
+//
+void P_SightSectorMoved(const sector_t* sector)
+{
+	if (sightqueriesvalid)
+		sightsectormoved[sector - sectors] = sightbatch;
+}
+
+//
+// P_FindSightQuery
+//
+// Looks for the answer to a sight check made ahead of time that still
+// holds
+//
+static bool P_FindSightQuery(const AActor* t1, const AActor* t2, bool& result)
+{
+	if (!sightqueriesvalid || !t1 || !t2)
+		return false;
+
+	SightQueryTable::const_iterator it = sightquerytable.find(t1);
+	if (it == sightquerytable.end())
+		return false;
+
+	for (size_t i = it->second; i < sightqueries.size() && sightqueries[i].t1 == t1; i++)
+	{
+		const sightquery_t& q = sightqueries[i];
+
+		if (q.t2 != t2)
+			continue;
+
+		if (q.ss1 != t1->subsector || q.x1 != t1->x || q.y1 != t1->y ||
+			q.z1 != t1->z || q.h1 != t1->height ||
+			q.ss2 != t2->subsector || q.x2 != t2->x || q.y2 != t2->y ||
+			q.z2 != t2->z || q.h2 != t2->height)
+			return false;
+
+		for (unsigned int j = 0; j < q.numsectors; j++)
+			if (sightsectormoved[q.trace->sectors[q.firstsector + j]] == sightbatch)
+				return false;
+
+		result = q.result;
+		return true;
+	}
+
+	return false;
 }
 
 bool P_CheckSight(const AActor* t1, const AActor* t2)
 {
 	if (co_zdoomphys || HasBehavior)
 		return P_CheckSightZDoom(t1, t2);
-	else
-		return P_CheckSightDoom(t1, t2);
+
+	bool result;
+	if (P_FindSightQuery(t1, t2, result))
+		return result;
+
+	return P_CheckSightDoom(t1, t2);
 }
 
 //
@@ -69,88 +69,110 @@ EXTERN_CVAR(sv_fragexitswitch)
 
 std::list<movingsector_t> movingsectors;
 
+// the movingsectors entry of each sector by sector number, or
+// movingsectors.end() if the sector isn't moving
+static std::vector<std::list<movingsector_t>::iterator> movingsector_index;
+
 //
 // P_FindMovingSector
 //
 std::list<movingsector_t>::iterator P_FindMovingSector(sector_t *sector)
 {
-	std::list<movingsector_t>::iterator itr;
-	for (itr = movingsectors.begin(); itr != movingsectors.end(); ++itr)
-		if (sector == itr->sector)
-			return itr;
+	if (!sector)
+		return movingsectors.end();
+
+	size_t sectornum = sector - sectors;
+	if (sectornum >= movingsector_index.size())
+		return movingsectors.end();
 
-	// not found
-	return movingsectors.end();
+	return movingsector_index[sectornum];
 }
 
 //
-// P_AddMovingCeiling
+// P_AddMovingSector
 //
-// Updates the movingsectors list to include the passed sector, which
-// tracks which sectors currently have a moving ceiling/floor
+// Returns the movingsectors entry of the sector, adding one if the sector
+// wasn't moving yet
 //
-void P_AddMovingCeiling(sector_t *sector)
+static movingsector_t *P_AddMovingSector(sector_t *sector)
 {
-	if (!sector)
-		return;
-
-	movingsector_t *movesec;
-
-	// Check if this already exists
 	std::list<movingsector_t>::iterator itr = P_FindMovingSector(sector);
 	if (itr != movingsectors.end())
 	{
 		// this sector already is moving
-		movesec = &(*itr);
-	}
-	else
-	{
-		movingsectors.push_back(movingsector_t());
-		movesec = &(movingsectors.back());
+		return &(*itr);
 	}
 
+	if (movingsector_index.size() < (size_t)numsectors)
+		movingsector_index.resize(numsectors, movingsectors.end());
+
+	movingsectors.push_back(movingsector_t());
+	movingsector_t *movesec = &(movingsectors.back());
+
 	movesec->sector = sector;
-	movesec->moving_ceiling = true;
+	movesec->floorheight = P_FloorHeight(sector);
+	movesec->ceilingheight = P_CeilingHeight(sector);
+
+	movingsector_index[sector - sectors] = --movingsectors.end();
 
 	sector->moveable = true;
 	// [SL] 2012-05-04 - Register this sector as a moveable sector with the
 	// reconciliation system for unlagging
 	Unlag::getInstance().registerSector(sector);
+
+	return movesec;
 }
 
 //
-// P_AddMovingFloor
+// P_RemoveMovingSector
+//
+// Removes an entry from the movingsectors list.  Returns the entry
+// following it.
+//
+std::list<movingsector_t>::iterator P_RemoveMovingSector(std::list<movingsector_t>::iterator itr)
+{
+	size_t sectornum = itr->sector - sectors;
+	if (sectornum < movingsector_index.size())
+		movingsector_index[sectornum] = movingsectors.end();
+
+	return movingsectors.erase(itr);
+}
+
+//
+// P_ClearMovingSectors
+//
+void P_ClearMovingSectors()
+{
+	movingsectors.clear();
+	movingsector_index.clear();
+}
+
+//
+// P_AddMovingCeiling
 //
 // Updates the movingsectors list to include the passed sector, which
 // tracks which sectors currently have a moving ceiling/floor
 //
-void P_AddMovingFloor(sector_t *sector)
+void P_AddMovingCeiling(sector_t *sector)
 {
 	if (!sector)
 		return;
 
-	movingsector_t *movesec;
-
-	// Check if this already exists
-	std::list<movingsector_t>::iterator itr = P_FindMovingSector(sector);
-	if (itr != movingsectors.end())
-	{
-		// this sector already is moving
-		movesec = &(*itr);
-	}
-	else
-	{
-		movingsectors.push_back(movingsector_t());
-		movesec = &(movingsectors.back());
-	}
+	P_AddMovingSector(sector)->moving_ceiling = true;
+}
 
-	movesec->sector = sector;
-	movesec->moving_floor = true;
+//
+// P_AddMovingFloor
+//
+// Updates the movingsectors list to include the passed sector, which
+// tracks which sectors currently have a moving ceiling/floor
+//
+void P_AddMovingFloor(sector_t *sector)
+{
+	if (!sector)
+		return;
 
-	sector->moveable = true;
-	// [SL] 2012-05-04 - Register this sector as a moveable sector with the
-	// reconciliation system for unlagging
-	Unlag::getInstance().registerSector(sector);
+	P_AddMovingSector(sector)->moving_floor = true;
 }
 
 //
@@ -172,7 +194,7 @@ void P_RemoveMovingCeiling(sector_t *sector)
 		// Does this sector have a moving floor as well?  If so, just
 		// mark the ceiling as invalid but don't remove from the list
 		if (!itr->moving_floor)
-			movingsectors.erase(itr);
+			P_RemoveMovingSector(itr);
 
 		return;
 	}
@@ -197,7 +219,7 @@ void P_RemoveMovingFloor(sector_t *sector)
 		// Does this sector have a moving ceiling as well?  If so, just
 		// mark the floor as invalid but don't remove from the list
 		if (!itr->moving_ceiling)
-			movingsectors.erase(itr);
+			P_RemoveMovingSector(itr);
 
 		return;
 	}
@@ -646,6 +668,35 @@ void P_InitPicAnims (void)
 	Z_Free (animdefs);
 }
 
+//
+// P_MarkAnimatedTextures
+//
+// Marks every frame of the wall texture animations that have a frame
+// marked in hitlist, so they can be cached before they are shown.
+//
+void P_MarkAnimatedTextures(byte *hitlist)
+{
+	for (anim_t *anim = anims; anim < lastanim; anim++)
+	{
+		if (!anim->istexture)
+			continue;
+
+		int i;
+		for (i = 0; i < anim->numframes; i++)
+		{
+			int pic = anim->uniqueframes ? anim->framepic[i] : anim->basepic + i;
+			if (hitlist[pic])
+				break;
+		}
+
+		if (i == anim->numframes)
+			continue;
+
+		for (i = 0; i < anim->numframes; i++)
+			hitlist[anim->uniqueframes ? anim->framepic[i] : anim->basepic + i] = 1;
+	}
+}
+
 
 //
 // UTILITIES
@@ -2723,7 +2774,7 @@ void DPusher::RunThink ()
 		yh = (tmbbox[BOXTOP] - bmaporgy + MAXRADIUS)>>MAPBLOCKSHIFT;
 		for (bx=xl ; bx<=xh ; bx++)
 			for (by=yl ; by<=yh ; by++)
-				P_BlockThingsIterator (bx, by, PIT_PushThing);
+				P_BlockThingsIterator<PIT_PushThing>(bx, by);
 		return;
 	}
 
@@ -34,17 +34,29 @@
 typedef struct movingsector_s
 {
 	movingsector_s() :
-		sector(NULL), moving_ceiling(false), moving_floor(false)
+		sector(NULL), moving_ceiling(false), moving_floor(false),
+		serial(0), statekey(0), floorheight(0), ceilingheight(0)
 	{}
 	
 	sector_t	*sector;
 	bool		moving_ceiling;
 	bool		moving_floor;
+
+	// [SV] bumped whenever the sector stops moving the way clients
+	// would predict from its last update
+	unsigned int	serial;
+	unsigned int	statekey;
+	fixed_t		floorheight;	// as of the previous tic
+	fixed_t		ceilingheight;
 } movingsector_t;
 
+// Sectors with a moving floor or ceiling.  Always go through the functions
+// below to add or remove entries, as they keep an index by sector number.
 extern std::list<movingsector_t> movingsectors;
 
 std::list<movingsector_t>::iterator P_FindMovingSector(sector_t *sector);
+std::list<movingsector_t>::iterator P_RemoveMovingSector(std::list<movingsector_t>::iterator itr);
+void P_ClearMovingSectors();
 void P_AddMovingCeiling(sector_t *sector);
 void P_AddMovingFloor(sector_t *sector);
 void P_RemoveMovingCeiling(sector_t *sector);
@@ -178,6 +190,9 @@ BOOL	CheckIfExitIsGood (AActor *self);
 // at game start
 void	P_InitPicAnims (void);
 
+// marks the other frames of animations using a marked wall texture
+void	P_MarkAnimatedTextures (byte *hitlist);
+
 // at map load
 void	P_SpawnSpecials (void);
 
@@ -430,6 +445,9 @@ void	P_ChangeSwitchTexture (line_t *line, int useAgain);
 
 void	P_InitSwitchList ();
 
+// marks the other state of marked switch textures
+void	P_MarkSwitchTextures (byte *hitlist);
+
 void	P_ProcessSwitchDef ();
 
 bool	P_GetButtonInfo (line_t *line, unsigned &state, unsigned &time);
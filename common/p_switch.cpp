@@ -124,6 +124,22 @@ void P_InitSwitchList(void)
 	Z_Free (alphSwitchList);
 }
 
+//
+// P_MarkSwitchTextures
+//
+// Marks the other state of each switch texture marked in hitlist.
+//
+void P_MarkSwitchTextures(byte *hitlist)
+{
+	for (int i = 0; i < numswitches; i++)
+	{
+		int on = switchlist[i * 2], off = switchlist[i * 2 + 1];
+
+		if (hitlist[on] || hitlist[off])
+			hitlist[on] = hitlist[off] = 1;
+	}
+}
+
 //
 // Start a button counting down till it turns off.
 // [RH] Rewritten to remove MAXBUTTONS limit and use temporary soundorgs.
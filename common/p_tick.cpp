@@ -75,7 +75,9 @@ void P_Ticker (void)
 		P_AnimationTick(it->mo);
 	}
 
+	P_RunSightQueries ();
 	DThinker::RunThinkers ();
+	P_ClearSightQueries ();
 	
 	P_UpdateSpecials ();
 	P_RespawnSpecials ();
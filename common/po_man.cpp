@@ -1054,9 +1054,13 @@ static BOOL CheckMobjBlocking (seg_t *seg, polyobj_t *po)
 	{
 		for (i = left; i <= right; i++)
 		{
-			for (mobj = blocklinks[j+i]; mobj; mobj = mobj->bmapnode.Next(i, j/bmapwidth))
+			const blockthings_t &block = blockthings[j+i];
+
+			blockthingwalks++;
+			for (int k = block.count - 1; k >= 0; k--)
 			{
-				if ((mobj->flags&MF_SOLID) && !(mobj->flags&MF_NOCLIP))
+				mobj = block.things[k].actor;
+				if (mobj && (mobj->flags&MF_SOLID) && !(mobj->flags&MF_NOCLIP))
 				{
 					tmbbox[BOXTOP] = mobj->y+mobj->radius;
 					tmbbox[BOXBOTTOM] = mobj->y-mobj->radius;
@@ -1078,6 +1082,7 @@ static BOOL CheckMobjBlocking (seg_t *seg, polyobj_t *po)
 					blocked = true;
 				}
 			}
+			blockthingwalks--;
 		}
 	}
 	return blocked;
@@ -24,6 +24,7 @@
 //-----------------------------------------------------------------------------
 
 #include "i_system.h"
+#include "i_thread.h"
 #include "z_zone.h"
 #include "m_alloc.h"
 
@@ -41,6 +42,7 @@
 #include "cmdlib.h"
 
 #include "r_data.h"
+#include "c_dispatch.h"
 
 #include "v_palette.h"
 #include "v_video.h"
@@ -49,6 +51,7 @@
 #include <cstddef>
 
 #include <algorithm>
+#include <vector>
 
 //
 // Graphics.
@@ -88,6 +91,24 @@ int*			flattranslation;
 
 int*			texturetranslation;
 
+// Textures the level may show later, composed a few at a time between
+// frames by R_PrecacheUpdate
+static std::vector<int>	precachequeue;
+static size_t			precacheposition;
+
+static const dtime_t PRECACHE_FRAME_BUDGET = 1000LL * 1000LL;	// 1 ms
+
+static struct
+{
+	dtime_t		loadtime;
+	int			loaded;			// composed by R_PrecacheLevel
+	int			background;		// composed by R_PrecacheUpdate
+	int			ondemand;		// composed while drawing
+	int			frames;
+	dtime_t		firstframe;
+	dtime_t		worstframe;
+} precachestats;
+
 //
 // R_CalculateNewPatchSize
 //
@@ -237,31 +258,31 @@ void R_DrawColumnInCache(const tallpost_t *post, byte *cache,
 }
 
 //
-// R_GenerateComposite
+// R_ComposeTexture
 // Using the texture definition,
 //	the composite texture is created from the patches,
 //	and each column is cached.
 //
+// Only touches block and the texture's own lookups, so several textures
+// can be composed at once by different threads.
+//
 // Rewritten by Lee Killough for performance and to fix Medusa bug
 
-void R_GenerateComposite (int texnum)
+static void R_ComposeTexture(int texnum, byte *block, patch_t *const *patches)
 {
-	byte *block = (byte *)Z_Malloc (texturecompositesize[texnum], PU_STATIC,
-						   (void **) &texturecomposite[texnum]);
-	texturecomposite[texnum] = block;
-	texture_t *texture = textures[texnum];
+	const texture_t *texture = textures[texnum];
 
 	// Composite the columns together.
-	texpatch_t *texpatch = texture->patches;
-	short *collump = texturecolumnlump[texnum];
+	const texpatch_t *texpatch = texture->patches;
+	const short *collump = texturecolumnlump[texnum];
 
 	// killough 4/9/98: marks to identify transparent regions in merged textures
 	byte *marks = new byte[texture->width * texture->height];
 	memset(marks, 0, texture->width * texture->height);
 
-	for (int i = texture->patchcount; --i >=0; texpatch++)
+	for (int i = 0; i < texture->patchcount; i++, texpatch++)
 	{
-		patch_t *patch = W_CachePatch(texpatch->patch);
+		const patch_t *patch = patches[i];
 		int x1 = texpatch->originx, x2 = x1 + patch->width();
 		const int *cofs = patch->columnofs-x1;
 		if (x1<0)
@@ -324,6 +345,45 @@ void R_GenerateComposite (int texnum)
 
 	delete [] marks;
 	delete [] tmpdata;
+}
+
+//
+// R_LockTexturePatches
+//
+// Caches the patches of a texture and keeps them from being purged until
+// R_UnlockTexturePatches is called.
+//
+static void R_LockTexturePatches(int texnum, std::vector<patch_t*> &patches)
+{
+	const texture_t *texture = textures[texnum];
+
+	for (int i = 0; i < texture->patchcount; i++)
+		patches.push_back(W_CachePatch(texture->patches[i].patch, PU_STATIC));
+}
+
+static void R_UnlockTexturePatches(int texnum)
+{
+	const texture_t *texture = textures[texnum];
+
+	for (int i = 0; i < texture->patchcount; i++)
+		W_CachePatch(texture->patches[i].patch, PU_CACHE);
+}
+
+//
+// R_GenerateComposite
+//
+void R_GenerateComposite (int texnum)
+{
+	std::vector<patch_t*> patches;
+	R_LockTexturePatches(texnum, patches);
+
+	byte *block = (byte *)Z_Malloc (texturecompositesize[texnum], PU_STATIC,
+						   (void **) &texturecomposite[texnum]);
+	texturecomposite[texnum] = block;
+
+	R_ComposeTexture(texnum, block, patches.empty() ? NULL : &patches[0]);
+
+	R_UnlockTexturePatches(texnum);
 
 	// Now that the texture has been built in column cache,
 	// it is purgable from zone memory.
@@ -331,6 +391,171 @@ void R_GenerateComposite (int texnum)
 	Z_ChangeTag(block, PU_CACHE);
 }
 
+//
+// R_NeedsComposite
+//
+static bool R_NeedsComposite(int texnum)
+{
+	return texturecompositesize[texnum] > 0 && !texturecomposite[texnum];
+}
+
+//
+// R_ComposeTextures
+//
+// Builds the composites for a list of textures on all CPUs.  The zone is
+// not thread safe, so patches are cached and blocks allocated here and
+// the threads only compose.  Textures are done in batches so the locked
+// patches do not fill the zone.
+//
+// The worker threads are started the first time they are needed and are
+// handed each batch through a queue of their own.  Every worker and the
+// calling thread then take textures from the batch until none are left.
+//
+struct compositebatch_t
+{
+	std::vector<int>		texnums;
+	std::vector<byte*>		blocks;
+	std::vector<size_t>		firstpatch;
+	std::vector<patch_t*>	patches;
+	volatile int			next;
+	volatile int			finished;	// workers done with the batch
+};
+
+static const size_t COMPOSITE_BATCH_SIZE = 64;
+static const int MAX_COMPOSITE_WORKERS = 16;
+
+struct compositeworker_t
+{
+	OThread			thread;
+	OEvent			wake;
+	OSPSCRing<compositebatch_t*, 4>	queue;
+};
+
+static compositeworker_t compositeworkers[MAX_COMPOSITE_WORKERS];
+static int compositeworkercount = 0;
+static bool compositestarted = false;
+static volatile int compositequit = 0;
+static OEvent compositedone;
+
+static void R_ComposeBatch(compositebatch_t *batch)
+{
+	const int count = batch->texnums.size();
+
+	int i;
+	while ((i = I_AtomicAdd(&batch->next, 1) - 1) < count)
+	{
+		patch_t **patches = batch->patches.empty() ? NULL : &batch->patches[0] + batch->firstpatch[i];
+		R_ComposeTexture(batch->texnums[i], batch->blocks[i], patches);
+	}
+}
+
+static void R_CompositeWorkerThread(void *data)
+{
+	compositeworker_t *worker = (compositeworker_t*)data;
+
+	while (true)
+	{
+		compositebatch_t *batch;
+
+		if (!worker->queue.pop(batch))
+		{
+			if (I_AtomicLoad(&compositequit))
+				break;
+
+			worker->wake.wait(1000);
+			continue;
+		}
+
+		R_ComposeBatch(batch);
+
+		if (I_AtomicAdd(&batch->finished, 1) == compositeworkercount)
+			compositedone.signal();
+	}
+}
+
+static void STACK_ARGS R_StopCompositeWorkers()
+{
+	I_AtomicStore(&compositequit, 1);
+
+	for (int i = 0; i < compositeworkercount; i++)
+		compositeworkers[i].wake.signal();
+	for (int i = 0; i < compositeworkercount; i++)
+		compositeworkers[i].thread.join();
+
+	compositeworkercount = 0;
+}
+
+static void R_StartCompositeWorkers()
+{
+	compositestarted = true;
+	atterm(R_StopCompositeWorkers);
+
+	// the calling thread composes too
+	const int wanted = std::min<int>(std::max(I_GetCPUCount(), 2u) - 1, MAX_COMPOSITE_WORKERS);
+
+	while (compositeworkercount < wanted)
+	{
+		compositeworker_t *worker = &compositeworkers[compositeworkercount];
+
+		if (!worker->thread.start(R_CompositeWorkerThread, worker))
+			break;
+
+		compositeworkercount++;
+	}
+}
+
+static void R_ComposeTextures(const std::vector<int> &texnums)
+{
+	if (texnums.empty())
+		return;
+
+	if (!compositestarted)
+		R_StartCompositeWorkers();
+
+	for (size_t start = 0; start < texnums.size(); start += COMPOSITE_BATCH_SIZE)
+	{
+		const size_t end = std::min(start + COMPOSITE_BATCH_SIZE, texnums.size());
+
+		compositebatch_t batch;
+		batch.next = 0;
+		batch.finished = 0;
+
+		for (size_t i = start; i < end; i++)
+		{
+			batch.texnums.push_back(texnums[i]);
+			batch.firstpatch.push_back(batch.patches.size());
+			R_LockTexturePatches(texnums[i], batch.patches);
+		}
+
+		for (size_t i = start; i < end; i++)
+		{
+			int texnum = texnums[i];
+			byte *block = (byte *)Z_Malloc(texturecompositesize[texnum], PU_STATIC,
+										   (void **) &texturecomposite[texnum]);
+			texturecomposite[texnum] = block;
+			batch.blocks.push_back(block);
+		}
+
+		// the queues never hold more than this batch, so there is room
+		for (int t = 0; t < compositeworkercount; t++)
+		{
+			compositeworkers[t].queue.push(&batch);
+			compositeworkers[t].wake.signal();
+		}
+
+		R_ComposeBatch(&batch);
+
+		while (I_AtomicLoad(&batch.finished) < compositeworkercount)
+			compositedone.wait(100);
+
+		for (size_t i = 0; i < batch.texnums.size(); i++)
+		{
+			R_UnlockTexturePatches(batch.texnums[i]);
+			Z_ChangeTag(batch.blocks[i], PU_CACHE);
+		}
+	}
+}
+
 //
 // R_GenerateLookup
 //
@@ -466,7 +691,10 @@ tallpost_t* R_GetTextureColumn(int texnum, int colnum)
 		return (tallpost_t*)((byte *)W_CachePatch(lump, PU_CACHE) + ofs);
 
 	if (!texturecomposite[texnum])
+	{
 		R_GenerateComposite(texnum);
+		precachestats.ondemand++;
+	}
 
 	return (tallpost_t*)(texturecomposite[texnum] + ofs);
 }
@@ -968,6 +1196,10 @@ int R_ColormapForBlend(const argb_t blend_color)
 //
 void R_InitData()
 {
+	// the queue holds numbers of the textures about to be replaced
+	precachequeue.clear();
+	precacheposition = 0;
+
 	R_InitTextures();
 	R_InitFlats();
 	R_InitSpriteLumps();
@@ -1073,6 +1305,12 @@ void R_PrecacheLevel (void)
 	byte *hitlist;
 	int i;
 
+	dtime_t start = I_GetTime();
+
+	memset(&precachestats, 0, sizeof(precachestats));
+	precachequeue.clear();
+	precacheposition = 0;
+
 	if (demoplayback)
 		return;
 
@@ -1115,18 +1353,39 @@ void R_PrecacheLevel (void)
 	hitlist[sky1texture] = 1;
 	hitlist[sky2texture] = 1;
 
+	std::vector<int> composites;
+
 	for (i = numtextures - 1; i >= 0; i--)
 	{
-		if (hitlist[i])
+		if (!hitlist[i])
+			continue;
+
+		if (R_NeedsComposite(i))
+		{
+			composites.push_back(i);
+		}
+		else
 		{
-			int j;
 			texture_t *texture = textures[i];
 
-			for (j = texture->patchcount - 1; j > 0; j--)
+			for (int j = texture->patchcount - 1; j >= 0; j--)
 				W_CachePatch(texture->patches[j].patch, PU_CACHE);
 		}
 	}
 
+	R_ComposeTextures(composites);
+	precachestats.loaded = composites.size();
+
+	// Animation frames and switch states are not needed until later, so
+	// they are left for R_PrecacheUpdate to do between frames
+	std::vector<byte> later(hitlist, hitlist + numtextures);
+	P_MarkAnimatedTextures(&later[0]);
+	P_MarkSwitchTextures(&later[0]);
+
+	for (i = 0; i < numtextures; i++)
+		if (later[i] && !hitlist[i])
+			precachequeue.push_back(i);
+
 	// Precache sprites.
 	memset (hitlist, 0, numsprites);
 
@@ -1145,8 +1404,68 @@ void R_PrecacheLevel (void)
 	}
 
 	delete[] hitlist;
+
+	precachestats.loadtime = I_GetTime() - start;
+	DPrintf("R_PrecacheLevel: %d composites in %u ms, %u left for later\n",
+		precachestats.loaded, (unsigned int)I_ConvertTimeToMs(precachestats.loadtime),
+		(unsigned int)precachequeue.size());
 }
 
+//
+// R_PrecacheUpdate
+//
+// Composes queued textures until the frame's budget is used up.
+//
+void R_PrecacheUpdate()
+{
+	if (precacheposition >= precachequeue.size())
+		return;
+
+	dtime_t start = I_GetTime();
+
+	while (precacheposition < precachequeue.size() &&
+		   I_GetTime() - start < PRECACHE_FRAME_BUDGET)
+	{
+		int texnum = precachequeue[precacheposition++];
+
+		if (R_NeedsComposite(texnum))
+		{
+			R_GenerateComposite(texnum);
+			precachestats.background++;
+		}
+	}
+}
+
+//
+// R_PrecacheFrameTime
+//
+// Records how long a frame took to render, to tell how well the
+// precaching hides texture composition.
+//
+void R_PrecacheFrameTime(dtime_t frametime)
+{
+	if (precachestats.frames++ == 0)
+		precachestats.firstframe = frametime;
+
+	precachestats.worstframe = std::max(precachestats.worstframe, frametime);
+}
+
+#ifdef CLIENT_APP
+BEGIN_COMMAND (precachestats)
+{
+	Printf(PRINT_HIGH, "Level precache: %u ms, %d composites\n",
+		(unsigned int)I_ConvertTimeToMs(precachestats.loadtime), precachestats.loaded);
+	Printf(PRINT_HIGH, "Between frames: %d composites, %u queued\n",
+		precachestats.background, (unsigned int)(precachequeue.size() - precacheposition));
+	Printf(PRINT_HIGH, "While drawing: %d composites\n", precachestats.ondemand);
+
+	if (precachestats.frames)
+		Printf(PRINT_HIGH, "Frames: %d, first %.2f ms, worst %.2f ms\n", precachestats.frames,
+			precachestats.firstframe / 1e6, precachestats.worstframe / 1e6);
+}
+END_COMMAND (precachestats)
+#endif
+
 // Utility function,
 //	called by R_PointToAngle.
 unsigned int SlopeDiv (unsigned int num, unsigned int den)
@@ -95,6 +95,8 @@ byte* R_GetTextureColumnData(int texnum, int colnum);
 // I/O, setting up the stuff.
 void R_InitData (void);
 void R_PrecacheLevel (void);
+void R_PrecacheUpdate();
+void R_PrecacheFrameTime(dtime_t frametime);
 
 
 // Retrieval.
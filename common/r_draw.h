@@ -161,11 +161,13 @@ void R_DrawSlopeSpanD_c(void);
 class IWindowSurface;
 
 void r_dimpatchD_c(IWindowSurface* surface, argb_t color, int alpha, int x1, int y1, int w, int h);
+void r_stretchrowD_c(argb_t* dest, const argb_t* source, const int* runs, int count);
 
 #ifdef __SSE2__
 void R_DrawSpanD_SSE2(void);
 void R_DrawSlopeSpanD_SSE2(void);
 void r_dimpatchD_SSE2(IWindowSurface*, argb_t color, int alpha, int x1, int y1, int w, int h);
+void r_stretchrowD_SSE2(argb_t* dest, const argb_t* source, const int* runs, int count);
 #endif
 
 #ifdef __MMX__
@@ -184,6 +186,7 @@ void r_dimpatchD_ALTIVEC(IWindowSurface*, argb_t color, int alpha, int x1, int y
 extern void (*R_DrawSpanD)(void);
 extern void (*R_DrawSlopeSpanD)(void);
 extern void (*r_dimpatchD)(IWindowSurface* surface, argb_t color, int alpha, int x1, int y1, int w, int h);
+extern void (*r_stretchrowD)(argb_t* dest, const argb_t* source, const int* runs, int count);
 
 extern byte*			translationtables;
 extern argb_t           translationRGB[MAXPLAYERS+1][16];
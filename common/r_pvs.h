@@ -0,0 +1,47 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Potentially visible set, used to skip BSP subtrees that cannot be seen
+//	from the sector the view is in.
+//
+//	Sectors are the cells and two-sided linedefs the portals between them.
+//	A sector is potentially visible from another if a straight line can
+//	pass through some chain of portals between them.  Heights are ignored,
+//	so doors and lifts never hide anything.  The sets are built by worker
+//	threads after a level is loaded and cached in the user directory.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __R_PVS_H__
+#define __R_PVS_H__
+
+#include "doomtype.h"
+
+// Starts building (or loading) the sets for the level just loaded
+void R_BuildPVS();
+void R_ClearPVS();
+
+// Marks the nodes and subsectors visible from the view for this frame
+void R_PVSSetupFrame();
+
+// Nonzero for each node / subsector that may be visible, NULL when
+// nothing is culled this frame
+extern const byte *pvsnodes;
+extern const byte *pvssubsectors;
+
+#endif	// __R_PVS_H__
@@ -138,6 +138,9 @@ void S_StopMusic (void);
 void S_PauseSound (void);
 void S_ResumeSound (void);
 
+// Drop new sounds while fast-forwarding through a netdemo.
+void S_MuteSounds (bool mute);
+
 
 //
 // Updates music & sounds
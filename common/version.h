@@ -26,9 +26,9 @@
 
 // Lots of different representations for the version number
 #define CONFIGVERSIONSTR "80"
-#define GAMEVER (0*256+80)
+#define GAMEVER (0*256+81)
 
-#define DOTVERSIONSTR "0.8.0"
+#define DOTVERSIONSTR "0.8.1"
 
 #define COPYRIGHTSTR "Copyright (C) 2006-2019 The Odamex Team"
 
@@ -44,7 +44,7 @@
 // earlier than this version.
 #define SAVESIG "ODAMEXSAVE080   "	// Needs to be exactly 16 chars long
 
-#define NETDEMOVER 3
+#define NETDEMOVER 4
 
 // denis - per-file svn version stamps
 class file_version
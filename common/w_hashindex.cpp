@@ -0,0 +1,331 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Persistent index of resource file MD5s
+//
+//-----------------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "c_console.h"
+#include "md5.h"
+
+#include "w_hashindex.h"
+
+struct hashentry_t
+{
+	std::string	md5;
+	int64_t		size;
+	int64_t		mtime;
+};
+
+typedef std::map<std::string, hashentry_t> hashindex_t;
+
+static hashindex_t hashindex;
+static bool hashindex_loaded = false;
+static bool hashindex_dirty = false;
+
+static const char *HASHINDEX_FILENAME = "wadhashes.txt";
+
+//
+// W_StatFile
+//
+static bool W_StatFile(const std::string &filename, int64_t &size, int64_t &mtime)
+{
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0 || (info.st_mode & S_IFDIR))
+		return false;
+
+	size = info.st_size;
+	mtime = info.st_mtime;
+	return true;
+}
+
+//
+// W_ComputeMD5
+//
+// denis - Standard MD5SUM
+//
+static std::string W_ComputeMD5(const std::string &filename)
+{
+	const size_t file_chunk_size = 65536;
+	FILE *fp = fopen(filename.c_str(), "rb");
+
+	if (!fp)
+		return "";
+
+	md5_state_t state;
+	md5_init(&state);
+
+	std::vector<unsigned char> buf(file_chunk_size);
+	size_t n;
+
+	while ((n = fread(&buf[0], 1, buf.size(), fp)))
+		md5_append(&state, &buf[0], n);
+
+	md5_byte_t digest[16];
+	md5_finish(&state, digest);
+
+	fclose(fp);
+
+	std::stringstream hash;
+
+	for (int i = 0; i < 16; i++)
+		hash << std::setw(2) << std::setfill('0') << std::hex << std::uppercase << (short)digest[i];
+
+	return hash.str();
+}
+
+//
+// W_HashIndexLoad
+//
+// Reads the index file.  Entries for files that have gone away are dropped.
+//
+static void W_HashIndexLoad()
+{
+	if (hashindex_loaded)
+		return;
+
+	hashindex_loaded = true;
+	atterm(W_HashIndexFlush);
+
+	std::ifstream in(I_GetUserFileName(HASHINDEX_FILENAME).c_str());
+	std::string line;
+
+	// each line is "md5 size mtime path"
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		hashentry_t entry;
+		std::string filename;
+
+		if (!(fields >> entry.md5 >> entry.size >> entry.mtime))
+			continue;
+
+		fields.get();
+		std::getline(fields, filename);
+
+		if (entry.md5.length() != 32 || filename.empty())
+			continue;
+
+		int64_t size, mtime;
+		if (!W_StatFile(filename, size, mtime))
+		{
+			hashindex_dirty = true;
+			continue;
+		}
+
+		hashindex[filename] = entry;
+	}
+}
+
+//
+// W_HashIndexFlush
+//
+// The index is written out whole, so it is replaced in one go and a crash
+// halfway through leaves the old one in place
+//
+void STACK_ARGS W_HashIndexFlush()
+{
+	if (!hashindex_dirty)
+		return;
+
+	std::string filename = I_GetUserFileName(HASHINDEX_FILENAME);
+	std::string tmpname = filename + ".tmp";
+	std::ofstream out(tmpname.c_str(), std::ios::out | std::ios::trunc);
+
+	for (hashindex_t::const_iterator it = hashindex.begin(); it != hashindex.end(); ++it)
+	{
+		out << it->second.md5 << ' ' << it->second.size << ' '
+			<< it->second.mtime << ' ' << it->first << '\n';
+	}
+
+	out.close();
+
+	bool failed = out.fail();
+
+	if (!failed)
+	{
+		// rename won't replace an existing file on Windows
+		remove(filename.c_str());
+		failed = rename(tmpname.c_str(), filename.c_str()) != 0;
+	}
+
+	if (failed)
+		DPrintf("W_HashIndexFlush: unable to write %s\n", filename.c_str());
+	else
+		hashindex_dirty = false;
+}
+
+//
+// W_HashIndexFind
+//
+// Returns the indexed entry for a file if it is still current, or NULL
+//
+static const hashentry_t *W_HashIndexFind(const std::string &filename, int64_t size, int64_t mtime)
+{
+	hashindex_t::const_iterator it = hashindex.find(filename);
+
+	if (it == hashindex.end() || it->second.size != size || it->second.mtime != mtime)
+		return NULL;
+
+	return &it->second;
+}
+
+static void W_HashIndexSet(const std::string &filename, const std::string &md5, int64_t size, int64_t mtime)
+{
+	hashentry_t &entry = hashindex[filename];
+	entry.md5 = md5;
+	entry.size = size;
+	entry.mtime = mtime;
+
+	hashindex_dirty = true;
+}
+
+//
+// W_HashIndexLookup
+//
+std::string W_HashIndexLookup(const std::string &filename)
+{
+	W_HashIndexLoad();
+
+	int64_t size, mtime;
+	if (!W_StatFile(filename, size, mtime))
+		return "";
+
+	const hashentry_t *entry = W_HashIndexFind(filename, size, mtime);
+	if (entry)
+		return entry->md5;
+
+	std::string md5 = W_ComputeMD5(filename);
+	if (md5.empty())
+		return md5;
+
+	// written out by W_HashIndexFlush once the caller is done looking up
+	W_HashIndexSet(filename, md5, size, mtime);
+
+	return md5;
+}
+
+//
+// W_HashIndexStore
+//
+void W_HashIndexStore(const std::string &filename, const std::string &md5)
+{
+	W_HashIndexLoad();
+
+	int64_t size, mtime;
+	if (!W_StatFile(filename, size, mtime))
+		return;
+
+	W_HashIndexSet(filename, md5, size, mtime);
+	W_HashIndexFlush();
+}
+
+// Work shared between the hashing threads.  Each thread claims the next
+// file by bumping next, results land in their own slot so no locking is
+// needed.
+struct hashwork_t
+{
+	std::vector<std::string>	filenames;
+	std::vector<std::string>	md5s;
+	volatile int				next;
+};
+
+static void W_HashWorker(void *data)
+{
+	hashwork_t *work = static_cast<hashwork_t*>(data);
+	int count = (int)work->filenames.size();
+
+	for (;;)
+	{
+		int i = I_AtomicAdd(&work->next, 1) - 1;
+		if (i >= count)
+			break;
+
+		work->md5s[i] = W_ComputeMD5(work->filenames[i]);
+	}
+}
+
+//
+// W_HashIndexUpdate
+//
+void W_HashIndexUpdate(const std::vector<std::string> &filenames)
+{
+	W_HashIndexLoad();
+
+	hashwork_t work;
+	work.next = 0;
+
+	std::vector<int64_t> sizes, mtimes;
+
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		int64_t size, mtime;
+		if (!W_StatFile(filenames[i], size, mtime))
+			continue;
+
+		if (W_HashIndexFind(filenames[i], size, mtime))
+			continue;
+
+		work.filenames.push_back(filenames[i]);
+		sizes.push_back(size);
+		mtimes.push_back(mtime);
+	}
+
+	if (work.filenames.empty())
+		return;
+
+	work.md5s.resize(work.filenames.size());
+
+	// reading is the expensive part, so one thread per core is plenty and
+	// the calling thread takes a share of the work too
+	size_t numthreads = I_GetCPUCount();
+	if (numthreads > work.filenames.size())
+		numthreads = work.filenames.size();
+
+	OThread *threads = new OThread[numthreads - 1];
+	for (size_t i = 0; i < numthreads - 1; i++)
+		threads[i].start(W_HashWorker, &work);
+
+	W_HashWorker(&work);
+
+	for (size_t i = 0; i < numthreads - 1; i++)
+		threads[i].join();
+	delete [] threads;
+
+	for (size_t i = 0; i < work.filenames.size(); i++)
+		if (!work.md5s[i].empty())
+			W_HashIndexSet(work.filenames[i], work.md5s[i], sizes[i], mtimes[i]);
+
+	W_HashIndexFlush();
+}
+
+VERSION_CONTROL (w_hashindex_cpp, "$Id$")
@@ -0,0 +1,49 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Persistent index of resource file MD5s
+//
+//	Hashes are remembered by path, size and modification time in
+//	wadhashes.txt next to the config file, so a file is only read again
+//	after it changes.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __W_HASHINDEX_H__
+#define __W_HASHINDEX_H__
+
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+
+// Returns the MD5 of a file, from the index when the file is unchanged.
+// Returns an empty string if the file can't be read.
+std::string W_HashIndexLookup(const std::string &filename);
+
+// Writes out the hashes W_HashIndexLookup added, if any.  Also done at exit.
+void STACK_ARGS W_HashIndexFlush();
+
+// Records a hash that is already known, e.g. for a file just downloaded
+void W_HashIndexStore(const std::string &filename, const std::string &md5);
+
+// Brings the index up to date for all of the given files, hashing the
+// stale ones on several threads at once
+void W_HashIndexUpdate(const std::vector<std::string> &filenames);
+
+#endif	// __W_HASHINDEX_H__
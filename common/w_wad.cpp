@@ -49,17 +49,15 @@
 #include "z_zone.h"
 #include "cmdlib.h"
 #include "m_argv.h"
-#include "md5.h"
 
 #include "w_wad.h"
+#include "w_hashindex.h"
 
 
 #include <string>
-#include <sstream>
 #include <algorithm>
 #include <vector>
 #include <iostream>
-#include <iomanip>
 
 
 //
@@ -139,35 +137,15 @@ void uppercopy (char *to, const char *from)
 }
 
 
-// denis - Standard MD5SUM
+//
+// W_MD5
+//
+// Returns the MD5 of a file, only reading the file when the hash index
+// doesn't have a current entry for it
+//
 std::string W_MD5(std::string filename)
 {
-	const int file_chunk_size = 8192;
-	FILE *fp = fopen(filename.c_str(), "rb");
-
-	if(!fp)
-		return "";
-
-	md5_state_t state;
-	md5_init(&state);
-
-	unsigned n = 0;
-	unsigned char buf[file_chunk_size];
-
-	while((n = fread(buf, 1, sizeof(buf), fp)))
-		md5_append(&state, (unsigned char *)buf, n);
-
-	md5_byte_t digest[16];
-	md5_finish(&state, digest);
-
-	fclose(fp);
-
-	std::stringstream hash;
-
-	for(int i = 0; i < 16; i++)
-		hash << std::setw(2) << std::setfill('0') << std::hex << std::uppercase << (short)digest[i];
-
-	return hash.str();
+	return W_HashIndexLookup(filename);
 }
 
 
@@ -509,6 +487,9 @@ std::vector<std::string> W_InitMultipleFiles (std::vector<std::string> &filename
 
 	stdisk_lumpnum = W_GetNumForName("STDISK");
 
+	// save the hashes of any files that were new to the index
+	W_HashIndexFlush();
+
 	return hashes;
 }
 
@@ -600,11 +581,24 @@ void W_ReadLump(unsigned int lump, void* dest)
 	if (lump != stdisk_lumpnum)
     	I_BeginRead();
 
+#if defined(UNIX) && defined(SERVER_APP)
+	// pread leaves the file offset alone, which server instances forked by
+	// the supervisor share with each other
+	c = 0;
+	while (c < (int)l->size)
+	{
+		ssize_t n = pread(fileno(l->handle), (byte*)dest + c, l->size - c, l->position + c);
+		if (n <= 0)
+			I_Error ("W_ReadLump: only read %i of %i on lump %i", c, l->size, lump);
+		c += n;
+	}
+#else
 	fseek (l->handle, l->position, SEEK_SET);
 	c = fread (dest, l->size, 1, l->handle);
 
 	if (feof(l->handle))
 		I_Error ("W_ReadLump: only read %i of %i on lump %i", c, l->size, lump);
+#endif
 
 	if (lump != stdisk_lumpnum)
     	I_EndRead();
@@ -24,11 +24,11 @@
 #include <iostream>
 
 #include "dlg_main.h"
-#include "query_thread.h"
 #include "plat_utils.h"
 #include "str_utils.h"
 #include "oda_defs.h"
 #include "net_utils.h"
+#include "net_query.h"
 
 #include "md5.h"
 
@@ -68,8 +68,6 @@
 
 using namespace odalpapi;
 
-extern int NUM_THREADS;
-
 // Control ID assignments for events
 // application icon
 
@@ -197,13 +195,6 @@ dlgMain::dlgMain(wxWindow* parent, wxWindowID id)
 
 	QServer = NULL;
 
-	NUM_THREADS = QueryThread::GetIdealThreadCount();
-
-	for(size_t i = 0; i < NUM_THREADS; ++i)
-	{
-		threadVector.push_back(new QueryThread(this));
-	}
-
 	{
 		wxFileConfig ConfigInfo;
 
@@ -347,23 +338,6 @@ void dlgMain::OnClose(wxCloseEvent& event)
 	if(GetThread() && GetThread()->IsRunning())
 		GetThread()->Wait();
 
-	// Gracefully terminate any running worker threads and then deallocate
-	// their memory
-	{
-        std::vector<QueryThread*>::reverse_iterator it;
-        
-        for(it = threadVector.rbegin(); it != threadVector.rend(); it++)
-        {
-            if((*it)->IsRunning())
-            {
-                (*it)->GracefulExit();
-                delete *it;
-            }
-
-            threadVector.pop_back();
-        }
-	}
-    
 	// Save the UI layout and shut it all down
 	wxFileConfig ConfigInfo;
 
@@ -799,6 +773,16 @@ bool dlgMain::MonThrGetMasterList()
 	return (Signal == mtrs_master_success) ? true : false;
 }
 
+// Hands a finished query to the main thread as a worker signal
+static void MonThrQueryResult(const odalpapi::QueryResult_t& Result, void* Data)
+{
+	wxCommandEvent newEvent(wxEVT_THREAD_WORKER_SIGNAL, wxID_ANY);
+
+	newEvent.SetId(Result.Result);
+	newEvent.SetInt((wxInt32)(size_t)Result.UserData);
+	wxPostEvent((wxEvtHandler*)Data, newEvent);
+}
+
 void dlgMain::MonThrGetServerList()
 {
 	wxFileConfig ConfigInfo;
@@ -806,8 +790,6 @@ void dlgMain::MonThrGetServerList()
 	wxInt32 RetryCount;
 	size_t ServerCount;
 
-	size_t count = 0;
-	size_t serverNum = 0;
 	std::string Address;
 	uint16_t Port = 0;
 
@@ -828,56 +810,43 @@ void dlgMain::MonThrGetServerList()
 	delete[] QServer;
 	QServer = new Server [ServerCount];
 
-	size_t thrvec_size = threadVector.size();
+	// Every server is queried at once from one socket, so a refresh takes
+	// about as long as the slowest server rather than a multiple of the
+	// timeout
+	odalpapi::QueryEngine Engine;
 
-	while(count < ServerCount)
-	{
-		for(size_t i = 0; i < thrvec_size; ++i)
-		{
-			QueryThread* OdaQT = threadVector[i];
-			QueryThread::Status Status = OdaQT->GetStatus();
+	Engine.SetRate(ODA_QRYSENDRATE);
 
-			// Check if the user wants us to exit
-			if(OdaTH->TestDestroy())
-			{
-				return;
-			}
-
-			if(Status == QueryThread::Running)
-			{
-				// Give up some timeslice for this thread so worker thread slots
-				// become available
-				OdaTH->Sleep(15);
+	for(size_t serverNum = 0; serverNum < ServerCount; ++serverNum)
+	{
+		MServer.GetServerAddress(serverNum, Address, Port);
 
-				continue;
-			}
-			else
-				++count;
+		QServer[serverNum].SetAddress(Address, Port);
 
-			// If we got this far, it means a thread has finished and needs more
-			// work, give it a job to do
-			if(serverNum < ServerCount)
-			{
-				//OdaTH->Sleep(1);
-				MServer.GetServerAddress(serverNum, Address, Port);
-
-				OdaQT->Signal(&QServer[serverNum], Address, Port, serverNum,
-				              ServerTimeout, RetryCount);
+		if(!Engine.Add(&QServer[serverNum], ServerTimeout, RetryCount,
+		               (void*)serverNum))
+		{
+			// Unresolvable or listed twice, report it as not responding
+			odalpapi::QueryResult_t Result = { &QServer[serverNum], (void*)serverNum, 0 };
 
-				++serverNum;
-			}
+			MonThrQueryResult(Result, this);
 		}
 	}
 
-	// Wait until all threads have finished before posting an event
-	for(size_t i = 0; i < thrvec_size; ++i)
+	while(Engine.Run(50))
 	{
-		QueryThread* OdaQT = threadVector[i];
+		// Check if the user wants us to exit
+		if(OdaTH->TestDestroy())
+		{
+			Engine.Cancel();
+			return;
+		}
 
-		while(OdaQT->GetStatus() == QueryThread::Running)
-			OdaTH->Sleep(15);
+		Engine.DispatchResults(MonThrQueryResult, this);
 	}
 
+	Engine.DispatchResults(MonThrQueryResult, this);
+
 	MonThrPostEvent(wxEVT_THREAD_MONITOR_SIGNAL, -1,
 	                mtrs_servers_querydone, -1, -1);
 }
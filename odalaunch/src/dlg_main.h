@@ -45,10 +45,10 @@
 #include <wx/timer.h>
 #include <wx/process.h>
 #include <wx/srchctrl.h>
+#include <wx/thread.h>
 
 #include <vector>
 
-#include "query_thread.h"
 #include "net_packet.h"
 
 // custom event declarations
@@ -267,8 +267,6 @@ protected:
 	// Our monitoring thread entry point, from wxThreadHelper
 	void* Entry();
 
-	std::vector<QueryThread*> threadVector;
-
 private:
 
 	DECLARE_EVENT_TABLE()
@@ -94,6 +94,9 @@ static const char* def_masterlist[] =
 // Number of retries to query the game server
 #define ODA_QRYGSRETRYCOUNT 2
 
+// Game server challenges sent per second when refreshing the list
+#define ODA_QRYSENDRATE 1000
+
 // Broadcast across all networks for servers
 #define ODA_QRYUSEBROADCAST 0
 
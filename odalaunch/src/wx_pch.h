@@ -51,7 +51,6 @@
 #include "lst_custom.h"
 #include "main.h"
 #include "md5.h"
-#include "query_thread.h"
 #include "resource.h"
 
 #include "dlg_about.h"
@@ -768,4 +768,14 @@ void BufferedSocket::ClearBuffer()
 	m_BufferPos = 0;
 }
 
+void BufferedSocket::SetData(const byte* Data, const size_t& Size)
+{
+	m_BufferSize = std::min(Size, MAX_PAYLOAD);
+
+	memcpy(m_SocketBuffer, Data, m_BufferSize);
+
+	m_BufferPos = 0;
+	m_BadRead = false;
+}
+
 } // namespace
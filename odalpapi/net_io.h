@@ -148,6 +148,18 @@ public:
 	// Clear buffer
 	void ClearBuffer();
 
+	// Raw access to the buffer, for QueryEngine which does its own socket
+	// I/O.  SetData loads a received packet so it can be read back.
+	const byte* GetBuffer() const
+	{
+		return m_SocketBuffer;
+	}
+	size_t GetBufferPos() const
+	{
+		return m_BufferPos;
+	}
+	void SetData(const byte* Data, const size_t& Size);
+
 private:
 	bool CreateSocket();
 	void DestroySocket();
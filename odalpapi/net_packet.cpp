@@ -59,7 +59,7 @@ int32_t ServerBase::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
+		WriteChallenge(Socket);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
@@ -97,6 +97,33 @@ ok:
 	return 1;
 }
 
+/*
+   Parse a reply that was received by someone else, usually a QueryEngine
+   that sent the challenge written by WriteChallenge
+*/
+int32_t ServerBase::ParseReply(BufferedSocket* s, const uint64_t& Now,
+                               const std::vector<uint64_t>& SentAt)
+{
+	BufferedSocket* OldSocket = Socket;
+
+	Socket = s;
+
+	int32_t Result = Parse();
+
+	Socket = OldSocket;
+
+	// a reply to an earlier challenge can arrive after a retry was sent,
+	// so time it from the challenge it answers when the server says which
+	uint32_t Attempt = GetReplyAttempt();
+
+	if(!Attempt || Attempt > SentAt.size())
+		Attempt = SentAt.size();
+
+	Ping = Attempt ? Now - SentAt[Attempt - 1] : 0;
+
+	return Result;
+}
+
 /*
    Read a packet received from a master server
    */
@@ -180,6 +207,7 @@ Server::~Server()
 void Server::ResetData()
 {
 	m_ValidResponse = false;
+	m_Attempt = 0;
 
 	Info.Cvars.clear();
 	Info.Wads.clear();
@@ -596,6 +624,15 @@ int32_t Server::Parse()
 	return 0;
 }
 
+void Server::WriteChallenge(BufferedSocket* s)
+{
+	s->Write32(challenge);
+	s->Write32(VERSION);
+	s->Write32(PROTOCOL_VERSION);
+	// bond - time, echoed back as Info.PTime
+	s->Write32(m_Attempt);
+}
+
 int32_t Server::Query(int32_t Timeout)
 {
 	int8_t Retry = m_RetryCount;
@@ -612,11 +649,7 @@ int32_t Server::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
-		Socket->Write32(VERSION);
-		Socket->Write32(PROTOCOL_VERSION);
-		// bond - time
-		Socket->Write32(Info.PTime);
+		WriteChallenge(Socket);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
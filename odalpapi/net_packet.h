@@ -223,6 +223,34 @@ public:
 	// Query the server
 	int32_t Query(int32_t Timeout);
 
+	// Write the challenge packet that asks for a reply
+	virtual void WriteChallenge(BufferedSocket* s)
+	{
+		s->Write32(challenge);
+	}
+
+	// Clear any data from a previous reply before querying again
+	virtual void ResetData()
+	{
+	}
+
+	// Number the next challenge, from 1, so a reply can tell which one it
+	// answers.  Only servers that echo the number back make use of it.
+	virtual void SetAttempt(const uint32_t& Attempt)
+	{
+	}
+
+	// The challenge a parsed reply answers, or 0 if the reply doesn't say
+	virtual uint32_t GetReplyAttempt() const
+	{
+		return 0;
+	}
+
+	// Parse a reply to a challenge that was sent by a QueryEngine, SentAt
+	// holds when each challenge of the query was sent
+	int32_t ParseReply(BufferedSocket* s, const uint64_t& Now,
+	                   const std::vector<uint64_t>& SentAt);
+
 	void SetSocket(BufferedSocket* s)
 	{
 		Socket = s;
@@ -476,6 +504,19 @@ public:
 
 	int32_t Query(int32_t Timeout);
 
+	void WriteChallenge(BufferedSocket* s);
+
+	void SetAttempt(const uint32_t& Attempt)
+	{
+		m_Attempt = Attempt;
+	}
+
+	// the server echoes the time field of the challenge
+	uint32_t GetReplyAttempt() const
+	{
+		return Info.PTime;
+	}
+
 	void ReadInformation();
 
 	int32_t TranslateResponse(const uint16_t& TagId,
@@ -494,6 +535,7 @@ protected:
 	bool ReadCvars();
 
 	bool m_ValidResponse;
+	uint32_t m_Attempt;
 };
 
 } // namespace
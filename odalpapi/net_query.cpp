@@ -0,0 +1,457 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Multiplexed server queries
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <errno.h>
+
+#include "net_query.h"
+#include "net_utils.h"
+#include "net_error.h"
+
+#ifdef _WIN32
+#define AI_ALL 0x00000100
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#define closesocket close
+#endif
+
+using namespace std;
+
+namespace odalpapi
+{
+
+#ifndef _WIN32
+static const int INVALID_SOCKET = -1;
+#endif
+
+// the receive buffer is sized for what the server may legally send
+static const size_t MAX_REPLY = MAX_PAYLOAD;
+
+// a few packets may go out back to back after the engine was idle
+static const uint64_t RATE_BURST = 16;
+
+static uint64_t MakeKey(const uint32_t& Address, const uint16_t& Port)
+{
+	return ((uint64_t)Address << 16) | Port;
+}
+
+/*
+   Resolve an address to network byte order, without a lookup if it is
+   already numeric
+*/
+static bool ResolveAddress(const string& Address, uint32_t& Out)
+{
+	uint32_t Numeric = inet_addr(Address.c_str());
+
+	if(Numeric != INADDR_NONE || Address == "255.255.255.255")
+	{
+		Out = Numeric;
+		return true;
+	}
+
+#ifdef _XBOX
+	struct hostent* he = gethostbyname(Address.c_str());
+
+	if(he == NULL)
+		return false;
+
+	Out = ((struct in_addr*)he->h_addr)->s_addr;
+#else
+	addrinfo  hints;
+	addrinfo* result = NULL;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_flags = AI_ALL;
+	hints.ai_family = PF_INET;
+
+	if(getaddrinfo(Address.c_str(), NULL, &hints, &result) != 0 || result == NULL)
+		return false;
+
+	Out = ((sockaddr_in*)result->ai_addr)->sin_addr.s_addr;
+
+	freeaddrinfo(result);
+#endif
+
+	return true;
+}
+
+QueryEngine::QueryEngine() : m_Socket(INVALID_SOCKET), m_Pending(0),
+	m_Wheel(WHEEL_SLOTS), m_WheelTick(0), m_Rate(0), m_Tokens(0),
+	m_LastRefill(0)
+{
+	m_ResultsMutex = threads::MutexFactory::inst().createMutex();
+}
+
+QueryEngine::~QueryEngine()
+{
+	DestroySocket();
+
+	if(NULL != m_ResultsMutex)
+	{
+		delete m_ResultsMutex;
+	}
+}
+
+bool QueryEngine::CreateSocket()
+{
+	if(m_Socket != INVALID_SOCKET)
+		return true;
+
+	m_Socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if(m_Socket == INVALID_SOCKET)
+	{
+		NET_ReportError(REPERR_NO_ARGS);
+
+		return false;
+	}
+
+	// replies are drained until the socket runs dry
+#ifdef _WIN32
+	u_long NonBlocking = 1;
+	ioctlsocket(m_Socket, FIONBIO, &NonBlocking);
+#else
+	fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	// a large receive buffer keeps a burst of replies from being dropped
+	int BufferSize = 1024 * 1024;
+	setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, (char*)&BufferSize,
+	           sizeof(BufferSize));
+
+	return true;
+}
+
+void QueryEngine::DestroySocket()
+{
+	if(m_Socket != INVALID_SOCKET)
+	{
+		if(closesocket(m_Socket) != 0)
+			NET_ReportError("Could not close socket: %d", m_Socket);
+
+		m_Socket = INVALID_SOCKET;
+	}
+}
+
+void QueryEngine::SetRate(const uint32_t& PacketsPerSecond)
+{
+	m_Rate = PacketsPerSecond;
+}
+
+bool QueryEngine::Add(ServerBase* Server, const int32_t& Timeout,
+                      const uint8_t& Retries, void* UserData)
+{
+	string Address;
+	uint16_t Port;
+	uint32_t IP;
+
+	Server->GetAddress(Address, Port);
+
+	if(Address.empty() || !Port || !ResolveAddress(Address, IP))
+		return false;
+
+	uint64_t Key = MakeKey(IP, htons(Port));
+
+	if(m_ByAddress.find(Key) != m_ByAddress.end())
+		return false;
+
+	if(!CreateSocket())
+		return false;
+
+	Query_t Query;
+
+	Query.Server = Server;
+	Query.UserData = UserData;
+	Query.Key = Key;
+	Query.Deadline = 0;
+	Query.Timeout = std::max(Timeout, 1);
+	Query.Retries = std::max(Retries, (uint8_t)1);
+	Query.Active = true;
+
+	Server->ResetData();
+
+	m_ByAddress[Key] = m_Queries.size();
+	m_SendQueue.push_back(m_Queries.size());
+	m_Queries.push_back(Query);
+
+	++m_Pending;
+
+	return true;
+}
+
+/*
+   Put a query on the timer wheel at its deadline
+*/
+void QueryEngine::Schedule(const size_t& Index)
+{
+	Timer_t Timer;
+
+	Timer.Query = Index;
+	Timer.Deadline = m_Queries[Index].Deadline;
+
+	m_Wheel[(Timer.Deadline / WHEEL_TICK) % WHEEL_SLOTS].push_back(Timer);
+}
+
+/*
+   Turn the wheel up to Now, retrying or failing the queries that timed out
+*/
+void QueryEngine::ExpireTimers(const uint64_t& Now)
+{
+	uint64_t NowTick = Now / WHEEL_TICK;
+
+	if(!m_WheelTick)
+		m_WheelTick = NowTick;
+
+	// after a long stall every slot needs looking at, but only once
+	if(NowTick - m_WheelTick >= WHEEL_SLOTS)
+		m_WheelTick = NowTick - WHEEL_SLOTS + 1;
+
+	for(; m_WheelTick <= NowTick; ++m_WheelTick)
+	{
+		vector<Timer_t>& Slot = m_Wheel[m_WheelTick % WHEEL_SLOTS];
+
+		for(size_t i = 0; i < Slot.size(); )
+		{
+			Query_t& Query = m_Queries[Slot[i].Query];
+
+			// answered, or rescheduled by a retry
+			bool Stale = !Query.Active || Query.Deadline != Slot[i].Deadline;
+
+			if(!Stale && Slot[i].Deadline > Now)
+			{
+				// due on a later turn of the wheel
+				++i;
+				continue;
+			}
+
+			size_t Index = Slot[i].Query;
+
+			Slot[i] = Slot.back();
+			Slot.pop_back();
+
+			if(Stale)
+				continue;
+
+			if(--Query.Retries)
+				m_SendQueue.push_back(Index);
+			else
+				Finish(Index, 0);
+		}
+	}
+
+	// the current tick may still gain timers, look at it again next time
+	m_WheelTick = NowTick;
+}
+
+/*
+   Send as many queued challenges as the rate allows
+*/
+void QueryEngine::SendChallenges(const uint64_t& Now)
+{
+	if(m_Rate)
+	{
+		uint64_t Elapsed = m_LastRefill ? Now - m_LastRefill : 1000;
+
+		m_Tokens = std::min(m_Tokens + Elapsed * m_Rate, RATE_BURST * 1000);
+		m_LastRefill = Now;
+	}
+
+	while(!m_SendQueue.empty())
+	{
+		if(m_Rate && m_Tokens < 1000)
+			break;
+
+		size_t Index = m_SendQueue.front();
+		m_SendQueue.pop_front();
+
+		Query_t& Query = m_Queries[Index];
+
+		if(!Query.Active)
+			continue;
+
+		struct sockaddr_in To;
+
+		memset(&To, 0, sizeof(To));
+		To.sin_family = PF_INET;
+		To.sin_addr.s_addr = (uint32_t)(Query.Key >> 16);
+		To.sin_port = (uint16_t)(Query.Key & 0xFFFF);
+
+		// a failed send is treated as a lost packet and retried
+		Query.SentAt.push_back(Now);
+		Query.Deadline = Now + Query.Timeout;
+		Schedule(Index);
+
+		m_Buffer.ClearBuffer();
+		Query.Server->SetAttempt(Query.SentAt.size());
+		Query.Server->WriteChallenge(&m_Buffer);
+
+		int32_t BytesSent = sendto(m_Socket, (const char*)m_Buffer.GetBuffer(),
+		                           m_Buffer.GetBufferPos(), 0,
+		                           (struct sockaddr*)&To, sizeof(To));
+
+		if(BytesSent < 0)
+			NET_ReportError(REPERR_NO_ARGS);
+
+		if(m_Rate)
+			m_Tokens -= 1000;
+	}
+}
+
+/*
+   Read every waiting reply and hand it to the server it came from
+*/
+void QueryEngine::ReadReplies(const uint64_t& Now)
+{
+	byte Reply[MAX_REPLY];
+
+	while(1)
+	{
+		struct sockaddr_in From;
+		socklen_t FromLen = sizeof(From);
+
+		int32_t BytesReceived = recvfrom(m_Socket, (char*)Reply, sizeof(Reply), 0,
+		                                 (struct sockaddr*)&From, &FromLen);
+
+		// nothing left, or an ICMP error for one of the servers
+		if(BytesReceived <= 0)
+			break;
+
+		map<uint64_t, size_t>::iterator it =
+		    m_ByAddress.find(MakeKey(From.sin_addr.s_addr, From.sin_port));
+
+		// a stray packet, or a late reply to a query that already finished
+		// or has not sent its challenge yet
+		if(it == m_ByAddress.end() || !m_Queries[it->second].Active ||
+		   m_Queries[it->second].SentAt.empty())
+			continue;
+
+		size_t Index = it->second;
+		Query_t& Query = m_Queries[Index];
+
+		m_Buffer.SetData(Reply, BytesReceived);
+
+		int32_t Result = Query.Server->ParseReply(&m_Buffer, Now, Query.SentAt);
+
+		Finish(Index, Result ? 1 : 0);
+	}
+}
+
+void QueryEngine::Finish(const size_t& Index, const int32_t& Result)
+{
+	Query_t& Query = m_Queries[Index];
+
+	Query.Active = false;
+	m_ByAddress.erase(Query.Key);
+	--m_Pending;
+
+	QueryResult_t Finished;
+
+	Finished.Server = Query.Server;
+	Finished.UserData = Query.UserData;
+	Finished.Result = Result;
+
+	if(NULL != m_ResultsMutex)
+		m_ResultsMutex->getLock();
+
+	m_Results.push_back(Finished);
+
+	if(NULL != m_ResultsMutex)
+		m_ResultsMutex->unlock();
+}
+
+size_t QueryEngine::Run(const uint32_t& Wait)
+{
+	uint64_t Start = GetMillisNow();
+	uint64_t Now = Start;
+
+	while(m_Pending)
+	{
+		ExpireTimers(Now);
+		SendChallenges(Now);
+
+		if(!m_Pending || Now - Start >= Wait)
+			break;
+
+		// sleep until a reply arrives, the next timer tick or the next
+		// packet may be sent
+		uint64_t Sleep = WHEEL_TICK - Now % WHEEL_TICK;
+
+		if(!m_SendQueue.empty() && m_Rate)
+			Sleep = std::min(Sleep, (uint64_t)(1000 / m_Rate) + 1);
+
+		Sleep = std::min(Sleep, Wait - (Now - Start));
+
+		fd_set readfds;
+		struct timeval tv;
+
+		FD_ZERO(&readfds);
+		FD_SET(m_Socket, &readfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = Sleep * 1000;
+
+		int32_t res = select(m_Socket + 1, &readfds, NULL, NULL, &tv);
+
+		Now = GetMillisNow();
+
+		if(res > 0)
+			ReadReplies(Now);
+		else if(res < 0 && errno != EINTR)
+			NET_ReportError(REPERR_NO_ARGS);
+	}
+
+	return m_Pending;
+}
+
+size_t QueryEngine::DispatchResults(QueryCallback Callback, void* CallbackData)
+{
+	vector<QueryResult_t> Results;
+
+	if(NULL != m_ResultsMutex)
+		m_ResultsMutex->getLock();
+
+	Results.swap(m_Results);
+
+	if(NULL != m_ResultsMutex)
+		m_ResultsMutex->unlock();
+
+	for(size_t i = 0; i < Results.size(); ++i)
+		Callback(Results[i], CallbackData);
+
+	return Results.size();
+}
+
+void QueryEngine::Cancel()
+{
+	m_Queries.clear();
+	m_ByAddress.clear();
+	m_SendQueue.clear();
+	m_Pending = 0;
+
+	for(size_t i = 0; i < m_Wheel.size(); ++i)
+		m_Wheel[i].clear();
+}
+
+} // namespace
@@ -0,0 +1,145 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Multiplexed server queries
+//
+//  QueryEngine queries many servers at once from a single socket.  The
+//  challenges go out at a limited rate and replies are matched to their
+//  server by address.  Timeouts and retries run off a timer wheel.
+//  Finished queries are queued and handed to a callback by
+//  DispatchResults, so the caller decides which thread sees them.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef NET_QUERY_H
+#define NET_QUERY_H
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "net_io.h"
+#include "net_packet.h"
+#include "typedefs.h"
+#include "threads/mutex_factory.h"
+
+namespace odalpapi
+{
+
+// A finished query
+struct QueryResult_t
+{
+	ServerBase* Server;
+	void*       UserData;
+	int32_t     Result;     // what ServerBase::Query would have returned
+};
+
+typedef void (*QueryCallback)(const QueryResult_t& Result, void* CallbackData);
+
+class QueryEngine
+{
+public:
+	QueryEngine();
+	~QueryEngine();
+
+	// Limits how many challenges are sent each second, 0 for no limit
+	void SetRate(const uint32_t& PacketsPerSecond);
+
+	// Queues a query of Server, which must have its address set.  Each
+	// attempt waits Timeout milliseconds and up to Retries attempts are
+	// made, as with ServerBase::Query.  Returns false if the address does
+	// not resolve or the server is already being queried.
+	bool Add(ServerBase* Server, const int32_t& Timeout, const uint8_t& Retries,
+	         void* UserData = NULL);
+
+	// Sends challenges, reads replies and expires timeouts for up to Wait
+	// milliseconds.  Returns the number of queries that have not finished.
+	size_t Run(const uint32_t& Wait);
+
+	// Calls Callback for every query that has finished since the last call
+	size_t DispatchResults(QueryCallback Callback, void* CallbackData);
+
+	// Drops all unfinished queries without reporting them
+	void Cancel();
+
+	size_t GetPending() const
+	{
+		return m_Pending;
+	}
+
+private:
+	QueryEngine(const QueryEngine&);
+	QueryEngine& operator=(const QueryEngine&);
+
+	struct Query_t
+	{
+		ServerBase* Server;
+		void*       UserData;
+		uint64_t    Key;        // address and port
+		std::vector<uint64_t> SentAt;   // when each challenge went out
+		uint64_t    Deadline;
+		int32_t     Timeout;
+		uint8_t     Retries;    // attempts left
+		bool        Active;
+	};
+
+	// Timer wheel slots are WHEEL_TICK milliseconds wide, a timeout longer
+	// than a turn of the wheel stays in its slot until it is due
+	static const uint64_t WHEEL_TICK = 10;
+	static const size_t WHEEL_SLOTS = 256;
+
+	struct Timer_t
+	{
+		size_t      Query;
+		uint64_t    Deadline;
+	};
+
+	bool CreateSocket();
+	void DestroySocket();
+
+	void Schedule(const size_t& Index);
+	void ExpireTimers(const uint64_t& Now);
+	void SendChallenges(const uint64_t& Now);
+	void ReadReplies(const uint64_t& Now);
+	void Finish(const size_t& Index, const int32_t& Result);
+
+	SOCKET m_Socket;
+
+	// challenges are written to and replies parsed from here
+	BufferedSocket m_Buffer;
+
+	std::vector<Query_t> m_Queries;
+	std::map<uint64_t, size_t> m_ByAddress;
+	std::deque<size_t> m_SendQueue;
+	size_t m_Pending;
+
+	std::vector<std::vector<Timer_t> > m_Wheel;
+	uint64_t m_WheelTick;
+
+	// send rate limiting, tokens are thousandths of a packet
+	uint32_t m_Rate;
+	uint64_t m_Tokens;
+	uint64_t m_LastRefill;
+
+	std::vector<QueryResult_t> m_Results;
+	threads::Mutex* m_ResultsMutex;
+};
+
+} // namespace
+
+#endif // NET_QUERY_H
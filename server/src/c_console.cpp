@@ -41,6 +41,8 @@
 #include "r_main.h"
 #include "s_sound.h"
 #include "sv_main.h"
+#include "sv_log.h"
+#include "cmdlib.h"
 #include "doomstat.h"
 #include "gi.h"
 
@@ -129,6 +131,7 @@ int VPrintf(int printlevel, const char* format, va_list parms)
 
 	std::string str(TimeStamp());
 	str.append(" ");
+	const size_t stamplen = str.length();
 	str.append(outline);
 
 	if (str[str.length() - 1] != '\n')
@@ -147,12 +150,17 @@ int VPrintf(int printlevel, const char* format, va_list parms)
 		}
 	}
 
-	if (LOG.is_open()) {
-		LOG << str;
-		LOG.flush();
-	}
+	// stdout and the log files are written by the log thread
+	SV_LogLine(printlevel, str, stamplen);
+
+	// what reaches stdout, as PrintString returned
+	StripColorCodes(str);
+	return str.length();
+}
 
-	return PrintString(printlevel, str.c_str());
+void C_FlushLog()
+{
+	SV_LogFlush();
 }
 
 int STACK_ARGS Printf (int printlevel, const char *format, ...)
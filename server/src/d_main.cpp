@@ -73,6 +73,9 @@
 #include "gi.h"
 #include "sv_main.h"
 #include "sv_banlist.h"
+#include "sv_supervisor.h"
+#include "sv_bench.h"
+#include "sv_log.h"
 
 #include "res_texture.h"
 #include "w_ident.h"
@@ -126,6 +129,7 @@ void D_DoomLoop (void)
 		{
 			Printf (PRINT_HIGH, "ERROR: %s\n", error.GetMsg().c_str());
 			Printf (PRINT_HIGH, "sleeping for 10 seconds before map reload...");
+			SV_LogFlush();
 
 			// denis - drop clients
 			SV_SendDisconnectSignal();
@@ -249,6 +253,7 @@ void STACK_ARGS D_Shutdown()
 void D_DoomMain()
 {
 	unsigned int p;
+	dtime_t started = I_GetTime();
 
 	gamestate = GS_STARTUP;
 
@@ -283,6 +288,15 @@ void D_DoomMain()
 
 	D_LoadResourceFiles(newwadfiles, newpatchfiles);
 
+	#ifdef UNIX
+	// parse the resources once, the supervised instances inherit them
+	if (Args.CheckParm("-supervise"))
+	{
+		D_Init();
+		SV_Supervise(started);		// only returns in an instance
+	}
+	#endif
+
 	// Ch0wW: Loading the config here fixes the "addmap" issue.
 	M_LoadDefaults();					// load before initing other systems
 	C_ExecCmdLineParams(true, false);	// [RH] do all +set commands on the command line
@@ -291,7 +305,8 @@ void D_DoomMain()
 	I_Init();
 
 	// [SL] Call init routines that need to be reinitialized every time WAD changes
-	D_Init();
+	if (!SV_SupervisedInstance())
+		D_Init();
 	atterm(D_Shutdown);
 
 	Printf(PRINT_HIGH, "SV_InitNetwork: Checking network game status.\n");
@@ -360,7 +375,8 @@ void D_DoomMain()
 	Printf(PRINT_HIGH, "========== Odamex Server Initialized ==========\n");
 
 	#ifdef UNIX
-	if (Args.CheckParm("-fork"))
+	// a supervised instance's supervisor is already in the background
+	if (Args.CheckParm("-fork") && !SV_SupervisedInstance())
 		daemon_init();
 	#endif
 
@@ -395,6 +411,11 @@ void D_DoomMain()
 
 	G_ChangeMap();
 
+	SV_ReportStartup(started);
+
+	// -playsimbench runs the map flat out and quits
+	SV_PlaysimBenchmark();
+
 	D_DoomLoop();	// never returns
 }
 
@@ -59,6 +59,7 @@
 #include "sc_man.h"
 #include "sv_main.h"
 #include "sv_maplist.h"
+#include "sv_sqp.h"
 #include "sv_vote.h"
 #include "v_video.h"
 #include "w_wad.h"
@@ -692,6 +693,9 @@ void G_DoLoadLevel (int position)
 
 	G_InitLevelLocals ();
 
+	// Launcher responses still describe the previous map
+	SV_QryInvalidateCache();
+
 	if (firstmapinit) {
 		Printf (PRINT_HIGH, "--- %s: \"%s\" ---\n", level.mapname, level.level_name);
 		firstmapinit = false;
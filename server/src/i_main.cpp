@@ -53,6 +53,7 @@
 #include "errors.h"
 #include "i_net.h"
 #include "sv_main.h"
+#include "sv_log.h"
 #include "m_ostring.h"
 
 using namespace std;
@@ -109,6 +110,7 @@ int __cdecl main(int argc, char *argv[])
 {
 	// [AM] Set crash callbacks, so we get something useful from crashes.
 	I_SetCrashCallbacks();
+	I_SetCrashLogFlush(SV_LogCrashFlush);
 
     try
     {
@@ -162,6 +164,8 @@ int __cdecl main(int argc, char *argv[])
     }
     catch (CDoomError &error)
     {
+		SV_LogStop();
+
 		if (LOG.is_open())
         {
             LOG << error.GetMsg() << std::endl;
@@ -211,6 +215,9 @@ void daemon_init(void)
 
     Printf(PRINT_HIGH, "Launched into the background\n");
 
+    // the child would not have the log thread
+    SV_LogStop();
+
     if ((pid = fork()) != 0)
     {
     	call_terms();
@@ -234,6 +241,7 @@ int main (int argc, char **argv)
 {
 	// [AM] Set crash callbacks, so we get something useful from crashes.
 	I_SetCrashCallbacks();
+	I_SetCrashLogFlush(SV_LogCrashFlush);
 
     try
     {
@@ -283,6 +291,8 @@ int main (int argc, char **argv)
     }
     catch (CDoomError &error)
     {
+	SV_LogStop();
+
 	fprintf (stderr, "%s\n", error.GetMsg().c_str());
 
 	if (LOG.is_open())
@@ -141,6 +141,10 @@ void S_StopAllChannels (void)
 {
 }
 
+void S_MuteSounds (bool mute)
+{
+}
+
 // Moves all the sounds from one thing to another. If the destination is
 // NULL, then the sound becomes a positioned sound.
 void S_RelinkSound (AActor *from, AActor *to)
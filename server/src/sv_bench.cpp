@@ -0,0 +1,531 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Playsim benchmark
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "c_console.h"
+#include "m_argv.h"
+#include "i_system.h"
+#include "actor.h"
+#include "info.h"
+#include "p_local.h"
+#include "r_state.h"
+#include "sv_main.h"
+#include "sv_bench.h"
+
+void STACK_ARGS call_terms (void);
+void SV_StepTics (QWORD count);
+
+extern unsigned char prndindex;
+
+// Thinkers are timed one tic in this many.  The other tics give the tic
+// rate, so that it does not include the cost of the timing.  The profiled
+// tic moves around within each group of tics so that it does not keep
+// landing on the same step of the monsters' state cycles.
+static const int BENCH_PROFILE_INTERVAL = 4;
+
+struct benchclass_t
+{
+	benchclass_t() : time(0), count(0) {}
+
+	dtime_t		time;
+	size_t		count;
+};
+
+typedef std::map<const TypeInfo *, benchclass_t> benchclasses_t;
+
+static benchclasses_t bench_classes;
+static dtime_t bench_thinktime;		// sum of the thinkers' own times
+
+// first and last timestamp of the profiled tic's thinkers, which is the
+// time spent in DThinker::RunThinkers including the cost of timing
+static dtime_t bench_phasestart;
+static dtime_t bench_phaseend;
+
+//
+// SV_BenchThink
+//
+// DThinker::ThinkHook for the tics that are profiled
+//
+static void SV_BenchThink(DThinker *thinker)
+{
+	const TypeInfo *type = RUNTIME_TYPE(thinker);
+
+	dtime_t start = I_GetTime();
+	thinker->RunThink();
+	bench_phaseend = I_GetTime();
+
+	dtime_t elapsed = bench_phaseend - start;
+	if (bench_phasestart == 0)
+		bench_phasestart = start;
+
+	benchclass_t &bc = bench_classes[type];
+	bc.time += elapsed;
+	bc.count++;
+	bench_thinktime += elapsed;
+}
+
+static bool SV_BenchCompareClasses(const std::pair<const TypeInfo *, benchclass_t> &a,
+                                   const std::pair<const TypeInfo *, benchclass_t> &b)
+{
+	return a.second.time > b.second.time;
+}
+
+static inline void SV_BenchHash(DWORD &sum, int value)
+{
+	// FNV-1a, a word at a time
+	sum = (sum ^ (DWORD)value) * 16777619u;
+}
+
+//
+// SV_WorldChecksum
+//
+// Sums up everything the playsim changes from one tic to the next that
+// would show a desync: the actors, the sectors and the random number index.
+//
+static DWORD SV_WorldChecksum()
+{
+	DWORD sum = 2166136261u;
+
+	AActor *mo;
+	TThinkerIterator<AActor> iterator;
+	while ((mo = iterator.Next()))
+	{
+		SV_BenchHash(sum, mo->type);
+		SV_BenchHash(sum, mo->x);
+		SV_BenchHash(sum, mo->y);
+		SV_BenchHash(sum, mo->z);
+		SV_BenchHash(sum, mo->momx);
+		SV_BenchHash(sum, mo->momy);
+		SV_BenchHash(sum, mo->momz);
+		SV_BenchHash(sum, mo->angle);
+		SV_BenchHash(sum, mo->health);
+		SV_BenchHash(sum, mo->flags);
+		SV_BenchHash(sum, mo->state ? mo->state - states : -1);
+		SV_BenchHash(sum, mo->tics);
+		SV_BenchHash(sum, mo->movedir);
+		SV_BenchHash(sum, mo->movecount);
+		SV_BenchHash(sum, mo->target ? mo->target->netid : -1);
+	}
+
+	for (int i = 0; i < numsectors; i++)
+	{
+		SV_BenchHash(sum, sectors[i].floorplane.d);
+		SV_BenchHash(sum, sectors[i].ceilingplane.d);
+		SV_BenchHash(sum, sectors[i].lightlevel);
+	}
+
+	SV_BenchHash(sum, prndindex);
+	SV_BenchHash(sum, level.time);
+
+	return sum;
+}
+
+//
+// SV_BenchRandom
+//
+// The monsters are placed with a generator of their own so that the game's
+// random numbers start out the same whether monsters are added or not.
+//
+static DWORD bench_seed = 1;
+
+static int SV_BenchRandom(int range)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return (bench_seed >> 8) % range;
+}
+
+//
+// SV_BenchPointInMap
+//
+// Checks that a point is on the inside of every seg of its subsector, which
+// rules out the void outside the map and inside solid pillars.
+//
+static bool SV_BenchPointInMap(fixed_t x, fixed_t y)
+{
+	subsector_t *subsector = P_PointInSubsector(x, y);
+
+	for (unsigned int i = 0; i < subsector->numlines; i++)
+	{
+		const seg_t *seg = &segs[subsector->firstline + i];
+
+		SQWORD dx = (x - seg->v1->x) >> FRACBITS;
+		SQWORD dy = (y - seg->v1->y) >> FRACBITS;
+		SQWORD ldx = (seg->v2->x - seg->v1->x) >> FRACBITS;
+		SQWORD ldy = (seg->v2->y - seg->v1->y) >> FRACBITS;
+
+		if (dx * ldy - dy * ldx <= 0)
+			return false;
+	}
+
+	return true;
+}
+
+// bounds of the map's vertexes
+static fixed_t bench_minx, bench_miny;
+static int bench_width, bench_height;
+
+//
+// SV_BenchFindBounds
+//
+static void SV_BenchFindBounds()
+{
+	fixed_t minx = MAXINT, miny = MAXINT, maxx = MININT, maxy = MININT;
+	for (int i = 0; i < numvertexes; i++)
+	{
+		minx = MIN(minx, vertexes[i].x);
+		miny = MIN(miny, vertexes[i].y);
+		maxx = MAX(maxx, vertexes[i].x);
+		maxy = MAX(maxy, vertexes[i].y);
+	}
+
+	bench_minx = minx;
+	bench_miny = miny;
+	bench_width = ((maxx - minx) >> FRACBITS) + 1;
+	bench_height = ((maxy - miny) >> FRACBITS) + 1;
+}
+
+//
+// SV_BenchRandomPoint
+//
+// Picks a random point within the bounds of the map, which may be outside
+// of the map itself
+//
+static void SV_BenchRandomPoint(fixed_t &x, fixed_t &y)
+{
+	x = bench_minx + (SV_BenchRandom(bench_width) << FRACBITS);
+	y = bench_miny + (SV_BenchRandom(bench_height) << FRACBITS);
+}
+
+//
+// SV_BenchSpawnMonsters
+//
+// Spawns count monsters at random spots where they fit.  Returns how many
+// were placed.
+//
+static int SV_BenchSpawnMonsters(int count)
+{
+	static const mobjtype_t types[] = { MT_POSSESSED, MT_SHOTGUY, MT_TROOP, MT_SERGEANT };
+	static const int numtypes = sizeof(types) / sizeof(types[0]);
+
+	if (numvertexes == 0)
+		return 0;
+
+	int spawned = 0;
+	for (int attempt = 0; spawned < count && attempt < count * 20; attempt++)
+	{
+		fixed_t x, y;
+		SV_BenchRandomPoint(x, y);
+
+		if (!SV_BenchPointInMap(x, y))
+			continue;
+
+		AActor *mo = new AActor(x, y, ONFLOORZ, types[spawned % numtypes]);
+
+		if (mo->ceilingz - mo->floorz < mo->height || !P_CheckPosition(mo, x, y))
+		{
+			mo->Destroy();
+			continue;
+		}
+
+		mo->angle = ANG45 * SV_BenchRandom(8);
+		level.total_monsters++;
+		spawned++;
+	}
+
+	return spawned;
+}
+
+//
+// SV_BenchWakeMonsters
+//
+// With nobody in the game the monsters would never leave their spawn
+// state, so each one is given another monster to fight.
+//
+static void SV_BenchWakeMonsters()
+{
+	std::vector<AActor *> monsters;
+
+	AActor *mo;
+	TThinkerIterator<AActor> iterator;
+	while ((mo = iterator.Next()))
+	{
+		if ((mo->flags & MF_COUNTKILL) && mo->health > 0)
+			monsters.push_back(mo);
+	}
+
+	if (monsters.size() < 2)
+		return;
+
+	for (size_t i = 0; i < monsters.size(); i++)
+	{
+		size_t other = SV_BenchRandom(monsters.size() - 1);
+		if (other >= i)
+			other++;
+
+		mo = monsters[i];
+		mo->target = monsters[other]->ptr();
+
+		if (mo->info->seestate != S_NULL)
+			P_SetMobjState(mo, (statenum_t)mo->info->seestate);
+	}
+}
+
+//
+// SV_BenchTraverse
+//
+// Traverser for the trace benchmark.  Sums up what the trace passes
+// through and stops at one-sided lines, like a hitscan attack.
+//
+static DWORD bench_tracesum;
+
+static BOOL SV_BenchTraverse(intercept_t *in)
+{
+	SV_BenchHash(bench_tracesum, in->frac);
+
+	if (in->isaline)
+	{
+		SV_BenchHash(bench_tracesum, in->d.line - lines);
+		return in->d.line->backsector != NULL;
+	}
+
+	SV_BenchHash(bench_tracesum, in->d.thing->netid);
+	return true;
+}
+
+//
+// SV_BenchTraces
+//
+// Runs count P_PathTraverse calls of MISSILERANGE from random spots in
+// random directions, the way P_LineAttack does, and reports the time per
+// trace along with a checksum of everything they passed through.
+//
+static void SV_BenchTraces(int count)
+{
+	if (numvertexes == 0 || count <= 0)
+		return;
+
+	bench_tracesum = 2166136261u;
+
+	int traced = 0;
+	dtime_t elapsed = 0;
+
+	for (int attempt = 0; traced < count && attempt < count * 20; attempt++)
+	{
+		fixed_t x, y;
+		SV_BenchRandomPoint(x, y);
+
+		if (!SV_BenchPointInMap(x, y))
+			continue;
+
+		int an = SV_BenchRandom(FINEANGLES);
+		fixed_t x2 = x + (MISSILERANGE >> FRACBITS) * finecosine[an];
+		fixed_t y2 = y + (MISSILERANGE >> FRACBITS) * finesine[an];
+
+		dtime_t start = I_GetTime();
+		P_PathTraverse(x, y, x2, y2, PT_ADDLINES|PT_ADDTHINGS, SV_BenchTraverse);
+		elapsed += I_GetTime() - start;
+
+		traced++;
+	}
+
+	Printf(PRINT_HIGH, "Trace benchmark: %d traces, %.3f us/trace, checksum %08x\n",
+		traced, traced ? elapsed / 1e3 / traced : 0.0, bench_tracesum);
+}
+
+//
+// SV_BenchReadChecksums
+//
+static bool SV_BenchReadChecksums(const char *filename, std::vector<DWORD> &checksums)
+{
+	FILE *f = fopen(filename, "r");
+	if (f == NULL)
+		return false;
+
+	int tic;
+	unsigned int checksum;
+	while (fscanf(f, "%d %x", &tic, &checksum) == 2)
+	{
+		if (tic != (int)checksums.size())
+			break;
+		checksums.push_back(checksum);
+	}
+
+	fclose(f);
+	return true;
+}
+
+//
+// SV_PlaysimBenchmark
+//
+void SV_PlaysimBenchmark()
+{
+	size_t p = Args.CheckParm("-playsimbench");
+	if (!p)
+		return;
+
+	int tics = 0;
+	if (p < Args.NumArgs() - 1)
+		tics = atoi(Args.GetArg(p + 1));
+	if (tics <= 0)
+		tics = 1000;
+
+	const char *monsters = Args.CheckValue("-benchmonsters");
+	const char *traces = Args.CheckValue("-benchtraces");
+	const char *checksumfile = Args.CheckValue("-benchchecksums");
+	const char *baselinefile = Args.CheckValue("-benchbaseline");
+
+	std::vector<DWORD> baseline;
+	if (baselinefile && !SV_BenchReadChecksums(baselinefile, baseline))
+		I_FatalError("Could not read benchmark baseline %s", baselinefile);
+
+	FILE *checksums = NULL;
+	if (checksumfile && (checksums = fopen(checksumfile, "w")) == NULL)
+		I_FatalError("Could not create %s", checksumfile);
+
+	// the first tic loads the map, as in the main loop
+	SV_StepTics(1);
+	if (gamestate != GS_LEVEL)
+		I_FatalError("Playsim benchmark: no level was loaded");
+
+	SV_BenchFindBounds();
+
+	int added = 0;
+	if (monsters)
+		added = SV_BenchSpawnMonsters(atoi(monsters));
+	SV_BenchWakeMonsters();
+
+	Printf(PRINT_HIGH, "Playsim benchmark: %s, %d tics, %d monsters added\n",
+		level.mapname, tics, added);
+
+	if (traces)
+		SV_BenchTraces(atoi(traces));
+
+	dtime_t plaintime = 0, profiledtime = 0, thinkphase = 0;
+	int plaintics = 0, profiledtics = 0;
+	int mismatches = 0, firstmismatch = -1;
+	DWORD checksum = 0;
+
+	bench_classes.clear();
+	bench_thinktime = 0;
+
+	for (int tic = 0; tic < tics; tic++)
+	{
+		const bool profile = (tic % BENCH_PROFILE_INTERVAL) ==
+			(tic / BENCH_PROFILE_INTERVAL) % BENCH_PROFILE_INTERVAL;
+		DThinker::ThinkHook = profile ? SV_BenchThink : NULL;
+
+		bench_phasestart = bench_phaseend = 0;
+
+		dtime_t start = I_GetTime();
+		SV_StepTics(1);
+		dtime_t elapsed = I_GetTime() - start;
+
+		if (profile)
+		{
+			profiledtime += elapsed;
+			thinkphase += bench_phaseend - bench_phasestart;
+			profiledtics++;
+		}
+		else
+		{
+			plaintime += elapsed;
+			plaintics++;
+		}
+
+		checksum = SV_WorldChecksum();
+
+		if (checksums)
+			fprintf(checksums, "%d %08x\n", tic, checksum);
+
+		if (tic < (int)baseline.size() && baseline[tic] != checksum)
+		{
+			if (firstmismatch < 0)
+				firstmismatch = tic;
+			mismatches++;
+		}
+	}
+
+	DThinker::ThinkHook = NULL;
+
+	if (checksums)
+		fclose(checksums);
+
+	const double ms = plaintime / 1e6 / MAX(plaintics, 1);
+	Printf(PRINT_HIGH, "%.1f tics/s, %.3f ms/tic\n", ms > 0.0 ? 1000.0 / ms : 0.0, ms);
+
+	// Timing each thinker slows them down, so the profiled tics only give
+	// the share of each class and the time spent outside the thinkers.
+	if (profiledtics && bench_thinktime && ms > 0.0)
+	{
+		std::vector<std::pair<const TypeInfo *, benchclass_t> > classes(
+			bench_classes.begin(), bench_classes.end());
+		std::sort(classes.begin(), classes.end(), SV_BenchCompareClasses);
+
+		// the part of the profiled tics spent outside the thinkers
+		double rest = 0.0;
+		if (profiledtime > thinkphase)
+			rest = ms * (profiledtime - thinkphase) / profiledtime;
+		const double thinkms = ms - rest;
+
+		Printf(PRINT_HIGH, "%-20s %8s %8s %6s\n", "class", "count", "ms/tic", "share");
+
+		for (size_t i = 0; i < classes.size(); i++)
+		{
+			const benchclass_t &bc = classes[i].second;
+			const double classms = thinkms * bc.time / bench_thinktime;
+
+			Printf(PRINT_HIGH, "%-20s %8d %8.3f %5.1f%%\n", classes[i].first->Name,
+				(int)(bc.count / profiledtics), classms, 100.0 * classms / ms);
+		}
+
+		Printf(PRINT_HIGH, "%-20s %8s %8.3f %5.1f%%\n", "rest of the tic", "",
+			rest, 100.0 * rest / ms);
+	}
+
+	Printf(PRINT_HIGH, "Checksum after tic %d: %08x\n", tics - 1, checksum);
+
+	if (baselinefile)
+	{
+		if (mismatches)
+			Printf(PRINT_HIGH, "%d of %d tics differ from %s, the first is tic %d\n",
+				mismatches, MIN(tics, (int)baseline.size()), baselinefile, firstmismatch);
+		else if ((int)baseline.size() < tics)
+			Printf(PRINT_HIGH, "The first %d tics match %s, it has no more\n",
+				(int)baseline.size(), baselinefile);
+		else
+			Printf(PRINT_HIGH, "All tics match %s\n", baselinefile);
+	}
+
+	call_terms();
+	exit(mismatches ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+VERSION_CONTROL (sv_bench_cpp, "$Id$")
@@ -0,0 +1,40 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Playsim benchmark
+//
+//	"-playsimbench <tics>" runs the starting map for that many tics as
+//	fast as it can with no clients, reports tics per second with the time
+//	taken by each thinker class and quits.  "-benchmonsters <n>" adds n
+//	monsters at random spots first.  A checksum of the world is taken
+//	after every tic: "-benchchecksums <file>" writes them out and
+//	"-benchbaseline <file>" compares them with an earlier run, so that
+//	changes to the playsim can be checked for determinism.
+//	"-benchtraces <n>" times n hitscan traces from random spots before
+//	the tics are run and prints a checksum of what they passed through.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_BENCH_H__
+#define __SV_BENCH_H__
+
+// Runs the benchmark if it was asked for on the command line, in which
+// case it does not return
+void SV_PlaysimBenchmark();
+
+#endif	// __SV_BENCH_H__
@@ -33,6 +33,24 @@ CVAR(			log_fulltimestamps, "0", "Extended timestamp info (dd/mm/yyyy hh:mm:ss)"
 CVAR(			log_packetdebug, "0", "Print debugging messages for each packet sent",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
 
+CVAR_RANGE_FUNC_DECL(log_flushinterval, "250", "Milliseconds console lines may wait before they are written to the log",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 10000.0f)
+
+CVAR_RANGE_FUNC_DECL(log_flushsize, "65536", "Bytes of console lines collected before they are written to the log",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 1024.0f, 16777216.0f)
+
+CVAR_FUNC_DECL(	log_jsonfile, "", "Also write the log to this file as one JSON object per line, empty to disable",
+				CVARTYPE_STRING, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE)
+
+CVAR_RANGE(		sv_ticstats_interval, "0", "Seconds between writing tic phase timings to sv_ticstats_file, 0 to disable",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 86400.0f)
+
+CVAR(			sv_ticstats_file, "ticstats.json", "File the tic phase timings are written to as JSON",
+				CVARTYPE_STRING, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE)
+
+CVAR_RANGE_FUNC_DECL(sv_statsport, "0", "Port on 127.0.0.1 that serves per-client network metrics, 0 to disable",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 65535.0f)
+
 // Server administrative settings
 // ------------------------------
 
@@ -114,6 +132,18 @@ CVAR_RANGE_FUNC_DECL(sv_maxrate, "200", "Forces clients to be on or below this r
 CVAR_RANGE_FUNC_DECL(sv_waddownloadcap, "200", "Cap wad file downloading to a specific rate",
 				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 7.0f, 100000.0f)
 
+CVAR_RANGE(		sv_qrycacheage, "1000", "Maximum age of a cached launcher query response (in milliseconds), " \
+				"0 rebuilds the response for every query",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 60000.0f)
+
+CVAR_RANGE(		sv_qryratelimit, "4", "Launcher queries allowed per second from a single address, " \
+				"0 disables the limit",
+				CVARTYPE_FLOAT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 1000.0f)
+
+CVAR_RANGE(		sv_qryburst, "8", "Launcher queries a single address may send in a burst before " \
+				"sv_qryratelimit applies",
+				CVARTYPE_FLOAT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 1.0f, 1000.0f)
+
 #ifdef ODA_HAVE_MINIUPNP
 CVAR(			sv_upnp, "1", "Enable UPnP support",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
@@ -241,6 +271,10 @@ CVAR(			sv_dmfarspawn, "0", "EXPERIMENTAL: When enabled in DM, players will spaw
                 "from each other.",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE | CVAR_LATCH | CVAR_SERVERINFO)
 
+CVAR_RANGE_FUNC_DECL(sv_aithreads, "0", "EXPERIMENTAL: Threads that help make the sight checks of monsters " \
+				"ahead of each tic, 0 to make them as they come up",
+				CVARTYPE_BYTE, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 16.0f)
+
 // Hacky abominations that should be purged with fire and brimstone
 // =================================================================
 
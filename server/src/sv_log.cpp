@@ -0,0 +1,397 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Buffered server log
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <fstream>
+
+#include "doomtype.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "sv_log.h"
+
+struct logline_t
+{
+	std::string	text;			// timestamp, message and newline
+	size_t		stamplen;
+	time_t		time;
+	int			printlevel;
+};
+
+static const int LOG_QUEUE_SIZE = 4096;
+
+static OSPSCRing<logline_t*, LOG_QUEUE_SIZE> log_queue;
+
+static OThread log_thread;
+static OEvent log_event;
+static bool log_started = false;
+static bool log_synchronous = false;	// the writer was shut down for good
+
+static volatile int log_quit = 0;
+static volatile int log_flushing = 0;
+static volatile int log_queued = 0;		// lines accepted by SV_LogLine
+static volatile int log_written = 0;	// lines the writer has finished with
+static volatile int log_dropped = 0;
+static int log_dropped_reported = 0;	// game thread only
+
+// copies of the cvars for the writer thread
+static volatile int log_interval = 250;
+static volatile int log_size = 65536;
+static volatile int log_jsonenabled = 0;
+
+// only opened or closed after SV_LogFlush
+static std::ofstream log_json;
+
+CVAR_FUNC_IMPL(log_flushinterval)
+{
+	I_AtomicStore(&log_interval, var.asInt());
+}
+
+CVAR_FUNC_IMPL(log_flushsize)
+{
+	I_AtomicStore(&log_size, var.asInt());
+}
+
+CVAR_FUNC_IMPL(log_jsonfile)
+{
+	SV_LogFlush();
+
+	I_AtomicStore(&log_jsonenabled, 0);
+	if (log_json.is_open())
+		log_json.close();
+
+	if (strlen(var.cstring()) == 0)
+		return;
+
+	log_json.open(var.cstring(), std::ios::app);
+	if (log_json.is_open())
+		I_AtomicStore(&log_jsonenabled, 1);
+	else
+		Printf(PRINT_HIGH, "Unable to create JSON log file: %s\n", var.cstring());
+}
+
+//
+// SV_LogAppendJSON
+//
+// Appends line as a JSON object on a line of its own
+//
+static void SV_LogAppendJSON(std::string& out, const logline_t* line)
+{
+	char buf[64];
+	sprintf(buf, "{\"time\":%ld,\"level\":%d,\"text\":\"", (long)line->time, line->printlevel);
+	out += buf;
+
+	std::string text = line->text.substr(line->stamplen);
+	StripColorCodes(text);
+	if (!text.empty() && text[text.length() - 1] == '\n')
+		text.resize(text.length() - 1);
+
+	for (size_t i = 0; i < text.length(); i++)
+	{
+		unsigned char c = text[i];
+
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c == '\n')
+			out += "\\n";
+		else if (c == '\t')
+			out += "\\t";
+		else if (c < 0x20 || c >= 0x7F)
+		{
+			// messages are not UTF-8, keep other bytes as Latin-1
+			sprintf(buf, "\\u%04x", c);
+			out += buf;
+		}
+		else
+			out += c;
+	}
+
+	out += "\"}\n";
+}
+
+//
+// SV_LogWrite
+//
+// Writes a batch of lines.  Called by the writer thread, or by the game
+// thread once the writer is gone.
+//
+static void SV_LogWrite(const std::string& out, const std::string& json)
+{
+	if (!out.empty())
+	{
+		std::string stripped(out);
+		StripColorCodes(stripped);
+
+		fwrite(stripped.data(), 1, stripped.length(), stdout);
+		fflush(stdout);
+
+		if (LOG.is_open())
+		{
+			LOG.write(out.data(), out.length());
+			LOG.flush();
+		}
+	}
+
+	if (!json.empty() && log_json.is_open())
+	{
+		log_json.write(json.data(), json.length());
+		log_json.flush();
+	}
+}
+
+//
+// SV_LogThread
+//
+// Collects lines into a batch and writes it once it is old or big enough,
+// or right away while the game thread is waiting in SV_LogFlush.
+//
+static void SV_LogThread(void* data)
+{
+	std::string out, json;
+	int lines = 0;
+	dtime_t batch_start = 0;
+
+	while (true)
+	{
+		const size_t size = I_AtomicLoad(&log_size);
+		logline_t* line;
+
+		while (out.length() < size && log_queue.pop(line))
+		{
+			if (out.empty())
+				batch_start = I_GetTime();
+
+			out += line->text;
+			if (I_AtomicLoad(&log_jsonenabled))
+				SV_LogAppendJSON(json, line);
+
+			delete line;
+			lines++;
+		}
+
+		const dtime_t interval = I_ConvertTimeFromMs(I_AtomicLoad(&log_interval));
+		const dtime_t age = I_GetTime() - batch_start;
+		const bool quit = I_AtomicLoad(&log_quit) != 0;
+
+		if (!out.empty() && (out.length() >= size || age >= interval ||
+			I_AtomicLoad(&log_flushing) || quit))
+		{
+			SV_LogWrite(out, json);
+			out.clear();
+			json.clear();
+
+			// the files are not touched again until more lines arrive
+			I_AtomicAdd(&log_written, lines);
+			lines = 0;
+		}
+
+		if (log_queue.empty())
+		{
+			if (quit)
+				break;
+
+			dtime_t wait = out.empty() ? interval : interval - age;
+			log_event.wait(MAX(1, (int)I_ConvertTimeToMs(wait)));
+		}
+	}
+}
+
+//
+// SV_LogShutdown
+//
+// Writes whatever is left.  Later lines are written directly.
+//
+static void STACK_ARGS SV_LogShutdown()
+{
+	SV_LogStop();
+	log_synchronous = true;
+}
+
+static bool SV_LogStart()
+{
+	I_AtomicStore(&log_quit, 0);
+	if (!log_thread.start(SV_LogThread, NULL))
+		return false;
+
+	if (!log_started)
+	{
+		log_started = true;
+		atterm(SV_LogShutdown);
+	}
+
+	return true;
+}
+
+//
+// SV_LogNewLine
+//
+static logline_t* SV_LogNewLine(int printlevel, const std::string& text, size_t stamplen)
+{
+	logline_t* line = new logline_t;
+	line->text = text;
+	line->stamplen = stamplen < text.length() ? stamplen : 0;
+	line->time = time(NULL);
+	line->printlevel = printlevel;
+
+	return line;
+}
+
+//
+// SV_LogReportDropped
+//
+// Queues a notice about the lines dropped since the last one, so the
+// writer only ever writes what it was handed
+//
+static void SV_LogReportDropped()
+{
+	int dropped = I_AtomicLoad(&log_dropped);
+	if (dropped == log_dropped_reported)
+		return;
+
+	char buf[64];
+	sprintf(buf, "Log: %d lines dropped, the writer fell behind\n", dropped - log_dropped_reported);
+
+	logline_t* line = SV_LogNewLine(PRINT_HIGH, buf, 0);
+	if (!log_queue.push(line))
+	{
+		delete line;
+		return;
+	}
+
+	I_AtomicAdd(&log_queued, 1);
+	log_dropped_reported = dropped;
+}
+
+//
+// SV_LogLine
+//
+void SV_LogLine(int printlevel, const std::string& text, size_t stamplen)
+{
+	if (!log_synchronous && !log_thread.running() && !SV_LogStart())
+		log_synchronous = true;
+
+	logline_t* line = SV_LogNewLine(printlevel, text, stamplen);
+
+	if (log_synchronous)
+	{
+		std::string json;
+		if (log_json.is_open())
+			SV_LogAppendJSON(json, line);
+		SV_LogWrite(line->text, json);
+		delete line;
+		return;
+	}
+
+	SV_LogReportDropped();
+
+	if (!log_queue.push(line))
+	{
+		delete line;
+		I_AtomicAdd(&log_dropped, 1);
+		return;
+	}
+
+	int backlog = I_AtomicAdd(&log_queued, 1) - I_AtomicLoad(&log_written);
+
+	// otherwise the writer looks for lines once per log_flushinterval
+	if (I_AtomicLoad(&log_interval) == 0 || backlog >= LOG_QUEUE_SIZE / 2)
+		log_event.signal();
+}
+
+//
+// SV_LogWaitWritten
+//
+// Hurries the writer along until every queued line is written, or for at
+// most timeout ms if that is not 0
+//
+static void SV_LogWaitWritten(int timeout)
+{
+	if (!log_thread.running())
+		return;
+
+	I_AtomicAdd(&log_flushing, 1);
+	log_event.signal();
+
+	for (int waited = 0; I_AtomicLoad(&log_written) != I_AtomicLoad(&log_queued); waited++)
+	{
+		if (timeout && waited >= timeout)
+			break;
+
+		I_Sleep(I_ConvertTimeFromMs(1));
+	}
+
+	I_AtomicAdd(&log_flushing, -1);
+}
+
+//
+// SV_LogFlush
+//
+void SV_LogFlush()
+{
+	if (log_thread.running())
+		SV_LogReportDropped();
+
+	SV_LogWaitWritten(0);
+}
+
+//
+// SV_LogCrashFlush
+//
+// The crash may have been in the writer itself, so don't wait on it for
+// long
+//
+void SV_LogCrashFlush()
+{
+	SV_LogWaitWritten(1000);
+}
+
+//
+// SV_LogStop
+//
+void SV_LogStop()
+{
+	if (!log_thread.running())
+		return;
+
+	SV_LogFlush();
+
+	I_AtomicStore(&log_quit, 1);
+	log_event.signal();
+	log_thread.join();
+}
+
+BEGIN_COMMAND (logstats)
+{
+	Printf(PRINT_HIGH, "%d lines logged, %d waiting, %d dropped\n",
+		I_AtomicLoad(&log_written), I_AtomicLoad(&log_queued) - I_AtomicLoad(&log_written),
+		I_AtomicLoad(&log_dropped));
+}
+END_COMMAND (logstats)
+
+VERSION_CONTROL (sv_log_cpp, "$Id$")
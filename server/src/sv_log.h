@@ -0,0 +1,50 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Buffered server log
+//
+//	Console lines are passed from the game thread to a writer thread
+//	through a lock-free ring and written to stdout, the log file and the
+//	optional JSON lines log in batches, once log_flushinterval has passed
+//	or log_flushsize bytes are waiting.  When the ring is full lines are
+//	dropped and counted instead of stalling the game.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_LOG_H__
+#define __SV_LOG_H__
+
+#include <string>
+
+// Queues a line for writing.  stamplen is the length of the timestamp at
+// the start of text, which the JSON log keeps separately.
+void SV_LogLine(int printlevel, const std::string& text, size_t stamplen);
+
+// Waits until every queued line has been written, so the log files can be
+// opened or closed by the caller
+void SV_LogFlush();
+
+// Gives the writer thread a moment to write what is queued before the
+// process dies of a crash
+void SV_LogCrashFlush();
+
+// Flushes and stops the writer thread, which starts again with the next
+// line.  Needed before fork() since the child gets no threads.
+void SV_LogStop();
+
+#endif	// __SV_LOG_H__
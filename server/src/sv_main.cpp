@@ -65,6 +65,11 @@
 #include "g_warmup.h"
 #include "sv_banlist.h"
 #include "d_main.h"
+#include "farchive.h"
+#include "m_swap.h"
+#include "i_netschema.h"
+#include "sv_stats.h"
+#include "sv_metrics.h"
 
 #include <algorithm>
 #include <sstream>
@@ -275,6 +280,11 @@ CVAR_FUNC_IMPL (sv_waddownloadcap)
 		var.Set(sv_maxrate);
 }
 
+CVAR_FUNC_IMPL (sv_aithreads)
+{
+	P_SetSightWorkers(var.asInt());
+}
+
 client_c clients;
 
 
@@ -548,6 +558,8 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 
 	int player_id = it->id;
 
+	SV_MetricsDisconnect(player_id);
+
 	// remove player awareness from all actors
 	AActor* mo;
 	TThinkerIterator<AActor> iterator;
@@ -588,6 +600,8 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 //
 void SV_GetPackets()
 {
+	TicPhaseTimer timer(TICPHASE_PACKETS);
+
 	while (NET_GetPacket())
 	{
 		player_t &player = SV_FindPlayerByAddr();
@@ -813,6 +827,8 @@ void SV_Sound (fixed_t x, fixed_t y, byte channel, const char *name, byte attenu
 //
 void SV_UpdateFrags(player_t &player)
 {
+	SV_QryInvalidateCache();
+
 	for (Players::iterator it = players.begin();it != players.end();++it)
 	{
 		client_t *cl = &(it->client);
@@ -865,6 +881,8 @@ void SV_BroadcastUserInfo(player_t &player)
  */
 bool SV_SetupUserInfo(player_t &player)
 {
+	SV_QryInvalidateCache();
+
 	// read in userinfo from packet
 	std::string old_netname(player.userinfo.netname);
 	std::string new_netname(MSG_ReadString());
@@ -1103,6 +1121,43 @@ team_t SV_GoodTeam (void)
 	return smallest_team;
 }
 
+//
+// SV_WriteMoveMobj
+//
+// Writes the body of an svc_movemobj message.  The offsets are added to
+// the actor's position.
+//
+static void SV_WriteMoveMobj(buf_t *b, AActor *mo, fixed_t xoffs = 0, fixed_t yoffs = 0, fixed_t zoffs = 0)
+{
+	int values[MOVEMOBJ_NUMFIELDS];
+
+	values[MOVEMOBJ_NETID] = mo->netid;
+	values[MOVEMOBJ_RNDINDEX] = mo->rndindex;
+	values[MOVEMOBJ_X] = mo->x + xoffs;
+	values[MOVEMOBJ_Y] = mo->y + yoffs;
+	values[MOVEMOBJ_Z] = mo->z + zoffs;
+
+	MSG_WriteSchema(b, movemobj_schema, values);
+}
+
+//
+// SV_WriteMobjSpeedAngle
+//
+// Writes the body of an svc_mobjspeedangle message
+//
+static void SV_WriteMobjSpeedAngle(buf_t *b, AActor *mo)
+{
+	int values[SPEEDANGLE_NUMFIELDS];
+
+	values[SPEEDANGLE_NETID] = mo->netid;
+	values[SPEEDANGLE_ANGLE] = mo->angle;
+	values[SPEEDANGLE_MOMX] = mo->momx;
+	values[SPEEDANGLE_MOMY] = mo->momy;
+	values[SPEEDANGLE_MOMZ] = mo->momz;
+
+	MSG_WriteSchema(b, speedangle_schema, values);
+}
+
 //
 // SV_SendMobjToClient
 //
@@ -1134,11 +1189,7 @@ void SV_SendMobjToClient(AActor *mo, client_t *cl)
 	if(mo->flags & MF_MISSILE || mobjinfo[mo->type].flags & MF_MISSILE) // denis - check type as that is what the client will be spawning
 	{
 		MSG_WriteShort (&cl->reliablebuf, mo->target ? mo->target->netid : 0);
-		MSG_WriteShort (&cl->reliablebuf, mo->netid);
-		MSG_WriteLong (&cl->reliablebuf, mo->angle);
-		MSG_WriteLong (&cl->reliablebuf, mo->momx);
-		MSG_WriteLong (&cl->reliablebuf, mo->momy);
-		MSG_WriteLong (&cl->reliablebuf, mo->momz);
+		SV_WriteMobjSpeedAngle(&cl->reliablebuf, mo);
 	}
 	else
 	{
@@ -1383,29 +1434,21 @@ void SV_DestroyFinishedMovingSectors()
 		}
 
 		if (!itr->moving_ceiling && !itr->moving_floor)
-			movingsectors.erase(itr++);
+			itr = P_RemoveMovingSector(itr);
 		else
 			++itr;
 	}
 }
 
 //
-// SV_SendMovingSectorUpdate
+// SV_GetSectorMovers
 //
+// Determines which moving planes are in a sector
 //
-void SV_SendMovingSectorUpdate(player_t &player, sector_t *sector)
+static void SV_GetSectorMovers(sector_t *sector, movertype_t &ceiling_mover, movertype_t &floor_mover)
 {
-	if (!sector || !validplayer(player))
-		return;
-
-	int sectornum = sector - sectors;
-	if (sectornum < 0 || sectornum >= numsectors)
-		return;
-
-	buf_t *netbuf = &(player.client.netbuf);
-
-	// Determine which moving planes are in this sector
-	movertype_t floor_mover = SEC_INVALID, ceiling_mover = SEC_INVALID;
+	floor_mover = SEC_INVALID;
+	ceiling_mover = SEC_INVALID;
 
 	if (sector->ceilingdata && sector->ceilingdata->IsA(RUNTIME_CLASS(DCeiling)))
 		ceiling_mover = SEC_CEILING;
@@ -1425,15 +1468,37 @@ void SV_SendMovingSectorUpdate(player_t &player, sector_t *sector)
 		ceiling_mover = SEC_PILLAR;
 		floor_mover = SEC_INVALID;
 	}
+}
+
+//
+// SV_SendMovingSectorUpdate
+//
+// Returns the number of bytes written
+//
+size_t SV_SendMovingSectorUpdate(player_t &player, sector_t *sector)
+{
+	if (!sector || !validplayer(player))
+		return 0;
+
+	int sectornum = sector - sectors;
+	if (sectornum < 0 || sectornum >= numsectors)
+		return 0;
+
+	buf_t *netbuf = &(player.client.netbuf);
+
+	movertype_t floor_mover, ceiling_mover;
+	SV_GetSectorMovers(sector, ceiling_mover, floor_mover);
 
 	// no moving planes?  skip it.
 	if (ceiling_mover == SEC_INVALID && floor_mover == SEC_INVALID)
-		return;
+		return 0;
 
 	// Create bitfield to denote moving planes in this sector
 	byte movers = byte(ceiling_mover) | (byte(floor_mover) << 4);
 
 	MSG_WriteMarker(netbuf, svc_movingsector);
+	size_t start = netbuf->cursize - 1;
+
 	MSG_WriteShort(netbuf, sectornum);
 	MSG_WriteShort(netbuf, P_CeilingHeight(sector) >> FRACBITS);
 	MSG_WriteShort(netbuf, P_FloorHeight(sector) >> FRACBITS);
@@ -1537,6 +1602,159 @@ void SV_SendMovingSectorUpdate(player_t &player, sector_t *sector)
         MSG_WriteShort(netbuf, Plat->m_Height >> FRACBITS);
         MSG_WriteShort(netbuf, Plat->m_Lip >> FRACBITS);
 	}
+
+	return netbuf->cursize - start;
+}
+
+// Clients run the thinkers of moving sectors themselves, so a sector is
+// only sent again when it stops moving the way its last update said it
+// would.  Updates go out unreliably, so each sector is also resent every
+// so often, well before the client's snapshots of it run out.
+static const int MOVINGSECTOR_RESEND_TICS = NUM_SNAPSHOTS / 2;
+
+static unsigned int movingsector_serial = 0;
+
+// sectorsyncstats
+static unsigned int sectorsync_sent = 0, sectorsync_skipped = 0, sectorsync_bytes = 0;
+static int sectorsync_tic = 0;
+
+static inline void SV_HashMovingSector(unsigned int &hash, int value)
+{
+	hash = (hash ^ (unsigned int)value) * 16777619u;
+}
+
+//
+// SV_MovingSectorKey
+//
+// Hashes everything about a moving sector that decides where its planes
+// go next, leaving out the current heights and countdowns that clients
+// advance themselves
+//
+static unsigned int SV_MovingSectorKey(sector_t *sector)
+{
+	movertype_t floor_mover, ceiling_mover;
+	SV_GetSectorMovers(sector, ceiling_mover, floor_mover);
+
+	unsigned int key = 2166136261u;
+	SV_HashMovingSector(key, ceiling_mover | (floor_mover << 4));
+
+	if (ceiling_mover == SEC_ELEVATOR)
+	{
+		DElevator *Elevator = static_cast<DElevator *>(sector->ceilingdata);
+
+		SV_HashMovingSector(key, Elevator->m_Type);
+		SV_HashMovingSector(key, Elevator->m_Status);
+		SV_HashMovingSector(key, Elevator->m_Direction);
+		SV_HashMovingSector(key, Elevator->m_FloorDestHeight);
+		SV_HashMovingSector(key, Elevator->m_CeilingDestHeight);
+		SV_HashMovingSector(key, Elevator->m_Speed);
+	}
+
+	if (ceiling_mover == SEC_PILLAR)
+	{
+		DPillar *Pillar = static_cast<DPillar *>(sector->ceilingdata);
+
+		SV_HashMovingSector(key, Pillar->m_Type);
+		SV_HashMovingSector(key, Pillar->m_Status);
+		SV_HashMovingSector(key, Pillar->m_FloorSpeed);
+		SV_HashMovingSector(key, Pillar->m_CeilingSpeed);
+		SV_HashMovingSector(key, Pillar->m_FloorTarget);
+		SV_HashMovingSector(key, Pillar->m_CeilingTarget);
+		SV_HashMovingSector(key, Pillar->m_Crush);
+	}
+
+	if (ceiling_mover == SEC_CEILING)
+	{
+		DCeiling *Ceiling = static_cast<DCeiling *>(sector->ceilingdata);
+
+		SV_HashMovingSector(key, Ceiling->m_Type);
+		SV_HashMovingSector(key, Ceiling->m_BottomHeight);
+		SV_HashMovingSector(key, Ceiling->m_TopHeight);
+		SV_HashMovingSector(key, Ceiling->m_Speed);
+		SV_HashMovingSector(key, Ceiling->m_Speed1);
+		SV_HashMovingSector(key, Ceiling->m_Speed2);
+		SV_HashMovingSector(key, Ceiling->m_Crush);
+		SV_HashMovingSector(key, Ceiling->m_Direction);
+		SV_HashMovingSector(key, Ceiling->m_OldDirection);
+	}
+
+	if (ceiling_mover == SEC_DOOR)
+	{
+		DDoor *Door = static_cast<DDoor *>(sector->ceilingdata);
+
+		SV_HashMovingSector(key, Door->m_Type);
+		SV_HashMovingSector(key, Door->m_TopHeight);
+		SV_HashMovingSector(key, Door->m_Speed);
+		SV_HashMovingSector(key, Door->m_TopWait);
+		SV_HashMovingSector(key, Door->m_Status);
+	}
+
+	if (floor_mover == SEC_FLOOR)
+	{
+		DFloor *Floor = static_cast<DFloor *>(sector->floordata);
+
+		SV_HashMovingSector(key, Floor->m_Type);
+		SV_HashMovingSector(key, Floor->m_Status);
+		SV_HashMovingSector(key, Floor->m_Crush);
+		SV_HashMovingSector(key, Floor->m_Direction);
+		SV_HashMovingSector(key, Floor->m_FloorDestHeight);
+		SV_HashMovingSector(key, Floor->m_Speed);
+		SV_HashMovingSector(key, Floor->m_Height);
+		SV_HashMovingSector(key, Floor->m_Change);
+	}
+
+	if (floor_mover == SEC_PLAT)
+	{
+		DPlat *Plat = static_cast<DPlat *>(sector->floordata);
+
+		SV_HashMovingSector(key, Plat->m_Speed);
+		SV_HashMovingSector(key, Plat->m_Low);
+		SV_HashMovingSector(key, Plat->m_High);
+		SV_HashMovingSector(key, Plat->m_Wait);
+		SV_HashMovingSector(key, Plat->m_Status);
+		SV_HashMovingSector(key, Plat->m_OldStatus);
+		SV_HashMovingSector(key, Plat->m_Crush);
+		SV_HashMovingSector(key, Plat->m_Type);
+	}
+
+	return key;
+}
+
+//
+// SV_UpdateMovingSectorStates
+//
+// Called once a tic after the thinkers have run.  A sector whose
+// parameters changed, or whose planes moved by a different amount than
+// the tic before (it reached its destination or was blocked), gets a new
+// serial so that it is sent to everyone again.
+//
+void SV_UpdateMovingSectorStates()
+{
+	std::list<movingsector_t>::iterator itr;
+	for (itr = movingsectors.begin(); itr != movingsectors.end(); ++itr)
+	{
+		sector_t *sector = itr->sector;
+
+		fixed_t floorheight = P_FloorHeight(sector);
+		fixed_t ceilingheight = P_CeilingHeight(sector);
+
+		unsigned int key = SV_MovingSectorKey(sector);
+		SV_HashMovingSector(key, floorheight - itr->floorheight);
+		SV_HashMovingSector(key, ceilingheight - itr->ceilingheight);
+
+		if (itr->serial == 0 || key != itr->statekey)
+		{
+			// 0 is reserved for sectors that haven't been sent
+			if (++movingsector_serial == 0)
+				movingsector_serial = 1;
+
+			itr->serial = movingsector_serial;
+			itr->statekey = key;
+		}
+
+		itr->floorheight = floorheight;
+		itr->ceilingheight = ceilingheight;
+	}
 }
 
 //
@@ -1545,14 +1763,47 @@ void SV_SendMovingSectorUpdate(player_t &player, sector_t *sector)
 //
 void SV_UpdateMovingSectors(player_t &player)
 {
+	client_t *cl = &player.client;
+
+	if (cl->sectorsync.size() != (size_t)numsectors)
+		cl->sectorsync.assign(numsectors, client_t::sectorsync_t());
+
 	std::list<movingsector_t>::iterator itr;
 	for (itr = movingsectors.begin(); itr != movingsectors.end(); ++itr)
 	{
 		sector_t *sector = itr->sector;
+		client_t::sectorsync_t &sync = cl->sectorsync[sector - sectors];
+
+		if (sync.serial == itr->serial && gametic >= sync.tic &&
+			gametic - sync.tic < MOVINGSECTOR_RESEND_TICS)
+		{
+			sectorsync_skipped++;
+			continue;
+		}
+
+		sectorsync_bytes += SV_SendMovingSectorUpdate(player, sector);
+		sectorsync_sent++;
 
-		SV_SendMovingSectorUpdate(player, sector);
+		sync.serial = itr->serial;
+		sync.tic = gametic;
+	}
+}
+
+BEGIN_COMMAND (sectorsyncstats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		sectorsync_sent = sectorsync_skipped = sectorsync_bytes = 0;
+		sectorsync_tic = gametic;
+		return;
 	}
+
+	int tics = std::max(gametic - sectorsync_tic, 1);
+
+	Printf(PRINT_HIGH, "Moving sector updates: %u sent, %u skipped as predictable, %.1f bytes/tic\n",
+		sectorsync_sent, sectorsync_skipped, (float)sectorsync_bytes / tics);
 }
+END_COMMAND (sectorsyncstats)
 
 
 //
@@ -1568,12 +1819,87 @@ void SV_SendGametic(client_t* cl)
 }
 
 
+// largest full update that can be built, uncompressed
+static const size_t FULLUPDATE_MAX_SIZE = 4 * 1024 * 1024;
+
+// largest piece of the full update image sent in one packet
+static const size_t FULLUPDATE_CHUNK_SIZE = 1024;
+
+//
+// SV_ReleaseHeldMessages
+//
+// Sends the reliable messages held back during a full update, each in the
+// packet it would have gone out in
+//
+static bool SV_ReleaseHeldMessages(player_t &pl, size_t budget)
+{
+	client_t *cl = &pl.client;
+	client_t::fullupdate_t &fu = cl->fullupdate;
+
+	size_t sent = 0, i = 0;
+
+	fu.holding = false;
+
+	for (; i < fu.held.size() && sent < budget; i++)
+	{
+		SZ_Write(&cl->reliablebuf, &fu.held[i][0], fu.held[i].size());
+		sent += fu.held[i].size();
+		fu.heldsize -= fu.held[i].size();
+
+		if (!SV_SendPacket(pl))
+			return false;
+	}
+
+	fu.held.erase(fu.held.begin(), fu.held.begin() + i);
+
+	if (!fu.held.empty())
+	{
+		fu.holding = true;
+		return false;
+	}
+
+	return true;
+}
+
+//
+// SV_AbandonFullUpdate
+//
+// Stops sending a client its full update and forgets the messages held
+// back behind it, for when the client is about to be disconnected anyway
+//
+static void SV_AbandonFullUpdate(player_t &pl)
+{
+	client_t::fullupdate_t &fu = pl.client.fullupdate;
+
+	fu.holding = false;
+	fu.held.clear();
+	fu.heldsize = 0;
+	std::vector<byte>().swap(fu.image);
+}
+
 //
 // SV_ClientFullUpdate
 //
+// Builds everything a client needs to know about the current level into
+// one compressed image, which SV_SendFullUpdates then streams out
+//
 void SV_ClientFullUpdate(player_t &pl)
 {
 	client_t *cl = &pl.client;
+	client_t::fullupdate_t &fu = cl->fullupdate;
+
+	// a previous full update is being replaced, the client still needs the
+	// messages that came after it (like the map change)
+	if (fu.holding)
+		SV_ReleaseHeldMessages(pl, (size_t)-1);
+
+	// don't let anything already queued end up in the image
+	if (!SV_SendPacket(pl))
+		return;
+
+	// the start of the buffer is kept for the LZO image header
+	cl->reliablebuf.resize(FULLUPDATE_MAX_SIZE);
+	cl->reliablebuf.setcursize(8);
 
 	// send player's info to the client
 	for (Players::iterator it = players.begin();it != players.end();++it)
@@ -1582,10 +1908,6 @@ void SV_ClientFullUpdate(player_t &pl)
 			SV_AwarenessUpdate(pl, it->mo);
 
 		SV_SendUserInfo(*it, cl);
-
-		if (cl->reliablebuf.cursize >= 600)
-			if (!SV_SendPacket(pl))
-				return;
 	}
 
 	// update warmup state
@@ -1620,17 +1942,20 @@ void SV_ClientFullUpdate(player_t &pl)
 			MSG_WriteShort(&cl->reliablebuf, TEAMpoints[i]);
 	}
 
-	SV_UpdateHiddenMobj();
+	// every actor goes in right away instead of trickling in through
+	// SV_UpdateHiddenMobj
+	AActor *mo;
+	TThinkerIterator<AActor> iterator;
+	while ((mo = iterator.Next()))
+		SV_AwarenessUpdate(pl, mo);
 
 	// update flags
 	if (sv_gametype == GM_CTF)
 		CTF_Connect(pl);
 
-	// update sectors
+	// update sectors, moving ones are all sent again with the next update
 	SV_UpdateSectors(cl);
-	if (cl->reliablebuf.cursize >= 600)
-		if(!SV_SendPacket(pl))
-			return;
+	cl->sectorsync.clear();
 
 	// update switches
 	for (int l=0; l<numlines; l++)
@@ -1648,7 +1973,97 @@ void SV_ClientFullUpdate(player_t &pl)
 
 	MSG_WriteMarker(&cl->reliablebuf, svc_fullupdatedone);
 
-	SV_SendPacket(pl);
+	if (cl->reliablebuf.overflowed)
+	{
+		cl->reliablebuf.resize(MAX_UDP_PACKET);
+		SV_DropClient(pl);
+		return;
+	}
+
+	// wrap the messages up as a stored LZO image and compress it
+	byte *stored = cl->reliablebuf.data;
+	size_t length = cl->reliablebuf.cursize - 8;
+	((unsigned int*)stored)[0] = 0;
+	((unsigned int*)stored)[1] = BELONG((unsigned int)length);
+
+	std::vector<byte> image(length + 8);
+	image.resize(FLZOMemFile::CompressImage(stored, length + 8, &image[0], image.size()));
+
+	// only keep as much memory around as the client still needs
+	cl->reliablebuf.resize(MAX_UDP_PACKET);
+	std::vector<byte>(image).swap(fu.image);
+
+	fu.next_offset = 0;
+	fu.length = length;
+	fu.serial++;
+	fu.holding = true;
+	fu.starttime = I_GetTime();
+}
+
+//
+// SV_SendFullUpdates
+//
+// Streams full update images to the clients waiting for one, as fast as
+// their rate allows
+//
+void SV_SendFullUpdates()
+{
+	for (Players::iterator it = players.begin();it != players.end();++it)
+	{
+		client_t *cl = &(it->client);
+		client_t::fullupdate_t &fu = cl->fullupdate;
+
+		if (!fu.holding)
+			continue;
+
+		// whatever is queued now belongs after the image
+		if (!SV_SendPacket(*it))
+			continue;
+
+		size_t budget = cl->rate * 1000 / TICRATE;
+		size_t chunk_size = std::min(budget, FULLUPDATE_CHUNK_SIZE);
+		if (chunk_size == 0)
+			chunk_size = budget = FULLUPDATE_CHUNK_SIZE;
+
+		size_t sent = 0;
+		bool ok = true;
+
+		while (fu.next_offset < fu.image.size() && sent < budget)
+		{
+			size_t len = std::min(chunk_size, fu.image.size() - fu.next_offset);
+
+			fu.holding = false;
+
+			MSG_WriteMarker(&cl->reliablebuf, svc_fullupdatechunk);
+			MSG_WriteByte(&cl->reliablebuf, fu.serial);
+			MSG_WriteLong(&cl->reliablebuf, fu.image.size());
+			MSG_WriteLong(&cl->reliablebuf, fu.next_offset);
+			MSG_WriteShort(&cl->reliablebuf, len);
+			MSG_WriteChunk(&cl->reliablebuf, &fu.image[fu.next_offset], len);
+
+			ok = SV_SendPacket(*it);
+
+			fu.holding = true;
+			fu.next_offset += len;
+			sent += len;
+
+			if (!ok)
+				break;
+		}
+
+		if (!ok || fu.next_offset < fu.image.size() || sent >= budget)
+			continue;
+
+		if (!SV_ReleaseHeldMessages(*it, budget - sent))
+			continue;
+
+		DPrintf("Full update for %s: %u bytes (%u compressed) in %u ms\n",
+				it->userinfo.netname.c_str(), (unsigned int)fu.length,
+				(unsigned int)fu.image.size(),
+				(unsigned int)I_ConvertTimeToMs(I_GetTime() - fu.starttime));
+
+		std::vector<byte>().swap(fu.image);
+	}
 }
 
 //
@@ -1694,6 +2109,8 @@ void SV_SendServerSettings (player_t &pl)
 //
 void SV_ServerSettingChange (void)
 {
+	SV_QryInvalidateCache();
+
 	if (gamestate != GS_LEVEL)
 		return;
 
@@ -1869,7 +2286,8 @@ void SV_ConnectClient()
 
 	if (challenge == LAUNCHER_CHALLENGE)  // for Launcher
 	{
-		SV_SendServerInfo();
+		if (SV_QryAllowRequest(net_from))
+			SV_SendServerInfo();
 		return;
 	}
 
@@ -1899,8 +2317,11 @@ void SV_ConnectClient()
 	player_t* player = &(*it);
 	client_t* cl = &(player->client);
 
+	SV_QryInvalidateCache();
+
 	// clear client network info
 	cl->address = net_from;
+	SV_MetricsConnect(player->id, NET_AdrToString(net_from));
 	cl->last_received = gametic;
 	cl->reliable_bps = 0;
 	cl->unreliable_bps = 0;
@@ -2080,6 +2501,8 @@ void SV_DisconnectClient(player_t &who)
 	if (who.playerstate == PST_DISCONNECT)
 		return;
 
+	SV_QryInvalidateCache();
+
 	// tell others clients about it
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
@@ -2148,6 +2571,9 @@ void SV_DropClient(player_t &who)
 {
 	client_t *cl = &who.client;
 
+	// the disconnect can't wait behind a full update
+	SV_AbandonFullUpdate(who);
+
 	MSG_WriteMarker(&cl->reliablebuf, svc_disconnect);
 
 	SV_SendPacket(who);
@@ -2164,6 +2590,7 @@ void SV_SendDisconnectSignal()
 	{
 		client_t *cl = &(it->client);
 
+		SV_AbandonFullUpdate(*it);
 		MSG_WriteMarker(&cl->reliablebuf, svc_disconnect);
 		SV_SendPacket(*it);
 
@@ -2183,6 +2610,7 @@ void SV_SendReconnectSignal()
 	// tell others clients about it
 	for (Players::iterator it = players.begin();it != players.end();++it)
 	{
+		SV_AbandonFullUpdate(*it);
 		MSG_WriteMarker(&(it->client.reliablebuf), svc_reconnect);
 		SV_SendPacket(*it);
 
@@ -2903,18 +3331,10 @@ void SV_UpdateMissiles(player_t &pl)
 			client_t *cl = &pl.client;
 
 			MSG_WriteMarker (&cl->netbuf, svc_movemobj);
-			MSG_WriteShort (&cl->netbuf, mo->netid);
-			MSG_WriteByte (&cl->netbuf, mo->rndindex);
-			MSG_WriteLong (&cl->netbuf, mo->x);
-			MSG_WriteLong (&cl->netbuf, mo->y);
-			MSG_WriteLong (&cl->netbuf, mo->z);
+			SV_WriteMoveMobj(&cl->netbuf, mo);
 
 			MSG_WriteMarker (&cl->netbuf, svc_mobjspeedangle);
-			MSG_WriteShort(&cl->netbuf, mo->netid);
-			MSG_WriteLong (&cl->netbuf, mo->angle);
-			MSG_WriteLong (&cl->netbuf, mo->momx);
-			MSG_WriteLong (&cl->netbuf, mo->momy);
-			MSG_WriteLong (&cl->netbuf, mo->momz);
+			SV_WriteMobjSpeedAngle(&cl->netbuf, mo);
 
 			if (mo->tracer)
 			{
@@ -2975,18 +3395,10 @@ void SV_UpdateMonsters(player_t &pl)
 			client_t *cl = &pl.client;
 
 			MSG_WriteMarker(&cl->netbuf, svc_movemobj);
-			MSG_WriteShort(&cl->netbuf, mo->netid);
-			MSG_WriteByte(&cl->netbuf, mo->rndindex);
-			MSG_WriteLong(&cl->netbuf, mo->x);
-			MSG_WriteLong(&cl->netbuf, mo->y);
-			MSG_WriteLong(&cl->netbuf, mo->z);
+			SV_WriteMoveMobj(&cl->netbuf, mo);
 
 			MSG_WriteMarker(&cl->netbuf, svc_mobjspeedangle);
-			MSG_WriteShort(&cl->netbuf, mo->netid);
-			MSG_WriteLong(&cl->netbuf, mo->angle);
-			MSG_WriteLong(&cl->netbuf, mo->momx);
-			MSG_WriteLong(&cl->netbuf, mo->momy);
-			MSG_WriteLong(&cl->netbuf, mo->momz);
+			SV_WriteMobjSpeedAngle(&cl->netbuf, mo);
 
 			MSG_WriteMarker(&cl->netbuf, svc_actor_movedir);
 			MSG_WriteShort(&cl->netbuf, mo->netid);
@@ -3181,6 +3593,8 @@ void SV_ClearClientsBPS(void)
 //
 void SV_SendPackets()
 {
+	TicPhaseTimer timer(TICPHASE_SENDPACKETS);
+
 	if (players.empty())
 		return;
 
@@ -3257,6 +3671,8 @@ void SV_SpyPlayer(player_t &viewer)
 //
 void SV_WriteCommands(void)
 {
+	TicPhaseTimer timer(TICPHASE_WRITECOMMANDS);
+
 	// [SL] 2011-05-11 - Save player positions and moving sector heights so
 	// they can be reconciled later for unlagging
 	Unlag::getInstance().recordPlayerPositions();
@@ -3295,44 +3711,37 @@ void SV_WriteCommands(void)
 				if(!SV_IsPlayerAllowedToSee(*it, pit->mo))
 					continue;
 
-				MSG_WriteMarker(&cl->netbuf, svc_moveplayer);
-				MSG_WriteByte(&cl->netbuf, pit->id); // player number
+				int values[MOVEPLAYER_NUMFIELDS];
+
+				values[MOVEPLAYER_ID] = pit->id;
 
 				// [SL] 2011-09-14 - the most recently processed ticcmd from the
 				// client we're sending this message to.
-				MSG_WriteLong(&cl->netbuf, it->tic);
-
-				MSG_WriteLong(&cl->netbuf, pit->mo->x);
-				MSG_WriteLong(&cl->netbuf, pit->mo->y);
-				MSG_WriteLong(&cl->netbuf, pit->mo->z);
+				values[MOVEPLAYER_TIC] = it->tic;
 
-				if (GAMEVER > 60)
-				{
-					MSG_WriteShort(&cl->netbuf, pit->mo->angle >> FRACBITS);
-					MSG_WriteShort(&cl->netbuf, pit->mo->pitch >> FRACBITS);
-				}
-				else
-				{
-					MSG_WriteLong(&cl->netbuf, pit->mo->angle);
-				}
+				values[MOVEPLAYER_X] = pit->mo->x;
+				values[MOVEPLAYER_Y] = pit->mo->y;
+				values[MOVEPLAYER_Z] = pit->mo->z;
+				values[MOVEPLAYER_ANGLE] = pit->mo->angle;
+				values[MOVEPLAYER_PITCH] = pit->mo->pitch;
 
 				if (pit->mo->frame == 32773)
-					MSG_WriteByte(&cl->netbuf, PLAYER_FULLBRIGHTFRAME);
+					values[MOVEPLAYER_FRAME] = PLAYER_FULLBRIGHTFRAME;
 				else
-					MSG_WriteByte(&cl->netbuf, pit->mo->frame);
+					values[MOVEPLAYER_FRAME] = pit->mo->frame;
 
 				// write velocity
-				MSG_WriteLong(&cl->netbuf, pit->mo->momx);
-				MSG_WriteLong(&cl->netbuf, pit->mo->momy);
-				MSG_WriteLong(&cl->netbuf, pit->mo->momz);
+				values[MOVEPLAYER_MOMX] = pit->mo->momx;
+				values[MOVEPLAYER_MOMY] = pit->mo->momy;
+				values[MOVEPLAYER_MOMZ] = pit->mo->momz;
 
 				// [Russell] - hack, tell the client about the partial
 				// invisibility power of another player.. (cheaters can disable
 				// this but its all we have for now)
-				if (GAMEVER > 60)
-					MSG_WriteByte(&cl->netbuf, pit->powers[pw_invisibility]);
-				else
-					MSG_WriteLong(&cl->netbuf, pit->powers[pw_invisibility]);
+				values[MOVEPLAYER_INVISIBILITY] = pit->powers[pw_invisibility];
+
+				MSG_WriteMarker(&cl->netbuf, svc_moveplayer);
+				MSG_WriteSchema(&cl->netbuf, moveplayer_schema, values);
 			}
 		}
 
@@ -3615,6 +4024,8 @@ void SV_SetPlayerSpec(player_t &player, bool setting, bool silent)
 	if (player.ingame() == false)
 		return;
 
+	SV_QryInvalidateCache();
+
 	if (!setting && player.spectator)
 	{
 		// We want to unspectate the player.
@@ -4465,6 +4876,8 @@ void SV_IntermissionTimeCheck()
 //
 void SV_GameTics (void)
 {
+	TicPhaseTimer timer(TICPHASE_GAMETICS);
+
 	if (sv_gametype == GM_CTF)
 		CTF_RunTics();
 
@@ -4489,6 +4902,7 @@ void SV_GameTics (void)
 		SV_ProcessPlayerCmd(*it);
 
 	SV_WadDownloads();
+	SV_SendFullUpdates();
 }
 
 void SV_TouchSpecial(AActor *special, player_t *player)
@@ -4528,6 +4942,8 @@ bool SV_Frozen()
 //
 void SV_StepTics(QWORD count)
 {
+	TicPhaseTimer timer(TICPHASE_STEPTICS);
+
 	DObject::BeginFrame();
 
 	// run the newtime tics
@@ -4535,7 +4951,11 @@ void SV_StepTics(QWORD count)
 	{
 		SV_GameTics();
 
+		SV_BeginTicPhase(TICPHASE_TICKER);
 		G_Ticker();
+		SV_EndTicPhase(TICPHASE_TICKER);
+
+		SV_UpdateMovingSectorStates();
 
 		SV_WriteCommands();
 		SV_SendPackets();
@@ -4578,6 +4998,8 @@ void SV_DisplayTics()
 //
 void SV_RunTics()
 {
+	TicPhaseTimer timer(TICPHASE_TIC);
+
 	SV_GetPackets();
 
 	std::string cmd = I_ConsoleInput();
@@ -4986,18 +5408,10 @@ void SV_SendDamageMobj(AActor *target, int pain)
 		MSG_WriteByte(&cl->reliablebuf, pain);
 
 		MSG_WriteMarker (&cl->netbuf, svc_movemobj);
-		MSG_WriteShort (&cl->netbuf, target->netid);
-		MSG_WriteByte (&cl->netbuf, target->rndindex);
-		MSG_WriteLong (&cl->netbuf, target->x);
-		MSG_WriteLong (&cl->netbuf, target->y);
-		MSG_WriteLong (&cl->netbuf, target->z);
+		SV_WriteMoveMobj(&cl->netbuf, target);
 
 		MSG_WriteMarker (&cl->netbuf, svc_mobjspeedangle);
-		MSG_WriteShort(&cl->netbuf, target->netid);
-		MSG_WriteLong (&cl->netbuf, target->angle);
-		MSG_WriteLong (&cl->netbuf, target->momx);
-		MSG_WriteLong (&cl->netbuf, target->momy);
-		MSG_WriteLong (&cl->netbuf, target->momz);
+		SV_WriteMobjSpeedAngle(&cl->netbuf, target);
 	}
 }
 
@@ -5014,11 +5428,6 @@ void SV_SendKillMobj(AActor *source, AActor *target, AActor *inflictor,
 		if (!SV_IsPlayerAllowedToSee(*it, target))
 			continue;
 
-		// send death location first
-		MSG_WriteMarker(&cl->reliablebuf, svc_movemobj);
-		MSG_WriteShort(&cl->reliablebuf, target->netid);
-		MSG_WriteByte(&cl->reliablebuf, target->rndindex);
-
 		// [SL] 2012-12-26 - Get real position since this actor is at
 		// a reconciled position with sv_unlag 1
 		fixed_t xoffs = 0, yoffs = 0, zoffs = 0;
@@ -5028,16 +5437,12 @@ void SV_SendKillMobj(AActor *source, AActor *target, AActor *inflictor,
 					target->player->id, xoffs, yoffs, zoffs);
 		}
 
-		MSG_WriteLong(&cl->reliablebuf, target->x + xoffs);
-		MSG_WriteLong(&cl->reliablebuf, target->y + yoffs);
-		MSG_WriteLong(&cl->reliablebuf, target->z + zoffs);
+		// send death location first
+		MSG_WriteMarker(&cl->reliablebuf, svc_movemobj);
+		SV_WriteMoveMobj(&cl->reliablebuf, target, xoffs, yoffs, zoffs);
 
 		MSG_WriteMarker (&cl->reliablebuf, svc_mobjspeedangle);
-		MSG_WriteShort(&cl->reliablebuf, target->netid);
-		MSG_WriteLong (&cl->reliablebuf, target->angle);
-		MSG_WriteLong (&cl->reliablebuf, target->momx);
-		MSG_WriteLong (&cl->reliablebuf, target->momy);
-		MSG_WriteLong (&cl->reliablebuf, target->momz);
+		SV_WriteMobjSpeedAngle(&cl->reliablebuf, target);
 
 		MSG_WriteMarker(&cl->reliablebuf, svc_killmobj);
 		if (source)
@@ -5089,11 +5494,7 @@ void SV_ExplodeMissile(AActor *mo)
 			continue;
 
 		MSG_WriteMarker (&cl->reliablebuf, svc_movemobj);
-		MSG_WriteShort (&cl->reliablebuf, mo->netid);
-		MSG_WriteByte (&cl->reliablebuf, mo->rndindex);
-		MSG_WriteLong (&cl->reliablebuf, mo->x);
-		MSG_WriteLong (&cl->reliablebuf, mo->y);
-		MSG_WriteLong (&cl->reliablebuf, mo->z);
+		SV_WriteMoveMobj(&cl->reliablebuf, mo);
 
 		MSG_WriteMarker(&cl->reliablebuf, svc_explodemissile);
 		MSG_WriteShort(&cl->reliablebuf, mo->netid);
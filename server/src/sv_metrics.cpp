@@ -0,0 +1,509 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Per-client network telemetry
+//
+//-----------------------------------------------------------------------------
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "win32inc.h"
+#ifdef _WIN32
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#include <sys/socket.h>
+	#include <sys/types.h>
+	#include <sys/time.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+	#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0	// a scraper that hangs up must not raise SIGPIPE
+#endif
+
+#ifndef _WIN32
+typedef int SOCKET;
+#define SOCKET_ERROR -1
+#define INVALID_SOCKET -1
+#define closesocket close
+#endif
+
+#include "doomtype.h"
+#include "doomdef.h"
+#include "c_console.h"
+#include "c_cvars.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "sv_metrics.h"
+
+EXTERN_CVAR(sv_statsport)
+
+// upper bounds of the round trip time buckets, in milliseconds
+static const int rtt_bounds[] = { 10, 25, 50, 75, 100, 150, 250, 500, 1000 };
+static const int NUM_RTT_BUCKETS = sizeof(rtt_bounds) / sizeof(rtt_bounds[0]);
+
+// Everything here except the send times is read by the stats thread, so it
+// is only ever changed with the I_Atomic functions.  Counters are 32 bits
+// and wrap, which a scraper sees as a counter reset.
+struct clientmetrics_t
+{
+	// odd while a client has this id, bumped on connect and disconnect
+	// so a reader can tell it raced with either
+	volatile int	generation;
+	char			address[32];
+
+	volatile int	packets_sent;
+	volatile int	bytes_sent;
+	volatile int	bytes_uncompressed;
+	volatile int	packets_acked;
+	volatile int	packets_lost;
+	volatile int	packets_resent;
+	volatile int	netbuf_drops;
+	volatile int	netbuf_dropped_bytes;
+	volatile int	spawn_queue;
+
+	volatile int	rtt_buckets[NUM_RTT_BUCKETS + 1];
+	volatile int	rtt_sum_ms;
+	volatile int	rtt_count;
+
+	// game thread only, send times of the last 256 packets by sequence
+	dtime_t			sendtime[256];
+	int				sendseq[256];
+};
+
+static clientmetrics_t clientmetrics[MAXPLAYERS + 1];
+
+static clientmetrics_t *SV_ClientMetrics(int id)
+{
+	if (id < 0 || id > MAXPLAYERS)
+		return NULL;
+
+	clientmetrics_t *m = &clientmetrics[id];
+	if (!(I_AtomicLoad(&m->generation) & 1))
+		return NULL;
+
+	return m;
+}
+
+static inline void SV_MetricsAdd(volatile int *value, int amount)
+{
+	I_AtomicAdd(value, amount);
+}
+
+//
+// SV_MetricsConnect
+//
+void SV_MetricsConnect(int id, const char *address)
+{
+	if (id < 0 || id > MAXPLAYERS)
+		return;
+
+	clientmetrics_t *m = &clientmetrics[id];
+
+	// close off the previous owner of the id first
+	if (I_AtomicLoad(&m->generation) & 1)
+		SV_MetricsAdd(&m->generation, 1);
+
+	strncpy(m->address, address, sizeof(m->address) - 1);
+	m->address[sizeof(m->address) - 1] = 0;
+
+	I_AtomicStore(&m->packets_sent, 0);
+	I_AtomicStore(&m->bytes_sent, 0);
+	I_AtomicStore(&m->bytes_uncompressed, 0);
+	I_AtomicStore(&m->packets_acked, 0);
+	I_AtomicStore(&m->packets_lost, 0);
+	I_AtomicStore(&m->packets_resent, 0);
+	I_AtomicStore(&m->netbuf_drops, 0);
+	I_AtomicStore(&m->netbuf_dropped_bytes, 0);
+	I_AtomicStore(&m->spawn_queue, 0);
+	for (int i = 0; i <= NUM_RTT_BUCKETS; i++)
+		I_AtomicStore(&m->rtt_buckets[i], 0);
+	I_AtomicStore(&m->rtt_sum_ms, 0);
+	I_AtomicStore(&m->rtt_count, 0);
+
+	for (int i = 0; i < 256; i++)
+		m->sendseq[i] = -1;
+
+	SV_MetricsAdd(&m->generation, 1);
+}
+
+//
+// SV_MetricsDisconnect
+//
+void SV_MetricsDisconnect(int id)
+{
+	if (SV_ClientMetrics(id))
+		SV_MetricsAdd(&clientmetrics[id].generation, 1);
+}
+
+void SV_MetricsPacketSent(int id, int sequence, size_t plainsize, size_t size)
+{
+	clientmetrics_t *m = SV_ClientMetrics(id);
+	if (!m)
+		return;
+
+	SV_MetricsAdd(&m->packets_sent, 1);
+	SV_MetricsAdd(&m->bytes_sent, (int)size);
+	SV_MetricsAdd(&m->bytes_uncompressed, (int)plainsize);
+
+	m->sendtime[sequence & 0xFF] = I_GetTime();
+	m->sendseq[sequence & 0xFF] = sequence;
+}
+
+void SV_MetricsNetbufDropped(int id, size_t size)
+{
+	clientmetrics_t *m = SV_ClientMetrics(id);
+	if (!m)
+		return;
+
+	SV_MetricsAdd(&m->netbuf_drops, 1);
+	SV_MetricsAdd(&m->netbuf_dropped_bytes, (int)size);
+}
+
+void SV_MetricsPacketAcked(int id, int sequence, int missed)
+{
+	clientmetrics_t *m = SV_ClientMetrics(id);
+	if (!m)
+		return;
+
+	SV_MetricsAdd(&m->packets_acked, 1);
+	if (missed > 0)
+		SV_MetricsAdd(&m->packets_lost, missed);
+
+	if (m->sendseq[sequence & 0xFF] != sequence)
+		return;
+
+	int ms = (int)I_ConvertTimeToMs(I_GetTime() - m->sendtime[sequence & 0xFF]);
+
+	int bucket = 0;
+	while (bucket < NUM_RTT_BUCKETS && ms > rtt_bounds[bucket])
+		bucket++;
+
+	SV_MetricsAdd(&m->rtt_buckets[bucket], 1);
+	SV_MetricsAdd(&m->rtt_sum_ms, ms);
+	SV_MetricsAdd(&m->rtt_count, 1);
+
+	// only the first ack of a packet counts
+	m->sendseq[sequence & 0xFF] = -1;
+}
+
+void SV_MetricsPacketResent(int id)
+{
+	clientmetrics_t *m = SV_ClientMetrics(id);
+	if (m)
+		SV_MetricsAdd(&m->packets_resent, 1);
+}
+
+void SV_MetricsSpawnQueue(int id, size_t depth)
+{
+	clientmetrics_t *m = SV_ClientMetrics(id);
+	if (m)
+		I_AtomicStore(&m->spawn_queue, (int)depth);
+}
+
+//
+// Stats thread
+//
+
+struct metricinfo_t
+{
+	const char	*name;
+	const char	*type;
+	const char	*help;
+	size_t		offset;
+};
+
+static const metricinfo_t metricinfo[] =
+{
+	{ "odasrv_client_packets_sent_total", "counter", "Packets sent to the client",
+		offsetof(clientmetrics_t, packets_sent) },
+	{ "odasrv_client_bytes_sent_total", "counter", "Bytes sent to the client after compression",
+		offsetof(clientmetrics_t, bytes_sent) },
+	{ "odasrv_client_bytes_uncompressed_total", "counter", "Bytes sent to the client before compression",
+		offsetof(clientmetrics_t, bytes_uncompressed) },
+	{ "odasrv_client_packets_acked_total", "counter", "Packets acknowledged by the client",
+		offsetof(clientmetrics_t, packets_acked) },
+	{ "odasrv_client_packets_lost_total", "counter", "Packets the client reported missing",
+		offsetof(clientmetrics_t, packets_lost) },
+	{ "odasrv_client_packets_resent_total", "counter", "Reliable packets sent again",
+		offsetof(clientmetrics_t, packets_resent) },
+	{ "odasrv_client_netbuf_drops_total", "counter", "Unreliable updates dropped by the rate limit",
+		offsetof(clientmetrics_t, netbuf_drops) },
+	{ "odasrv_client_netbuf_dropped_bytes_total", "counter", "Bytes of unreliable updates dropped by the rate limit",
+		offsetof(clientmetrics_t, netbuf_dropped_bytes) },
+	{ "odasrv_client_spawn_queue", "gauge", "Actors waiting to be sent to the client",
+		offsetof(clientmetrics_t, spawn_queue) }
+};
+
+static const size_t NUM_METRICS = sizeof(metricinfo) / sizeof(metricinfo[0]);
+
+// a consistent copy of one client's block
+struct metricsnapshot_t
+{
+	int		id;
+	char	address[32];
+	unsigned int values[NUM_METRICS];
+	unsigned int rtt_buckets[NUM_RTT_BUCKETS + 1];
+	unsigned int rtt_sum_ms;
+	unsigned int rtt_count;
+};
+
+static bool SV_SnapshotMetrics(int id, metricsnapshot_t &snap)
+{
+	clientmetrics_t *m = &clientmetrics[id];
+
+	int generation = I_AtomicLoad(&m->generation);
+	if (!(generation & 1))
+		return false;
+
+	snap.id = id;
+	memcpy(snap.address, m->address, sizeof(snap.address));
+	snap.address[sizeof(snap.address) - 1] = 0;
+
+	for (size_t i = 0; i < NUM_METRICS; i++)
+		snap.values[i] = I_AtomicLoad((volatile int *)((char *)m + metricinfo[i].offset));
+	for (int i = 0; i <= NUM_RTT_BUCKETS; i++)
+		snap.rtt_buckets[i] = I_AtomicLoad(&m->rtt_buckets[i]);
+	snap.rtt_sum_ms = I_AtomicLoad(&m->rtt_sum_ms);
+	snap.rtt_count = I_AtomicLoad(&m->rtt_count);
+
+	// the client left or was replaced while copying
+	return I_AtomicLoad(&m->generation) == generation;
+}
+
+static void SV_AppendMetric(std::string &out, const char *format, ...)
+{
+	char line[256];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+
+	out += line;
+}
+
+//
+// SV_ExposeMetrics
+//
+// Prometheus text exposition format
+//
+static std::string SV_ExposeMetrics()
+{
+	std::vector<metricsnapshot_t> snaps;
+	for (int id = 0; id <= MAXPLAYERS; id++)
+	{
+		metricsnapshot_t snap;
+		if (SV_SnapshotMetrics(id, snap))
+			snaps.push_back(snap);
+	}
+
+	std::string out;
+
+	for (size_t i = 0; i < NUM_METRICS; i++)
+	{
+		SV_AppendMetric(out, "# HELP %s %s\n# TYPE %s %s\n", metricinfo[i].name,
+			metricinfo[i].help, metricinfo[i].name, metricinfo[i].type);
+
+		for (size_t s = 0; s < snaps.size(); s++)
+			SV_AppendMetric(out, "%s{id=\"%d\",address=\"%s\"} %u\n", metricinfo[i].name,
+				snaps[s].id, snaps[s].address, snaps[s].values[i]);
+	}
+
+	const char *rtt = "odasrv_client_rtt_milliseconds";
+	SV_AppendMetric(out, "# HELP %s Time until a packet is acknowledged\n# TYPE %s histogram\n", rtt, rtt);
+
+	for (size_t s = 0; s < snaps.size(); s++)
+	{
+		const metricsnapshot_t &snap = snaps[s];
+		unsigned int cumulative = 0;
+
+		for (int b = 0; b <= NUM_RTT_BUCKETS; b++)
+		{
+			cumulative += snap.rtt_buckets[b];
+
+			if (b < NUM_RTT_BUCKETS)
+				SV_AppendMetric(out, "%s_bucket{id=\"%d\",address=\"%s\",le=\"%d\"} %u\n",
+					rtt, snap.id, snap.address, rtt_bounds[b], cumulative);
+			else
+				SV_AppendMetric(out, "%s_bucket{id=\"%d\",address=\"%s\",le=\"+Inf\"} %u\n",
+					rtt, snap.id, snap.address, cumulative);
+		}
+
+		SV_AppendMetric(out, "%s_sum{id=\"%d\",address=\"%s\"} %u\n", rtt, snap.id, snap.address, snap.rtt_sum_ms);
+		SV_AppendMetric(out, "%s_count{id=\"%d\",address=\"%s\"} %u\n", rtt, snap.id, snap.address, snap.rtt_count);
+	}
+
+	SV_AppendMetric(out, "# HELP odasrv_clients Connected clients\n# TYPE odasrv_clients gauge\nodasrv_clients %u\n",
+		(unsigned int)snaps.size());
+
+	return out;
+}
+
+static void SV_SendAll(SOCKET s, const std::string &data)
+{
+	size_t sent = 0;
+	while (sent < data.length())
+	{
+		int n = send(s, data.c_str() + sent, (int)(data.length() - sent), MSG_NOSIGNAL);
+		if (n <= 0)
+			return;
+		sent += n;
+	}
+}
+
+//
+// StatsServer
+//
+// Accepts connections on the loopback interface and answers each with the
+// current metrics.  A request that starts with GET gets an HTTP response,
+// anything else (or nothing within a moment) gets the bare text.
+//
+class StatsServer
+{
+public:
+	StatsServer() : m_Socket(INVALID_SOCKET), m_Stop(0) {}
+	~StatsServer() { stop(); }
+
+	void start(int port)
+	{
+		stop();
+
+		if (port <= 0)
+			return;
+
+		m_Socket = socket(AF_INET, SOCK_STREAM, 0);
+		if (m_Socket == INVALID_SOCKET)
+		{
+			Printf(PRINT_HIGH, "Stats: unable to create socket\n");
+			return;
+		}
+
+		int reuse = 1;
+		setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if (bind(m_Socket, (struct sockaddr *)&address, sizeof(address)) == SOCKET_ERROR ||
+			listen(m_Socket, 4) == SOCKET_ERROR)
+		{
+			Printf(PRINT_HIGH, "Stats: unable to listen on 127.0.0.1:%d\n", port);
+			closesocket(m_Socket);
+			m_Socket = INVALID_SOCKET;
+			return;
+		}
+
+		I_AtomicStore(&m_Stop, 0);
+		m_Thread.start(StatsServer::run, this);
+
+		Printf(PRINT_HIGH, "Stats: serving client metrics on 127.0.0.1:%d\n", port);
+	}
+
+	void stop()
+	{
+		if (m_Socket == INVALID_SOCKET)
+			return;
+
+		I_AtomicStore(&m_Stop, 1);
+		m_Thread.join();
+
+		closesocket(m_Socket);
+		m_Socket = INVALID_SOCKET;
+	}
+
+private:
+	static bool waitReadable(SOCKET s, int ms)
+	{
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(s, &fds);
+
+		struct timeval tv;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+
+		return select((int)s + 1, &fds, NULL, NULL, &tv) > 0;
+	}
+
+	static void run(void *data)
+	{
+		StatsServer *self = static_cast<StatsServer *>(data);
+
+		while (!I_AtomicLoad(&self->m_Stop))
+		{
+			// wake up now and then to notice stop()
+			if (!waitReadable(self->m_Socket, 250))
+				continue;
+
+			SOCKET client = accept(self->m_Socket, NULL, NULL);
+			if (client == INVALID_SOCKET)
+				continue;
+
+#ifdef SO_NOSIGPIPE
+			// no MSG_NOSIGNAL here, so ask for the same on the socket
+			int nosigpipe = 1;
+			setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, (const char *)&nosigpipe, sizeof(nosigpipe));
+#endif
+
+			char request[512];
+			int len = 0;
+			if (waitReadable(client, 100))
+				len = recv(client, request, sizeof(request) - 1, 0);
+
+			std::string body = SV_ExposeMetrics();
+
+			if (len >= 3 && strncmp(request, "GET", 3) == 0)
+			{
+				char header[128];
+				snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain; version=0.0.4\r\n"
+					"Content-Length: %u\r\n\r\n", (unsigned int)body.length());
+				SV_SendAll(client, header);
+			}
+
+			SV_SendAll(client, body);
+			closesocket(client);
+		}
+	}
+
+	SOCKET			m_Socket;
+	volatile int	m_Stop;
+	OThread			m_Thread;
+};
+
+CVAR_FUNC_IMPL (sv_statsport)
+{
+	// constructed on first use, the cvar can be set before file statics
+	static StatsServer statsserver;
+	statsserver.start(var.asInt());
+}
+
+VERSION_CONTROL (sv_metrics_cpp, "$Id$")
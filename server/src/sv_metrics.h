@@ -0,0 +1,48 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Per-client network telemetry
+//
+//	The game thread updates a block of counters for each client with
+//	atomic operations only.  When sv_statsport is set, a thread serves
+//	them on 127.0.0.1 in the Prometheus text format, readable with a
+//	plain TCP connection or an HTTP GET, so a local scraper never waits
+//	on the game.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_METRICS_H__
+#define __SV_METRICS_H__
+
+#include <stddef.h>
+
+void SV_MetricsConnect(int id, const char *address);
+void SV_MetricsDisconnect(int id);
+
+// a packet left for the client, sizes before and after compression
+void SV_MetricsPacketSent(int id, int sequence, size_t plainsize, size_t size);
+// the unreliable part of a packet was thrown away by the rate limiter
+void SV_MetricsNetbufDropped(int id, size_t size);
+// the client acknowledged a packet, after missing some
+void SV_MetricsPacketAcked(int id, int sequence, int missed);
+// a missed reliable packet was sent again
+void SV_MetricsPacketResent(int id);
+// actors waiting in player_t::to_spawn
+void SV_MetricsSpawnQueue(int id, size_t depth);
+
+#endif	// __SV_METRICS_H__
@@ -29,6 +29,8 @@
 #include "doomstat.h"
 #include "p_local.h"
 #include "sv_main.h"
+#include "sv_stats.h"
+#include "sv_metrics.h"
 #include "huffman.h"
 #include "i_net.h"
 
@@ -39,6 +41,10 @@ EXTERN_CVAR (log_packetdebug)
 buf_t plain(MAX_UDP_PACKET); // denis - todo - call_terms destroys these statics on quit
 buf_t sendd(MAX_UDP_PACKET);
 
+// most reliable data held back while a client receives its full update,
+// the client is dropped if more piles up
+static const size_t FULLUPDATE_MAX_HELD = 256 * 1024;
+
 //
 // SV_CompressPacket
 //
@@ -47,6 +53,8 @@ buf_t sendd(MAX_UDP_PACKET);
 // if 0'd sections
 void SV_CompressPacket(buf_t &send, unsigned int reserved, client_t *cl)
 {
+	TicPhaseTimer timer(TICPHASE_COMPRESS);
+
 	if(plain.maxsize() < send.maxsize())
 		plain.resize(send.maxsize());
 	
@@ -105,7 +113,32 @@ bool SV_SendPacket(player_t &pl)
 	}
 	else
 		if (cl->netbuf.overflowed)
+		{
+			SV_MetricsNetbufDropped(pl.id, cl->netbuf.cursize);
+			SZ_Clear(&cl->netbuf);
+		}
+
+	// the client is still receiving the full update, reliable messages have
+	// to wait until it has been applied
+	if (cl->fullupdate.holding && cl->reliablebuf.cursize)
+	{
+		client_t::fullupdate_t &fu = cl->fullupdate;
+
+		// a client that takes this long over its full update is not
+		// going to catch up
+		if (fu.heldsize + cl->reliablebuf.cursize > FULLUPDATE_MAX_HELD)
+		{
 			SZ_Clear(&cl->netbuf);
+			SZ_Clear(&cl->reliablebuf);
+			SV_DropClient(pl);
+			return false;
+		}
+
+		fu.held.push_back(std::vector<byte>(cl->reliablebuf.data,
+			cl->reliablebuf.data + cl->reliablebuf.cursize));
+		fu.heldsize += cl->reliablebuf.cursize;
+		SZ_Clear(&cl->reliablebuf);
+	}
 
 	// [SL] 2012-05-04 - Don't send empty packets - they still have overhead
 	if (cl->reliablebuf.cursize + cl->netbuf.cursize == 0)
@@ -143,7 +176,9 @@ bool SV_SendPacket(player_t &pl)
     }
 
 	// add the unreliable part if space is available and rate value
-	// allows it
+	// allows it, whatever is left over is dropped
+	size_t dropped = cl->netbuf.cursize;
+
 	if (gametic % 35)
 	    bps = (int)((double)( (cl->unreliable_bps + cl->reliable_bps) * TICRATE)/(double)(gametic%35));
 
@@ -153,11 +188,17 @@ bool SV_SendPacket(player_t &pl)
 	  {
          SZ_Write (&sendd, cl->netbuf.data, cl->netbuf.cursize);
 	     cl->unreliable_bps += cl->netbuf.cursize;
+	     dropped = 0;
 	  }
+
+	if (dropped)
+		SV_MetricsNetbufDropped(pl.id, dropped);
     
 	SZ_Clear(&cl->netbuf);
 	SZ_Clear(&cl->reliablebuf);
 	
+	size_t plainsize = sendd.size();
+
 	// compress the packet, but not the sequence id
 	if (sendd.size() > sizeof(int))
 		SV_CompressPacket(sendd, sizeof(int), cl);
@@ -170,6 +211,9 @@ bool SV_SendPacket(player_t &pl)
 
 	NET_SendPacket(sendd, cl->address);
 
+	SV_MetricsPacketSent(pl.id, cl->sequence - 1, plainsize, sendd.size());
+	SV_MetricsSpawnQueue(pl.id, pl.to_spawn.size());
+
 	return true;
 }
 
@@ -184,6 +228,9 @@ void SV_AcknowledgePacket(player_t &player)
 
 	cl->compressor.packet_acked(sequence);
 
+	SV_MetricsPacketAcked(player.id, sequence,
+		sequence > cl->last_sequence ? sequence - cl->last_sequence - 1 : 0);
+
 	// packet is missed
 	if (sequence - cl->last_sequence > 1)
 	{
@@ -215,6 +262,8 @@ void SV_AcknowledgePacket(player_t &player)
 				SZ_Write (&cl->reliablebuf, cl->relpackets.data, 
 					cl->packetbegin[n], cl->packetsize[n]);
 
+			SV_MetricsPacketResent(player.id);
+
 			if (cl->reliablebuf.overflowed)
 			{
 				// do full update
@@ -22,6 +22,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <deque>
 
 #include "sv_sqp.h"
 
@@ -43,6 +45,9 @@ static buf_t ml_message(MAX_UDP_PACKET);
 
 EXTERN_CVAR(join_password)
 EXTERN_CVAR(sv_timelimit)
+EXTERN_CVAR(sv_qrycacheage)
+EXTERN_CVAR(sv_qryratelimit)
+EXTERN_CVAR(sv_qryburst)
 
 struct CvarField_t
 {
@@ -78,26 +83,26 @@ struct CvarField_t
 // IntQryBuildInformation()
 //
 // Protocol building routine, the passed parameter is the enquirer version
+//
+// The enquirer's time is not written here, it is the only per-request field
+// and is placed in front of the (possibly cached) output by the caller.
 static void IntQryBuildInformation(const DWORD& EqProtocolVersion,
-                                   const DWORD& EqTime)
+                                   buf_t &out)
 {
 	std::vector<CvarField_t> Cvars;
 
-	// bond - time
-	MSG_WriteLong(&ml_message, EqTime);
-
 	// The servers real protocol version
 	// bond - real protocol
-	MSG_WriteLong(&ml_message, PROTOCOL_VERSION);
+	MSG_WriteLong(&out, PROTOCOL_VERSION);
 
 	// Built revision of server
 	// TODO: Remove guard before next release
 	QRYNEWINFO(7)
 	{
-	    MSG_WriteString(&ml_message, GitDescribe());
+	    MSG_WriteString(&out, GitDescribe());
 	}
 	else
-        MSG_WriteLong(&ml_message, -1);
+        MSG_WriteLong(&out, -1);
 
 	cvar_t* var = GetFirstCvar();
 
@@ -127,40 +132,40 @@ next:
 	}
 
 	// Cvar count
-	MSG_WriteByte(&ml_message, (BYTE)Cvars.size());
+	MSG_WriteByte(&out, (BYTE)Cvars.size());
 
 	// Write cvars
 	for(size_t i = 0; i < Cvars.size(); ++i)
 	{
-		MSG_WriteString(&ml_message, Cvars[i].Name.c_str());
+		MSG_WriteString(&out, Cvars[i].Name.c_str());
 
 		// Type field
-		MSG_WriteByte(&ml_message, (byte)Cvars[i].Type);
+		MSG_WriteByte(&out, (byte)Cvars[i].Type);
 
 		switch(Cvars[i].Type)
 		{
 		case CVARTYPE_BYTE:
 		{
-			MSG_WriteByte(&ml_message, (byte)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteByte(&out, (byte)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_WORD:
 		{
-			MSG_WriteShort(&ml_message, (short)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteShort(&out, (short)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_INT:
 		{
-			MSG_WriteLong(&ml_message, (int)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteLong(&out, (int)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_FLOAT:
 		case CVARTYPE_STRING:
 		{
-			MSG_WriteString(&ml_message, Cvars[i].Value.c_str());
+			MSG_WriteString(&out, Cvars[i].Value.c_str());
 		}
 		break;
 
@@ -171,9 +176,9 @@ next:
 		}
 	}
 
-	MSG_WriteHexString(&ml_message, strlen(join_password.cstring()) ? MD5SUM(join_password.cstring()).c_str() : "");
+	MSG_WriteHexString(&out, strlen(join_password.cstring()) ? MD5SUM(join_password.cstring()).c_str() : "");
 
-	MSG_WriteString(&ml_message, level.mapname);
+	MSG_WriteString(&out, level.mapname);
 
 	int timeleft = (int)(sv_timelimit - level.time/(TICRATE*60));
 
@@ -186,77 +191,77 @@ next:
     QRYNEWINFO(6)
     {
         if (sv_timelimit.asInt())
-            MSG_WriteShort(&ml_message, timeleft);
+            MSG_WriteShort(&out, timeleft);
     }
     else
-        MSG_WriteShort(&ml_message, timeleft);
+        MSG_WriteShort(&out, timeleft);
     
 	// Teams
 	if(sv_gametype == GM_TEAMDM || sv_gametype == GM_CTF)
 	{
 		// Team data
-		MSG_WriteByte(&ml_message, 2);
+		MSG_WriteByte(&out, 2);
 
 		// Blue
-		MSG_WriteString(&ml_message, "Blue");
-		MSG_WriteLong(&ml_message, 0x000000FF);
-		MSG_WriteShort(&ml_message, (short)TEAMpoints[it_blueflag]);
+		MSG_WriteString(&out, "Blue");
+		MSG_WriteLong(&out, 0x000000FF);
+		MSG_WriteShort(&out, (short)TEAMpoints[it_blueflag]);
 
-		MSG_WriteString(&ml_message, "Red");
-		MSG_WriteLong(&ml_message, 0x00FF0000);
-		MSG_WriteShort(&ml_message, (short)TEAMpoints[it_redflag]);
+		MSG_WriteString(&out, "Red");
+		MSG_WriteLong(&out, 0x00FF0000);
+		MSG_WriteShort(&out, (short)TEAMpoints[it_redflag]);
 	}
 
 	// TODO: When real dynamic teams are implemented
 	//byte TeamCount = (byte)sv_teamsinplay;
-	//MSG_WriteByte(&ml_message, TeamCount);
+	//MSG_WriteByte(&out, TeamCount);
 
 	//for (byte i = 0; i < TeamCount; ++i)
 	//{
 	// TODO - Figure out where the info resides
-	//MSG_WriteString(&ml_message, "");
-	//MSG_WriteLong(&ml_message, 0);
-	//MSG_WriteShort(&ml_message, TEAMpoints[i]);
+	//MSG_WriteString(&out, "");
+	//MSG_WriteLong(&out, 0);
+	//MSG_WriteShort(&out, TEAMpoints[i]);
 	//}
 
 	// Patch files
-	MSG_WriteByte(&ml_message, patchfiles.size());
+	MSG_WriteByte(&out, patchfiles.size());
 
 	for(size_t i = 0; i < patchfiles.size(); ++i)
 	{
-		MSG_WriteString(&ml_message, D_CleanseFileName(patchfiles[i]).c_str());
+		MSG_WriteString(&out, D_CleanseFileName(patchfiles[i]).c_str());
 	}
 
 	// Wad files
-	MSG_WriteByte(&ml_message, wadfiles.size());
+	MSG_WriteByte(&out, wadfiles.size());
 
 	for(size_t i = 0; i < wadfiles.size(); ++i)
 	{
-		MSG_WriteString(&ml_message, D_CleanseFileName(wadfiles[i], "wad").c_str());
-		MSG_WriteHexString(&ml_message, wadhashes[i].c_str());
+		MSG_WriteString(&out, D_CleanseFileName(wadfiles[i], "wad").c_str());
+		MSG_WriteHexString(&out, wadhashes[i].c_str());
 	}
 
-	MSG_WriteByte(&ml_message, players.size());
+	MSG_WriteByte(&out, players.size());
 
 	// Player info
 	for(Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
-		MSG_WriteString(&ml_message, it->userinfo.netname.c_str());
+		MSG_WriteString(&out, it->userinfo.netname.c_str());
 
 		for (int i = 3; i >= 0; i--)
-			MSG_WriteByte(&ml_message, it->userinfo.color[i]);
+			MSG_WriteByte(&out, it->userinfo.color[i]);
 
 		if(sv_gametype == GM_TEAMDM || sv_gametype == GM_CTF)
-			MSG_WriteByte(&ml_message, it->userinfo.team);
+			MSG_WriteByte(&out, it->userinfo.team);
 
-		MSG_WriteShort(&ml_message, it->ping);
+		MSG_WriteShort(&out, it->ping);
 
 		int timeingame = (time(NULL) - it->JoinTime) / 60;
 
 		if(timeingame < 0)
 			timeingame = 0;
 
-		MSG_WriteShort(&ml_message, timeingame);
+		MSG_WriteShort(&out, timeingame);
 
 		// FIXME - Treat non-players (downloaders/others) as spectators too for
 		// now
@@ -267,12 +272,210 @@ next:
 		              (it->playerstate != PST_DEAD) &&
 		              (it->playerstate != PST_REBORN)));
 
-		MSG_WriteBool(&ml_message, spectator);
+		MSG_WriteBool(&out, spectator);
+
+		MSG_WriteShort(&out, it->fragcount);
+		MSG_WriteShort(&out, it->killcount);
+		MSG_WriteShort(&out, it->deathcount);
+	}
+}
+
+//
+// Response cache
+//
+// Building the information response walks every cvar, resource file and
+// player, so it is done once per protocol version and reused until something
+// it describes changes (see SV_QryInvalidateCache) or it becomes older than
+// sv_qrycacheage, which takes care of pings, frags and the time fields.
+//
+struct QryCacheEntry_t
+{
+	QryCacheEntry_t() : valid(false), built(0), generation(0) {}
+
+	bool valid;
+	dtime_t built;
+	DWORD generation;
+	buf_t data;
+};
+
+static QryCacheEntry_t QryCache[PROTOCOL_VERSION + 1];
+static DWORD QryCacheGeneration = 1;
+
+//
+// Per-address rate limiting
+//
+// Each source address gets a token bucket refilled at sv_qryratelimit tokens
+// per second and capped at sv_qryburst, every query costs one token.
+//
+struct QryBucket_t
+{
+	float tokens;
+	dtime_t lastrefill;
+};
+
+typedef std::map<DWORD, QryBucket_t> QryBuckets_t;
+static QryBuckets_t QryBuckets;
+
+// Tracked addresses, oldest first
+static std::deque<DWORD> QryBucketOrder;
+static dtime_t QryLastPrune;
+
+// No more than this many addresses are tracked.  When full, idle ones are
+// pruned, then the oldest ones are forgotten
+#define QRY_MAXBUCKETS 4096
+
+struct QryStats_t
+{
+	DWORD received;
+	DWORD dropped;
+	DWORD evicted;
+	DWORD cachehits;
+	DWORD rebuilds;
+	DWORD invalidations;
+};
+
+static QryStats_t QryStats;
+
+//
+// SV_QryInvalidateCache()
+//
+// Marks every cached response as stale, called when players, serverinfo cvars
+// or the map change
+void SV_QryInvalidateCache()
+{
+	++QryCacheGeneration;
+	++QryStats.invalidations;
+}
+
+//
+// IntQryPruneBuckets()
+//
+// Forgets addresses whose bucket has refilled completely, they would start
+// from a full bucket anyway
+static void IntQryPruneBuckets(const dtime_t &now)
+{
+	const float rate = sv_qryratelimit;
+	const float burst = sv_qryburst;
+
+	QryBuckets_t::iterator it = QryBuckets.begin();
+
+	while (it != QryBuckets.end())
+	{
+		float elapsed = (now - it->second.lastrefill) / 1000.0f;
+
+		if (it->second.tokens + elapsed * rate >= burst)
+			QryBuckets.erase(it++);
+		else
+			++it;
+	}
+
+	size_t kept = 0;
+
+	for (size_t i = 0; i < QryBucketOrder.size(); i++)
+	{
+		if (QryBuckets.find(QryBucketOrder[i]) != QryBuckets.end())
+			QryBucketOrder[kept++] = QryBucketOrder[i];
+	}
+
+	QryBucketOrder.resize(kept);
+}
+
+//
+// SV_QryAllowRequest()
+//
+// Charges a launcher query to the address that sent it, returns false if that
+// address is over its rate and the query should be dropped without a reply
+bool SV_QryAllowRequest(const netadr_t &from)
+{
+	++QryStats.received;
+
+	if (sv_qryratelimit <= 0.0f)
+		return true;
+
+	const dtime_t now = I_MSTime();
+	const DWORD ip = (from.ip[0] << 24) | (from.ip[1] << 16) |
+	                 (from.ip[2] << 8) | from.ip[3];
+
+	QryBuckets_t::iterator it = QryBuckets.find(ip);
+
+	if (it == QryBuckets.end())
+	{
+		if (QryBuckets.size() >= QRY_MAXBUCKETS)
+		{
+			// Pruning walks every bucket, so a flood of new addresses only
+			// gets to trigger it once a second
+			if (now - QryLastPrune >= 1000)
+			{
+				IntQryPruneBuckets(now);
+				QryLastPrune = now;
+			}
+
+			while (QryBuckets.size() >= QRY_MAXBUCKETS)
+			{
+				QryBuckets.erase(QryBucketOrder.front());
+				QryBucketOrder.pop_front();
+				++QryStats.evicted;
+			}
+		}
+
+		QryBucket_t bucket;
+		bucket.tokens = sv_qryburst;
+		bucket.lastrefill = now;
+
+		it = QryBuckets.insert(std::make_pair(ip, bucket)).first;
+		QryBucketOrder.push_back(ip);
+	}
+
+	QryBucket_t &bucket = it->second;
+
+	bucket.tokens += ((now - bucket.lastrefill) / 1000.0f) * sv_qryratelimit;
+	bucket.lastrefill = now;
+
+	if (bucket.tokens > sv_qryburst)
+		bucket.tokens = sv_qryburst;
+
+	if (bucket.tokens < 1.0f)
+	{
+		++QryStats.dropped;
+		return false;
+	}
+
+	bucket.tokens -= 1.0f;
+
+	return true;
+}
+
+//
+// IntQryGetInformation()
+//
+// Returns the information response for the given protocol version, rebuilding
+// it only if the cached copy is missing or stale
+static const buf_t &IntQryGetInformation(const DWORD& EqProtocolVersion)
+{
+	QryCacheEntry_t &entry = QryCache[EqProtocolVersion];
+	const dtime_t now = I_MSTime();
 
-		MSG_WriteShort(&ml_message, it->fragcount);
-		MSG_WriteShort(&ml_message, it->killcount);
-		MSG_WriteShort(&ml_message, it->deathcount);
+	if (entry.valid && entry.generation == QryCacheGeneration &&
+	    now - entry.built < (dtime_t)sv_qrycacheage.asInt())
+	{
+		++QryStats.cachehits;
+		return entry.data;
 	}
+
+	if (entry.data.maxsize() == 0)
+		entry.data.resize(MAX_UDP_PACKET);
+
+	entry.data.clear();
+
+	IntQryBuildInformation(EqProtocolVersion, entry.data);
+
+	entry.valid = !entry.data.overflowed;
+	entry.built = now;
+	entry.generation = QryCacheGeneration;
+
+	++QryStats.rebuilds;
+
+	return entry.data;
 }
 
 //
@@ -406,7 +609,12 @@ static DWORD IntQrySendResponse(const WORD& TagId,
 	else
 		MSG_WriteLong(&ml_message, EqProtocolVersion);
 
-	IntQryBuildInformation(EqProtocolVersion, EqTime);
+	// bond - time
+	MSG_WriteLong(&ml_message, EqTime);
+
+	const buf_t &info = IntQryGetInformation(EqProtocolVersion);
+
+	MSG_WriteChunk(&ml_message, info.data, info.cursize);
 
 	NET_SendPacket(ml_message, net_from);
 
@@ -434,7 +642,29 @@ DWORD SV_QryParseEnquiry(const DWORD& Tag)
 		return 1;
 	}
 
+	// Flooding address, swallow the query without replying
+	if (!SV_QryAllowRequest(net_from))
+		return 0;
+
 	return IntQrySendResponse(TagId, TagApplication, TagQRId, TagPacketType);
 }
 
+BEGIN_COMMAND (qrystats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		memset(&QryStats, 0, sizeof(QryStats));
+		return;
+	}
+
+	Printf(PRINT_HIGH, "Launcher queries received: %u\n", QryStats.received);
+	Printf(PRINT_HIGH, "Dropped by rate limit: %u\n", QryStats.dropped);
+	Printf(PRINT_HIGH, "Addresses forgotten when full: %u\n", QryStats.evicted);
+	Printf(PRINT_HIGH, "Answered from cache: %u\n", QryStats.cachehits);
+	Printf(PRINT_HIGH, "Responses rebuilt: %u\n", QryStats.rebuilds);
+	Printf(PRINT_HIGH, "Cache invalidations: %u\n", QryStats.invalidations);
+	Printf(PRINT_HIGH, "Addresses tracked: %u\n", (DWORD)QryBuckets.size());
+}
+END_COMMAND (qrystats)
+
 VERSION_CONTROL(sv_sqp_cpp, "$Id$")
@@ -25,6 +25,7 @@
 
 #include "version.h"
 #include "doomtype.h"
+#include "i_net.h"
 
 #define ASSEMBLEVERSION(MAJOR,MINOR,PATCH) ((MAJOR) * 256 + (MINOR)(PATCH))
 #define DISECTVERSION(VERSION,MAJOR,MINOR,PATCH) \
@@ -39,5 +40,7 @@
 #define VERSIONPATCH(VERSION) ((VERSION % 256) % 10)
 
 DWORD SV_QryParseEnquiry(const DWORD &Tag);
+bool SV_QryAllowRequest(const netadr_t &from);
+void SV_QryInvalidateCache();
 
 #endif // __SV_SQP_H__
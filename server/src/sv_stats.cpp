@@ -21,7 +21,347 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomdef.h"
+#include "c_console.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "i_system.h"
 #include "sv_stats.h"
 #include "version.h"
 
+EXTERN_CVAR(sv_ticstats_interval)
+EXTERN_CVAR(sv_ticstats_file)
+
+// Latency histogram with 8 buckets per power of two microseconds, so
+// percentiles are within 1/8th of the real value.  The first 8 buckets
+// are 0-7us one each.
+static const int HISTOGRAM_SUBBUCKETS = 8;
+static const int HISTOGRAM_BUCKETS = HISTOGRAM_SUBBUCKETS * 30;
+
+class TicHistogram
+{
+public:
+	TicHistogram() { clear(); }
+
+	void clear()
+	{
+		memset(m_Buckets, 0, sizeof(m_Buckets));
+		m_Count = 0;
+		m_Total = 0;
+		m_Max = 0;
+		m_Overruns = 0;
+	}
+
+	void add(dtime_t ns)
+	{
+		m_Buckets[bucket(ns / 1000)]++;
+		m_Count++;
+		m_Total += ns;
+		if (ns > m_Max)
+			m_Max = ns;
+	}
+
+	// in milliseconds
+	double percentile(double p) const
+	{
+		if (m_Count == 0)
+			return 0.0;
+
+		QWORD target = (QWORD)(p * m_Count);
+		if (target >= m_Count)
+			target = m_Count - 1;
+
+		QWORD seen = 0;
+		for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		{
+			seen += m_Buckets[i];
+			if (seen > target)
+			{
+				// the top of the bucket, but never above what was seen
+				double ms = upperbound(i) / 1000.0;
+				return ms < max() ? ms : max();
+			}
+		}
+
+		return max();
+	}
+
+	double mean() const	{ return m_Count ? m_Total / 1e6 / m_Count : 0.0; }
+	double max() const	{ return m_Max / 1e6; }
+	QWORD count() const	{ return m_Count; }
+
+	QWORD m_Overruns;
+
+private:
+	static int bucket(QWORD us)
+	{
+		if (us < (QWORD)HISTOGRAM_SUBBUCKETS)
+			return (int)us;
+
+		int msb = 0;
+		while ((us >> msb) > 1)
+			msb++;
+
+		int shift = msb - 3;
+		int b = (shift + 1) * HISTOGRAM_SUBBUCKETS + (int)((us >> shift) & (HISTOGRAM_SUBBUCKETS - 1));
+		return b < HISTOGRAM_BUCKETS ? b : HISTOGRAM_BUCKETS - 1;
+	}
+
+	// in microseconds
+	static QWORD upperbound(int b)
+	{
+		if (b < HISTOGRAM_SUBBUCKETS)
+			return b + 1;
+
+		int shift = b / HISTOGRAM_SUBBUCKETS - 1;
+		return (QWORD)(HISTOGRAM_SUBBUCKETS + b % HISTOGRAM_SUBBUCKETS + 1) << shift;
+	}
+
+	QWORD m_Buckets[HISTOGRAM_BUCKETS];
+	QWORD m_Count;
+	dtime_t m_Total;
+	dtime_t m_Max;
+};
+
+struct ticphaseinfo_t
+{
+	const char	*name;
+	int			parent;
+};
+
+static const ticphaseinfo_t ticphaseinfo[NUMTICPHASES] =
+{
+	{ "tic",			-1 },
+	{ "packets",		TICPHASE_TIC },
+	{ "steptics",		TICPHASE_TIC },
+	{ "gametics",		TICPHASE_STEPTICS },
+	{ "ticker",			TICPHASE_STEPTICS },
+	{ "writecommands",	TICPHASE_STEPTICS },
+	{ "sendpackets",	TICPHASE_STEPTICS },
+	{ "compress",		TICPHASE_SENDPACKETS }
+};
+
+struct ticphase_state_t
+{
+	int		depth;		// phases can be reentered, e.g. packets sent early
+	dtime_t	start;
+	dtime_t	elapsed;	// this tic so far
+	bool	ran;
+};
+
+static ticphase_state_t ticphases[NUMTICPHASES];
+
+// since the last "ticstats reset" and since the last JSON dump
+static TicHistogram histograms[NUMTICPHASES];
+static TicHistogram intervalhistograms[NUMTICPHASES];
+static dtime_t lastdump = 0;
+
+// the simulation runs at TICRATE, anything slower falls behind
+static const dtime_t TIC_BUDGET = 1000LL * 1000LL * 1000LL / TICRATE;
+
+static void SV_FinishTic();
+static void SV_DumpTicStatsJSON();
+
+//
+// SV_BeginTicPhase
+//
+void SV_BeginTicPhase(ticphase_t phase)
+{
+	ticphase_state_t &state = ticphases[phase];
+
+	if (state.depth++ == 0)
+		state.start = I_GetTime();
+}
+
+//
+// SV_EndTicPhase
+//
+void SV_EndTicPhase(ticphase_t phase)
+{
+	ticphase_state_t &state = ticphases[phase];
+
+	if (state.depth == 0 || --state.depth > 0)
+		return;
+
+	state.elapsed += I_GetTime() - state.start;
+	state.ran = true;
+
+	if (phase == TICPHASE_TIC)
+		SV_FinishTic();
+}
+
+//
+// SV_FinishTic
+//
+// Files the times of every phase that ran this tic
+//
+static void SV_FinishTic()
+{
+	// time spent in each phase outside of the phases nested in it, to
+	// find what made a tic go over budget
+	dtime_t self[NUMTICPHASES];
+	for (int i = 0; i < NUMTICPHASES; i++)
+		self[i] = ticphases[i].elapsed;
+
+	for (int i = 0; i < NUMTICPHASES; i++)
+	{
+		int parent = ticphaseinfo[i].parent;
+		if (parent >= 0)
+			self[parent] = self[parent] > ticphases[i].elapsed ? self[parent] - ticphases[i].elapsed : 0;
+	}
+
+	if (ticphases[TICPHASE_TIC].elapsed > TIC_BUDGET)
+	{
+		int worst = 0;
+		for (int i = 1; i < NUMTICPHASES; i++)
+			if (self[i] > self[worst])
+				worst = i;
+
+		histograms[worst].m_Overruns++;
+		intervalhistograms[worst].m_Overruns++;
+	}
+
+	for (int i = 0; i < NUMTICPHASES; i++)
+	{
+		if (ticphases[i].ran)
+		{
+			histograms[i].add(ticphases[i].elapsed);
+			intervalhistograms[i].add(ticphases[i].elapsed);
+		}
+
+		ticphases[i].elapsed = 0;
+		ticphases[i].ran = false;
+	}
+
+	if (sv_ticstats_interval > 0)
+	{
+		dtime_t now = I_GetTime();
+
+		if (lastdump == 0)
+			lastdump = now;
+		else if (now - lastdump >= (dtime_t)(sv_ticstats_interval * 1e9))
+		{
+			SV_DumpTicStatsJSON();
+			lastdump = now;
+		}
+	}
+	else
+	{
+		lastdump = 0;
+	}
+}
+
+static QWORD SV_TicOverruns(const TicHistogram *hist)
+{
+	QWORD overruns = 0;
+	for (int i = 0; i < NUMTICPHASES; i++)
+		overruns += hist[i].m_Overruns;
+	return overruns;
+}
+
+//
+// SV_DumpTicStatsJSON
+//
+// Writes the stats of the last interval and starts a new one.  The file is
+// replaced in one go so a dashboard never reads half of it.
+//
+static void SV_DumpTicStatsJSON()
+{
+	std::string filename = sv_ticstats_file.str();
+	std::string tmpname = filename + ".tmp";
+
+	FILE *fp = fopen(tmpname.c_str(), "w");
+	if (!fp)
+	{
+		DPrintf("SV_DumpTicStatsJSON: unable to write %s\n", tmpname.c_str());
+		return;
+	}
+
+	fprintf(fp, "{\n\t\"time\": %ld,\n\t\"interval\": %.3f,\n\t\"budget_ms\": %.3f,\n",
+		(long)time(NULL), (double)sv_ticstats_interval, TIC_BUDGET / 1e6);
+	fprintf(fp, "\t\"tics\": %llu,\n\t\"overruns\": %llu,\n\t\"phases\": [\n",
+		(unsigned long long)intervalhistograms[TICPHASE_TIC].count(),
+		(unsigned long long)SV_TicOverruns(intervalhistograms));
+
+	for (int i = 0; i < NUMTICPHASES; i++)
+	{
+		const TicHistogram &hist = intervalhistograms[i];
+		int parent = ticphaseinfo[i].parent;
+
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"parent\": %s%s%s, \"count\": %llu, "
+			"\"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, "
+			"\"overruns\": %llu }%s\n",
+			ticphaseinfo[i].name,
+			parent >= 0 ? "\"" : "", parent >= 0 ? ticphaseinfo[parent].name : "null", parent >= 0 ? "\"" : "",
+			(unsigned long long)hist.count(), hist.mean(), hist.percentile(0.5),
+			hist.percentile(0.99), hist.max(), (unsigned long long)hist.m_Overruns,
+			i < NUMTICPHASES - 1 ? "," : "");
+	}
+
+	fprintf(fp, "\t]\n}\n");
+
+	bool failed = ferror(fp) != 0;
+	fclose(fp);
+
+	if (!failed)
+	{
+		// rename won't replace an existing file on Windows
+		remove(filename.c_str());
+		failed = rename(tmpname.c_str(), filename.c_str()) != 0;
+	}
+
+	if (failed)
+		DPrintf("SV_DumpTicStatsJSON: unable to write %s\n", filename.c_str());
+
+	for (int i = 0; i < NUMTICPHASES; i++)
+		intervalhistograms[i].clear();
+}
+
+static int SV_TicPhaseDepth(int phase)
+{
+	int depth = 0;
+	while ((phase = ticphaseinfo[phase].parent) >= 0)
+		depth++;
+	return depth;
+}
+
+BEGIN_COMMAND (ticstats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		for (int i = 0; i < NUMTICPHASES; i++)
+			histograms[i].clear();
+		return;
+	}
+
+	Printf(PRINT_HIGH, "%-18s %10s %8s %8s %8s %8s %8s\n",
+		"phase", "tics", "mean", "p50", "p99", "max", "overrun");
+
+	for (int i = 0; i < NUMTICPHASES; i++)
+	{
+		const TicHistogram &hist = histograms[i];
+		std::string name = std::string(SV_TicPhaseDepth(i) * 2, ' ') + ticphaseinfo[i].name;
+
+		Printf(PRINT_HIGH, "%-18s %10llu %8.3f %8.3f %8.3f %8.3f %8llu\n",
+			name.c_str(), (unsigned long long)hist.count(), hist.mean(),
+			hist.percentile(0.5), hist.percentile(0.99), hist.max(),
+			(unsigned long long)hist.m_Overruns);
+	}
+
+	Printf(PRINT_HIGH, "%llu of %llu tics took longer than %.2fms, times are in ms\n",
+		(unsigned long long)SV_TicOverruns(histograms),
+		(unsigned long long)histograms[TICPHASE_TIC].count(), TIC_BUDGET / 1e6);
+}
+END_COMMAND (ticstats)
+
+
 VERSION_CONTROL (sv_stats_cpp, "$Id$")
@@ -19,5 +19,47 @@
 // DESCRIPTION:
 // Player statistics generation
 //
+// Tic phase profiler: the server's tic is split into nested phases that
+// are timed every tic.  Each phase keeps a latency histogram and a count of
+// the tics that went over budget while it was the most expensive part.
+// "ticstats" prints them, sv_ticstats_interval writes them out as JSON.
+//
 //-----------------------------------------------------------------------------
 
+#ifndef __SV_STATS_H__
+#define __SV_STATS_H__
+
+enum ticphase_t
+{
+	TICPHASE_TIC,				// all of SV_RunTics
+	TICPHASE_PACKETS,			// reading and parsing client packets
+	TICPHASE_STEPTICS,			// SV_StepTics
+	TICPHASE_GAMETICS,			// SV_GameTics
+	TICPHASE_TICKER,			// G_Ticker, the playsim
+	TICPHASE_WRITECOMMANDS,		// SV_WriteCommands
+	TICPHASE_SENDPACKETS,		// SV_SendPackets
+	TICPHASE_COMPRESS,			// SV_CompressPacket
+
+	NUMTICPHASES
+};
+
+void SV_BeginTicPhase(ticphase_t phase);
+void SV_EndTicPhase(ticphase_t phase);
+
+//
+// TicPhaseTimer
+//
+// Times the enclosing scope as a phase of the current tic
+//
+class TicPhaseTimer
+{
+public:
+	TicPhaseTimer(ticphase_t phase) : m_Phase(phase) { SV_BeginTicPhase(m_Phase); }
+	~TicPhaseTimer() { SV_EndTicPhase(m_Phase); }
+
+private:
+	ticphase_t m_Phase;
+};
+
+#endif	// __SV_STATS_H__
+
@@ -0,0 +1,383 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Server supervisor
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef UNIX
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "doomtype.h"
+#include "doomdef.h"
+#include "c_console.h"
+#include "c_dispatch.h"
+#include "i_system.h"
+#include "i_net.h"
+#include "m_argv.h"
+#include "m_fileio.h"
+#include "m_misc.h"
+#include "sv_supervisor.h"
+#include "sv_log.h"
+
+void STACK_ARGS call_terms(void);
+
+#ifdef UNIX
+void daemon_init();
+#endif
+
+static int supervised_instance = 0;
+static dtime_t instance_begin = 0;		// when this instance was forked
+static dtime_t shared_load_time = 0;	// resource loading done before forking
+
+//
+// SV_InstanceFileName
+//
+// foo.cfg -> foo-3.cfg
+//
+static std::string SV_InstanceFileName(const std::string &filename, int instance)
+{
+	std::ostringstream suffix;
+	suffix << "-" << instance;
+
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filename + suffix.str();
+
+	return filename.substr(0, dot) + suffix.str() + filename.substr(dot);
+}
+
+//
+// SV_SetArgValue
+//
+// Replaces the value of a command line parameter, or adds it
+//
+static void SV_SetArgValue(const char *parm, const std::string &value)
+{
+	size_t p = Args.CheckParm(parm);
+
+	if (p && p < Args.NumArgs() - 1)
+	{
+		Args.SetArg(p + 1, value.c_str());
+	}
+	else
+	{
+		Args.AppendArg(parm);
+		Args.AppendArg(value.c_str());
+	}
+}
+
+int SV_SupervisedInstance()
+{
+	return supervised_instance;
+}
+
+#ifdef UNIX
+
+struct serverinstance_t
+{
+	pid_t		pid;
+	dtime_t		started;
+	dtime_t		restart_at;
+	dtime_t		restart_delay;
+	bool		finished;
+};
+
+// an instance that dies sooner than this after starting is restarted with
+// an increasing delay, so a broken config does not fork in a tight loop
+static const dtime_t INSTANCE_MIN_UPTIME = 10 * 1000LL * 1000LL * 1000LL;
+static const dtime_t INSTANCE_MIN_DELAY = 1000LL * 1000LL * 1000LL;
+static const dtime_t INSTANCE_MAX_DELAY = 60 * 1000LL * 1000LL * 1000LL;
+
+static volatile sig_atomic_t supervisor_quit = 0;
+
+static void SV_SupervisorSignal(int s)
+{
+	supervisor_quit = s;
+}
+
+static const int supervisor_signals[] = { SIGINT, SIGTERM, SIGHUP };
+static const size_t NUM_SUPERVISOR_SIGNALS = sizeof(supervisor_signals) / sizeof(supervisor_signals[0]);
+
+//
+// SV_BecomeInstance
+//
+// Sets up a freshly forked instance before the rest of D_DoomMain runs
+//
+static void SV_BecomeInstance(int instance, int baseport, void (*oldhandlers[])(int))
+{
+	for (size_t i = 0; i < NUM_SUPERVISOR_SIGNALS; i++)
+		signal(supervisor_signals[i], oldhandlers[i]);
+
+	supervised_instance = instance;
+	instance_begin = I_GetTime();
+
+	// each instance gets its own log
+	static std::string logfile;
+	if (LOG.is_open())
+	{
+		LOG.close();
+		logfile = SV_InstanceFileName(LOG_FILE, instance);
+		LOG_FILE = logfile.c_str();
+		LOG.open(LOG_FILE, std::ios::app);
+	}
+
+	std::ostringstream port;
+	port << baseport + instance - 1;
+	SV_SetArgValue("-port", port.str());
+
+	// keep sharing the base config if the instance has none of its own
+	std::string config = SV_InstanceFileName(M_GetConfigPath(), instance);
+	if (M_FileExists(config))
+		SV_SetArgValue("-config", config);
+
+	Printf(PRINT_HIGH, "Instance %d: pid %d, port %s, config %s\n", instance,
+		(int)getpid(), port.str().c_str(), M_GetConfigPath().c_str());
+}
+
+//
+// SV_Supervise
+//
+void SV_Supervise(dtime_t started)
+{
+	const char *val = Args.CheckValue("-supervise");
+	int count = val ? atoi(val) : 0;
+	if (count < 1)
+		return;
+
+	shared_load_time = I_GetTime() - started;
+
+	const char *v = Args.CheckValue("-port");
+	int baseport = v ? atoi(v) : SERVERPORT;
+
+	// the supervisor goes to the background, not the instances
+	if (Args.CheckParm("-fork"))
+		daemon_init();
+
+	Printf(PRINT_HIGH, "Supervisor: shared resources loaded in %u ms, starting %d instances on ports %d-%d\n",
+		(unsigned int)I_ConvertTimeToMs(shared_load_time), count, baseport, baseport + count - 1);
+
+	void (*oldhandlers[NUM_SUPERVISOR_SIGNALS])(int);
+	for (size_t i = 0; i < NUM_SUPERVISOR_SIGNALS; i++)
+		oldhandlers[i] = signal(supervisor_signals[i], SV_SupervisorSignal);
+
+	std::vector<serverinstance_t> instances(count);
+	for (int i = 0; i < count; i++)
+	{
+		instances[i].pid = 0;
+		instances[i].restart_at = 0;
+		instances[i].restart_delay = INSTANCE_MIN_DELAY;
+		instances[i].finished = false;
+	}
+
+	int running = count;
+
+	while (!supervisor_quit && running > 0)
+	{
+		dtime_t now = I_GetTime();
+
+		for (int i = 0; i < count; i++)
+		{
+			serverinstance_t &inst = instances[i];
+			if (inst.pid || inst.finished || now < inst.restart_at)
+				continue;
+
+			// flush so buffered output is not written twice, and stop
+			// the log thread since the child would not have it
+			SV_LogStop();
+			fflush(stdout);
+			LOG.flush();
+
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				SV_BecomeInstance(i + 1, baseport, oldhandlers);
+				return;
+			}
+
+			if (pid < 0)
+			{
+				Printf(PRINT_HIGH, "Supervisor: could not fork instance %d\n", i + 1);
+				inst.restart_at = now + inst.restart_delay;
+				continue;
+			}
+
+			inst.pid = pid;
+			inst.started = now;
+		}
+
+		int status;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+
+		if (pid <= 0)
+		{
+			I_Sleep(100 * 1000LL * 1000LL);
+			continue;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			serverinstance_t &inst = instances[i];
+			if (inst.pid != pid)
+				continue;
+
+			inst.pid = 0;
+			now = I_GetTime();
+
+			if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+			{
+				// told to quit, leave it be
+				Printf(PRINT_HIGH, "Supervisor: instance %d quit\n", i + 1);
+				inst.finished = true;
+				running--;
+				break;
+			}
+
+			if (now - inst.started >= INSTANCE_MIN_UPTIME)
+				inst.restart_delay = INSTANCE_MIN_DELAY;
+
+			if (WIFSIGNALED(status))
+				Printf(PRINT_HIGH, "Supervisor: instance %d killed by signal %d, restarting in %u ms\n",
+					i + 1, WTERMSIG(status), (unsigned int)I_ConvertTimeToMs(inst.restart_delay));
+			else
+				Printf(PRINT_HIGH, "Supervisor: instance %d exited with status %d, restarting in %u ms\n",
+					i + 1, WEXITSTATUS(status), (unsigned int)I_ConvertTimeToMs(inst.restart_delay));
+
+			inst.restart_at = now + inst.restart_delay;
+			inst.restart_delay = std::min(inst.restart_delay * 2, INSTANCE_MAX_DELAY);
+			break;
+		}
+	}
+
+	if (supervisor_quit)
+	{
+		Printf(PRINT_HIGH, "Supervisor: stopping instances\n");
+
+		for (int i = 0; i < count; i++)
+			if (instances[i].pid)
+				kill(instances[i].pid, SIGTERM);
+
+		for (int i = 0; i < count; i++)
+			if (instances[i].pid)
+				waitpid(instances[i].pid, NULL, 0);
+	}
+
+	call_terms();
+	exit(EXIT_SUCCESS);
+}
+
+//
+// SV_ReadMemoryUsage
+//
+// Sums fields of /proc/self/smaps_rollup (Linux 4.14+), in kB
+//
+static bool SV_ReadMemoryUsage(unsigned int &rss, unsigned int &pss, unsigned int &shared)
+{
+	std::ifstream smaps("/proc/self/smaps_rollup");
+	if (!smaps.is_open())
+		return false;
+
+	rss = pss = shared = 0;
+
+	std::string line;
+	while (std::getline(smaps, line))
+	{
+		unsigned int kb;
+		char field[64];
+
+		if (sscanf(line.c_str(), "%63[^:]: %u kB", field, &kb) != 2)
+			continue;
+
+		if (strcmp(field, "Rss") == 0)
+			rss = kb;
+		else if (strcmp(field, "Pss") == 0)
+			pss = kb;
+		else if (strcmp(field, "Shared_Clean") == 0 || strcmp(field, "Shared_Dirty") == 0)
+			shared += kb;
+	}
+
+	return true;
+}
+
+#else
+
+void SV_Supervise(dtime_t started)
+{
+	if (Args.CheckParm("-supervise"))
+		Printf(PRINT_HIGH, "Supervisor: -supervise is not supported on this platform\n");
+}
+
+static bool SV_ReadMemoryUsage(unsigned int &rss, unsigned int &pss, unsigned int &shared)
+{
+	return false;
+}
+
+#endif
+
+//
+// SV_ReportStartup
+//
+void SV_ReportStartup(dtime_t started)
+{
+	dtime_t now = I_GetTime();
+
+	if (supervised_instance)
+		Printf(PRINT_HIGH, "Instance %d: started in %u ms, shared resources took %u ms once\n",
+			supervised_instance, (unsigned int)I_ConvertTimeToMs(now - instance_begin),
+			(unsigned int)I_ConvertTimeToMs(shared_load_time));
+	else
+		Printf(PRINT_HIGH, "Server started in %u ms\n",
+			(unsigned int)I_ConvertTimeToMs(now - started));
+
+	// Pss splits shared pages between the processes using them, so it
+	// drops below Rss as instances share more
+	unsigned int rss, pss, shared;
+	if (SV_ReadMemoryUsage(rss, pss, shared))
+		Printf(PRINT_HIGH, "Memory: rss %u kB, pss %u kB, shared %u kB\n", rss, pss, shared);
+}
+
+BEGIN_COMMAND (instanceinfo)
+{
+	if (supervised_instance)
+		Printf(PRINT_HIGH, "Instance %d of a supervised server\n", supervised_instance);
+
+	unsigned int rss, pss, shared;
+	if (SV_ReadMemoryUsage(rss, pss, shared))
+		Printf(PRINT_HIGH, "Memory: rss %u kB, pss %u kB, shared %u kB\n", rss, pss, shared);
+	else
+		Printf(PRINT_HIGH, "Memory usage is not available on this platform\n");
+}
+END_COMMAND (instanceinfo)
+
+VERSION_CONTROL (sv_supervisor_cpp, "$Id$")
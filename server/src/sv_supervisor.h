@@ -0,0 +1,45 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Server supervisor
+//
+//	With -supervise <n>, odasrv loads and parses its WADs and DEHACKED
+//	patches once and then forks n server instances that inherit them
+//	copy-on-write.  Instance i listens on the base port + i - 1, uses
+//	<config>-<i>.cfg when it exists and logs to <log>-<i>.log.  The
+//	supervisor restarts instances that crash and stops them all when it
+//	is told to quit.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_SUPERVISOR_H__
+#define __SV_SUPERVISOR_H__
+
+#include "doomtype.h"
+
+// Forks the server instances and supervises them.  Only returns in an
+// instance.  started is when D_DoomMain began.
+void SV_Supervise(dtime_t started);
+
+// The number of this instance, 0 if the server is not supervised
+int SV_SupervisedInstance();
+
+// Prints how long the server took to start and how much memory it uses
+void SV_ReportStartup(dtime_t started);
+
+#endif	// __SV_SUPERVISOR_H__
@@ -0,0 +1,48 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc main {} {
+ global server serverout
+
+ # round trip random messages through every field schema
+ clear
+ server "netschematest 20000"
+ wait 2
+
+ set result {}
+ set tries 0
+ while { $tries < 30 } {
+  if { [gets $serverout line] < 0 } {
+   incr tries
+   wait 1
+   continue
+  }
+  regsub {^\[[^]]*\] } $line {} line
+  if { [regexp {FAILED|: wrote } $line] } {
+   puts "FAIL $line"
+  }
+  if { [regexp {round trip|Round trip} $line] } {
+   set result [lindex [split $line ","] 0]
+   break
+  }
+ }
+
+ if { $result == "All schemas round trip" } {
+  puts "PASS $result"
+ } else {
+  puts "FAIL (All schemas round trip|$result)"
+ }
+}
+
+startServer
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
@@ -1,26 +1,61 @@
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <vector>
 
 #ifdef UNIX
 #include <netinet/in.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/select.h>
 #endif
 
 #ifdef WIN32
 #include <winsock.h>
 #include <time.h>
-#define usleep(n) Sleep(n/1000)
 #endif
 
-#include "../master/i_net.h"
+#include "../../master/i_net.h"
+#include "tv/relay.h"
+
+extern int net_socket;
 
 netadr_t net_local, net_remote;
 
-void OnInit()
+unsigned long I_MSTime()
+{
+#ifdef WIN32
+	return GetTickCount();
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+#endif
+}
+
+//
+// WaitForPacket
+//
+// Sleeps until the socket is readable or timeout ms have passed
+//
+void WaitForPacket(long timeout)
+{
+	fd_set fds;
+	struct timeval tv;
+
+	FD_ZERO(&fds);
+	FD_SET(net_socket, &fds);
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	select(net_socket + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv);
+}
+
+void OnInit(const char *server)
 {
-	NET_StringToAdr("127.0.0.1:10667", &net_local);
-	NET_StringToAdr("voxelsoft.com:10666", &net_remote);
+	NET_StringToAdr((char *)"127.0.0.1:10667", &net_local);
+	NET_StringToAdr((char *)server, &net_remote);
 }
 
 void OnPacket()
@@ -35,39 +70,87 @@ void OnPacket()
 	}
 }
 
+long OnNextEvent()
+{
+	return -1;
+}
+
 typedef void (*fp)();
 
 struct protocol_t
 {
 	const char *name;
-	fp onInit;
+	void (*onInit)(const char *server);
 	fp onPacket;
+	fp onTimer;
+	long (*nextEvent)();
 };
 
 void OnPacketTV();
-void OnInitTV();
+void OnInitTV(const char *server);
+void OnTimerTV();
+long OnNextEventTV();
+
+extern Relay relay;
 
-int main()
+void Usage()
 {
-	//protocol_t protocol = {"transparent", OnInit, OnPacket};
-	protocol_t protocol = {"odatv", OnInitTV, OnPacketTV};
+	printf("usage: proxy [-port n] [-server host:port] [-delay ms] [-rate kbps]\n"
+	       "             [-ring packets] [-timeout ms] [-transparent]\n");
+	exit(1);
+}
 
-	// Create a UDP socket
+int main(int argc, char **argv)
+{
+	protocol_t transparent = {"transparent", OnInit, OnPacket, NULL, OnNextEvent};
+	protocol_t odatv = {"odatv", OnInitTV, OnPacketTV, OnTimerTV, OnNextEventTV};
+	protocol_t protocol = odatv;
+
+	const char *server = "127.0.0.1:10666";
 	localport = 10999;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasvalue = i + 1 < argc;
+
+		if (!strcmp(argv[i], "-port") && hasvalue)
+			localport = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-server") && hasvalue)
+			server = argv[++i];
+		else if (!strcmp(argv[i], "-delay") && hasvalue)
+			relay.setDelay(atol(argv[++i]));
+		else if (!strcmp(argv[i], "-rate") && hasvalue)
+			relay.setRate(atol(argv[++i]) * 1000 / 8);
+		else if (!strcmp(argv[i], "-ring") && hasvalue)
+			relay.setRingSize(atol(argv[++i]));
+		else if (!strcmp(argv[i], "-timeout") && hasvalue)
+			relay.setTimeout(atol(argv[++i]));
+		else if (!strcmp(argv[i], "-transparent"))
+			protocol = transparent;
+		else
+			Usage();
+	}
+
+	// Create a UDP socket
 	InitNetCommon();
 
-	protocol.onInit();
+	protocol.onInit(server);
+
+	printf("%s proxy on port %d for %s\n", protocol.name, localport, server);
 
 	while (true)
 	{
+		// block until a packet arrives or the protocol has timed work to do
+		WaitForPacket(protocol.nextEvent());
+
 		while (NET_GetPacket())
 		{
 			protocol.onPacket();
 		}
 
-		usleep(1);
+		if (protocol.onTimer)
+			protocol.onTimer();
 	}
 
 	CloseNetwork();
 }
-
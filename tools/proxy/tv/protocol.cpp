@@ -5,16 +5,28 @@
 // This proxy will create the first connection transparently,
 // but other connections will be hidden from the server
 //
+// The first connection gets the server packets as they arrive, everyone
+// else is fed through the relay (see relay.h), which adds the broadcast
+// delay, limits the rate of each spectator and catches up late joiners
+//
 
 #include <string.h>
 #include <vector>
 #include <iostream>
 
-#include "../../master/i_net.h"
+#include "../../../master/i_net.h"
+#include "relay.h"
 
-std::vector<netadr_t> spectators;
 netadr_t net_server;
 
+// the client whose connection the server actually sees
+netadr_t anchor;
+bool have_anchor = false;
+
+Relay relay;
+
+unsigned long I_MSTime();
+
 buf_t challenge_message(MAX_UDP_PACKET), first_message(MAX_UDP_PACKET);
 
 class MessageTranslator
@@ -118,6 +130,7 @@ enum svc_t
 public:
 
 	std::string map, digest;
+	bool mapchanged;
 	byte consoleplayer;
 	int playermobj;
 	int spawnpos[3];
@@ -136,6 +149,7 @@ public:
 						Copy(in, out, 1);
 						map = in.ReadString();
 						out.WriteString(map.c_str());
+						mapchanged = true;
 						std::cout<< "map " << map << std::endl; // todo unsafe
 					}
 					break;
@@ -343,34 +357,20 @@ public:
 	}
 };
 
-void OnInitTV()
+void OnInitTV(const char *server)
 {
-	NET_StringToAdr("voxelsoft.com:10666", &net_server);
-	NET_StringToAdr("127.0.0.1:10666", &net_server);	
-}
-
-void OnClientTV(int i)
-{
-	if(i == 0)
-	{
-		// only forward the first client's packet
-		NET_SendPacket(net_message.cursize, net_message.data, net_server);
-	}
-	else	
-	{
-		// TODO should keep client's tick info
-		// TODO and also catch client disconnect messages
-	}
+	NET_StringToAdr((char *)server, &net_server);
 }
 
 Translate_ServerToTV tr;
 
 void OnNewClientTV()
 {
-	spectators.push_back(net_from);
-
-	if(spectators.size() == 1)
+	if(!have_anchor)
 	{
+		anchor = net_from;
+		have_anchor = true;
+
 		// only forward the first client's packets
 		NET_SendPacket(net_message.cursize, net_message.data, net_server);
 
@@ -383,6 +383,8 @@ void OnNewClientTV()
 	}
 	else
 	{
+		relay.add(net_from, I_MSTime());
+
 		// send back to the non-first client a fake challenge
 		NET_SendPacket(challenge_message.cursize, challenge_message.data, net_from);
 
@@ -418,6 +420,8 @@ void OnPacketTV()
 	if(NET_CompareAdr(net_from, net_server))
 	{
 		buf_t out = net_message;
+		int flags = 0;
+		tr.mapchanged = false;
 		// if this is a server connect message, keep a copy for other clients
 		int t = net_message.ReadLong();
 		if(t == CHALLENGE)
@@ -430,6 +434,9 @@ void OnPacketTV()
 			first_message = net_message;
 			buf_t tmp;
 			tr.Go(net_message, tmp);
+
+			// late joiners get their own version of the first message
+			flags |= RELAY_NOCATCHUP;
 		}
 		else
 		{
@@ -437,22 +444,32 @@ void OnPacketTV()
 			out.WriteLong(t);
 			tr.Go(net_message, out);
 		}
-		// replicate server packet to all connected clients
-		for(int i = 0; i < spectators.size(); i++)
-		{
-			NET_SendPacket(out.cursize, out.data, spectators[i]);
-		}
+		if(tr.mapchanged)
+			flags |= RELAY_MAPCHANGE;
+
+		// the anchor gets the packet right away, the spectators once it
+		// comes out of the relay
+		if(have_anchor)
+			NET_SendPacket(out.cursize, out.data, anchor);
+
+		relay.push(out.data, out.cursize, I_MSTime(), flags);
+	}
+	else if(have_anchor && NET_CompareAdr(net_from, anchor))
+	{
+		// only forward the first client's packet
+		NET_SendPacket(net_message.cursize, net_message.data, net_server);
 	}
 	else
 	{
 		// is this an existing client?
-		for(int i = 0; i < spectators.size(); i++)
+		spectator_t *spec = relay.find(net_from);
+
+		if(spec)
 		{
-			if(NET_CompareAdr(net_from, spectators[i]))
-			{
-				OnClientTV(i);
-				return;
-			}
+			// TODO should keep client's tick info
+			// TODO and also catch client disconnect messages
+			spec->lastheard = I_MSTime();
+			return;
 		}
 
 		// must be a new client
@@ -460,3 +477,13 @@ void OnPacketTV()
 	}
 }
 
+void OnTimerTV()
+{
+	relay.run(I_MSTime());
+}
+
+long OnNextEventTV()
+{
+	return relay.nextEvent(I_MSTime());
+}
+
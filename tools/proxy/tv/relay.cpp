@@ -0,0 +1,365 @@
+//
+// OdaTV relay - delayed, rate controlled fan-out of one server stream
+// to many spectators
+//
+
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+
+#ifdef UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#ifdef WIN32
+#include <winsock.h>
+#endif
+
+#include "relay.h"
+
+// spectators may burst this many ms worth of their rate
+#define RELAY_BURST_MS 250
+
+// stop growing the catch-up log past this size, late joiners then only
+// receive the live stream
+#define RELAY_MAX_CATCHUP (32 * 1024 * 1024)
+
+// most packets handed to a single sendmmsg call
+#define RELAY_BATCH 64
+
+extern int net_socket;
+void NetadrToSockadr(netadr_t *a, struct sockaddr_in *s);
+
+//
+// DelayRing
+//
+DelayRing::DelayRing(size_t capacity)
+	: m_packets(new relaypacket_t[capacity]), m_capacity(capacity), m_head(0)
+{
+}
+
+DelayRing::~DelayRing()
+{
+	delete[] m_packets;
+}
+
+void DelayRing::push(const byte *data, size_t length, unsigned long now, int flags)
+{
+	if (length > MAX_UDP_PACKET)
+		length = MAX_UDP_PACKET;
+
+	relaypacket_t &packet = m_packets[m_head % m_capacity];
+
+	packet.arrival = now;
+	packet.flags = flags;
+	packet.length = length;
+	memcpy(packet.data, data, length);
+
+	m_head++;
+}
+
+const relaypacket_t *DelayRing::get(relayseq_t seq) const
+{
+	if (seq < tail() || seq >= m_head)
+		return NULL;
+
+	return &m_packets[seq % m_capacity];
+}
+
+//
+// Relay
+//
+Relay::Relay()
+	: m_ring(new DelayRing(1024)), m_released(0), m_catchupbytes(0),
+	  m_delay(0), m_rate(0), m_timeout(10000)
+{
+}
+
+Relay::~Relay()
+{
+	delete m_ring;
+}
+
+void Relay::setRingSize(size_t packets)
+{
+	delete m_ring;
+	m_ring = new DelayRing(packets);
+	m_released = 0;
+}
+
+void Relay::push(const byte *data, size_t length, unsigned long now, int flags)
+{
+	m_ring->push(data, length, now, flags);
+}
+
+spectator_t *Relay::find(const netadr_t &address)
+{
+	for (size_t i = 0; i < m_spectators.size(); i++)
+	{
+		if (NET_CompareAdr(m_spectators[i].address, address))
+			return &m_spectators[i];
+	}
+
+	return NULL;
+}
+
+spectator_t *Relay::add(const netadr_t &address, unsigned long now)
+{
+	spectator_t spec;
+
+	spec.address = address;
+	spec.cursor = m_released;
+	spec.catchup = 0;
+	spec.catchupend = m_catchup.size();
+	spec.tokens = m_rate * RELAY_BURST_MS / 1000.0f;
+	spec.lastrefill = now;
+	spec.lastheard = now;
+
+	m_spectators.push_back(spec);
+
+	return &m_spectators.back();
+}
+
+void Relay::refill(spectator_t &spec, unsigned long now)
+{
+	if (!m_rate)
+		return;
+
+	float burst = m_rate * RELAY_BURST_MS / 1000.0f;
+
+	if (burst < 2 * MAX_UDP_PACKET)
+		burst = 2 * MAX_UDP_PACKET;
+
+	spec.tokens += (now - spec.lastrefill) * m_rate / 1000.0f;
+	spec.lastrefill = now;
+
+	if (spec.tokens > burst)
+		spec.tokens = burst;
+}
+
+bool Relay::canSend(spectator_t &spec, size_t length)
+{
+	if (!m_rate)
+		return true;
+
+	if (spec.tokens < length)
+		return false;
+
+	spec.tokens -= length;
+	return true;
+}
+
+//
+// Relay::release
+//
+// Moves packets that have waited out the delay into the released range and
+// the catch-up log
+//
+void Relay::release(unsigned long now)
+{
+	if (m_released < m_ring->tail())
+	{
+		printf("relay: ring too small for the delay, %lu packets lost\n",
+		       m_ring->tail() - m_released);
+		m_released = m_ring->tail();
+	}
+
+	while (m_released < m_ring->head())
+	{
+		const relaypacket_t *packet = m_ring->get(m_released);
+
+		if (packet->arrival + m_delay > now)
+			break;
+
+		if (packet->flags & RELAY_MAPCHANGE)
+		{
+			// older catch-up data describes the previous map
+			m_catchup.clear();
+			m_catchupbytes = 0;
+
+			for (size_t i = 0; i < m_spectators.size(); i++)
+				m_spectators[i].catchup = m_spectators[i].catchupend = 0;
+		}
+
+		if (!(packet->flags & RELAY_NOCATCHUP) &&
+		    m_catchupbytes + packet->length <= RELAY_MAX_CATCHUP)
+		{
+			m_catchup.push_back(std::string((const char *)packet->data, packet->length));
+			m_catchupbytes += packet->length;
+		}
+
+		m_released++;
+	}
+}
+
+void Relay::dropIdle(unsigned long now)
+{
+	std::vector<spectator_t>::iterator it = m_spectators.begin();
+
+	while (it != m_spectators.end())
+	{
+		if (now - it->lastheard > m_timeout)
+		{
+			printf("spectator %s timed out\n", NET_AdrToString(it->address));
+			it = m_spectators.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+//
+// Relay::run
+//
+void Relay::run(unsigned long now)
+{
+	release(now);
+	dropIdle(now);
+
+	relayseq_t first = m_released;
+
+	// late joiners replay the catch-up log before following the live stream,
+	// their positions differ so these are sent one by one
+	for (size_t i = 0; i < m_spectators.size(); i++)
+	{
+		spectator_t &spec = m_spectators[i];
+
+		refill(spec, now);
+
+		while (spec.catchup < spec.catchupend)
+		{
+			std::string &packet = m_catchup[spec.catchup];
+
+			if (!canSend(spec, packet.size()))
+				break;
+
+			NET_SendPacket(packet.size(), (byte *)packet.data(), spec.address);
+			spec.catchup++;
+		}
+
+		if (spec.catchup < spec.catchupend)
+			continue;
+
+		if (spec.cursor < m_ring->tail())
+		{
+			printf("spectator %s fell behind, skipping %lu packets\n",
+			       NET_AdrToString(spec.address), m_ring->tail() - spec.cursor);
+			spec.cursor = m_ring->tail();
+		}
+
+		if (spec.cursor < first)
+			first = spec.cursor;
+	}
+
+	// live stream, every spectator waiting on the same packet shares one batch
+	std::vector<netadr_t> batch;
+
+	for (relayseq_t seq = first; seq < m_released; seq++)
+	{
+		const relaypacket_t *packet = m_ring->get(seq);
+
+		batch.clear();
+
+		for (size_t i = 0; i < m_spectators.size(); i++)
+		{
+			spectator_t &spec = m_spectators[i];
+
+			if (spec.catchup < spec.catchupend || spec.cursor != seq)
+				continue;
+
+			if (!canSend(spec, packet->length))
+				continue;
+
+			batch.push_back(spec.address);
+			spec.cursor++;
+		}
+
+		if (!batch.empty())
+			NET_SendPacketBatch(packet->length, (byte *)packet->data, batch);
+	}
+}
+
+//
+// Relay::nextEvent
+//
+long Relay::nextEvent(unsigned long now) const
+{
+	long wait = 1000;
+
+	if (m_released < m_ring->head())
+	{
+		unsigned long due = m_ring->get(m_released)->arrival + m_delay;
+		wait = due > now ? (long)(due - now) : 0;
+	}
+
+	// a rate limited spectator with a backlog needs to be revisited as soon
+	// as it can afford another packet
+	if (m_rate)
+	{
+		for (size_t i = 0; i < m_spectators.size(); i++)
+		{
+			const spectator_t &spec = m_spectators[i];
+
+			if (spec.catchup < spec.catchupend || spec.cursor < m_released)
+			{
+				long refill = (long)(MAX_UDP_PACKET * 1000 / m_rate) + 1;
+
+				if (refill < wait)
+					wait = refill;
+				break;
+			}
+		}
+	}
+
+	return wait;
+}
+
+//
+// NET_SendPacketBatch
+//
+void NET_SendPacketBatch(int length, byte *data, const std::vector<netadr_t> &to)
+{
+#if defined(__linux__)
+	struct mmsghdr msgs[RELAY_BATCH];
+	struct sockaddr_in addrs[RELAY_BATCH];
+	struct iovec iov;
+
+	iov.iov_base = data;
+	iov.iov_len = length;
+
+	for (size_t start = 0; start < to.size(); start += RELAY_BATCH)
+	{
+		size_t count = to.size() - start;
+
+		if (count > RELAY_BATCH)
+			count = RELAY_BATCH;
+
+		memset(msgs, 0, sizeof(msgs[0]) * count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			netadr_t adr = to[start + i];
+			NetadrToSockadr(&adr, &addrs[i]);
+
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iov;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		// partial sends leave the rest to the per packet path
+		int sent = sendmmsg(net_socket, msgs, count, 0);
+
+		if (sent < 0)
+			sent = 0;
+
+		for (size_t i = sent; i < count; i++)
+			NET_SendPacket(length, data, to[start + i]);
+	}
+#else
+	for (size_t i = 0; i < to.size(); i++)
+		NET_SendPacket(length, data, to[i]);
+#endif
+}
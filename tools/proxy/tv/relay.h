@@ -0,0 +1,121 @@
+//
+// OdaTV relay - delayed, rate controlled fan-out of one server stream
+// to many spectators
+//
+// Server packets are pushed into a fixed size ring together with their
+// arrival time.  A packet is released once it is older than the broadcast
+// delay, and every spectator then reads the released packets through its
+// own cursor, limited by a per spectator byte rate.  Spectators that join
+// late are first fed the catch-up log, which holds every packet released
+// since the current map was loaded.
+//
+
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include <string>
+#include <vector>
+
+#include "../../../master/i_net.h"
+
+typedef unsigned long relayseq_t;
+
+// relay packet flags
+enum
+{
+	RELAY_MAPCHANGE = 1,		// packet loads a new map, restart the catch-up log
+	RELAY_NOCATCHUP = 2			// never replay this packet to late joiners
+};
+
+struct relaypacket_t
+{
+	unsigned long arrival;		// ms
+	int flags;
+	size_t length;
+	byte data[MAX_UDP_PACKET];
+};
+
+//
+// DelayRing
+//
+// Packets are addressed by an ever increasing sequence number, only the last
+// <capacity> of them are retained
+//
+class DelayRing
+{
+public:
+	DelayRing(size_t capacity);
+	~DelayRing();
+
+	void push(const byte *data, size_t length, unsigned long now, int flags);
+	const relaypacket_t *get(relayseq_t seq) const;
+
+	relayseq_t head() const { return m_head; }
+	relayseq_t tail() const { return m_head > m_capacity ? m_head - m_capacity : 0; }
+
+private:
+	relaypacket_t *m_packets;
+	size_t m_capacity;
+	relayseq_t m_head;			// next sequence number to be written
+};
+
+struct spectator_t
+{
+	netadr_t address;
+	relayseq_t cursor;			// next ring packet to send
+	size_t catchup;				// next catch-up packet to send
+	size_t catchupend;			// catch-up log length when this spectator joined
+	float tokens;				// bytes that may be sent right now
+	unsigned long lastrefill;
+	unsigned long lastheard;
+};
+
+class Relay
+{
+public:
+	Relay();
+	~Relay();
+
+	// configuration, set before the first packet arrives
+	void setDelay(unsigned long ms) { m_delay = ms; }
+	void setRate(unsigned long bytespersec) { m_rate = bytespersec; }
+	void setTimeout(unsigned long ms) { m_timeout = ms; }
+	void setRingSize(size_t packets);
+
+	void push(const byte *data, size_t length, unsigned long now, int flags);
+
+	spectator_t *find(const netadr_t &address);
+	spectator_t *add(const netadr_t &address, unsigned long now);
+
+	// releases due packets and sends whatever the spectators can take
+	void run(unsigned long now);
+
+	// ms until run() has something to do
+	long nextEvent(unsigned long now) const;
+
+	size_t spectators() const { return m_spectators.size(); }
+
+private:
+	void refill(spectator_t &spec, unsigned long now);
+	bool canSend(spectator_t &spec, size_t length);
+	void release(unsigned long now);
+	void dropIdle(unsigned long now);
+
+	DelayRing *m_ring;
+	relayseq_t m_released;		// first packet still held back by the delay
+
+	std::vector<std::string> m_catchup;
+	size_t m_catchupbytes;
+
+	std::vector<spectator_t> m_spectators;
+
+	unsigned long m_delay;
+	unsigned long m_rate;
+	unsigned long m_timeout;
+};
+
+// Sends one packet to many addresses, batched into as few system calls
+// as the platform allows
+void NET_SendPacketBatch(int length, byte *data, const std::vector<netadr_t> &to);
+
+#endif
@@ -0,0 +1,482 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2019 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  querybench - times a launcher refresh against fake local servers
+//
+//  Binds a UDP socket on 127.0.0.1 for every fake server and answers each
+//  challenge with a canned server reply after a per-server delay, dropping
+//  a share of them.  The fake servers are then queried the way the launcher
+//  used to (a pool of threads, one blocking query each) and the way it does
+//  now (one QueryEngine), and the wall time of each refresh is printed.
+//
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "net_packet.h"
+#include "net_query.h"
+
+using namespace odalpapi;
+
+// Launcher defaults, see odalaunch/src/oda_defs.h
+#define ODA_QRYSERVERTIMEOUT 1000
+#define ODA_QRYGSRETRYCOUNT 2
+#define ODA_QRYSENDRATE 1000
+#define ODA_THRMULVAL 12
+#define ODA_THRMAXVAL 48
+
+// A reply from odasrv to a challenge whose time field was 0x12345678, the
+// time field (bytes 12 to 15) is replaced with the one of each challenge
+static const unsigned char CannedReply[] =
+{
+	0x03, 0x20, 0x03, 0xad, 0x51, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00,
+	0x78, 0x56, 0x34, 0x12, 0x07, 0x00, 0x00, 0x00, 0x65, 0x66, 0x37, 0x36,
+	0x30, 0x36, 0x38, 0x00, 0x21, 0x73, 0x76, 0x5f, 0x74, 0x69, 0x63, 0x62,
+	0x75, 0x66, 0x66, 0x65, 0x72, 0x00, 0x01, 0x63, 0x74, 0x66, 0x5f, 0x66,
+	0x6c, 0x61, 0x67, 0x74, 0x69, 0x6d, 0x65, 0x6f, 0x75, 0x74, 0x00, 0x02,
+	0x0a, 0x63, 0x74, 0x66, 0x5f, 0x66, 0x6c, 0x61, 0x67, 0x61, 0x74, 0x68,
+	0x6f, 0x6d, 0x65, 0x74, 0x6f, 0x73, 0x63, 0x6f, 0x72, 0x65, 0x00, 0x01,
+	0x73, 0x76, 0x5f, 0x74, 0x65, 0x61, 0x6d, 0x73, 0x69, 0x6e, 0x70, 0x6c,
+	0x61, 0x79, 0x00, 0x02, 0x02, 0x73, 0x76, 0x5f, 0x6d, 0x61, 0x78, 0x70,
+	0x6c, 0x61, 0x79, 0x65, 0x72, 0x73, 0x70, 0x65, 0x72, 0x74, 0x65, 0x61,
+	0x6d, 0x00, 0x02, 0x03, 0x73, 0x76, 0x5f, 0x6d, 0x61, 0x78, 0x70, 0x6c,
+	0x61, 0x79, 0x65, 0x72, 0x73, 0x00, 0x02, 0x04, 0x73, 0x76, 0x5f, 0x6d,
+	0x61, 0x78, 0x63, 0x6c, 0x69, 0x65, 0x6e, 0x74, 0x73, 0x00, 0x02, 0x04,
+	0x73, 0x76, 0x5f, 0x77, 0x65, 0x62, 0x73, 0x69, 0x74, 0x65, 0x00, 0x06,
+	0x68, 0x74, 0x74, 0x70, 0x3a, 0x2f, 0x2f, 0x6f, 0x64, 0x61, 0x6d, 0x65,
+	0x78, 0x2e, 0x6e, 0x65, 0x74, 0x2f, 0x00, 0x73, 0x76, 0x5f, 0x65, 0x6d,
+	0x61, 0x69, 0x6c, 0x00, 0x06, 0x65, 0x6d, 0x61, 0x69, 0x6c, 0x40, 0x64,
+	0x6f, 0x6d, 0x61, 0x69, 0x6e, 0x2e, 0x63, 0x6f, 0x6d, 0x00, 0x73, 0x76,
+	0x5f, 0x6d, 0x6f, 0x74, 0x64, 0x00, 0x06, 0x57, 0x65, 0x6c, 0x63, 0x6f,
+	0x6d, 0x65, 0x20, 0x74, 0x6f, 0x20, 0x4f, 0x64, 0x61, 0x6d, 0x65, 0x78,
+	0x00, 0x73, 0x76, 0x5f, 0x73, 0x70, 0x6c, 0x61, 0x73, 0x68, 0x66, 0x61,
+	0x63, 0x74, 0x6f, 0x72, 0x00, 0x05, 0x31, 0x00, 0x73, 0x76, 0x5f, 0x61,
+	0x69, 0x72, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x6f, 0x6c, 0x00, 0x05, 0x30,
+	0x2e, 0x30, 0x30, 0x33, 0x39, 0x30, 0x36, 0x32, 0x35, 0x00, 0x73, 0x76,
+	0x5f, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x00, 0x03, 0x20, 0x03,
+	0x73, 0x76, 0x5f, 0x63, 0x6f, 0x6f, 0x70, 0x75, 0x6e, 0x61, 0x73, 0x73,
+	0x69, 0x67, 0x6e, 0x65, 0x64, 0x76, 0x6f, 0x6f, 0x64, 0x6f, 0x6f, 0x64,
+	0x6f, 0x6c, 0x6c, 0x73, 0x66, 0x6f, 0x72, 0x6e, 0x70, 0x6c, 0x61, 0x79,
+	0x65, 0x72, 0x73, 0x00, 0x03, 0x01, 0x00, 0x73, 0x76, 0x5f, 0x63, 0x6f,
+	0x6f, 0x70, 0x75, 0x6e, 0x61, 0x73, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x64,
+	0x76, 0x6f, 0x6f, 0x64, 0x6f, 0x6f, 0x64, 0x6f, 0x6c, 0x6c, 0x73, 0x00,
+	0x01, 0x73, 0x76, 0x5f, 0x63, 0x6f, 0x6f, 0x70, 0x73, 0x70, 0x61, 0x77,
+	0x6e, 0x76, 0x6f, 0x6f, 0x64, 0x6f, 0x6f, 0x64, 0x6f, 0x6c, 0x6c, 0x73,
+	0x00, 0x01, 0x73, 0x76, 0x5f, 0x68, 0x6f, 0x73, 0x74, 0x6e, 0x61, 0x6d,
+	0x65, 0x00, 0x06, 0x55, 0x6e, 0x74, 0x69, 0x74, 0x6c, 0x65, 0x64, 0x20,
+	0x4f, 0x64, 0x61, 0x6d, 0x65, 0x78, 0x20, 0x53, 0x65, 0x72, 0x76, 0x65,
+	0x72, 0x00, 0x73, 0x76, 0x5f, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x72, 0x65,
+	0x73, 0x70, 0x61, 0x77, 0x6e, 0x74, 0x69, 0x6d, 0x65, 0x00, 0x03, 0x1e,
+	0x00, 0x73, 0x76, 0x5f, 0x61, 0x6c, 0x6c, 0x6f, 0x77, 0x73, 0x68, 0x6f,
+	0x77, 0x73, 0x70, 0x61, 0x77, 0x6e, 0x73, 0x00, 0x01, 0x73, 0x76, 0x5f,
+	0x61, 0x6c, 0x6c, 0x6f, 0x77, 0x77, 0x69, 0x64, 0x65, 0x73, 0x63, 0x72,
+	0x65, 0x65, 0x6e, 0x00, 0x01, 0x73, 0x76, 0x5f, 0x6d, 0x61, 0x78, 0x75,
+	0x6e, 0x6c, 0x61, 0x67, 0x74, 0x69, 0x6d, 0x65, 0x00, 0x05, 0x31, 0x00,
+	0x73, 0x76, 0x5f, 0x75, 0x6e, 0x6c, 0x61, 0x67, 0x00, 0x01, 0x73, 0x76,
+	0x5f, 0x77, 0x65, 0x61, 0x70, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x79, 0x00,
+	0x01, 0x73, 0x76, 0x5f, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x73,
+	0x73, 0x69, 0x6f, 0x6e, 0x6c, 0x69, 0x6d, 0x69, 0x74, 0x00, 0x03, 0x0a,
+	0x00, 0x73, 0x76, 0x5f, 0x73, 0x6b, 0x69, 0x6c, 0x6c, 0x00, 0x02, 0x03,
+	0x73, 0x76, 0x5f, 0x6d, 0x6f, 0x6e, 0x73, 0x74, 0x65, 0x72, 0x73, 0x68,
+	0x65, 0x61, 0x6c, 0x74, 0x68, 0x00, 0x05, 0x31, 0x00, 0x73, 0x76, 0x5f,
+	0x69, 0x74, 0x65, 0x6d, 0x72, 0x65, 0x73, 0x70, 0x61, 0x77, 0x6e, 0x74,
+	0x69, 0x6d, 0x65, 0x00, 0x03, 0x1e, 0x00, 0x73, 0x76, 0x5f, 0x6d, 0x6f,
+	0x6e, 0x73, 0x74, 0x65, 0x72, 0x64, 0x61, 0x6d, 0x61, 0x67, 0x65, 0x00,
+	0x05, 0x31, 0x00, 0x73, 0x76, 0x5f, 0x77, 0x65, 0x61, 0x70, 0x6f, 0x6e,
+	0x64, 0x61, 0x6d, 0x61, 0x67, 0x65, 0x00, 0x05, 0x31, 0x00, 0x73, 0x76,
+	0x5f, 0x61, 0x6c, 0x6c, 0x6f, 0x77, 0x65, 0x78, 0x69, 0x74, 0x00, 0x01,
+	0x73, 0x76, 0x5f, 0x74, 0x65, 0x61, 0x6d, 0x73, 0x70, 0x61, 0x77, 0x6e,
+	0x73, 0x00, 0x01, 0x73, 0x76, 0x5f, 0x73, 0x63, 0x6f, 0x72, 0x65, 0x6c,
+	0x69, 0x6d, 0x69, 0x74, 0x00, 0x02, 0x05, 0x73, 0x76, 0x5f, 0x66, 0x72,
+	0x69, 0x65, 0x6e, 0x64, 0x6c, 0x79, 0x66, 0x69, 0x72, 0x65, 0x00, 0x01,
+	0x00, 0x4d, 0x41, 0x50, 0x30, 0x31, 0x00, 0x00, 0x02, 0x4f, 0x44, 0x41,
+	0x4d, 0x45, 0x58, 0x2e, 0x57, 0x41, 0x44, 0x00, 0x10, 0x25, 0x1a, 0x81,
+	0xe9, 0x6a, 0x88, 0xc4, 0x13, 0xc9, 0x1e, 0x2f, 0x5f, 0x32, 0x87, 0x75,
+	0x5e, 0x44, 0x4f, 0x4f, 0x4d, 0x32, 0x2e, 0x57, 0x41, 0x44, 0x00, 0x10,
+	0x42, 0x0e, 0x25, 0xc6, 0x8b, 0xda, 0xe2, 0xaf, 0x86, 0x5e, 0xc2, 0x4f,
+	0xb8, 0xc1, 0x2a, 0xdf, 0x00,
+};
+
+static const size_t ReplyTimeOffset = 12;
+
+static uint64_t MillisNow()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+//
+// Fake servers
+//
+
+struct PendingReply_t
+{
+	uint64_t    Due;
+	int         Socket;
+	sockaddr_in To;
+	uint32_t    Time;
+
+	bool operator>(const PendingReply_t& other) const
+	{
+		return Due > other.Due;
+	}
+};
+
+static std::vector<int> FakeSockets;
+static std::vector<uint32_t> FakeLatency;
+static uint16_t FakeBasePort;
+static int FakeLoss;
+static volatile bool FakeQuit;
+static unsigned FakeSeed;
+
+static void* FakeServerThread(void*)
+{
+	std::vector<pollfd> fds(FakeSockets.size());
+	std::vector<PendingReply_t> pending;
+	std::greater<PendingReply_t> later;
+	unsigned char buf[64];
+	unsigned char reply[sizeof(CannedReply)];
+
+	memcpy(reply, CannedReply, sizeof(reply));
+
+	for(size_t i = 0; i < FakeSockets.size(); ++i)
+	{
+		fds[i].fd = FakeSockets[i];
+		fds[i].events = POLLIN;
+	}
+
+	while(!FakeQuit)
+	{
+		uint64_t now = MillisNow();
+		int wait = 10;
+
+		// Send every reply that is due
+		while(!pending.empty() && pending.front().Due <= now)
+		{
+			PendingReply_t r = pending.front();
+
+			std::pop_heap(pending.begin(), pending.end(), later);
+			pending.pop_back();
+
+			memcpy(reply + ReplyTimeOffset, &r.Time, 4);
+			sendto(r.Socket, (const char*)reply, sizeof(reply), 0,
+			       (sockaddr*)&r.To, sizeof(r.To));
+		}
+
+		if(!pending.empty())
+			wait = std::min<int>(wait, (int)(pending.front().Due - now));
+
+		if(poll(&fds[0], fds.size(), wait) <= 0)
+			continue;
+
+		now = MillisNow();
+
+		for(size_t i = 0; i < fds.size(); ++i)
+		{
+			if(!(fds[i].revents & POLLIN))
+				continue;
+
+			PendingReply_t r;
+			socklen_t len = sizeof(r.To);
+			ssize_t got;
+
+			while((got = recvfrom(fds[i].fd, (char*)buf, sizeof(buf), MSG_DONTWAIT,
+			                      (sockaddr*)&r.To, &len)) > 0)
+			{
+				len = sizeof(r.To);
+
+				if(got < 16 || (int)(rand_r(&FakeSeed) % 100) < FakeLoss)
+					continue;
+
+				r.Due = now + FakeLatency[i];
+				r.Socket = fds[i].fd;
+				memcpy(&r.Time, buf + 12, 4);
+
+				pending.push_back(r);
+				std::push_heap(pending.begin(), pending.end(), later);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static bool StartFakeServers(size_t Count, uint32_t MinLatency,
+                             uint32_t MaxLatency)
+{
+	unsigned seed = 1;
+
+	for(size_t i = 0; i < Count; ++i)
+	{
+		int s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sockaddr_in addr;
+
+		if(s < 0)
+		{
+			perror("socket");
+			return false;
+		}
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(FakeBasePort + i);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if(bind(s, (sockaddr*)&addr, sizeof(addr)) < 0)
+		{
+			fprintf(stderr, "can't bind port %u: %s\n",
+			        (unsigned)(FakeBasePort + i), strerror(errno));
+			return false;
+		}
+
+		FakeSockets.push_back(s);
+		FakeLatency.push_back(MinLatency +
+		                      rand_r(&seed) % (MaxLatency - MinLatency + 1));
+	}
+
+	return true;
+}
+
+//
+// The old refresh, a pool of threads that each query one server at a time
+//
+
+struct ThreadPool_t
+{
+	Server*         Servers;
+	size_t          Count;
+	size_t          Next;
+	size_t          Answered;
+	int32_t         Timeout;
+	int8_t          Retries;
+	pthread_mutex_t Lock;
+};
+
+static void* QueryThread(void* Data)
+{
+	ThreadPool_t& pool = *(ThreadPool_t*)Data;
+	BufferedSocket Socket;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pool.Lock);
+		size_t i = pool.Next++;
+		pthread_mutex_unlock(&pool.Lock);
+
+		if(i >= pool.Count)
+			break;
+
+		Server& server = pool.Servers[i];
+
+		server.SetSocket(&Socket);
+		server.SetRetries(pool.Retries);
+
+		if(server.Query(pool.Timeout))
+		{
+			pthread_mutex_lock(&pool.Lock);
+			++pool.Answered;
+			pthread_mutex_unlock(&pool.Lock);
+		}
+	}
+
+	return NULL;
+}
+
+static size_t RefreshThreads(Server* Servers, size_t Count, int32_t Timeout,
+                             int8_t Retries, size_t Threads)
+{
+	ThreadPool_t pool;
+	std::vector<pthread_t> threads(Threads);
+
+	pool.Servers = Servers;
+	pool.Count = Count;
+	pool.Next = 0;
+	pool.Answered = 0;
+	pool.Timeout = Timeout;
+	pool.Retries = Retries;
+	pthread_mutex_init(&pool.Lock, NULL);
+
+	for(size_t i = 0; i < Threads; ++i)
+		pthread_create(&threads[i], NULL, QueryThread, &pool);
+
+	for(size_t i = 0; i < Threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pool.Lock);
+
+	return pool.Answered;
+}
+
+//
+// The current refresh, every server at once from one QueryEngine
+//
+
+static void CountResult(const QueryResult_t& Result, void* Data)
+{
+	if(Result.Result)
+		++*(size_t*)Data;
+}
+
+static size_t RefreshEngine(Server* Servers, size_t Count, int32_t Timeout,
+                            uint8_t Retries, uint32_t Rate)
+{
+	QueryEngine Engine;
+	size_t answered = 0;
+
+	Engine.SetRate(Rate);
+
+	for(size_t i = 0; i < Count; ++i)
+		Engine.Add(&Servers[i], Timeout, Retries, (void*)i);
+
+	while(Engine.Run(50))
+		Engine.DispatchResults(CountResult, &answered);
+
+	Engine.DispatchResults(CountResult, &answered);
+
+	return answered;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+	        "usage: querybench [-servers n] [-latency min max] [-loss percent]\n"
+	        "                  [-timeout ms] [-retries n] [-threads n] [-rate n]\n"
+	        "                  [-port n] [-mode threads|engine|both]\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = 500;
+	uint32_t minlatency = 20, maxlatency = 80;
+	int32_t timeout = ODA_QRYSERVERTIMEOUT;
+	int retries = ODA_QRYGSRETRYCOUNT;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = std::min<size_t>(std::max<long>(cpus, 1) * ODA_THRMULVAL,
+	                                  ODA_THRMAXVAL);
+	uint32_t rate = ODA_QRYSENDRATE;
+	std::string mode = "both";
+
+	FakeBasePort = 20000;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool more = i + 1 < argc;
+
+		if(arg == "-servers" && more)
+			count = atoi(argv[++i]);
+		else if(arg == "-latency" && i + 2 < argc)
+		{
+			minlatency = atoi(argv[++i]);
+			maxlatency = std::max<uint32_t>(atoi(argv[++i]), minlatency);
+		}
+		else if(arg == "-loss" && more)
+			FakeLoss = atoi(argv[++i]);
+		else if(arg == "-timeout" && more)
+			timeout = atoi(argv[++i]);
+		else if(arg == "-retries" && more)
+			retries = atoi(argv[++i]);
+		else if(arg == "-threads" && more)
+			threads = std::max(atoi(argv[++i]), 1);
+		else if(arg == "-rate" && more)
+			rate = atoi(argv[++i]);
+		else if(arg == "-port" && more)
+			FakeBasePort = atoi(argv[++i]);
+		else if(arg == "-mode" && more)
+			mode = argv[++i];
+		else
+			Usage();
+	}
+
+	if(mode != "threads" && mode != "engine" && mode != "both")
+		Usage();
+
+	if(!StartFakeServers(count, minlatency, maxlatency))
+		return 1;
+
+	FakeSeed = 1;
+
+	pthread_t fake;
+
+	pthread_create(&fake, NULL, FakeServerThread, NULL);
+
+	printf("%u fake servers, %u-%u ms latency, %d%% loss, "
+	       "timeout %d ms, %d retries\n", (unsigned)count, minlatency, maxlatency,
+	       FakeLoss, timeout, retries);
+
+	if(mode != "engine")
+	{
+		Server* servers = new Server[count];
+
+		for(size_t i = 0; i < count; ++i)
+			servers[i].SetAddress("127.0.0.1", FakeBasePort + i);
+
+		uint64_t start = MillisNow();
+		size_t answered = RefreshThreads(servers, count, timeout, retries,
+		                                 threads);
+
+		printf("threads (%u): %llu ms, %u answered\n", (unsigned)threads,
+		       (unsigned long long)(MillisNow() - start), (unsigned)answered);
+
+		delete[] servers;
+	}
+
+	if(mode != "threads")
+	{
+		Server* servers = new Server[count];
+
+		for(size_t i = 0; i < count; ++i)
+			servers[i].SetAddress("127.0.0.1", FakeBasePort + i);
+
+		uint64_t start = MillisNow();
+		size_t answered = RefreshEngine(servers, count, timeout, retries,
+		                                rate);
+
+		printf("engine: %llu ms, %u answered\n",
+		       (unsigned long long)(MillisNow() - start), (unsigned)answered);
+
+		delete[] servers;
+	}
+
+	FakeQuit = true;
+	pthread_join(fake, NULL);
+
+	for(size_t i = 0; i < FakeSockets.size(); ++i)
+		close(FakeSockets[i]);
+
+	return 0;
+}